@@ -0,0 +1,573 @@
+#include "hal_native.h"
+#include <Wire.h>
+#include <driver/i2s.h>
+#include <esp_dsp.h>
+#include <stdarg.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "config.h"
+
+// LIS3DH registers the simulation gives meaning to
+#define SIM_REG_WHO_AM_I 0x0F
+#define SIM_REG_CTRL3 0x22
+#define SIM_REG_CTRL5 0x24
+#define SIM_REG_OUT_X_L 0x28
+#define SIM_REG_OUT_Z_H 0x2D
+#define SIM_REG_FIFO_CTRL 0x2E
+#define SIM_REG_FIFO_SRC 0x2F
+#define SIM_REG_INT1_SRC 0x31
+#define SIM_REG_CLICK_SRC 0x39
+#define SIM_REG_AUTO_INCREMENT 0x80
+
+#define SIM_CTRL3_I1_WTM 0x04
+#define SIM_CTRL5_FIFO_EN 0x40
+#define SIM_FIFO_MODE_MASK 0xC0
+#define SIM_FIFO_SRC_WTM 0x80
+#define SIM_FIFO_SRC_OVRN 0x40
+#define SIM_FIFO_SRC_EMPTY 0x20
+#define SIM_FIFO_SRC_FSS 0x1F
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+// Simulated time
+static std::atomic<uint64_t> simMicros(0);
+
+// Simulated LIS3DH. The click engine and the activity interrupt are not
+// modelled, CLICK_SRC and INT1_SRC always read 0.
+struct AccelSim {
+    uint8_t registers[0x40];
+    uint8_t pointer;
+    int16_t fifo[LIS3DH_SIM_FIFO_DEPTH][3];
+    size_t fifoHead;
+    size_t fifoLevel;
+    int16_t output[3];
+    uint32_t droppedSamples;
+};
+
+static AccelSim accel;
+static void (*int1Handler)() = nullptr;
+static bool int1Level = false;
+
+// One I2S frame waiting for the capture task
+static std::mutex audioMutex;
+static std::condition_variable audioCondition;
+static const int16_t* audioFrame = nullptr;
+static size_t audioFrameSamples = 0;
+static size_t audioFramePosition = 0;
+static bool audioFrameDone = false;
+static bool audioFrameQueued = false;
+static bool audioRunning = false;
+
+static std::atomic<uintptr_t> nextTaskHandle(1);
+
+static bool fifoEnabled() {
+    return (accel.registers[SIM_REG_CTRL5] & SIM_CTRL5_FIFO_EN) &&
+           (accel.registers[SIM_REG_FIFO_CTRL] & SIM_FIFO_MODE_MASK) != 0;
+}
+
+static uint8_t fifoWatermark() {
+    return accel.registers[SIM_REG_FIFO_CTRL] & SIM_FIFO_SRC_FSS;
+}
+
+static void updateInt1() {
+    bool level = (accel.registers[SIM_REG_CTRL3] & SIM_CTRL3_I1_WTM) &&
+                 fifoEnabled() && accel.fifoLevel >= fifoWatermark();
+    
+    if (level && !int1Level && int1Handler) {
+        int1Handler();
+    }
+    int1Level = level;
+}
+
+static void clearFifo() {
+    accel.fifoHead = 0;
+    accel.fifoLevel = 0;
+}
+
+// Next sample for an OUT_X_L..OUT_Z_H read, from the FIFO when it is enabled
+static void loadOutput() {
+    if (fifoEnabled() && accel.fifoLevel > 0) {
+        size_t tail = (accel.fifoHead + LIS3DH_SIM_FIFO_DEPTH - accel.fifoLevel) % LIS3DH_SIM_FIFO_DEPTH;
+        memcpy(accel.output, accel.fifo[tail], sizeof(accel.output));
+        accel.fifoLevel--;
+    }
+}
+
+static uint8_t readAccelRegister(uint8_t reg) {
+    if (reg >= SIM_REG_OUT_X_L && reg <= SIM_REG_OUT_Z_H) {
+        if (reg == SIM_REG_OUT_X_L) {
+            loadOutput();
+        }
+        uint16_t value = (uint16_t)accel.output[(reg - SIM_REG_OUT_X_L) / 2];
+        return (reg & 1) ? (value >> 8) : (value & 0xFF);
+    }
+    
+    switch (reg) {
+        case SIM_REG_WHO_AM_I:
+            return 0x33;
+        case SIM_REG_FIFO_SRC: {
+            uint8_t source = (uint8_t)min(accel.fifoLevel, (size_t)SIM_FIFO_SRC_FSS);
+            if (accel.fifoLevel == 0) {
+                source |= SIM_FIFO_SRC_EMPTY;
+            }
+            if (accel.fifoLevel >= fifoWatermark()) {
+                source |= SIM_FIFO_SRC_WTM;
+            }
+            // Set while all 32 slots hold unread samples
+            if (accel.fifoLevel == LIS3DH_SIM_FIFO_DEPTH) {
+                source |= SIM_FIFO_SRC_OVRN;
+            }
+            return source;
+        }
+        case SIM_REG_INT1_SRC:
+        case SIM_REG_CLICK_SRC:
+            return 0;
+        default:
+            return accel.registers[reg & 0x3F];
+    }
+}
+
+static void writeAccelRegister(uint8_t reg, uint8_t value) {
+    accel.registers[reg & 0x3F] = value;
+    
+    // Bypass mode empties the FIFO
+    if (reg == SIM_REG_FIFO_CTRL && (value & SIM_FIFO_MODE_MASK) == 0) {
+        clearFifo();
+    }
+    updateInt1();
+}
+
+void NativeHal::reset() {
+    simMicros.store(0);
+    
+    memset(&accel, 0, sizeof(accel));
+    int1Handler = nullptr;
+    int1Level = false;
+    
+    std::lock_guard<std::mutex> lock(audioMutex);
+    audioFrame = nullptr;
+    audioFrameSamples = 0;
+    audioFramePosition = 0;
+    audioFrameDone = false;
+    audioFrameQueued = false;
+}
+
+void NativeHal::advanceTo(uint64_t micros) {
+    uint64_t current = simMicros.load();
+    while (micros > current && !simMicros.compare_exchange_weak(current, micros)) {
+    }
+}
+
+void NativeHal::advance(uint64_t micros) {
+    simMicros.fetch_add(micros);
+}
+
+uint64_t NativeHal::now() {
+    return simMicros.load();
+}
+
+void NativeHal::pushAccelSample(int16_t x, int16_t y, int16_t z) {
+    accel.output[0] = x;
+    accel.output[1] = y;
+    accel.output[2] = z;
+    
+    if (!fifoEnabled()) {
+        return;
+    }
+    
+    // Stream mode, a full FIFO drops its oldest sample
+    if (accel.fifoLevel == LIS3DH_SIM_FIFO_DEPTH) {
+        accel.fifoLevel--;
+        accel.droppedSamples++;
+    }
+    
+    accel.fifo[accel.fifoHead][0] = x;
+    accel.fifo[accel.fifoHead][1] = y;
+    accel.fifo[accel.fifoHead][2] = z;
+    accel.fifoHead = (accel.fifoHead + 1) % LIS3DH_SIM_FIFO_DEPTH;
+    accel.fifoLevel++;
+    
+    updateInt1();
+}
+
+uint32_t NativeHal::getAccelDroppedSamples() {
+    return accel.droppedSamples;
+}
+
+bool NativeHal::feedAudio(const int16_t* samples, size_t count) {
+    std::unique_lock<std::mutex> lock(audioMutex);
+    
+    audioFrame = samples;
+    audioFrameSamples = count;
+    audioFramePosition = 0;
+    audioFrameDone = false;
+    audioFrameQueued = false;
+    audioCondition.notify_all();
+    
+    bool queued = audioCondition.wait_for(lock, std::chrono::seconds(1), [] { return audioFrameQueued; });
+    audioFrame = nullptr;
+    return queued;
+}
+
+void NativeHal::audioQueued() {
+    std::lock_guard<std::mutex> lock(audioMutex);
+    if (audioFrameDone) {
+        audioFrameQueued = true;
+        audioCondition.notify_all();
+    }
+}
+
+bool NativeHal::i2cWrite(uint8_t address, const uint8_t* data, size_t length) {
+    if (address != ACCEL_I2C_ADDRESS || length == 0) {
+        return false;
+    }
+    
+    // The first byte selects the register, the rest are written from there
+    accel.pointer = data[0];
+    uint8_t reg = data[0] & ~SIM_REG_AUTO_INCREMENT;
+    for (size_t i = 1; i < length; i++) {
+        writeAccelRegister(reg, data[i]);
+        if (data[0] & SIM_REG_AUTO_INCREMENT) {
+            reg++;
+        }
+    }
+    return true;
+}
+
+size_t NativeHal::i2cRead(uint8_t address, uint8_t* data, size_t length) {
+    if (address != ACCEL_I2C_ADDRESS) {
+        return 0;
+    }
+    
+    uint8_t reg = accel.pointer & ~SIM_REG_AUTO_INCREMENT;
+    bool increment = (accel.pointer & SIM_REG_AUTO_INCREMENT) != 0;
+    
+    for (size_t i = 0; i < length; i++) {
+        data[i] = readAccelRegister(reg);
+        if (!increment) {
+            continue;
+        }
+        
+        // With the FIFO on, auto-increment wraps from OUT_Z_H back to OUT_X_L
+        reg++;
+        if (reg == SIM_REG_OUT_Z_H + 1 && fifoEnabled()) {
+            reg = SIM_REG_OUT_X_L;
+        }
+    }
+    
+    updateInt1();
+    return length;
+}
+
+// Arduino core
+
+void HardwareSerial::begin(unsigned long baud) {
+}
+
+size_t HardwareSerial::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vfprintf(stderr, format, args);
+    va_end(args);
+    return written > 0 ? written : 0;
+}
+
+size_t HardwareSerial::print(const char* text) {
+    return fprintf(stderr, "%s", text);
+}
+
+size_t HardwareSerial::print(int value) {
+    return fprintf(stderr, "%d", value);
+}
+
+size_t HardwareSerial::println(const char* text) {
+    return fprintf(stderr, "%s\n", text);
+}
+
+size_t HardwareSerial::println(int value) {
+    return fprintf(stderr, "%d\n", value);
+}
+
+size_t HardwareSerial::println() {
+    return fprintf(stderr, "\n");
+}
+
+void HardwareSerial::flush() {
+    fflush(stderr);
+}
+
+uint32_t millis() {
+    return (uint32_t)(simMicros.load() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)simMicros.load();
+}
+
+void delay(uint32_t ms) {
+    NativeHal::advance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    NativeHal::advance(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+}
+
+int digitalRead(uint8_t pin) {
+    if (ACCEL_INT1_PIN >= 0 && pin == ACCEL_INT1_PIN) {
+        return int1Level ? HIGH : LOW;
+    }
+    return LOW;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode) {
+    if (ACCEL_INT1_PIN >= 0 && pin == ACCEL_INT1_PIN) {
+        int1Handler = handler;
+    }
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (ACCEL_INT1_PIN >= 0 && pin == ACCEL_INT1_PIN) {
+        int1Handler = nullptr;
+    }
+}
+
+bool psramFound() {
+    return false;
+}
+
+void* ps_malloc(size_t size) {
+    return malloc(size);
+}
+
+// Wire
+
+TwoWire::TwoWire() {
+    address = 0;
+    txLength = 0;
+    rxLength = 0;
+    rxPosition = 0;
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    return true;
+}
+
+void TwoWire::setClock(uint32_t frequency) {
+}
+
+void TwoWire::beginTransmission(uint8_t deviceAddress) {
+    address = deviceAddress;
+    txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+    if (txLength >= NATIVE_WIRE_BUFFER_SIZE) {
+        return 0;
+    }
+    txBuffer[txLength++] = value;
+    return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    // 2 is the Arduino code for an address NACK
+    return NativeHal::i2cWrite(address, txBuffer, txLength) ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(int deviceAddress, int length) {
+    size_t count = min((size_t)max(length, 0), (size_t)NATIVE_WIRE_BUFFER_SIZE);
+    rxLength = NativeHal::i2cRead((uint8_t)deviceAddress, rxBuffer, count);
+    rxPosition = 0;
+    return (uint8_t)rxLength;
+}
+
+int TwoWire::available() {
+    return (int)(rxLength - rxPosition);
+}
+
+int TwoWire::read() {
+    if (rxPosition >= rxLength) {
+        return -1;
+    }
+    return rxBuffer[rxPosition++];
+}
+
+// FreeRTOS
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    if (handle) {
+        *handle = (TaskHandle_t)nextTaskHandle.fetch_add(1);
+    }
+    std::thread(function, param).detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    // The host thread ends when the task function returns
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(max(ticks, (TickType_t)1)));
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    // Host threads have no fixed stack to watch
+    return 0;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    return pdFALSE;
+}
+
+// I2S and ADC
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queueSize, void* queue) {
+    // Frames are handed over in lockstep, there is no DMA to overrun
+    if (queue) {
+        *(QueueHandle_t*)queue = nullptr;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t port) {
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_adc_mode(adc_unit_t unit, adc1_channel_t channel) {
+    return ESP_OK;
+}
+
+esp_err_t i2s_adc_enable(i2s_port_t port) {
+    std::lock_guard<std::mutex> lock(audioMutex);
+    audioRunning = true;
+    return ESP_OK;
+}
+
+esp_err_t i2s_adc_disable(i2s_port_t port) {
+    std::lock_guard<std::mutex> lock(audioMutex);
+    audioRunning = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_clk(i2s_port_t port, uint32_t rate, uint32_t bits, int channel) {
+    // Traces are replayed at whatever rate they were recorded
+    return ESP_OK;
+}
+
+esp_err_t i2s_start(i2s_port_t port) {
+    return ESP_OK;
+}
+
+esp_err_t i2s_stop(i2s_port_t port) {
+    return ESP_OK;
+}
+
+esp_err_t i2s_read(i2s_port_t port, void* dest, size_t size, size_t* bytesRead, TickType_t ticksToWait) {
+    std::unique_lock<std::mutex> lock(audioMutex);
+    *bytesRead = 0;
+    
+    bool ready = audioCondition.wait_for(lock, std::chrono::milliseconds(ticksToWait), [] {
+        return audioRunning && audioFrame != nullptr && !audioFrameDone;
+    });
+    if (!ready) {
+        return ESP_ERR_TIMEOUT;
+    }
+    
+    size_t count = min(size / sizeof(int16_t), audioFrameSamples - audioFramePosition);
+    memcpy(dest, audioFrame + audioFramePosition, count * sizeof(int16_t));
+    audioFramePosition += count;
+    audioFrameDone = audioFramePosition == audioFrameSamples;
+    
+    *bytesRead = count * sizeof(int16_t);
+    return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel) {
+    return 2048;
+}
+
+// ESP-DSP
+
+esp_err_t dsps_dotprod_s16(const int16_t* src1, const int16_t* src2, int16_t* dest, int len, int8_t shift) {
+    // Result is the sum scaled by 2^(shift - 15), rounded to nearest
+    int64_t acc = 0;
+    for (int i = 0; i < len; i++) {
+        acc += (int32_t)src1[i] * src2[i];
+    }
+    
+    int finalShift = 15 - shift;
+    if (finalShift > 0) {
+        acc = (acc + ((int64_t)1 << (finalShift - 1))) >> finalShift;
+    } else {
+        acc <<= -finalShift;
+    }
+    *dest = (int16_t)acc;
+    return ESP_OK;
+}
+
+esp_err_t dsps_fft2r_init_fc32(float* table, int tableSize) {
+    return ESP_OK;
+}
+
+esp_err_t dsps_fft2r_fc32(float* data, int n) {
+    if (n <= 0 || (n & (n - 1)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // Radix-2 decimation in frequency on interleaved re/im pairs, output in
+    // bit reversed order like the ESP-DSP kernel
+    for (int length = n; length >= 2; length >>= 1) {
+        int half = length / 2;
+        float step = -2.0f * (float)PI / length;
+        
+        for (int start = 0; start < n; start += length) {
+            for (int k = 0; k < half; k++) {
+                float wr = cosf(step * k);
+                float wi = sinf(step * k);
+                float* a = data + 2 * (start + k);
+                float* b = data + 2 * (start + k + half);
+                
+                float dr = a[0] - b[0];
+                float di = a[1] - b[1];
+                a[0] += b[0];
+                a[1] += b[1];
+                b[0] = dr * wr - di * wi;
+                b[1] = dr * wi + di * wr;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t dsps_bit_rev_fc32(float* data, int n) {
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        
+        if (i < j) {
+            std::swap(data[2 * i], data[2 * j]);
+            std::swap(data[2 * i + 1], data[2 * j + 1]);
+        }
+    }
+    return ESP_OK;
+}
+
+void dsps_wind_hann_f32(float* window, int len) {
+    float scale = len > 1 ? 1.0f / (len - 1) : 0.0f;
+    for (int i = 0; i < len; i++) {
+        window[i] = 0.5f * (1.0f - cosf(i * 2.0f * (float)PI * scale));
+    }
+}
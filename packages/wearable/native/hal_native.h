@@ -0,0 +1,38 @@
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+#include <Arduino.h>
+
+#define LIS3DH_SIM_FIFO_DEPTH 32
+
+// Host side of the HAL shim. The replay drives the simulated clock, the
+// LIS3DH behind Wire and the I2S input; the firmware code sees the same
+// register and driver behaviour it gets on the device.
+class NativeHal {
+public:
+    // Back to t=0 with an empty FIFO and no pending audio
+    static void reset();
+    
+    // Simulated time, millis() and micros() read it. Never goes backwards.
+    static void advanceTo(uint64_t micros);
+    static void advance(uint64_t micros);
+    static uint64_t now();
+    
+    // One accelerometer reading at the ODR. Lands in the FIFO when it is
+    // enabled and raises INT1 once the watermark is reached.
+    static void pushAccelSample(int16_t x, int16_t y, int16_t z);
+    static uint32_t getAccelDroppedSamples();
+    
+    // Hands one I2S frame to the capture task and waits until it has been
+    // queued for update(). False if the capture task is not reading.
+    static bool feedAudio(const int16_t* samples, size_t count);
+    
+    // Set as VoiceDetector::onAudioAvailable so feedAudio() can return
+    static void audioQueued();
+    
+    // Bus model, called by TwoWire
+    static bool i2cWrite(uint8_t address, const uint8_t* data, size_t length);
+    static size_t i2cRead(uint8_t address, uint8_t* data, size_t length);
+};
+
+#endif // HAL_NATIVE_H
@@ -0,0 +1,69 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Host stand-in for the parts of the ESP32 Arduino core the detection
+// pipelines use. Time is simulated, see hal_native.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+
+#define PI 3.1415926535897932384626433832795
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToInterrupt(pin) (pin)
+
+// Detector chatter goes to stderr so stdout only carries the replay report
+class HardwareSerial {
+public:
+    void begin(unsigned long baud);
+    size_t printf(const char* format, ...);
+    size_t print(const char* text);
+    size_t print(int value);
+    size_t println(const char* text);
+    size_t println(int value);
+    size_t println();
+    void flush();
+};
+
+extern HardwareSerial Serial;
+
+uint32_t millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+// No PSRAM on the host, buffers come from malloc()
+bool psramFound();
+void* ps_malloc(size_t size);
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,33 @@
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+#include <Arduino.h>
+
+#define NATIVE_WIRE_BUFFER_SIZE 128
+
+// I2C master backed by the simulated LIS3DH in hal_native. Transactions to
+// any other address are NACKed.
+class TwoWire {
+private:
+    uint8_t address;
+    uint8_t txBuffer[NATIVE_WIRE_BUFFER_SIZE];
+    size_t txLength;
+    uint8_t rxBuffer[NATIVE_WIRE_BUFFER_SIZE];
+    size_t rxLength;
+    size_t rxPosition;
+
+public:
+    TwoWire();
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    void setClock(uint32_t frequency);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t value);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(int address, int length);
+    int available();
+    int read();
+};
+
+extern TwoWire Wire;
+
+#endif // NATIVE_WIRE_H
@@ -0,0 +1,13 @@
+#ifndef NATIVE_DRIVER_ADC_H
+#define NATIVE_DRIVER_ADC_H
+
+typedef int adc_unit_t;
+typedef int adc1_channel_t;
+
+#define ADC_UNIT_1 1
+#define ADC1_CHANNEL_6 6
+#define ADC1_CHANNEL_7 7
+
+int adc1_get_raw(adc1_channel_t channel);
+
+#endif // NATIVE_DRIVER_ADC_H
@@ -0,0 +1,63 @@
+#ifndef NATIVE_DRIVER_I2S_H
+#define NATIVE_DRIVER_I2S_H
+
+// I2S input served from the audio trace in hal_native
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/adc.h"
+
+typedef int i2s_port_t;
+typedef int i2s_mode_t;
+
+#define I2S_NUM_0 0
+#define I2S_MODE_MASTER 1
+#define I2S_MODE_RX 2
+#define I2S_MODE_ADC_BUILT_IN 4
+#define I2S_BITS_PER_SAMPLE_16BIT 16
+#define I2S_CHANNEL_MONO 1
+#define I2S_CHANNEL_FMT_ONLY_LEFT 1
+#define I2S_COMM_FORMAT_I2S_LSB 1
+#define ESP_INTR_FLAG_LEVEL1 2
+
+typedef struct {
+    int mode;
+    int sample_rate;
+    int bits_per_sample;
+    int channel_format;
+    int communication_format;
+    int intr_alloc_flags;
+    int dma_buf_count;
+    int dma_buf_len;
+    bool use_apll;
+    bool tx_desc_auto_clear;
+    int fixed_mclk;
+} i2s_config_t;
+
+typedef enum {
+    I2S_EVENT_DMA_ERROR,
+    I2S_EVENT_TX_DONE,
+    I2S_EVENT_RX_DONE,
+    I2S_EVENT_TX_Q_OVF,
+    I2S_EVENT_RX_Q_OVF,
+    I2S_EVENT_MAX
+} i2s_event_type_t;
+
+typedef struct {
+    i2s_event_type_t type;
+    size_t size;
+} i2s_event_t;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queueSize, void* queue);
+esp_err_t i2s_driver_uninstall(i2s_port_t port);
+esp_err_t i2s_set_adc_mode(adc_unit_t unit, adc1_channel_t channel);
+esp_err_t i2s_adc_enable(i2s_port_t port);
+esp_err_t i2s_adc_disable(i2s_port_t port);
+esp_err_t i2s_set_clk(i2s_port_t port, uint32_t rate, uint32_t bits, int channel);
+esp_err_t i2s_start(i2s_port_t port);
+esp_err_t i2s_stop(i2s_port_t port);
+esp_err_t i2s_read(i2s_port_t port, void* dest, size_t size, size_t* bytesRead, TickType_t ticksToWait);
+
+#endif // NATIVE_DRIVER_I2S_H
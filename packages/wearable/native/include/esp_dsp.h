@@ -0,0 +1,18 @@
+#ifndef NATIVE_ESP_DSP_H
+#define NATIVE_ESP_DSP_H
+
+// Plain C versions of the ESP-DSP kernels the pipelines call, same rounding
+// as the ANSI reference implementations
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define CONFIG_DSP_MAX_FFT_SIZE 4096
+
+esp_err_t dsps_dotprod_s16(const int16_t* src1, const int16_t* src2, int16_t* dest, int len, int8_t shift);
+esp_err_t dsps_fft2r_init_fc32(float* table, int tableSize);
+esp_err_t dsps_fft2r_fc32(float* data, int n);
+esp_err_t dsps_bit_rev_fc32(float* data, int n);
+void dsps_wind_hann_f32(float* window, int len);
+
+#endif // NATIVE_ESP_DSP_H
@@ -0,0 +1,11 @@
+#ifndef NATIVE_FREERTOS_QUEUE_H
+#define NATIVE_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* QueueHandle_t;
+
+// Only the receive side the firmware polls, the host never posts events
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait);
+
+#endif // NATIVE_FREERTOS_QUEUE_H
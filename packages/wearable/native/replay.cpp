@@ -0,0 +1,355 @@
+// Host replay of recorded sensor traces through the real GestureDetector and
+// VoiceDetector, as fast as the host runs. Built by the PlatformIO native env.
+//
+//   program --accel walk.csv --audio hey_bil.wav [options]
+//
+// Accelerometer traces are CSV lines of raw LIS3DH counts at ACCEL_ODR_HZ,
+// "x,y,z" or "t_ms,x,y,z". Audio traces are 16 bit mono WAV files (scaled to
+// the built-in ADC range) or raw int16 dumps of what i2s_read() returns.
+//
+// Report on stdout, one CSV record per line. Times are simulated ms at which
+// the firmware would see the detection, FIFO batching included.
+//   gesture,<t_ms>,<name>,<confidence_percent>
+//   wake_word,<t_ms>
+//   level,<t_ms>,<energy>,<peak>,<zero_crossings>       (--levels)
+//   cost,<pipeline>,<samples>,<detections>,<host_us>,<ns_per_sample>,<realtime_factor>
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include "hal_native.h"
+#include "config.h"
+#include "gesture_detector.h"
+#include "voice_detector.h"
+
+struct ReplayOptions {
+    const char* accelPath;
+    const char* audioPath;
+    bool levels;
+    bool hardwareTap;
+    float tapThreshold;
+    float swipeThreshold;
+    float shakeThreshold;
+    float voiceThreshold;
+    float wakeWordThreshold;
+};
+
+struct AccelRecord {
+    uint64_t timeUs;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+// Indexed by GestureType
+static const char* const gestureNames[] = {
+    "none",
+    "tap",
+    "double_tap",
+    "swipe_up",
+    "swipe_down",
+    "swipe_left",
+    "swipe_right",
+    "shake",
+    "twist_cw",
+    "twist_ccw",
+};
+
+typedef std::chrono::steady_clock HostClock;
+
+static uint64_t elapsedNs(HostClock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(HostClock::now() - start).count();
+}
+
+static void printCost(const char* pipeline, size_t samples, uint32_t detections, uint64_t hostNs, uint64_t traceUs) {
+    double hostUs = hostNs / 1000.0;
+    printf("cost,%s,%zu,%u,%.0f,%.1f,%.1f\n", pipeline, samples, detections, hostUs,
+           samples > 0 ? (double)hostNs / samples : 0.0,
+           hostUs > 0 ? traceUs / hostUs : 0.0);
+}
+
+static bool loadAccelTrace(const char* path, std::vector<AccelRecord>& records) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        long values[4];
+        int count = sscanf(line, "%ld,%ld,%ld,%ld", &values[0], &values[1], &values[2], &values[3]);
+        
+        // Comments and header rows do not parse
+        AccelRecord record;
+        if (count == 4) {
+            record.timeUs = (uint64_t)values[0] * 1000;
+            record.x = (int16_t)values[1];
+            record.y = (int16_t)values[2];
+            record.z = (int16_t)values[3];
+        } else if (count == 3) {
+            record.timeUs = (uint64_t)records.size() * 1000000 / ACCEL_ODR_HZ;
+            record.x = (int16_t)values[0];
+            record.y = (int16_t)values[1];
+            record.z = (int16_t)values[2];
+        } else {
+            continue;
+        }
+        records.push_back(record);
+    }
+    
+    fclose(file);
+    return true;
+}
+
+static uint32_t readLE(const uint8_t* data, size_t bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint32_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+static bool loadAudioTrace(const char* path, std::vector<int16_t>& samples) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t bytesRead;
+    while ((bytesRead = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + bytesRead);
+    }
+    fclose(file);
+    
+    // Raw dump, already ADC codes
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        samples.resize(data.size() / sizeof(int16_t));
+        for (size_t i = 0; i < samples.size(); i++) {
+            samples[i] = (int16_t)readLE(&data[i * 2], 2);
+        }
+        return true;
+    }
+    
+    uint16_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint16_t bitsPerSample = 0;
+    
+    size_t position = 12;
+    while (position + 8 <= data.size()) {
+        const uint8_t* header = &data[position];
+        uint32_t chunkSize = readLE(header + 4, 4);
+        const uint8_t* body = header + 8;
+        size_t available = min((size_t)chunkSize, data.size() - position - 8);
+        
+        if (memcmp(header, "fmt ", 4) == 0 && available >= 16) {
+            channels = (uint16_t)readLE(body + 2, 2);
+            sampleRate = readLE(body + 4, 4);
+            bitsPerSample = (uint16_t)readLE(body + 14, 2);
+        } else if (memcmp(header, "data", 4) == 0) {
+            if (bitsPerSample != 16 || channels == 0) {
+                fprintf(stderr, "%s: only 16 bit PCM WAV files are supported\n", path);
+                return false;
+            }
+            if (sampleRate != SAMPLE_RATE) {
+                fprintf(stderr, "%s: %u Hz, replaying as %u Hz without resampling\n", path, sampleRate, SAMPLE_RATE);
+            }
+            
+            // First channel, 16 bit PCM mapped onto the 12 bit ADC around its midpoint
+            size_t frames = available / (2 * channels);
+            samples.resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                int16_t pcm = (int16_t)readLE(body + i * 2 * channels, 2);
+                samples[i] = (pcm >> 4) + 2048;
+            }
+            return true;
+        }
+        
+        position += 8 + chunkSize + (chunkSize & 1);
+    }
+    
+    fprintf(stderr, "%s: no data chunk\n", path);
+    return false;
+}
+
+static bool replayGestures(const ReplayOptions& options) {
+    std::vector<AccelRecord> records;
+    if (!loadAccelTrace(options.accelPath, records)) {
+        return false;
+    }
+    
+    NativeHal::reset();
+    
+    GestureDetector gesture;
+    gesture.setHardwareTapEnabled(options.hardwareTap);
+    if (options.tapThreshold > 0) {
+        gesture.setTapThreshold(options.tapThreshold);
+    }
+    if (options.swipeThreshold > 0) {
+        gesture.setSwipeThreshold(options.swipeThreshold);
+    }
+    if (options.shakeThreshold > 0) {
+        gesture.setShakeThreshold(options.shakeThreshold);
+    }
+    
+    if (!gesture.begin()) {
+        return false;
+    }
+    
+    // Trace time starts once the detector is configured
+    uint64_t startUs = NativeHal::now();
+    uint64_t hostNs = 0;
+    uint32_t detections = 0;
+    
+    for (const AccelRecord& record : records) {
+        NativeHal::advanceTo(startUs + record.timeUs);
+        NativeHal::pushAccelSample(record.x, record.y, record.z);
+        
+        HostClock::time_point start = HostClock::now();
+        gesture.update();
+        GestureType detected = gesture.detectGesture();
+        hostNs += elapsedNs(start);
+        
+        if (detected != GESTURE_NONE) {
+            printf("gesture,%u,%s,%u\n", millis(), gestureNames[detected], gesture.getConfidence());
+            detections++;
+        }
+    }
+    
+    if (gesture.getFifoOverruns() > 0) {
+        fprintf(stderr, "%u FIFO overruns, the trace is faster than the detector reads\n", gesture.getFifoOverruns());
+    }
+    
+    printCost("gesture", records.size(), detections, hostNs, NativeHal::now() - startUs);
+    gesture.end();
+    return true;
+}
+
+static bool replayVoice(const ReplayOptions& options) {
+    std::vector<int16_t> samples;
+    if (!loadAudioTrace(options.audioPath, samples)) {
+        return false;
+    }
+    
+    NativeHal::reset();
+    
+    VoiceDetector voice;
+    voice.onAudioAvailable = NativeHal::audioQueued;
+    
+    // Traces are taken at SAMPLE_RATE, the host I2S does not resample
+    voice.setCaptureProfile(AUDIO_PROFILE_LOW_LATENCY);
+    if (options.voiceThreshold > 0) {
+        voice.setVoiceThreshold(options.voiceThreshold);
+    }
+    
+    if (!voice.begin()) {
+        return false;
+    }
+    if (options.wakeWordThreshold > 0) {
+        voice.setWakeWordThreshold(options.wakeWordThreshold);
+    }
+    
+    uint64_t startUs = NativeHal::now();
+    uint64_t hostNs = 0;
+    uint32_t detections = 0;
+    
+    // Frames of the size the capture task reads, each queued before update()
+    for (size_t offset = 0; offset < samples.size(); offset += AUDIO_CAPTURE_FRAME_SAMPLES) {
+        size_t count = min((size_t)AUDIO_CAPTURE_FRAME_SAMPLES, samples.size() - offset);
+        NativeHal::advanceTo(startUs + (uint64_t)(offset + count) * 1000000 / SAMPLE_RATE);
+        
+        if (!NativeHal::feedAudio(&samples[offset], count)) {
+            fprintf(stderr, "Capture task stopped reading at sample %zu\n", offset);
+            break;
+        }
+        
+        HostClock::time_point start = HostClock::now();
+        voice.update();
+        bool wake = voice.detectWakeWord();
+        hostNs += elapsedNs(start);
+        
+        if (options.levels) {
+            const AudioFeatures& features = voice.getLastFeatures();
+            printf("level,%u,%u,%u,%u\n", millis(), features.energy, features.peak, features.zeroCrossings);
+        }
+        if (wake) {
+            printf("wake_word,%u\n", millis());
+            detections++;
+        }
+    }
+    
+    if (voice.getDroppedSamples() > 0) {
+        fprintf(stderr, "%u samples dropped by the capture ring\n", voice.getDroppedSamples());
+    }
+    
+    printCost("voice", samples.size(), detections, hostNs, NativeHal::now() - startUs);
+    voice.end();
+    return true;
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [--accel trace.csv] [--audio trace.wav] [options]\n"
+            "  --levels              print per block audio features\n"
+            "  --hardware-tap        leave taps to the (unsimulated) click engine\n"
+            "  --tap-threshold G     override GestureDetector thresholds, in g\n"
+            "  --swipe-threshold G\n"
+            "  --shake-threshold G\n"
+            "  --voice-threshold P   VAD threshold, Q15 mean power\n"
+            "  --wake-threshold C    keyword spotter confidence, 0 to 1\n",
+            program);
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    memset(&options, 0, sizeof(options));
+    
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        
+        if (strcmp(arg, "--levels") == 0) {
+            options.levels = true;
+        } else if (strcmp(arg, "--hardware-tap") == 0) {
+            options.hardwareTap = true;
+        } else if (!value) {
+            printUsage(argv[0]);
+            return 2;
+        } else if (strcmp(arg, "--accel") == 0) {
+            options.accelPath = argv[++i];
+        } else if (strcmp(arg, "--audio") == 0) {
+            options.audioPath = argv[++i];
+        } else if (strcmp(arg, "--tap-threshold") == 0) {
+            options.tapThreshold = atof(argv[++i]);
+        } else if (strcmp(arg, "--swipe-threshold") == 0) {
+            options.swipeThreshold = atof(argv[++i]);
+        } else if (strcmp(arg, "--shake-threshold") == 0) {
+            options.shakeThreshold = atof(argv[++i]);
+        } else if (strcmp(arg, "--voice-threshold") == 0) {
+            options.voiceThreshold = atof(argv[++i]);
+        } else if (strcmp(arg, "--wake-threshold") == 0) {
+            options.wakeWordThreshold = atof(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    
+    if (!options.accelPath && !options.audioPath) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    
+    bool ok = true;
+    if (options.accelPath) {
+        ok = replayGestures(options) && ok;
+    }
+    if (options.audioPath) {
+        ok = replayVoice(options) && ok;
+    }
+    
+    return ok ? 0 : 1;
+}
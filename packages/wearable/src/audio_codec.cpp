@@ -0,0 +1,264 @@
+#include "audio_codec.h"
+#include "logger.h"
+
+// IMA-ADPCM step size table
+static const int16_t adpcmStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// IMA-ADPCM step index adjustment table
+static const int8_t adpcmIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+AudioEncoder::AudioEncoder() {
+    codec = AUDIO_DEFAULT_CODEC;
+    predictor = 0;
+    stepIndex = 0;
+    
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+    opusEncoder = nullptr;
+    opusFrameIndex = 0;
+#endif
+}
+
+AudioEncoder::~AudioEncoder() {
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+    if (opusEncoder) {
+        opus_encoder_destroy(opusEncoder);
+        opusEncoder = nullptr;
+    }
+#endif
+}
+
+bool AudioEncoder::setCodec(AudioCodecType type) {
+    if (!isSupported(type)) {
+        return false;
+    }
+    
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+    if (type == AUDIO_CODEC_OPUS && !opusEncoder) {
+        int error = 0;
+        opusEncoder = opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, &error);
+        if (error != OPUS_OK || !opusEncoder) {
+            LOGGER_ERROR("Failed to create Opus encoder: %d", error);
+            opusEncoder = nullptr;
+            return false;
+        }
+        opus_encoder_ctl(opusEncoder, OPUS_SET_BITRATE(OPUS_BITRATE));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_COMPLEXITY(OPUS_COMPLEXITY));
+    }
+#endif
+    
+    codec = type;
+    reset();
+    return true;
+}
+
+AudioCodecType AudioEncoder::getCodec() {
+    return codec;
+}
+
+void AudioEncoder::reset() {
+    predictor = 0;
+    stepIndex = 0;
+    
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+    opusFrameIndex = 0;
+    if (opusEncoder) {
+        opus_encoder_ctl(opusEncoder, OPUS_RESET_STATE);
+    }
+#endif
+}
+
+size_t AudioEncoder::encode(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize) {
+    switch (codec) {
+        case AUDIO_CODEC_ADPCM:
+            return encodeADPCM(samples, count, output, outputSize);
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+        case AUDIO_CODEC_OPUS:
+            return encodeOpus(samples, count, output, outputSize, false);
+#endif
+        case AUDIO_CODEC_PCM:
+        default:
+            return encodePCM(samples, count, output, outputSize);
+    }
+}
+
+size_t AudioEncoder::flush(uint8_t* output, size_t outputSize) {
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+    if (codec == AUDIO_CODEC_OPUS) {
+        return encodeOpus(nullptr, 0, output, outputSize, true);
+    }
+#endif
+    // Sample based codecs never hold back data
+    return 0;
+}
+
+size_t AudioEncoder::encodePCM(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize) {
+    size_t bytes = min(count * sizeof(int16_t), outputSize & ~(size_t)1);
+    memcpy(output, samples, bytes);
+    return bytes;
+}
+
+size_t AudioEncoder::encodeADPCM(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize) {
+    if (outputSize < ADPCM_BLOCK_HEADER_SIZE) {
+        return 0;
+    }
+    
+    // Limit to what fits, two samples per byte after the header
+    count = min(count, (outputSize - ADPCM_BLOCK_HEADER_SIZE) * 2);
+    
+    // Each block starts with the encoder state so blocks decode independently
+    output[0] = predictor & 0xFF;
+    output[1] = (predictor >> 8) & 0xFF;
+    output[2] = stepIndex;
+    output[3] = 0;
+    
+    size_t outIndex = ADPCM_BLOCK_HEADER_SIZE;
+    for (size_t i = 0; i < count; i += 2) {
+        uint8_t low = encodeADPCMSample(samples[i]);
+        uint8_t high = (i + 1 < count) ? encodeADPCMSample(samples[i + 1]) : 0;
+        output[outIndex++] = low | (high << 4);
+    }
+    
+    return outIndex;
+}
+
+uint8_t AudioEncoder::encodeADPCMSample(int16_t sample) {
+    int32_t step = adpcmStepTable[stepIndex];
+    int32_t diff = (int32_t)sample - predictor;
+    uint8_t nibble = 0;
+    
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    
+    // Quantize the difference and reconstruct it exactly as the decoder will
+    int32_t delta = step >> 3;
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 1;
+        delta += step;
+    }
+    
+    int32_t newPredictor = predictor + ((nibble & 8) ? -delta : delta);
+    predictor = (int16_t)constrain(newPredictor, -32768, 32767);
+    stepIndex = constrain(stepIndex + adpcmIndexTable[nibble], 0, 88);
+    
+    return nibble;
+}
+
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+size_t AudioEncoder::encodeOpus(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize, bool flush) {
+    size_t outIndex = 0;
+    size_t i = 0;
+    
+    while (i < count || (flush && opusFrameIndex > 0)) {
+        // Collect a full Opus frame, padding with silence when flushing
+        while (i < count && opusFrameIndex < OPUS_FRAME_SAMPLES) {
+            opusFrame[opusFrameIndex++] = samples[i++];
+        }
+        if (opusFrameIndex < OPUS_FRAME_SAMPLES) {
+            if (!flush || i < count) {
+                break;
+            }
+            memset(opusFrame + opusFrameIndex, 0, (OPUS_FRAME_SAMPLES - opusFrameIndex) * sizeof(int16_t));
+        }
+        
+        // Each packet is prefixed with its length
+        if (outputSize - outIndex < 2) {
+            break;
+        }
+        int32_t packetSize = opus_encode(opusEncoder, opusFrame, OPUS_FRAME_SAMPLES,
+                                         output + outIndex + 1, min(outputSize - outIndex - 1, (size_t)255));
+        opusFrameIndex = 0;
+        
+        if (packetSize < 0) {
+            LOGGER_ERROR("Opus encode failed: %d", packetSize);
+            break;
+        }
+        output[outIndex] = (uint8_t)packetSize;
+        outIndex += packetSize + 1;
+    }
+    
+    return outIndex;
+}
+#endif
+
+bool AudioEncoder::isSupported(AudioCodecType type) {
+    switch (type) {
+        case AUDIO_CODEC_PCM:
+        case AUDIO_CODEC_ADPCM:
+            return true;
+        case AUDIO_CODEC_OPUS:
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+size_t AudioEncoder::getMaxEncodedSize(AudioCodecType type, size_t samples) {
+    switch (type) {
+        case AUDIO_CODEC_ADPCM:
+            return ADPCM_BLOCK_HEADER_SIZE + (samples + 1) / 2;
+        case AUDIO_CODEC_OPUS:
+            // One length-prefixed packet per frame, bounded by PCM size
+            return samples * sizeof(int16_t) + OPUS_FRAME_SAMPLES * sizeof(int16_t);
+        case AUDIO_CODEC_PCM:
+        default:
+            return samples * sizeof(int16_t);
+    }
+}
+
+const char* AudioEncoder::getCodecName(AudioCodecType type) {
+    switch (type) {
+        case AUDIO_CODEC_PCM:
+            return "pcm";
+        case AUDIO_CODEC_ADPCM:
+            return "adpcm";
+        case AUDIO_CODEC_OPUS:
+            return "opus";
+        default:
+            return "unknown";
+    }
+}
+
+bool AudioEncoder::parseCodecName(const char* name, AudioCodecType& type) {
+    if (strcmp(name, "pcm") == 0) {
+        type = AUDIO_CODEC_PCM;
+    } else if (strcmp(name, "adpcm") == 0) {
+        type = AUDIO_CODEC_ADPCM;
+    } else if (strcmp(name, "opus") == 0) {
+        type = AUDIO_CODEC_OPUS;
+    } else {
+        return false;
+    }
+    
+    return true;
+}
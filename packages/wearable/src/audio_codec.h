@@ -0,0 +1,61 @@
+#ifndef AUDIO_CODEC_H
+#define AUDIO_CODEC_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+#include <opus.h>
+#endif
+
+// Codecs that can be negotiated with the mobile app
+enum AudioCodecType {
+    AUDIO_CODEC_PCM,    // Raw 16-bit little endian PCM
+    AUDIO_CODEC_ADPCM,  // IMA-ADPCM, 4 bits per sample
+    AUDIO_CODEC_OPUS    // Opus, requires AUDIO_CODEC_OPUS_ENABLED
+};
+
+// ADPCM block header: predictor (int16 LE), step index, reserved
+#define ADPCM_BLOCK_HEADER_SIZE 4
+
+class AudioEncoder {
+private:
+    AudioCodecType codec;
+    
+    // IMA-ADPCM state, carried in each block header
+    int16_t predictor;
+    int8_t stepIndex;
+    
+#ifdef AUDIO_CODEC_OPUS_ENABLED
+    OpusEncoder* opusEncoder;
+    int16_t opusFrame[OPUS_FRAME_SAMPLES];
+    size_t opusFrameIndex;
+    size_t encodeOpus(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize, bool flush);
+#endif
+    
+    size_t encodePCM(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize);
+    size_t encodeADPCM(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize);
+    uint8_t encodeADPCMSample(int16_t sample);
+
+public:
+    AudioEncoder();
+    ~AudioEncoder();
+    
+    bool setCodec(AudioCodecType type);
+    AudioCodecType getCodec();
+    void reset();
+    
+    // Encode a chunk of samples, returns bytes written to output
+    size_t encode(const int16_t* samples, size_t count, uint8_t* output, size_t outputSize);
+    
+    // Emit any samples buffered by frame based codecs
+    size_t flush(uint8_t* output, size_t outputSize);
+    
+    // Codec helpers
+    static bool isSupported(AudioCodecType type);
+    static size_t getMaxEncodedSize(AudioCodecType type, size_t samples);
+    static const char* getCodecName(AudioCodecType type);
+    static bool parseCodecName(const char* name, AudioCodecType& type);
+};
+
+#endif // AUDIO_CODEC_H
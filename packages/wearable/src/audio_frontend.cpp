@@ -0,0 +1,65 @@
+#include "audio_frontend.h"
+
+// Filter coefficient in Q15
+#define DC_BLOCK_POLE 32604 // 0.995, about 13Hz corner at 16kHz
+
+static inline int16_t saturate16(int32_t value) {
+    if (value > 32767) {
+        return 32767;
+    }
+    if (value < -32768) {
+        return -32768;
+    }
+    return (int16_t)value;
+}
+
+AudioFrontend::AudioFrontend() {
+    reset();
+}
+
+void AudioFrontend::reset() {
+    dcInput = 0;
+    dcOutput = 0;
+    lastSample = 0;
+    primed = false;
+}
+
+void AudioFrontend::process(int16_t* samples, size_t count, AudioFeatures& features) {
+    uint16_t crossings = 0;
+    uint16_t peak = 0;
+    int64_t power = 0;
+    
+    // Start from the signal's own level, as if it had always been there
+    if (!primed && count > 0) {
+        dcInput = samples[0];
+        primed = true;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        // DC blocker y[n] = x[n] - x[n-1] + a * y[n-1], removes the ADC offset
+        int32_t input = samples[i];
+        dcOutput = input - dcInput + (int32_t)(((int64_t)dcOutput * DC_BLOCK_POLE) >> 15);
+        dcInput = input;
+        
+        int16_t sample = saturate16(dcOutput << AUDIO_FRONTEND_GAIN_SHIFT);
+        power += (int32_t)sample * sample;
+        
+        if ((sample ^ lastSample) < 0) {
+            crossings++;
+        }
+        
+        uint16_t magnitude = sample < 0 ? -(int32_t)sample : sample;
+        if (magnitude > peak) {
+            peak = magnitude;
+        }
+        
+        lastSample = sample;
+        samples[i] = sample;
+    }
+    
+    features.samples = samples;
+    features.count = count;
+    features.energy = count > 0 ? (uint16_t)min((int64_t)32768, (power / (int64_t)count) >> 15) : 0;
+    features.zeroCrossings = crossings;
+    features.peak = peak;
+}
@@ -0,0 +1,35 @@
+#ifndef AUDIO_FRONTEND_H
+#define AUDIO_FRONTEND_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Features of one block, computed once and shared by VAD, KWS and recording
+struct AudioFeatures {
+    const int16_t* samples; // DC blocked and scaled to 16 bit PCM
+    size_t count;
+    uint16_t energy;        // Mean power of the block, Q15 (32768 = full scale)
+    uint16_t zeroCrossings;
+    uint16_t peak;          // Largest absolute sample
+};
+
+// Conditions raw built-in ADC samples. The filters run in fixed point in one
+// pass. The first sample after reset() seeds the DC blocker, so the ADC's
+// mid-scale offset does not enter as a full scale step.
+class AudioFrontend {
+private:
+    // Filter state carried between blocks
+    int32_t dcInput;
+    int32_t dcOutput;
+    int16_t lastSample;
+    bool primed;
+
+public:
+    AudioFrontend();
+    
+    // Filters samples in place, count must not exceed AUDIO_FRONTEND_MAX_SAMPLES
+    void process(int16_t* samples, size_t count, AudioFeatures& features);
+    void reset();
+};
+
+#endif // AUDIO_FRONTEND_H
@@ -0,0 +1,100 @@
+#include "audio_ring_buffer.h"
+#include "logger.h"
+
+AudioRingBuffer::AudioRingBuffer() {
+    buffer = nullptr;
+    capacity = 0;
+    mask = 0;
+    head.store(0);
+    tail.store(0);
+    droppedSamples.store(0);
+}
+
+AudioRingBuffer::~AudioRingBuffer() {
+    end();
+}
+
+bool AudioRingBuffer::begin(size_t capacitySamples) {
+    // Capacity must be a power of two so positions can be wrapped with a mask
+    if (capacitySamples == 0 || (capacitySamples & (capacitySamples - 1)) != 0) {
+        LOGGER_ERROR("Ring buffer capacity %u is not a power of two", (unsigned)capacitySamples);
+        return false;
+    }
+    
+    buffer = (int16_t*)malloc(capacitySamples * sizeof(int16_t));
+    if (!buffer) {
+        return false;
+    }
+    
+    capacity = capacitySamples;
+    mask = capacitySamples - 1;
+    head.store(0);
+    tail.store(0);
+    droppedSamples.store(0);
+    
+    return true;
+}
+
+void AudioRingBuffer::end() {
+    if (buffer) {
+        free(buffer);
+        buffer = nullptr;
+    }
+    capacity = 0;
+    mask = 0;
+}
+
+size_t AudioRingBuffer::write(const int16_t* samples, size_t count) {
+    size_t currentHead = head.load(std::memory_order_relaxed);
+    size_t currentTail = tail.load(std::memory_order_acquire);
+    size_t space = capacity - (currentHead - currentTail);
+    size_t toWrite = min(count, space);
+    
+    for (size_t i = 0; i < toWrite; i++) {
+        buffer[(currentHead + i) & mask] = samples[i];
+    }
+    
+    // Publish the samples to the consumer
+    head.store(currentHead + toWrite, std::memory_order_release);
+    
+    if (toWrite < count) {
+        droppedSamples.fetch_add(count - toWrite, std::memory_order_relaxed);
+    }
+    
+    return toWrite;
+}
+
+size_t AudioRingBuffer::read(int16_t* samples, size_t count) {
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+    size_t currentHead = head.load(std::memory_order_acquire);
+    size_t toRead = min(count, currentHead - currentTail);
+    
+    for (size_t i = 0; i < toRead; i++) {
+        samples[i] = buffer[(currentTail + i) & mask];
+    }
+    
+    // Hand the space back to the producer
+    tail.store(currentTail + toRead, std::memory_order_release);
+    
+    return toRead;
+}
+
+void AudioRingBuffer::clear() {
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+size_t AudioRingBuffer::available() {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+size_t AudioRingBuffer::freeSpace() {
+    return capacity - available();
+}
+
+size_t AudioRingBuffer::getCapacity() {
+    return capacity;
+}
+
+uint32_t AudioRingBuffer::getDroppedSamples() {
+    return droppedSamples.load(std::memory_order_relaxed);
+}
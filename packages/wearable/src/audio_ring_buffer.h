@@ -0,0 +1,41 @@
+#ifndef AUDIO_RING_BUFFER_H
+#define AUDIO_RING_BUFFER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Single-producer/single-consumer lock-free ring of audio samples.
+// write() must only be called from one task and read() from one other task.
+class AudioRingBuffer {
+private:
+    int16_t* buffer;
+    size_t capacity;
+    size_t mask;
+    
+    // Free-running positions, wrapped with mask on access
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<uint32_t> droppedSamples;
+
+public:
+    AudioRingBuffer();
+    ~AudioRingBuffer();
+    
+    bool begin(size_t capacitySamples);
+    void end();
+    
+    // Producer side
+    size_t write(const int16_t* samples, size_t count);
+    
+    // Consumer side
+    size_t read(int16_t* samples, size_t count);
+    void clear();
+    
+    // Status
+    size_t available();
+    size_t freeSpace();
+    size_t getCapacity();
+    uint32_t getDroppedSamples();
+};
+
+#endif // AUDIO_RING_BUFFER_H
@@ -0,0 +1,347 @@
+#include "audio_transfer.h"
+#include "logger.h"
+
+AudioTransfer::AudioTransfer() {
+    buffer = nullptr;
+    capacity = 0;
+    mask = 0;
+    streamId = 0;
+    ended = false;
+    endAnnounced = false;
+    resumePending = false;
+    ackedOffset = 0;
+    sentOffset = 0;
+    highestSent = 0;
+    endOffset = 0;
+    retransmitCount = 0;
+    recoveredOffset = 0;
+    recoveredTime = 0;
+    retransmittedBytes = 0;
+}
+
+AudioTransfer::~AudioTransfer() {
+    end();
+}
+
+bool AudioTransfer::begin() {
+    // A whole recording fits in PSRAM, internal RAM only covers a short outage
+#ifdef BOARD_HAS_PSRAM
+    if (psramFound()) {
+        buffer = (uint8_t*)ps_malloc(AUDIO_RETENTION_PSRAM_BYTES);
+        if (buffer) {
+            capacity = AUDIO_RETENTION_PSRAM_BYTES;
+        }
+    }
+#endif
+
+    if (!buffer) {
+        buffer = (uint8_t*)malloc(AUDIO_RETENTION_INTERNAL_BYTES);
+        if (!buffer) {
+            return false;
+        }
+        capacity = AUDIO_RETENTION_INTERNAL_BYTES;
+    }
+    
+    // Both sizes are powers of two, offsets wrap with a mask
+    mask = capacity - 1;
+    LOGGER_INFO("Audio retention buffer: %u bytes", (unsigned)capacity);
+    return true;
+}
+
+void AudioTransfer::end() {
+    if (buffer) {
+        free(buffer);
+        buffer = nullptr;
+    }
+    capacity = 0;
+    mask = 0;
+}
+
+void AudioTransfer::startStream() {
+    streamId++;
+    ended = false;
+    endAnnounced = false;
+    resumePending = false;
+    ackedOffset = 0;
+    sentOffset = 0;
+    highestSent = 0;
+    endOffset = 0;
+    retransmitCount = 0;
+    recoveredOffset = 0;
+}
+
+size_t AudioTransfer::getFreeSpace() {
+    return capacity - (endOffset - ackedOffset);
+}
+
+bool AudioTransfer::append(const uint8_t* data, size_t length) {
+    if (!buffer || ended || length > getFreeSpace()) {
+        return false;
+    }
+    
+    // At most two copies, before and after the wrap
+    size_t position = endOffset & mask;
+    size_t first = min(length, capacity - position);
+    memcpy(buffer + position, data, first);
+    memcpy(buffer, data + first, length - first);
+    
+    endOffset += length;
+    return true;
+}
+
+void AudioTransfer::finishStream() {
+    ended = true;
+}
+
+void AudioTransfer::copyOut(uint32_t offset, uint8_t* dest, size_t length) {
+    size_t position = offset & mask;
+    size_t first = min(length, capacity - position);
+    memcpy(dest, buffer + position, first);
+    memcpy(dest + first, buffer, length - first);
+}
+
+bool AudioTransfer::hasPending() {
+    return retransmitCount > 0 || sentOffset < endOffset;
+}
+
+size_t AudioTransfer::nextPacket(uint8_t* packet, size_t maxLength, bool withHeader) {
+    size_t headerSize = withHeader ? AUDIO_PACKET_HEADER_SIZE : 0;
+    if (!buffer || maxLength <= headerSize) {
+        return 0;
+    }
+    
+    size_t maxPayload = maxLength - headerSize;
+    uint32_t offset;
+    size_t length;
+    bool resent;
+    
+    if (retransmitCount > 0) {
+        // Holes first, the app is waiting on them to reassemble
+        AudioTransferRange& range = retransmit[0];
+        offset = range.start;
+        length = min(maxPayload, (size_t)(range.end - range.start));
+        range.start += length;
+        
+        if (range.start >= range.end) {
+            retransmitCount--;
+            memmove(&retransmit[0], &retransmit[1], retransmitCount * sizeof(AudioTransferRange));
+        }
+        resent = true;
+    } else if (sentOffset < endOffset) {
+        // Below highestSent after a rewind, new data otherwise
+        offset = sentOffset;
+        length = min(maxPayload, (size_t)(endOffset - sentOffset));
+        if (offset < highestSent) {
+            length = min(length, (size_t)(highestSent - offset));
+        }
+        resent = offset < highestSent;
+        
+        sentOffset += length;
+        highestSent = max(highestSent, sentOffset);
+    } else {
+        return 0;
+    }
+    
+    if (resent) {
+        retransmittedBytes += length;
+    }
+    
+    if (withHeader) {
+        uint8_t flags = 0;
+        if (ended && offset + length == endOffset) {
+            flags |= AUDIO_PACKET_FLAG_END;
+        }
+        if (resent) {
+            flags |= AUDIO_PACKET_FLAG_RETRANSMIT;
+        }
+        
+        packet[0] = streamId;
+        packet[1] = flags;
+        packet[2] = offset & 0xFF;
+        packet[3] = (offset >> 8) & 0xFF;
+        packet[4] = (offset >> 16) & 0xFF;
+        packet[5] = (offset >> 24) & 0xFF;
+    } else {
+        // Nothing to resend without acks, the bytes are done once handed over
+        ackedOffset = sentOffset;
+    }
+    
+    copyOut(offset, packet + headerSize, length);
+    return headerSize + length;
+}
+
+bool AudioTransfer::takeEndOfStream() {
+    if (!ended || endAnnounced || hasPending()) {
+        return false;
+    }
+    endAnnounced = true;
+    return true;
+}
+
+void AudioTransfer::linkLost(bool resumable) {
+    retransmitCount = 0;
+    
+    if (resumable) {
+        resumePending = true;
+        return;
+    }
+    
+    // Nobody will ask for these again, and a stream that already ended is
+    // not announced to the next peer, which never saw any of it
+    ackedOffset = endOffset;
+    sentOffset = endOffset;
+    highestSent = endOffset;
+    if (ended) {
+        endAnnounced = true;
+    }
+}
+
+bool AudioTransfer::acknowledge(uint8_t stream, uint32_t cumulative, const AudioTransferRange* received, int receivedCount) {
+    if (stream != streamId || cumulative < ackedOffset || cumulative > highestSent) {
+        return false;
+    }
+    
+    ackedOffset = cumulative;
+    
+    // Queued holes the cumulative ack now covers are done
+    int kept = 0;
+    for (int i = 0; i < retransmitCount; i++) {
+        AudioTransferRange range = retransmit[i];
+        range.start = max(range.start, ackedOffset);
+        if (range.start < range.end) {
+            retransmit[kept++] = range;
+        }
+    }
+    retransmitCount = kept;
+    
+    // Received ranges in order, clipped to what was actually sent
+    AudioTransferRange ranges[AUDIO_TRANSFER_MAX_RANGES];
+    int count = 0;
+    uint32_t top = ackedOffset;
+    
+    for (int i = 0; i < receivedCount && count < AUDIO_TRANSFER_MAX_RANGES; i++) {
+        AudioTransferRange range;
+        range.start = max(received[i].start, ackedOffset);
+        range.end = min(received[i].end, highestSent);
+        if (range.start >= range.end) {
+            continue;
+        }
+        
+        int j = count++;
+        while (j > 0 && ranges[j - 1].start > range.start) {
+            ranges[j] = ranges[j - 1];
+            j--;
+        }
+        ranges[j] = range;
+        top = max(top, range.end);
+    }
+    
+    // First ack on a new link: nothing past the last byte the app has is on
+    // its way any more, and every hole is worth asking for again
+    if (resumePending) {
+        resumePending = false;
+        recoveredOffset = ackedOffset;
+        if (sentOffset > top) {
+            sentOffset = top;
+            endAnnounced = false;
+        }
+    }
+    
+    // A resend can be lost as well, e.g. dropped by a full stack. Once the
+    // queue went out and the app still reports holes a while later, every
+    // hole is asked for again.
+    if (retransmitCount == 0 && recoveredOffset > ackedOffset &&
+        millis() - recoveredTime >= AUDIO_TRANSFER_RESEND_MS) {
+        recoveredOffset = ackedOffset;
+    }
+    
+    // Holes below the highest received byte went missing, the rest may still
+    // be in flight. A hole is only queued again after the resend timeout so
+    // periodic acks do not repeat a retransmit that is already on its way.
+    uint32_t cursor = ackedOffset;
+    for (int i = 0; i < count; i++) {
+        uint32_t holeStart = max(cursor, recoveredOffset);
+        if (ranges[i].start > holeStart && retransmitCount < AUDIO_TRANSFER_MAX_RANGES) {
+            retransmit[retransmitCount].start = holeStart;
+            retransmit[retransmitCount].end = ranges[i].start;
+            retransmitCount++;
+            recoveredOffset = ranges[i].start;
+            recoveredTime = millis();
+            endAnnounced = false;
+        }
+        cursor = max(cursor, ranges[i].end);
+    }
+    
+    return true;
+}
+
+bool AudioTransfer::parseAck(const char* data, uint8_t& stream, uint32_t& cumulative,
+                             AudioTransferRange* received, int& receivedCount, int maxRanges) {
+    char* end;
+    receivedCount = 0;
+    
+    unsigned long value = strtoul(data, &end, 10);
+    if (end == data || *end != ',' || value > 0xFF) {
+        return false;
+    }
+    stream = (uint8_t)value;
+    
+    const char* cursor = end + 1;
+    cumulative = strtoul(cursor, &end, 10);
+    if (end == cursor) {
+        return false;
+    }
+    
+    // Optional selective blocks, "start-end" each
+    while (*end == ',' && receivedCount < maxRanges) {
+        cursor = end + 1;
+        uint32_t start = strtoul(cursor, &end, 10);
+        if (end == cursor || *end != '-') {
+            return false;
+        }
+        
+        cursor = end + 1;
+        uint32_t stop = strtoul(cursor, &end, 10);
+        if (end == cursor || stop <= start) {
+            return false;
+        }
+        
+        received[receivedCount].start = start;
+        received[receivedCount].end = stop;
+        receivedCount++;
+    }
+    
+    return true;
+}
+
+bool AudioTransfer::hasUnacknowledged() {
+    return endOffset > 0 && (!ended || ackedOffset < endOffset);
+}
+
+bool AudioTransfer::isResumePending() {
+    return resumePending;
+}
+
+uint8_t AudioTransfer::getStreamId() {
+    return streamId;
+}
+
+uint32_t AudioTransfer::getAckedOffset() {
+    return ackedOffset;
+}
+
+uint32_t AudioTransfer::getSentOffset() {
+    return sentOffset;
+}
+
+uint32_t AudioTransfer::getEndOffset() {
+    return endOffset;
+}
+
+uint32_t AudioTransfer::getRetransmittedBytes() {
+    return retransmittedBytes;
+}
+
+size_t AudioTransfer::getCapacity() {
+    return capacity;
+}
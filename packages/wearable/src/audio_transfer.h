@@ -0,0 +1,97 @@
+#ifndef AUDIO_TRANSFER_H
+#define AUDIO_TRANSFER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Resumable audio stream. Encoded audio is appended to a retention ring and
+// addressed by its byte offset in the stream; bytes stay retained until the
+// app acknowledges them, so a dropped link only costs what was in flight.
+//
+// Packet: stream id (uint8), flags, offset of the first payload byte
+// (uint32 LE), payload. Plain transfers send the payload alone and treat
+// every byte as acknowledged once it has been handed to the stack.
+#define AUDIO_PACKET_HEADER_SIZE 6
+#define AUDIO_PACKET_FLAG_END 0x01        // Payload ends the stream
+#define AUDIO_PACKET_FLAG_RETRANSMIT 0x02 // Sent before, resent after a loss
+
+// Half-open byte range [start, end) of a stream
+struct AudioTransferRange {
+    uint32_t start;
+    uint32_t end;
+};
+
+class AudioTransfer {
+private:
+    uint8_t* buffer;
+    size_t capacity;
+    size_t mask;
+    
+    uint8_t streamId;
+    bool ended;
+    bool endAnnounced;
+    bool resumePending;
+    
+    // Stream offsets: acked <= sent <= end, highestSent is the furthest
+    // position ever handed to the stack
+    uint32_t ackedOffset;
+    uint32_t sentOffset;
+    uint32_t highestSent;
+    uint32_t endOffset;
+    
+    // Holes the app reported, resent before new data. Holes below
+    // recoveredOffset were already queued, at recoveredTime.
+    AudioTransferRange retransmit[AUDIO_TRANSFER_MAX_RANGES];
+    int retransmitCount;
+    uint32_t recoveredOffset;
+    uint32_t recoveredTime;
+    uint32_t retransmittedBytes;
+    
+    void copyOut(uint32_t offset, uint8_t* dest, size_t length);
+
+public:
+    AudioTransfer();
+    ~AudioTransfer();
+    
+    bool begin();
+    void end();
+    
+    // Producer side. startStream() drops whatever the previous stream left.
+    void startStream();
+    size_t getFreeSpace();
+    bool append(const uint8_t* data, size_t length); // False when the retention ring is full
+    void finishStream();
+    
+    // Sender side. nextPacket() fills packet with at most maxLength bytes
+    // and returns its length, 0 when there is nothing to send.
+    bool hasPending();
+    size_t nextPacket(uint8_t* packet, size_t maxLength, bool withHeader);
+    
+    // True once per stream, when the last byte has been sent
+    bool takeEndOfStream();
+    
+    // The link went down. Resumable transfers rewind to what the app reports
+    // in its next ack, plain ones give up on everything appended so far.
+    void linkLost(bool resumable);
+    
+    // Cumulative ack plus the ranges received beyond it. Holes below the
+    // highest received byte are queued for retransmission, and queued again
+    // when still reported AUDIO_TRANSFER_RESEND_MS later.
+    bool acknowledge(uint8_t stream, uint32_t cumulative, const AudioTransferRange* received, int receivedCount);
+    
+    // "stream,cumulative[,start-end]..." as sent in the audio_ack command
+    static bool parseAck(const char* data, uint8_t& stream, uint32_t& cumulative,
+                         AudioTransferRange* received, int& receivedCount, int maxRanges);
+    
+    // Status
+    bool hasUnacknowledged();
+    bool isResumePending(); // Lost a resumable link, the next ack rewinds
+    uint8_t getStreamId();
+    uint32_t getAckedOffset();
+    uint32_t getSentOffset();
+    uint32_t getEndOffset();
+    uint32_t getRetransmittedBytes();
+    size_t getCapacity();
+};
+
+#endif // AUDIO_TRANSFER_H
@@ -0,0 +1,148 @@
+#include "battery_monitor.h"
+#include "logger.h"
+
+#define BATTERY_ADC_CHANNEL ADC1_CHANNEL_7 // GPIO35
+#define BATTERY_DEFAULT_VREF 1100
+
+volatile uint16_t BatteryMonitor::cachedMillivolts = 0;
+volatile uint8_t BatteryMonitor::cachedPercent = 0;
+
+// Resting LiPo discharge curve, millivolts to percent
+static const uint16_t socVoltage[] = {4200, 4100, 4000, 3900, 3800, 3700, 3600, 3500, 3400, 3300};
+static const uint8_t socPercent[] = {100, 90, 78, 65, 52, 38, 22, 10, 4, 0};
+#define SOC_POINTS (sizeof(socVoltage) / sizeof(socVoltage[0]))
+
+BatteryMonitor::BatteryMonitor() {
+    isInitialized = false;
+    memset(&adcCharacteristics, 0, sizeof(adcCharacteristics));
+    memset(readings, 0, sizeof(readings));
+    readingIndex = 0;
+    readingCount = 0;
+    readingSum = 0;
+    lowBattery = false;
+    onAdcAcquire = nullptr;
+    onAdcRelease = nullptr;
+    onLowBattery = nullptr;
+}
+
+bool BatteryMonitor::begin() {
+    LOGGER_INFO("Initializing Battery Monitor...");
+    
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(BATTERY_ADC_CHANNEL, ADC_ATTEN_DB_11);
+    
+    // Uses the per-chip reference burned into eFuse when there is one
+    esp_adc_cal_value_t calibration = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12,
+                                                               BATTERY_DEFAULT_VREF, &adcCharacteristics);
+    switch (calibration) {
+        case ESP_ADC_CAL_VAL_EFUSE_TP:
+            LOGGER_INFO("Battery ADC calibrated from eFuse two-point values");
+            break;
+        case ESP_ADC_CAL_VAL_EFUSE_VREF:
+            LOGGER_INFO("Battery ADC calibrated from eFuse Vref");
+            break;
+        default:
+            LOGGER_INFO("Battery ADC not calibrated, using default Vref");
+            break;
+    }
+    
+    isInitialized = true;
+    
+    // Seed the average so the first messages carry a real value
+    uint16_t millivolts = readMillivolts();
+    for (size_t i = 0; i < BATTERY_AVERAGE_SAMPLES; i++) {
+        addReading(millivolts);
+    }
+    
+    // Left clear even on a low first reading: the haptics and BLE are not up
+    // yet, the first update() warns once they are
+    lowBattery = false;
+    
+    LOGGER_INFO("Battery: %umV (%u%%)", cachedMillivolts, cachedPercent);
+    return true;
+}
+
+uint16_t BatteryMonitor::readMillivolts() {
+    if (onAdcAcquire) {
+        onAdcAcquire();
+    }
+    
+    // Oversample to average out ADC noise
+    uint32_t rawSum = 0;
+    for (int i = 0; i < BATTERY_OVERSAMPLE; i++) {
+        rawSum += adc1_get_raw(BATTERY_ADC_CHANNEL);
+    }
+    
+    if (onAdcRelease) {
+        onAdcRelease();
+    }
+    
+    uint32_t pinMillivolts = esp_adc_cal_raw_to_voltage(rawSum / BATTERY_OVERSAMPLE, &adcCharacteristics);
+    return (uint16_t)(pinMillivolts * BATTERY_DIVIDER_RATIO);
+}
+
+void BatteryMonitor::addReading(uint16_t millivolts) {
+    if (readingCount == BATTERY_AVERAGE_SAMPLES) {
+        readingSum -= readings[readingIndex];
+    } else {
+        readingCount++;
+    }
+    
+    readings[readingIndex] = millivolts;
+    readingSum += millivolts;
+    readingIndex = (readingIndex + 1) % BATTERY_AVERAGE_SAMPLES;
+    
+    cachedMillivolts = readingSum / readingCount;
+    cachedPercent = estimatePercent(cachedMillivolts);
+}
+
+void BatteryMonitor::update() {
+    if (!isInitialized) {
+        return;
+    }
+    
+    addReading(readMillivolts());
+    
+    // Hysteresis so a reading hovering at the threshold warns only once
+    uint16_t lowMillivolts = LOW_BATTERY_THRESHOLD * 1000;
+    if (!lowBattery && cachedMillivolts < lowMillivolts) {
+        lowBattery = true;
+        if (onLowBattery) {
+            onLowBattery();
+        }
+    } else if (lowBattery && cachedMillivolts > lowMillivolts + BATTERY_HYSTERESIS_MV) {
+        lowBattery = false;
+    }
+}
+
+uint8_t BatteryMonitor::estimatePercent(uint16_t millivolts) {
+    if (millivolts >= socVoltage[0]) {
+        return socPercent[0];
+    }
+    
+    // Linear interpolation between points of the discharge curve
+    for (size_t i = 1; i < SOC_POINTS; i++) {
+        if (millivolts >= socVoltage[i]) {
+            uint16_t span = socVoltage[i - 1] - socVoltage[i];
+            return socPercent[i] + (uint32_t)(socPercent[i - 1] - socPercent[i]) * (millivolts - socVoltage[i]) / span;
+        }
+    }
+    
+    return 0;
+}
+
+uint16_t BatteryMonitor::getMillivolts() {
+    return cachedMillivolts;
+}
+
+float BatteryMonitor::getVoltage() {
+    return cachedMillivolts / 1000.0;
+}
+
+uint8_t BatteryMonitor::getPercent() {
+    return cachedPercent;
+}
+
+bool BatteryMonitor::isLow() {
+    return lowBattery;
+}
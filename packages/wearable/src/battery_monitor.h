@@ -0,0 +1,55 @@
+#ifndef BATTERY_MONITOR_H
+#define BATTERY_MONITOR_H
+
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include "config.h"
+
+// Samples the battery on a slow timer with the eFuse ADC calibration and
+// keeps a filtered value that the message path can read without touching
+// the ADC.
+class BatteryMonitor {
+private:
+    esp_adc_cal_characteristics_t adcCharacteristics;
+    bool isInitialized;
+    
+    // Moving average over the last BATTERY_AVERAGE_SAMPLES readings
+    uint16_t readings[BATTERY_AVERAGE_SAMPLES];
+    size_t readingIndex;
+    size_t readingCount;
+    uint32_t readingSum;
+    
+    bool lowBattery;
+    
+    // Shared with Protocol, written only by update()
+    static volatile uint16_t cachedMillivolts;
+    static volatile uint8_t cachedPercent;
+    
+    uint16_t readMillivolts();
+    void addReading(uint16_t millivolts);
+    static uint8_t estimatePercent(uint16_t millivolts);
+
+public:
+    BatteryMonitor();
+    
+    bool begin();
+    
+    // Takes one sample, called from the scheduler every BATTERY_SAMPLE_INTERVAL_MS
+    void update();
+    
+    // Cached, filtered values, free to call from any task
+    static uint16_t getMillivolts();
+    static float getVoltage();
+    static uint8_t getPercent();
+    bool isLow();
+    
+    // ADC1 is shared with the I2S microphone, these bracket each sample
+    void (*onAdcAcquire)();
+    void (*onAdcRelease)();
+    
+    // Called once when the filtered voltage drops below LOW_BATTERY_THRESHOLD
+    void (*onLowBattery)();
+};
+
+#endif // BATTERY_MONITOR_H
@@ -1,289 +1,831 @@
 #include "ble_manager.h"
+#include "logger.h"
 #include "protocol.h"
 
 BLEManager::BLEManager() {
     deviceConnected = false;
-    oldDeviceConnected = false;
-    lastHeartbeat = 0;
-    server = nullptr;
-    service = nullptr;
-    audioCharacteristic = nullptr;
-    commandCharacteristic = nullptr;
-    statusCharacteristic = nullptr;
-    advertising = nullptr;
+    linkReported = false;
+    currentStatus = STATUS_READY;
+    memset(&sentState, 0, sizeof(sentState));
+    stateSent = false;
+    lastStateTime = 0;
+    stateSequence = 0;
+    onEvent = nullptr;
+    onLinkChange = nullptr;
+    onCommand = nullptr;
+    audioCodec = AUDIO_DEFAULT_CODEC;
+    binaryFrames = false;
+    txSequence = 0;
+    streamingMode = false;
+    resumableAudio = false;
+    transferSelected = false;
+    connectTime = 0;
+    audioLinkLost = false;
+    audioLinkLostResumable = false;
+    memset(&stats, 0, sizeof(stats));
+    statsStartTime = 0;
+    totalDrops = 0;
+    totalNotifyFailures = 0;
+    rxReceivedUs = 0;
+    rxReportedDrops = 0;
+    lastReceiveTime = 0;
+    resetCommandStats();
+    otaReadyTime = 0;
+    transport = nullptr;
 }
 
 bool BLEManager::begin() {
-    Serial.println("Initializing BLE...");
+    LOGGER_INFO("Initializing BLE...");
     
-    // Initialize BLE Device
-    BLEDevice::init(DEVICE_NAME);
+    uint32_t startTime = millis();
+    uint32_t heapBefore = ESP.getFreeHeap();
     
-    // Create BLE Server
-    server = BLEDevice::createServer();
-    server->setCallbacks(this);
+    // A freshly installed image stays on trial until the app connects
+    ota.begin();
     
-    // Setup service and characteristics
-    setupService();
-    setupCharacteristics();
-    setupAdvertising();
+    if (!audioTransfer.begin()) {
+        LOGGER_ERROR("Failed to allocate audio retention buffer");
+        return false;
+    }
+    
+    // Service, characteristics and advertising data are set up by the stack backend
+    transport = createBLETransport();
+    if (!transport->begin(DEVICE_NAME, this)) {
+        LOGGER_ERROR("BLE transport failed to start");
+        ota.rollback();
+        return false;
+    }
     
-    // Start advertising
-    startAdvertising();
+    // Start advertising, ConnectionManager takes over the interval from here
+    startAdvertising(BLE_ADV_FAST_INTERVAL);
     
-    Serial.println("BLE initialized successfully");
+    LOGGER_INFO("BLE initialized with %s in %u ms, %u bytes of heap", transport->getName(),
+                millis() - startTime, heapBefore - ESP.getFreeHeap());
     return true;
 }
 
-void BLEManager::setupService() {
-    service = server->createService(BLE_SERVICE_UUID);
+const char* BLEManager::getStackName() {
+    return transport ? transport->getName() : "none";
 }
 
-void BLEManager::setupCharacteristics() {
-    // Audio characteristic for sending voice data
-    audioCharacteristic = service->createCharacteristic(
-        BLE_AUDIO_CHARACTERISTIC_UUID,
-        BLECharacteristic::PROPERTY_NOTIFY
-    );
-    audioCharacteristic->addDescriptor(new BLE2902());
-    
-    // Command characteristic for sending commands to mobile app
-    commandCharacteristic = service->createCharacteristic(
-        BLE_COMMAND_CHARACTERISTIC_UUID,
-        BLECharacteristic::PROPERTY_NOTIFY
-    );
-    commandCharacteristic->addDescriptor(new BLE2902());
-    commandCharacteristic->setCallbacks(this);
-    
-    // Status characteristic for receiving commands from mobile app
-    statusCharacteristic = service->createCharacteristic(
-        BLE_STATUS_CHARACTERISTIC_UUID,
-        BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
-    );
-    statusCharacteristic->setCallbacks(this);
+void BLEManager::startAdvertising(uint16_t interval) {
+    // The phone is already here, a second central is not wanted
+    if (deviceConnected) {
+        return;
+    }
     
-    // Start the service
-    service->start();
-}
-
-void BLEManager::setupAdvertising() {
-    advertising = BLEDevice::getAdvertising();
-    advertising->addServiceUUID(BLE_SERVICE_UUID);
-    advertising->setScanResponse(true);
-    advertising->setMinPreferred(0x06);
-    advertising->setMinPreferred(0x12);
-}
-
-void BLEManager::startAdvertising() {
-    Serial.println("Starting BLE advertising...");
-    advertising->start();
+    LOGGER_INFO("Starting BLE advertising every %u.%03u ms", interval * 625 / 1000, interval * 625 % 1000);
+    transport->stopAdvertising();
+    transport->setAdvertisingInterval(interval, interval);
+    transport->startAdvertising();
 }
 
 void BLEManager::stopAdvertising() {
-    Serial.println("Stopping BLE advertising...");
-    advertising->stop();
+    LOGGER_INFO("Stopping BLE advertising...");
+    transport->stopAdvertising();
 }
 
 void BLEManager::update() {
-    // Handle connection state changes
-    if (!deviceConnected && oldDeviceConnected) {
-        delay(500); // Give the bluetooth stack time to get ready
-        server->startAdvertising();
-        Serial.println("Start advertising after disconnect");
-        oldDeviceConnected = deviceConnected;
-    }
+    // The transfer learns about a lost link before acks from the next one
+    handleAudioLinkLoss();
+    
+    // Decode and dispatch whatever the app wrote since the last run
+    processIncoming();
     
-    if (deviceConnected && !oldDeviceConnected) {
-        oldDeviceConnected = deviceConnected;
-        Serial.println("Device connected");
+    // Report connection changes from the main loop, advertising is restarted
+    // by whoever handles them
+    if (deviceConnected != linkReported) {
+        linkReported = deviceConnected;
+        LOGGER_INFO("%s", linkReported ? "Device connected" : "Device disconnected");
+        if (linkReported) {
+            ota.confirmImage();
+        }
+        if (onLinkChange) {
+            onLinkChange(linkReported);
+        }
     }
     
-    // Send periodic heartbeat if connected
-    if (deviceConnected && (millis() - lastHeartbeat > 30000)) {
-        sendHeartbeat();
-        lastHeartbeat = millis();
+    // The unchanged state record doubles as the heartbeat
+    if (deviceConnected && (!stateSent || millis() - lastStateTime >= STATE_HEARTBEAT_INTERVAL_MS)) {
+        sendState(true);
     }
+    
+    // Retained audio left over from the voice task or a previous link
+    pumpAudio();
+    
+    ota.update();
+    pumpOta();
 }
 
 bool BLEManager::isConnected() {
     return deviceConnected;
 }
 
+uint32_t BLEManager::getLastReceiveTime() {
+    return lastReceiveTime;
+}
+
 void BLEManager::disconnect() {
     if (deviceConnected) {
-        server->disconnect(server->getConnId());
+        transport->disconnect();
     }
 }
 
 bool BLEManager::sendAudioData(uint8_t* data, size_t length) {
-    if (!deviceConnected || !audioCharacteristic) {
+    if (!deviceConnected) {
         return false;
     }
     
-    // Split large audio data into smaller chunks if needed
-    const size_t maxChunkSize = 512;
+    // Fill each notification up to the negotiated MTU
+    const size_t maxChunkSize = getMaxNotifyPayload();
     size_t offset = 0;
     
     while (offset < length) {
+        // Pace on free controller buffers instead of fixed sleeps
+        if (!waitForNotifyCredit()) {
+            stats.drops++;
+            totalDrops++;
+            return false;
+        }
+        
         size_t chunkSize = min(maxChunkSize, length - offset);
-        audioCharacteristic->setValue(data + offset, chunkSize);
-        audioCharacteristic->notify();
+        if (!transport->notify(BLE_CHAR_AUDIO, data + offset, chunkSize) || !deviceConnected) {
+            stats.drops++;
+            totalDrops++;
+            return false;
+        }
+        
         offset += chunkSize;
-        delay(10); // Small delay to prevent overwhelming the connection
+        stats.bytesSent += chunkSize;
+        stats.notifications++;
     }
     
     return true;
 }
 
-bool BLEManager::sendCommand(const String& command) {
-    if (!deviceConnected || !commandCharacteristic) {
+void BLEManager::beginAudioTransfer() {
+    audioTransfer.startStream();
+}
+
+bool BLEManager::queueAudioData(const uint8_t* data, size_t length) {
+    return audioTransfer.append(data, length);
+}
+
+size_t BLEManager::getAudioQueueSpace() {
+    return audioTransfer.getFreeSpace();
+}
+
+void BLEManager::endAudioTransfer() {
+    audioTransfer.finishStream();
+}
+
+bool BLEManager::isAudioPending() {
+    return deviceConnected && audioTransfer.hasPending();
+}
+
+void BLEManager::handleAudioLinkLoss() {
+    // Set by onDisconnect() in the host task
+    if (audioLinkLost) {
+        audioLinkLost = false;
+        audioTransfer.linkLost(audioLinkLostResumable);
+    }
+}
+
+bool BLEManager::pumpAudio() {
+    handleAudioLinkLoss();
+    if (!deviceConnected) {
         return false;
     }
     
-    String message = Protocol::createCommandMessage(command);
+    // Retained audio waits until the new link picked its transfer mode, an
+    // app that never sends set_transfer gets plain transfers as before
+    if (!transferSelected) {
+        if (millis() - connectTime < AUDIO_TRANSFER_SELECT_WAIT_MS) {
+            return true;
+        }
+        transferSelected = true;
+    }
+    
+    // A resumable transfer resumes from what the app's first ack reports
+    if (resumableAudio && audioTransfer.isResumePending()) {
+        return true;
+    }
     
-    commandCharacteristic->setValue(message.c_str());
-    commandCharacteristic->notify();
+    // Bounded per pass so a backlog after a reconnect does not stall the loop
+    const size_t maxPacket = getMaxNotifyPayload();
+    size_t budget = AUDIO_TRANSFER_PUMP_BYTES;
+    
+    while (budget > 0 && audioTransfer.hasPending()) {
+        // Retained bytes are not lost when buffers stay full, just sent later
+        if (!waitForNotifyCredit()) {
+            return true;
+        }
+        
+        size_t length = audioTransfer.nextPacket(audioPacket, maxPacket, resumableAudio);
+        if (length == 0) {
+            break;
+        }
+        
+        // A resumable transfer gets the hole reported in the app's next ack
+        if (!transport->notify(BLE_CHAR_AUDIO, audioPacket, length) || !deviceConnected) {
+            stats.drops++;
+            totalDrops++;
+            return false;
+        }
+        
+        stats.bytesSent += length;
+        stats.notifications++;
+        budget -= min(budget, length);
+    }
+    
+    if (audioTransfer.takeEndOfStream()) {
+        sendCommand("audio_stream_end");
+        
+        BLEThroughputStats snapshot = getThroughputStats();
+        LOGGER_INFO("Audio stream %u: %u bytes in %u ms (%u B/s), MTU %u, %u notifies, %u waits, %u drops, %u failures, %u resent",
+                    audioTransfer.getStreamId(), snapshot.bytesSent, snapshot.elapsedMs, snapshot.bytesPerSecond,
+                    snapshot.mtu, snapshot.notifications, snapshot.creditWaits, snapshot.drops,
+                    snapshot.notifyFailures, audioTransfer.getRetransmittedBytes());
+        
+        // Short connection intervals were only needed for the stream
+        setStreamingMode(false);
+    }
     
-    Serial.printf("Sent command: %s\n", message.c_str());
     return true;
 }
 
-bool BLEManager::sendStatus(const String& status) {
-    if (!deviceConnected || !statusCharacteristic) {
+void BLEManager::handleAudioAck(const char* data) {
+    uint8_t stream;
+    uint32_t cumulative;
+    AudioTransferRange received[AUDIO_TRANSFER_MAX_RANGES];
+    int receivedCount;
+    
+    if (!AudioTransfer::parseAck(data, stream, cumulative, received, receivedCount, AUDIO_TRANSFER_MAX_RANGES) ||
+        !audioTransfer.acknowledge(stream, cumulative, received, receivedCount)) {
+        LOGGER_WARN("Ignoring audio ack: %s", data);
+    }
+}
+
+void BLEManager::handleOtaBegin(const char* data) {
+    uint32_t size;
+    uint8_t hash[OTA_SHA256_SIZE];
+    OtaImageFormat format;
+    
+    // The hash only covers integrity, who may flash is down to the bond
+    OtaError result = OTA_ERROR_BAD_REQUEST;
+    if (!transport->isEncrypted()) {
+        result = OTA_ERROR_INSECURE;
+    } else if (OtaUpdater::parseBegin(data, size, hash, format)) {
+        ota.onProgress = onEvent;
+        result = ota.start(size, hash, format);
+    }
+    
+    if (result != OTA_ERROR_NONE) {
+        LOGGER_WARN("OTA update refused: %s", OtaUpdater::getErrorName(result));
+        sendCommand("ota_error", OtaUpdater::getErrorName(result));
+        return;
+    }
+    
+    // Short connection intervals carry a packet per event in both directions
+    setStreamingMode(true);
+    otaReadyTime = 0;
+    
+    // Window and the largest packet the app may write, header included
+    char reply[PROTOCOL_DATA_SIZE];
+    snprintf(reply, sizeof(reply), "%u,%u", OTA_WINDOW_BYTES, getMTU() - 3);
+    sendCommand("ota_accepted", reply);
+}
+
+void BLEManager::pumpOta() {
+    // Only an ack the stack took counts as sent, otherwise it is retried
+    OtaAckRecord record;
+    if (deviceConnected && ota.peekAck(record) &&
+        transport->notify(BLE_CHAR_OTA, (const uint8_t*)&record, sizeof(record))) {
+        ota.ackSent(record);
+        
+        if (record.state == OTA_FAILED) {
+            sendCommand("ota_error", OtaUpdater::getErrorName((OtaError)record.error));
+        } else if (record.state == OTA_READY) {
+            otaReadyTime = max(millis(), (uint32_t)1);
+        }
+    }
+    
+    // The new image boots once the final ack had time to reach the app, or
+    // straight away when there is no link to send it on
+    if (ota.getState() == OTA_READY) {
+        if (otaReadyTime == 0 && !deviceConnected) {
+            otaReadyTime = max(millis(), (uint32_t)1);
+        }
+        if (otaReadyTime != 0 && millis() - otaReadyTime >= OTA_REBOOT_DELAY_MS) {
+            LOGGER_INFO("Restarting into the new image");
+            Logger::flush();
+            ESP.restart();
+        }
+    }
+}
+
+bool BLEManager::isOtaActive() {
+    OtaState state = ota.getState();
+    return state == OTA_RECEIVING || state == OTA_READY;
+}
+
+void BLEManager::sendAudioResume() {
+    if (!audioTransfer.hasUnacknowledged()) {
+        return;
+    }
+    
+    // Stream, acked and sent offsets, the app answers with audio_ack
+    char data[PROTOCOL_DATA_SIZE];
+    snprintf(data, sizeof(data), "%u,%u,%u", audioTransfer.getStreamId(),
+             audioTransfer.getAckedOffset(), audioTransfer.getSentOffset());
+    sendCommand("audio_resume", data);
+}
+
+bool BLEManager::waitForNotifyCredit() {
+    if (transport->hasNotifyCredit()) {
+        return true;
+    }
+    
+    stats.creditWaits++;
+    uint32_t waitStart = millis();
+    
+    while (!transport->hasNotifyCredit()) {
+        if (!deviceConnected || millis() - waitStart > BLE_NOTIFY_TIMEOUT_MS) {
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    
+    return true;
+}
+
+size_t BLEManager::getMaxNotifyPayload() {
+    // ATT notification header takes 3 bytes of the MTU
+    uint16_t mtu = getMTU();
+    if (mtu <= 3) {
+        return 20;
+    }
+    return min((size_t)(mtu - 3), (size_t)BLE_MAX_NOTIFY_PAYLOAD);
+}
+
+uint16_t BLEManager::getMTU() {
+    if (!deviceConnected) {
+        return 23;
+    }
+    return transport->getMTU();
+}
+
+void BLEManager::setStreamingMode(bool streaming) {
+    if (streaming == streamingMode) {
+        return;
+    }
+    
+    streamingMode = streaming;
+    
+    if (deviceConnected) {
+        updateConnectionParams(streaming);
+    }
+    
+    if (streaming) {
+        resetThroughputStats();
+    }
+}
+
+void BLEManager::updateConnectionParams(bool streaming) {
+    // Short intervals while streaming, long intervals with latency when idle
+    if (streaming) {
+        transport->updateConnectionParams(BLE_STREAM_CONN_INTERVAL_MIN, BLE_STREAM_CONN_INTERVAL_MAX,
+                                          0, BLE_SUPERVISION_TIMEOUT);
+    } else {
+        transport->updateConnectionParams(BLE_IDLE_CONN_INTERVAL_MIN, BLE_IDLE_CONN_INTERVAL_MAX,
+                                          BLE_IDLE_SLAVE_LATENCY, BLE_SUPERVISION_TIMEOUT);
+    }
+}
+
+BLEThroughputStats BLEManager::getThroughputStats() {
+    BLEThroughputStats snapshot = stats;
+    
+    snapshot.elapsedMs = millis() - statsStartTime;
+    snapshot.bytesPerSecond = snapshot.elapsedMs > 0 ? (uint32_t)((uint64_t)snapshot.bytesSent * 1000 / snapshot.elapsedMs) : 0;
+    snapshot.mtu = getMTU();
+    
+    return snapshot;
+}
+
+void BLEManager::resetThroughputStats() {
+    memset(&stats, 0, sizeof(stats));
+    statsStartTime = millis();
+}
+
+bool BLEManager::sendMessage(BLECharacteristicId characteristic, const uint8_t* message, size_t length) {
+    if (length == 0) {
         return false;
     }
     
-    StatusType statusType = STATUS_READY; // Default
-    if (status == "recording") statusType = STATUS_RECORDING;
-    else if (status == "processing") statusType = STATUS_PROCESSING;
-    else if (status == "low_battery") statusType = STATUS_LOW_BATTERY;
-    else if (status == "error") statusType = STATUS_ERROR;
-    else if (status == "disconnected") statusType = STATUS_DISCONNECTED;
+    return transport->notify(characteristic, message, length);
+}
+
+uint32_t BLEManager::getTxPoolExhausted() {
+    return txPool.getExhaustedCount();
+}
+
+uint32_t BLEManager::getTotalDrops() {
+    return totalDrops;
+}
+
+uint32_t BLEManager::getTotalNotifyFailures() {
+    return totalNotifyFailures;
+}
+
+bool BLEManager::setTelemetry(const uint8_t* data, size_t length) {
+    if (!transport) {
+        return false;
+    }
+    return transport->setValue(BLE_CHAR_TELEMETRY, data, length);
+}
+
+bool BLEManager::sendCommand(const char* command, const char* data) {
+    if (!deviceConnected) {
+        return false;
+    }
+    
+    uint8_t* buffer = txPool.acquire();
+    if (!buffer) {
+        LOGGER_ERROR("TX pool exhausted, dropped command: %s", command);
+        return false;
+    }
     
-    String message = Protocol::createStatusMessage(statusType);
+    size_t length;
+    if (binaryFrames) {
+        length = FrameProtocol::createCommandFrame(buffer, txPool.getBufferSize(), txSequence++, command, data);
+    } else {
+        length = Protocol::createCommandMessage((char*)buffer, txPool.getBufferSize(), command, data);
+    }
     
-    statusCharacteristic->setValue(message.c_str());
-    statusCharacteristic->notify();
+    bool sent = sendMessage(BLE_CHAR_COMMAND, buffer, length);
+    txPool.release(buffer);
     
+    if (sent) {
+        LOGGER_DEBUG("Sent command: %s (%u bytes)", command, (unsigned)length);
+    }
+    return sent;
+}
+
+bool BLEManager::updateState(StatusType status) {
+    currentStatus = status;
+    return sendState(false);
+}
+
+bool BLEManager::sendStatus(StatusType status) {
+    currentStatus = status;
+    return sendState(true);
+}
+
+bool BLEManager::sendState(bool force) {
+    if (!deviceConnected) {
+        return false;
+    }
+    
+    DeviceStateRecord record;
+    DeviceState::capture(record, currentStatus);
+    
+    // Each notification is a radio event, skip records the app already has
+    if (!force && stateSent && !DeviceState::hasChanged(record, sentState) &&
+        millis() - lastStateTime < STATE_HEARTBEAT_INTERVAL_MS) {
+        return false;
+    }
+    
+    record.sequence = stateSequence;
+    if (!sendMessage(BLE_CHAR_STATUS, (const uint8_t*)&record, sizeof(record))) {
+        return false;
+    }
+    
+    stateSequence++;
+    sentState = record;
+    stateSent = true;
+    lastStateTime = millis();
     return true;
 }
 
-void BLEManager::sendHeartbeat() {
-    if (!deviceConnected || !statusCharacteristic) {
+AudioCodecType BLEManager::getAudioCodec() {
+    return audioCodec;
+}
+
+bool BLEManager::isUsingBinaryFrames() {
+    return binaryFrames;
+}
+
+void BLEManager::sendError(ErrorCode error, const char* description) {
+    if (!deviceConnected) {
+        return;
+    }
+    
+    uint8_t* buffer = txPool.acquire();
+    if (!buffer) {
         return;
     }
     
-    String message = Protocol::createHeartbeatMessage();
-    statusCharacteristic->setValue(message.c_str());
-    statusCharacteristic->notify();
+    size_t length;
+    if (binaryFrames) {
+        length = FrameProtocol::createErrorFrame(buffer, txPool.getBufferSize(), txSequence++, error, description);
+    } else {
+        length = Protocol::createErrorMessage((char*)buffer, txPool.getBufferSize(), error, description);
+    }
+    
+    sendMessage(BLE_CHAR_STATUS, buffer, length);
+    txPool.release(buffer);
 }
 
-// BLE Server Callbacks
-void BLEManager::onConnect(BLEServer* server) {
+// Transport callbacks
+void BLEManager::onConnect() {
     deviceConnected = true;
-    Serial.println("BLE device connected");
+    audioCodec = AUDIO_DEFAULT_CODEC; // Renegotiated on every connection
+    binaryFrames = false;
+    resumableAudio = false;
+    transferSelected = false;
+    connectTime = millis();
+    txSequence = 0;
+    stateSent = false; // The first update() sends the current state
+    stateSequence = 0;
+    LOGGER_INFO("BLE device connected");
     stopAdvertising();
+    
+    transport->requestLinkUpgrade();
+    updateConnectionParams(streamingMode);
+    
+    if (onEvent) {
+        onEvent();
+    }
 }
 
-void BLEManager::onDisconnect(BLEServer* server) {
+void BLEManager::onDisconnect() {
     deviceConnected = false;
-    Serial.println("BLE device disconnected");
+    
+    // The mode of the link that went down decides what the transfer keeps
+    audioLinkLostResumable = resumableAudio;
+    audioLinkLost = true;
+    LOGGER_INFO("BLE device disconnected");
+    
+    // An image is sent in one go, the app starts over on the next link
+    ota.abort();
+    
+    if (onEvent) {
+        onEvent();
+    }
 }
 
-// BLE Characteristic Callbacks
-void BLEManager::onWrite(BLECharacteristic* characteristic) {
-    String value = characteristic->getValue().c_str();
+void BLEManager::onWrite(const uint8_t* data, size_t length) {
+    // Runs in the BLE host task: copy the raw bytes and hand over
+    lastReceiveTime = millis();
+    rxQueue.push(data, length);
     
-    if (value.length() > 0) {
-        Serial.printf("Received: %s\n", value.c_str());
-        
-        // Parse message using protocol
-        MessageType msgType;
-        String payload;
+    if (onEvent) {
+        onEvent();
+    }
+}
+
+void BLEManager::onOtaWrite(const uint8_t* data, size_t length) {
+    // Straight into the receive window, the OTA task wakes the loop with acks
+    lastReceiveTime = millis();
+    ota.receive(data, length);
+}
+
+void BLEManager::onNotifyFailure() {
+    stats.notifyFailures++;
+    totalNotifyFailures++;
+}
+
+void BLEManager::processIncoming() {
+    QueuedCommand* entry;
+    
+    while ((entry = rxQueue.peek()) != nullptr) {
+        rxReceivedUs = entry->receivedUs;
         
-        if (Protocol::parseMessage(value, msgType, payload)) {
-            handleIncomingMessage(msgType, payload);
+        // Binary frames are recognised by their magic byte, anything else is JSON
+        if (FrameProtocol::isFrame(entry->data, entry->length)) {
+            handleIncomingFrame(entry->data, entry->length);
         } else {
-            Serial.println("Failed to parse incoming message");
-            String errorMsg = Protocol::createErrorMessage(ERROR_INVALID_COMMAND, "Invalid message format");
-            statusCharacteristic->setValue(errorMsg.c_str());
-            statusCharacteristic->notify();
+            handleIncomingJson(entry->data, entry->length);
+        }
+        
+        rxQueue.pop();
+    }
+    
+    // Full queue or oversized message, tell the app once per batch
+    uint32_t drops = rxQueue.getDropped();
+    if (drops != rxReportedDrops) {
+        LOGGER_WARN("Dropped %u incoming messages", drops - rxReportedDrops);
+        rxReportedDrops = drops;
+        sendError(ERROR_INVALID_COMMAND, "Message dropped");
+    }
+}
+
+void BLEManager::handleIncomingJson(const uint8_t* data, size_t length) {
+    LOGGER_DEBUG("Received: %.*s", (int)length, (const char*)data);
+    
+    // Parsed once, the handlers read fields from the same document
+    MessageType msgType;
+    if (Protocol::parseMessage(rxDocument, (const char*)data, length, msgType)) {
+        handleIncomingMessage(msgType, rxDocument);
+    } else {
+        LOGGER_ERROR("Failed to parse incoming message");
+        sendError(ERROR_INVALID_COMMAND, "Invalid message format");
+    }
+}
+
+void BLEManager::handleIncomingFrame(const uint8_t* data, size_t length) {
+    FrameHeader header;
+    const uint8_t* fields;
+    size_t fieldsLength;
+    
+    if (!FrameProtocol::parseFrame(data, length, header, fields, fieldsLength)) {
+        LOGGER_ERROR("Failed to parse incoming frame");
+        sendError(ERROR_INVALID_COMMAND, "Invalid frame");
+        return;
+    }
+    
+    switch (header.type) {
+        case MSG_COMMAND: {
+            CommandType command;
+            char commandData[PROTOCOL_DATA_SIZE];
+            
+            if (FrameProtocol::parseCommand(fields, fieldsLength, command, commandData, sizeof(commandData))) {
+                handleCommand(command, commandData);
+            } else {
+                sendError(ERROR_INVALID_COMMAND);
+            }
+            break;
         }
+        case MSG_STATUS: {
+            StatusType status;
+            char statusData[PROTOCOL_DATA_SIZE];
+            
+            if (FrameProtocol::parseStatus(fields, fieldsLength, status, statusData, sizeof(statusData))) {
+                handleStatusUpdate(status, statusData);
+            }
+            break;
+        }
+        case MSG_HEARTBEAT:
+            sendState(true);
+            break;
+        default:
+            LOGGER_WARN("Unhandled frame type: %d", header.type);
+            break;
     }
 }
 
-void BLEManager::handleIncomingMessage(MessageType msgType, const String& payload) {
+void BLEManager::handleIncomingMessage(MessageType msgType, JsonDocument& doc) {
     switch (msgType) {
         case MSG_COMMAND: {
             CommandType command;
-            String data;
+            const char* data;
             
-            if (Protocol::parseCommand(payload, command, data)) {
+            if (Protocol::parseCommand(doc, command, data)) {
                 handleCommand(command, data);
             }
             break;
         }
         case MSG_STATUS: {
             StatusType status;
-            String data;
+            const char* data;
             
-            if (Protocol::parseStatus(payload, status, data)) {
+            if (Protocol::parseStatus(doc, status, data)) {
                 handleStatusUpdate(status, data);
             }
             break;
         }
         case MSG_HEARTBEAT:
-            // Respond to heartbeat
-            sendHeartbeat();
+            // Answered with the state record, it carries everything a heartbeat did
+            sendState(true);
             break;
         default:
-            Serial.printf("Unhandled message type: %d\n", msgType);
+            LOGGER_WARN("Unhandled message type: %d", msgType);
             break;
     }
 }
 
-void BLEManager::handleCommand(CommandType command, const String& data) {
+void BLEManager::handleCommand(CommandType command, const char* data) {
+    LOGGER_DEBUG("Mobile app command: %s %s", Protocol::getCommandName(command), data);
+    
     switch (command) {
         case CMD_START_RECORDING:
-            Serial.println("Mobile app requested start recording");
-            // This would trigger voice detector to start recording
-            break;
         case CMD_STOP_RECORDING:
-            Serial.println("Mobile app requested stop recording");
-            // This would trigger voice detector to stop recording
-            break;
         case CMD_HAPTIC_FEEDBACK:
-            Serial.printf("Mobile app requested haptic pattern: %s\n", data.c_str());
-            // This would trigger haptic controller
-            break;
         case CMD_SET_SENSITIVITY:
-            Serial.printf("Mobile app requested sensitivity change: %s\n", data.c_str());
-            // This would update voice detection sensitivity
-            break;
         case CMD_CALIBRATE:
-            Serial.println("Mobile app requested calibration");
-            // This would trigger gesture detector calibration
-            break;
         case CMD_SLEEP:
-            Serial.println("Mobile app requested sleep mode");
-            // This would put device into low power mode
-            break;
         case CMD_WAKE:
-            Serial.println("Mobile app requested wake up");
-            // This would wake device from low power mode
+        case CMD_SET_AUDIO_PROFILE:
+            // Application commands, dispatched to the components by the owner
+            if (onCommand) {
+                onCommand(command, data);
+            }
             break;
         case CMD_RESET:
-            Serial.println("Mobile app requested reset");
+            LOGGER_INFO("Mobile app requested reset");
+            Logger::flush();
             ESP.restart();
             break;
-        default:
-            Serial.printf("Unknown command: %d\n", command);
+        case CMD_SET_CODEC: {
+            AudioCodecType requested;
+            if (AudioEncoder::parseCodecName(data, requested) && AudioEncoder::isSupported(requested)) {
+                audioCodec = requested;
+                LOGGER_INFO("Audio codec set to %s", AudioEncoder::getCodecName(audioCodec));
+            } else {
+                LOGGER_WARN("Unsupported audio codec requested: %s", data);
+            }
+            // Always report the codec in use so the app can fall back
+            sendCommand("codec_selected", AudioEncoder::getCodecName(audioCodec));
+            break;
+        }
+        case CMD_SET_PROTOCOL:
+            // Reply in the format that was just selected
+            if (strcmp(data, "binary") == 0) {
+                binaryFrames = true;
+            } else if (strcmp(data, "json") == 0) {
+                binaryFrames = false;
+            } else {
+                LOGGER_WARN("Unsupported protocol requested: %s", data);
+            }
+            sendCommand("protocol_selected", binaryFrames ? "binary" : "json");
+            break;
+        case CMD_SET_TRANSFER:
+            // Sequenced audio packets and acks, the answer offers any stream left from before
+            if (strcmp(data, "resumable") == 0) {
+                resumableAudio = true;
+            } else if (strcmp(data, "plain") == 0) {
+                resumableAudio = false;
+            } else {
+                LOGGER_WARN("Unsupported transfer mode requested: %s", data);
+            }
+            transferSelected = true;
+            sendCommand("transfer_selected", resumableAudio ? "resumable" : "plain");
+            if (resumableAudio) {
+                sendAudioResume();
+            }
             break;
+        case CMD_AUDIO_ACK:
+            handleAudioAck(data);
+            break;
+        case CMD_OTA_BEGIN:
+            handleOtaBegin(data);
+            break;
+        case CMD_OTA_ABORT:
+            ota.abort();
+            break;
+        default:
+            LOGGER_WARN("Unknown command: %d", command);
+            return;
     }
+    
+    recordCommandLatency(command);
+}
+
+void BLEManager::recordCommandLatency(CommandType command) {
+    uint32_t latency = micros() - rxReceivedUs;
+    
+    commandCount[command]++;
+    commandLatencyTotal[command] += latency;
+    if (latency > commandLatencyMax[command]) {
+        commandLatencyMax[command] = latency;
+    }
+}
+
+BLECommandStats BLEManager::getCommandStats(CommandType command) {
+    BLECommandStats result;
+    
+    result.count = commandCount[command];
+    result.avgLatencyUs = result.count > 0 ? (uint32_t)(commandLatencyTotal[command] / result.count) : 0;
+    result.maxLatencyUs = commandLatencyMax[command];
+    
+    return result;
+}
+
+uint32_t BLEManager::getDroppedCommands() {
+    return rxQueue.getDropped();
+}
+
+void BLEManager::printCommandStats() {
+    LOGGER_INFO("Commands: %u dropped", getDroppedCommands());
+    
+    for (int i = 0; i < COMMAND_TYPE_COUNT; i++) {
+        BLECommandStats result = getCommandStats((CommandType)i);
+        if (result.count == 0) {
+            continue;
+        }
+        
+        LOGGER_INFO("  %-16s count %u, latency avg %u us max %u us",
+                    Protocol::getCommandName((CommandType)i), result.count, result.avgLatencyUs, result.maxLatencyUs);
+    }
+}
+
+void BLEManager::resetCommandStats() {
+    memset(commandCount, 0, sizeof(commandCount));
+    memset(commandLatencyTotal, 0, sizeof(commandLatencyTotal));
+    memset(commandLatencyMax, 0, sizeof(commandLatencyMax));
 }
 
-void BLEManager::handleStatusUpdate(StatusType status, const String& data) {
-    Serial.printf("Received status update: %d, data: %s\n", status, data.c_str());
+void BLEManager::handleStatusUpdate(StatusType status, const char* data) {
+    LOGGER_DEBUG("Received status update: %d, data: %s", status, data);
     // Handle status updates from mobile app if needed
 }
\ No newline at end of file
@@ -1,53 +1,182 @@
 #ifndef BLE_MANAGER_H
 #define BLE_MANAGER_H
 
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
 #include <ArduinoJson.h>
 #include "config.h"
+#include "ble_transport.h"
 #include "protocol.h"
+#include "audio_codec.h"
+#include "frame_protocol.h"
+#include "message_pool.h"
+#include "command_queue.h"
+#include "audio_transfer.h"
+#include "device_state.h"
+#include "ota_updater.h"
 
-class BLEManager : public BLEServerCallbacks, public BLECharacteristicCallbacks {
+// Notification pipeline counters, reset with resetThroughputStats()
+struct BLEThroughputStats {
+    uint32_t bytesSent;
+    uint32_t notifications;
+    uint32_t drops;          // Gave up waiting for controller buffers
+    uint32_t notifyFailures; // Reported by the stack after notify()
+    uint32_t creditWaits;    // Times the sender had to wait for buffers
+    uint32_t elapsedMs;
+    uint32_t bytesPerSecond;
+    uint16_t mtu;
+};
+
+// Receive-to-execute latency of one command type
+struct BLECommandStats {
+    uint32_t count;
+    uint32_t avgLatencyUs;
+    uint32_t maxLatencyUs;
+};
+
+class BLEManager : public BLETransportCallbacks {
 private:
-    BLEServer* server;
-    BLEService* service;
-    BLECharacteristic* audioCharacteristic;
-    BLECharacteristic* commandCharacteristic;
-    BLECharacteristic* statusCharacteristic;
-    BLEAdvertising* advertising;
+    // GATT stack chosen at build time
+    BLETransport* transport;
     
     bool deviceConnected;
-    bool oldDeviceConnected;
-    uint32_t lastHeartbeat;
-    
-    void setupService();
-    void setupCharacteristics();
-    void setupAdvertising();
-    void sendHeartbeat();
-    void handleIncomingMessage(MessageType msgType, const String& payload);
-    void handleCommand(CommandType command, const String& data);
-    void handleStatusUpdate(StatusType status, const String& data);
+    bool linkReported; // Connection state last passed to onLinkChange
+    AudioCodecType audioCodec;
+    
+    // Binary frames are used once the app negotiates them
+    bool binaryFrames;
+    uint16_t txSequence;
+    
+    // Link parameters
+    bool streamingMode;
+    
+    // Streamed audio, retained until acked when the app selects resumable transfers
+    AudioTransfer audioTransfer;
+    bool resumableAudio;
+    bool transferSelected; // The app sent set_transfer on this link
+    uint32_t connectTime;
+    volatile bool audioLinkLost;
+    bool audioLinkLostResumable;
+    uint8_t audioPacket[BLE_MAX_NOTIFY_PAYLOAD];
+    
+    // Firmware update over the OTA characteristic, restarts once verified
+    OtaUpdater ota;
+    uint32_t otaReadyTime;
+    
+    // Device state record, notified on change and at least every
+    // STATE_HEARTBEAT_INTERVAL_MS as the link heartbeat
+    StatusType currentStatus;
+    DeviceStateRecord sentState;
+    bool stateSent;
+    uint32_t lastStateTime;
+    uint16_t stateSequence;
+    
+    // Notification pacing and statistics
+    BLEThroughputStats stats;
+    uint32_t statsStartTime;
+    uint32_t totalDrops;          // Since boot, stats is reset per stream
+    uint32_t totalNotifyFailures;
+    
+    // Preallocated message buffers, nothing on the heap per message
+    MessagePool txPool;
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> rxDocument;
+    
+    // Written by the BLE host task, decoded and dispatched from update()
+    CommandQueue rxQueue;
+    uint32_t rxReceivedUs;
+    uint32_t rxReportedDrops;
+    volatile uint32_t lastReceiveTime; // Any write from the app, OTA packets included
+    uint32_t commandCount[COMMAND_TYPE_COUNT];
+    uint64_t commandLatencyTotal[COMMAND_TYPE_COUNT];
+    uint32_t commandLatencyMax[COMMAND_TYPE_COUNT];
+    
+    bool sendState(bool force);
+    void sendError(ErrorCode error, const char* description = nullptr);
+    bool sendMessage(BLECharacteristicId characteristic, const uint8_t* message, size_t length);
+    void processIncoming();
+    void handleIncomingFrame(const uint8_t* data, size_t length);
+    void handleIncomingJson(const uint8_t* data, size_t length);
+    void recordCommandLatency(CommandType command);
+    void updateConnectionParams(bool streaming);
+    bool waitForNotifyCredit();
+    size_t getMaxNotifyPayload();
+    void handleIncomingMessage(MessageType msgType, JsonDocument& doc);
+    void handleCommand(CommandType command, const char* data);
+    void handleStatusUpdate(StatusType status, const char* data);
+    void handleAudioAck(const char* data);
+    void handleAudioLinkLoss();
+    void sendAudioResume();
+    void handleOtaBegin(const char* data);
+    void pumpOta();
 
 public:
     BLEManager();
     bool begin();
     void update();
     bool isConnected();
-    void startAdvertising();
+    uint32_t getLastReceiveTime(); // millis() of the last write from the app
+    void startAdvertising(uint16_t interval = BLE_ADV_FAST_INTERVAL); // 0.625ms units
     void stopAdvertising();
     void disconnect();
     
     // Data transmission methods
     bool sendAudioData(uint8_t* data, size_t length);
-    bool sendCommand(const String& command);
-    bool sendStatus(const String& status);
     
-    // BLE Callbacks
-    void onConnect(BLEServer* server) override;
-    void onDisconnect(BLEServer* server) override;
-    void onWrite(BLECharacteristic* characteristic) override;
+    // Streamed audio. Appending works with or without a link; pumpAudio()
+    // sends what is due, retransmits first, and update() keeps pumping.
+    void beginAudioTransfer();
+    bool queueAudioData(const uint8_t* data, size_t length);
+    size_t getAudioQueueSpace();
+    void endAudioTransfer();
+    bool pumpAudio();
+    bool isAudioPending();
+    
+    // Firmware update in progress, the link should stay fast and awake
+    bool isOtaActive();
+    bool sendCommand(const char* command, const char* data = nullptr);
+    
+    // Device state record. updateState() only notifies when the record
+    // changed or the heartbeat is due, sendStatus() always does. Both
+    // return true when a record went out.
+    bool updateState(StatusType status);
+    bool sendStatus(StatusType status);
+    
+    // Codec negotiated with the mobile app for this connection
+    AudioCodecType getAudioCodec();
+    bool isUsingBinaryFrames();
+    
+    // Link tuning
+    void setStreamingMode(bool streaming);
+    uint16_t getMTU();
+    const char* getStackName();
+    BLEThroughputStats getThroughputStats();
+    void resetThroughputStats();
+    uint32_t getTxPoolExhausted();
+    uint32_t getTotalDrops();
+    uint32_t getTotalNotifyFailures();
+    
+    // Latest telemetry snapshot, returned when the app reads the characteristic
+    bool setTelemetry(const uint8_t* data, size_t length);
+    
+    // Command dispatch latency, measured from onWrite() to handler return
+    BLECommandStats getCommandStats(CommandType command);
+    uint32_t getDroppedCommands();
+    void printCommandStats();
+    void resetCommandStats();
+    
+    // Transport callbacks, called from the BLE host task
+    void onConnect() override;
+    void onDisconnect() override;
+    void onWrite(const uint8_t* data, size_t length) override;
+    void onOtaWrite(const uint8_t* data, size_t length) override;
+    void onNotifyFailure() override;
+    
+    // Called from the BLE stack task on connection changes and writes
+    void (*onEvent)();
+    
+    // Connection established or lost, called from update() in the main loop
+    void (*onLinkChange)(bool connected);
+    
+    // Commands handled outside the BLE layer, called from update() in the main loop
+    void (*onCommand)(CommandType command, const char* data);
 };
 
 #endif // BLE_MANAGER_H
\ No newline at end of file
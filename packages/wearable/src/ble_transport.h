@@ -0,0 +1,64 @@
+#ifndef BLE_TRANSPORT_H
+#define BLE_TRANSPORT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Characteristics of the BIL service, the same on every stack
+enum BLECharacteristicId {
+    BLE_CHAR_AUDIO,     // Notify, audio chunks
+    BLE_CHAR_COMMAND,   // Notify, events for the app
+    BLE_CHAR_STATUS,    // Write, read and notify, commands from the app, device state back
+    BLE_CHAR_TELEMETRY, // Read, runtime health snapshot polled by the app
+    BLE_CHAR_OTA,       // Write without response, firmware image packets; notify, acks
+    BLE_CHAR_COUNT
+};
+
+// Link events, called from the stack's host task
+class BLETransportCallbacks {
+public:
+    virtual ~BLETransportCallbacks() {}
+    
+    virtual void onConnect() = 0;
+    virtual void onDisconnect() = 0;
+    virtual void onWrite(const uint8_t* data, size_t length) = 0;
+    virtual void onOtaWrite(const uint8_t* data, size_t length) = 0;
+    virtual void onNotifyFailure() = 0;
+};
+
+// GATT service, advertising and link control for one BLE host stack.
+// The stack is chosen at build time, see BLE_STACK_NIMBLE in platformio.ini.
+class BLETransport {
+public:
+    virtual ~BLETransport() {}
+    
+    // Brings up the stack, the service and its characteristics
+    virtual bool begin(const char* deviceName, BLETransportCallbacks* callbacks) = 0;
+    virtual const char* getName() = 0;
+    
+    virtual void startAdvertising() = 0;
+    virtual void stopAdvertising() = 0;
+    virtual void setAdvertisingInterval(uint16_t minInterval, uint16_t maxInterval) = 0; // 0.625ms units, applies from the next start
+    virtual void disconnect() = 0;
+    
+    // Peers bonded with Just Works pairing, keys are kept in NVS by the stack
+    virtual int getBondCount() = 0;
+    
+    // Current link encrypted with a bonded key
+    virtual bool isEncrypted() = 0;
+    
+    // Data path
+    virtual bool notify(BLECharacteristicId characteristic, const uint8_t* data, size_t length) = 0;
+    virtual bool setValue(BLECharacteristicId characteristic, const uint8_t* data, size_t length) = 0; // Served on read
+    virtual bool hasNotifyCredit() = 0; // Controller or host buffers free for another notification
+    virtual uint16_t getMTU() = 0;
+    
+    // Link tuning for the current connection, intervals in 1.25ms units
+    virtual void requestLinkUpgrade() = 0; // Data length extension and 2M PHY where supported
+    virtual void updateConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) = 0;
+};
+
+// Returns the transport compiled into this build, statically allocated
+BLETransport* createBLETransport();
+
+#endif // BLE_TRANSPORT_H
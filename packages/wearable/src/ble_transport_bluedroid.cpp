@@ -0,0 +1,254 @@
+#include "ble_transport_bluedroid.h"
+#include "logger.h"
+
+#ifndef BLE_STACK_NIMBLE
+
+#include <esp_gap_ble_api.h>
+#include <soc/soc_caps.h>
+
+BluedroidTransport::BluedroidTransport() {
+    server = nullptr;
+    service = nullptr;
+    memset(characteristics, 0, sizeof(characteristics));
+    advertising = nullptr;
+    callbacks = nullptr;
+    connected = false;
+    encrypted = false;
+    connId = 0;
+    memset(peerAddress, 0, sizeof(peerAddress));
+}
+
+bool BluedroidTransport::begin(const char* deviceName, BLETransportCallbacks* transportCallbacks) {
+    callbacks = transportCallbacks;
+    
+    // Initialize BLE Device
+    BLEDevice::init(deviceName);
+    
+    // Accept the largest MTU the phone offers during the exchange
+    BLEDevice::setMTU(BLE_PREFERRED_MTU);
+    
+    // Create BLE Server
+    server = BLEDevice::createServer();
+    server->setCallbacks(this);
+    
+    service = server->createService(BLE_SERVICE_UUID);
+    
+    // Audio characteristic for sending voice data
+    createCharacteristic(BLE_CHAR_AUDIO, BLE_AUDIO_CHARACTERISTIC_UUID, BLECharacteristic::PROPERTY_NOTIFY);
+    
+    // Command characteristic for sending commands to mobile app
+    createCharacteristic(BLE_CHAR_COMMAND, BLE_COMMAND_CHARACTERISTIC_UUID, BLECharacteristic::PROPERTY_NOTIFY);
+    
+    // Status characteristic for commands from the mobile app, it notifies
+    // the device state record and errors back
+    createCharacteristic(BLE_CHAR_STATUS, BLE_STATUS_CHARACTERISTIC_UUID,
+                         BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ |
+                         BLECharacteristic::PROPERTY_NOTIFY);
+    
+    // Telemetry characteristic, the app reads the latest snapshot
+    createCharacteristic(BLE_CHAR_TELEMETRY, BLE_TELEMETRY_CHARACTERISTIC_UUID, BLECharacteristic::PROPERTY_READ);
+    
+    // Firmware updates, image packets in and acks out, only over an
+    // encrypted link
+    BLECharacteristic* ota = createCharacteristic(BLE_CHAR_OTA, BLE_OTA_CHARACTERISTIC_UUID,
+                                                  BLECharacteristic::PROPERTY_WRITE_NR | BLECharacteristic::PROPERTY_NOTIFY);
+    ota->setAccessPermissions(ESP_GATT_PERM_WRITE_ENCRYPTED);
+    
+    // Start the service
+    service->start();
+    
+    advertising = BLEDevice::getAdvertising();
+    advertising->addServiceUUID(BLE_SERVICE_UUID);
+    advertising->setScanResponse(true);
+    advertising->setMinPreferred(0x06);
+    advertising->setMinPreferred(0x12);
+    
+    // Bond with Just Works pairing. Keys are stored in NVS, so a returning
+    // phone only re-encrypts and reuses its cached attribute table.
+    BLESecurity* security = new BLESecurity();
+    security->setAuthenticationMode(ESP_LE_AUTH_REQ_SC_BOND);
+    security->setCapability(ESP_IO_CAP_NONE);
+    security->setInitEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+    security->setRespEncryptionKey(ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK);
+    BLEDevice::setSecurityCallbacks(this);
+    
+    LOGGER_INFO("%d bonded device(s)", getBondCount());
+    return true;
+}
+
+BLECharacteristic* BluedroidTransport::createCharacteristic(BLECharacteristicId id, const char* uuid, uint32_t properties) {
+    BLECharacteristic* characteristic = service->createCharacteristic(uuid, properties);
+    
+    // Notifying characteristics need a CCCD for the app to subscribe
+    if (properties & BLECharacteristic::PROPERTY_NOTIFY) {
+        characteristic->addDescriptor(new BLE2902());
+    }
+    characteristic->setCallbacks(this);
+    
+    characteristics[id] = characteristic;
+    return characteristic;
+}
+
+const char* BluedroidTransport::getName() {
+    return "Bluedroid";
+}
+
+void BluedroidTransport::startAdvertising() {
+    advertising->start();
+}
+
+void BluedroidTransport::stopAdvertising() {
+    advertising->stop();
+}
+
+void BluedroidTransport::setAdvertisingInterval(uint16_t minInterval, uint16_t maxInterval) {
+    advertising->setMinInterval(minInterval);
+    advertising->setMaxInterval(maxInterval);
+}
+
+void BluedroidTransport::disconnect() {
+    if (connected) {
+        server->disconnect(server->getConnId());
+    }
+}
+
+bool BluedroidTransport::notify(BLECharacteristicId id, const uint8_t* data, size_t length) {
+    BLECharacteristic* characteristic = characteristics[id];
+    if (!characteristic) {
+        return false;
+    }
+    
+    // setValue() keeps its own copy, the caller's buffer can be reused at once
+    characteristic->setValue((uint8_t*)data, length);
+    characteristic->notify();
+    return true;
+}
+
+bool BluedroidTransport::setValue(BLECharacteristicId id, const uint8_t* data, size_t length) {
+    BLECharacteristic* characteristic = characteristics[id];
+    if (!characteristic) {
+        return false;
+    }
+    
+    characteristic->setValue((uint8_t*)data, length);
+    return true;
+}
+
+bool BluedroidTransport::hasNotifyCredit() {
+    return esp_ble_get_cur_sendable_packets_num(connId) > 0;
+}
+
+int BluedroidTransport::getBondCount() {
+    return esp_ble_get_bond_device_num();
+}
+
+bool BluedroidTransport::isEncrypted() {
+    return connected && encrypted;
+}
+
+uint16_t BluedroidTransport::getMTU() {
+    if (!connected) {
+        return 23;
+    }
+    return server->getPeerMTU(connId);
+}
+
+void BluedroidTransport::requestLinkUpgrade() {
+    // Data length extension lets a full MTU travel in one link layer packet
+    esp_err_t err = esp_ble_gap_set_pkt_data_len(peerAddress, BLE_DATA_LENGTH);
+    if (err != ESP_OK) {
+        LOGGER_ERROR("Data length extension request failed: %d", err);
+    }
+    
+#if SOC_BLE_50_SUPPORTED
+    // 2M PHY doubles the air rate on chips with a BLE 5 controller
+    err = esp_ble_gap_set_preferred_phy(peerAddress, ESP_BLE_GAP_PHY_NO_TX_PREF_MASK | ESP_BLE_GAP_PHY_NO_RX_PREF_MASK,
+                                        ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                        ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+    if (err != ESP_OK) {
+        LOGGER_ERROR("2M PHY request failed: %d", err);
+    }
+#endif
+}
+
+void BluedroidTransport::updateConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) {
+    server->updateConnParams(peerAddress, minInterval, maxInterval, latency, timeout);
+}
+
+void BluedroidTransport::onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) {
+    connId = param->connect.conn_id;
+    memcpy(peerAddress, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+    connected = true;
+    encrypted = false;
+    
+    // Bonded peers re-encrypt with the stored key, new ones pair first
+    esp_ble_set_encryption(peerAddress, ESP_BLE_SEC_ENCRYPT);
+    
+    if (callbacks) {
+        callbacks->onConnect();
+    }
+}
+
+void BluedroidTransport::onDisconnect(BLEServer* server) {
+    connected = false;
+    encrypted = false;
+    
+    if (callbacks) {
+        callbacks->onDisconnect();
+    }
+}
+
+void BluedroidTransport::onWrite(BLECharacteristic* characteristic) {
+    // Value is read in place, the callback copies what it needs
+    if (!callbacks) {
+        return;
+    }
+    if (characteristic == characteristics[BLE_CHAR_OTA]) {
+        callbacks->onOtaWrite(characteristic->getData(), characteristic->getLength());
+    } else {
+        callbacks->onWrite(characteristic->getData(), characteristic->getLength());
+    }
+}
+
+void BluedroidTransport::onStatus(BLECharacteristic* characteristic, Status status, uint32_t code) {
+    switch (status) {
+        case SUCCESS_NOTIFY:
+        case SUCCESS_INDICATE:
+            break;
+        default:
+            if (callbacks) {
+                callbacks->onNotifyFailure();
+            }
+            break;
+    }
+}
+
+uint32_t BluedroidTransport::onPassKeyRequest() {
+    return 0;
+}
+
+void BluedroidTransport::onPassKeyNotify(uint32_t passKey) {
+}
+
+bool BluedroidTransport::onSecurityRequest() {
+    return true;
+}
+
+bool BluedroidTransport::onConfirmPIN(uint32_t pin) {
+    return true;
+}
+
+void BluedroidTransport::onAuthenticationComplete(esp_ble_auth_cmpl_t result) {
+    // Pairing or re-encryption done, either way the key is a bonded one
+    encrypted = result.success && (result.auth_mode & ESP_LE_AUTH_BOND);
+    if (!result.success) {
+        LOGGER_WARN("Link encryption failed: %d", result.fail_reason);
+    }
+}
+
+BLETransport* createBLETransport() {
+    static BluedroidTransport transport;
+    return &transport;
+}
+
+#endif // BLE_STACK_NIMBLE
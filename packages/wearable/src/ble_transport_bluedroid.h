@@ -0,0 +1,67 @@
+#ifndef BLE_TRANSPORT_BLUEDROID_H
+#define BLE_TRANSPORT_BLUEDROID_H
+
+#ifndef BLE_STACK_NIMBLE
+
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLEUtils.h>
+#include <BLE2902.h>
+#include <BLESecurity.h>
+#include "ble_transport.h"
+
+// Bluedroid host through the "ESP32 BLE Arduino" library
+class BluedroidTransport : public BLETransport, public BLEServerCallbacks, public BLECharacteristicCallbacks,
+                           public BLESecurityCallbacks {
+private:
+    BLEServer* server;
+    BLEService* service;
+    BLECharacteristic* characteristics[BLE_CHAR_COUNT];
+    BLEAdvertising* advertising;
+    BLETransportCallbacks* callbacks;
+    
+    bool connected;
+    volatile bool encrypted;
+    uint16_t connId;
+    esp_bd_addr_t peerAddress;
+    
+    BLECharacteristic* createCharacteristic(BLECharacteristicId id, const char* uuid, uint32_t properties);
+
+public:
+    BluedroidTransport();
+    
+    bool begin(const char* deviceName, BLETransportCallbacks* callbacks) override;
+    const char* getName() override;
+    
+    void startAdvertising() override;
+    void stopAdvertising() override;
+    void setAdvertisingInterval(uint16_t minInterval, uint16_t maxInterval) override;
+    void disconnect() override;
+    int getBondCount() override;
+    bool isEncrypted() override;
+    
+    bool notify(BLECharacteristicId characteristic, const uint8_t* data, size_t length) override;
+    bool setValue(BLECharacteristicId characteristic, const uint8_t* data, size_t length) override;
+    bool hasNotifyCredit() override;
+    uint16_t getMTU() override;
+    
+    void requestLinkUpgrade() override;
+    void updateConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) override;
+    
+    // Bluedroid callbacks
+    void onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) override;
+    void onDisconnect(BLEServer* server) override;
+    void onWrite(BLECharacteristic* characteristic) override;
+    void onStatus(BLECharacteristic* characteristic, Status status, uint32_t code) override;
+    
+    // Just Works, there is nothing to display or confirm
+    uint32_t onPassKeyRequest() override;
+    void onPassKeyNotify(uint32_t passKey) override;
+    bool onSecurityRequest() override;
+    bool onConfirmPIN(uint32_t pin) override;
+    void onAuthenticationComplete(esp_ble_auth_cmpl_t result) override;
+};
+
+#endif // BLE_STACK_NIMBLE
+
+#endif // BLE_TRANSPORT_BLUEDROID_H
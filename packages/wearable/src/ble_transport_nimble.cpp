@@ -0,0 +1,227 @@
+#include "ble_transport_nimble.h"
+#include "logger.h"
+
+#ifdef BLE_STACK_NIMBLE
+
+#include <soc/soc_caps.h>
+
+#if defined(CONFIG_NIMBLE_CPP_IDF)
+#include "os/os_mbuf.h"
+#else
+#include "nimble/porting/nimble/include/os/os_mbuf.h"
+#endif
+
+NimBLETransport::NimBLETransport() {
+    server = nullptr;
+    service = nullptr;
+    memset(characteristics, 0, sizeof(characteristics));
+    advertising = nullptr;
+    callbacks = nullptr;
+    connected = false;
+    encrypted = false;
+    connHandle = 0;
+}
+
+bool NimBLETransport::begin(const char* deviceName, BLETransportCallbacks* transportCallbacks) {
+    callbacks = transportCallbacks;
+    
+    NimBLEDevice::init(deviceName);
+    
+    // Accept the largest MTU the phone offers during the exchange
+    NimBLEDevice::setMTU(BLE_PREFERRED_MTU);
+    
+    server = NimBLEDevice::createServer();
+    server->setCallbacks(this);
+    
+    // ConnectionManager restarts advertising with its own interval
+    server->advertiseOnDisconnect(false);
+    
+    service = server->createService(BLE_SERVICE_UUID);
+    
+    // NimBLE adds the CCCD to notifying characteristics on its own
+    createCharacteristic(BLE_CHAR_AUDIO, BLE_AUDIO_CHARACTERISTIC_UUID, NIMBLE_PROPERTY::NOTIFY);
+    createCharacteristic(BLE_CHAR_COMMAND, BLE_COMMAND_CHARACTERISTIC_UUID, NIMBLE_PROPERTY::NOTIFY);
+    
+    // Commands from the app, the device state record and errors back
+    createCharacteristic(BLE_CHAR_STATUS, BLE_STATUS_CHARACTERISTIC_UUID,
+                         NIMBLE_PROPERTY::WRITE | NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+    
+    createCharacteristic(BLE_CHAR_TELEMETRY, BLE_TELEMETRY_CHARACTERISTIC_UUID, NIMBLE_PROPERTY::READ);
+    
+    // Firmware updates, image packets in and acks out, only over an
+    // encrypted link
+    createCharacteristic(BLE_CHAR_OTA, BLE_OTA_CHARACTERISTIC_UUID,
+                         NIMBLE_PROPERTY::WRITE_NR | NIMBLE_PROPERTY::WRITE_ENC | NIMBLE_PROPERTY::NOTIFY);
+    
+    service->start();
+    
+    advertising = NimBLEDevice::getAdvertising();
+    advertising->addServiceUUID(BLE_SERVICE_UUID);
+    advertising->setScanResponse(true);
+    advertising->setMinPreferred(0x06);
+    advertising->setMaxPreferred(0x12);
+    
+    // Bond with Just Works pairing. Keys are stored in NVS, so a returning
+    // phone only re-encrypts and reuses its cached attribute table.
+    NimBLEDevice::setSecurityAuth(true, false, true);
+    NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT);
+    NimBLEDevice::setSecurityInitKey(BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID);
+    NimBLEDevice::setSecurityRespKey(BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID);
+    
+    LOGGER_INFO("%d bonded device(s)", getBondCount());
+    return true;
+}
+
+NimBLECharacteristic* NimBLETransport::createCharacteristic(BLECharacteristicId id, const char* uuid, uint32_t properties) {
+    NimBLECharacteristic* characteristic = service->createCharacteristic(uuid, properties);
+    characteristic->setCallbacks(this);
+    
+    characteristics[id] = characteristic;
+    return characteristic;
+}
+
+const char* NimBLETransport::getName() {
+    return "NimBLE";
+}
+
+void NimBLETransport::startAdvertising() {
+    advertising->start();
+}
+
+void NimBLETransport::stopAdvertising() {
+    advertising->stop();
+}
+
+void NimBLETransport::setAdvertisingInterval(uint16_t minInterval, uint16_t maxInterval) {
+    advertising->setMinInterval(minInterval);
+    advertising->setMaxInterval(maxInterval);
+}
+
+void NimBLETransport::disconnect() {
+    if (connected) {
+        server->disconnect(connHandle);
+    }
+}
+
+bool NimBLETransport::notify(BLECharacteristicId id, const uint8_t* data, size_t length) {
+    NimBLECharacteristic* characteristic = characteristics[id];
+    if (!characteristic) {
+        return false;
+    }
+    
+    // Sent straight from the caller's buffer, the attribute value is not updated
+    characteristic->notify(data, length);
+    return true;
+}
+
+bool NimBLETransport::setValue(BLECharacteristicId id, const uint8_t* data, size_t length) {
+    NimBLECharacteristic* characteristic = characteristics[id];
+    if (!characteristic) {
+        return false;
+    }
+    
+    // Copied into the attribute, reads are answered by the host task
+    characteristic->setValue(data, length);
+    return true;
+}
+
+bool NimBLETransport::hasNotifyCredit() {
+    // Notifications are queued in host mbufs, keep a few back for the stack
+    return os_msys_num_free() >= BLE_NIMBLE_MIN_FREE_MBUFS;
+}
+
+int NimBLETransport::getBondCount() {
+    return NimBLEDevice::getNumBonds();
+}
+
+bool NimBLETransport::isEncrypted() {
+    return connected && encrypted;
+}
+
+uint16_t NimBLETransport::getMTU() {
+    if (!connected) {
+        return 23;
+    }
+    return server->getPeerMTU(connHandle);
+}
+
+void NimBLETransport::requestLinkUpgrade() {
+    // Data length extension lets a full MTU travel in one link layer packet
+    server->setDataLen(connHandle, BLE_DATA_LENGTH);
+    
+#if SOC_BLE_50_SUPPORTED
+    // 2M PHY doubles the air rate on chips with a BLE 5 controller
+    int rc = ble_gap_set_prefered_le_phy(connHandle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK,
+                                         BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) {
+        LOGGER_ERROR("2M PHY request failed: %d", rc);
+    }
+#endif
+}
+
+void NimBLETransport::updateConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) {
+    server->updateConnParams(connHandle, minInterval, maxInterval, latency, timeout);
+}
+
+void NimBLETransport::onConnect(NimBLEServer* server, ble_gap_conn_desc* desc) {
+    connHandle = desc->conn_handle;
+    connected = true;
+    encrypted = false;
+    
+    // Bonded peers re-encrypt with the stored key, new ones pair first
+    NimBLEDevice::startSecurity(connHandle);
+    
+    if (callbacks) {
+        callbacks->onConnect();
+    }
+}
+
+void NimBLETransport::onDisconnect(NimBLEServer* server, ble_gap_conn_desc* desc) {
+    connected = false;
+    encrypted = false;
+    
+    if (callbacks) {
+        callbacks->onDisconnect();
+    }
+}
+
+void NimBLETransport::onAuthenticationComplete(ble_gap_conn_desc* desc) {
+    // Pairing or re-encryption done
+    encrypted = desc->sec_state.encrypted && desc->sec_state.bonded;
+    if (!desc->sec_state.encrypted) {
+        LOGGER_WARN("Link encryption failed");
+    }
+}
+
+void NimBLETransport::onWrite(NimBLECharacteristic* characteristic) {
+    NimBLEAttValue value = characteristic->getValue();
+    
+    if (!callbacks) {
+        return;
+    }
+    if (characteristic == characteristics[BLE_CHAR_OTA]) {
+        callbacks->onOtaWrite(value.data(), value.length());
+    } else {
+        callbacks->onWrite(value.data(), value.length());
+    }
+}
+
+void NimBLETransport::onStatus(NimBLECharacteristic* characteristic, Status status, int code) {
+    switch (status) {
+        case SUCCESS_NOTIFY:
+        case SUCCESS_INDICATE:
+            break;
+        default:
+            if (callbacks) {
+                callbacks->onNotifyFailure();
+            }
+            break;
+    }
+}
+
+BLETransport* createBLETransport() {
+    static NimBLETransport transport;
+    return &transport;
+}
+
+#endif // BLE_STACK_NIMBLE
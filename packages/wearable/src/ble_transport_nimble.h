@@ -0,0 +1,55 @@
+#ifndef BLE_TRANSPORT_NIMBLE_H
+#define BLE_TRANSPORT_NIMBLE_H
+
+#ifdef BLE_STACK_NIMBLE
+
+#include <NimBLEDevice.h>
+#include "ble_transport.h"
+
+// Apache NimBLE host through the NimBLE-Arduino library
+class NimBLETransport : public BLETransport, public NimBLEServerCallbacks, public NimBLECharacteristicCallbacks {
+private:
+    NimBLEServer* server;
+    NimBLEService* service;
+    NimBLECharacteristic* characteristics[BLE_CHAR_COUNT];
+    NimBLEAdvertising* advertising;
+    BLETransportCallbacks* callbacks;
+    
+    bool connected;
+    volatile bool encrypted;
+    uint16_t connHandle;
+    
+    NimBLECharacteristic* createCharacteristic(BLECharacteristicId id, const char* uuid, uint32_t properties);
+
+public:
+    NimBLETransport();
+    
+    bool begin(const char* deviceName, BLETransportCallbacks* callbacks) override;
+    const char* getName() override;
+    
+    void startAdvertising() override;
+    void stopAdvertising() override;
+    void setAdvertisingInterval(uint16_t minInterval, uint16_t maxInterval) override;
+    void disconnect() override;
+    int getBondCount() override;
+    bool isEncrypted() override;
+    
+    bool notify(BLECharacteristicId characteristic, const uint8_t* data, size_t length) override;
+    bool setValue(BLECharacteristicId characteristic, const uint8_t* data, size_t length) override;
+    bool hasNotifyCredit() override;
+    uint16_t getMTU() override;
+    
+    void requestLinkUpgrade() override;
+    void updateConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) override;
+    
+    // NimBLE callbacks
+    void onConnect(NimBLEServer* server, ble_gap_conn_desc* desc) override;
+    void onDisconnect(NimBLEServer* server, ble_gap_conn_desc* desc) override;
+    void onAuthenticationComplete(ble_gap_conn_desc* desc) override;
+    void onWrite(NimBLECharacteristic* characteristic) override;
+    void onStatus(NimBLECharacteristic* characteristic, Status status, int code) override;
+};
+
+#endif // BLE_STACK_NIMBLE
+
+#endif // BLE_TRANSPORT_NIMBLE_H
@@ -0,0 +1,58 @@
+#include "boot_timeline.h"
+#include "logger.h"
+#include <esp_timer.h>
+
+volatile uint32_t BootTimeline::phaseMs[BOOT_PHASE_COUNT] = {};
+volatile bool BootTimeline::phaseOk[BOOT_PHASE_COUNT] = {};
+volatile bool BootTimeline::reached[BOOT_PHASE_COUNT] = {};
+
+static const char* const phaseNames[BOOT_PHASE_COUNT] = {
+    "setup",
+    "ble",
+    "advertising",
+    "haptic",
+    "gesture",
+    "voice",
+    "ready",
+    "connected"
+};
+
+void BootTimeline::mark(BootPhase phase, bool ok) {
+    if (phase >= BOOT_PHASE_COUNT || reached[phase]) {
+        return;
+    }
+    
+    // Published last, whoever sees reached also sees the time and result
+    phaseMs[phase] = (uint32_t)(esp_timer_get_time() / 1000);
+    phaseOk[phase] = ok;
+    reached[phase] = true;
+}
+
+bool BootTimeline::isReached(BootPhase phase) {
+    return phase < BOOT_PHASE_COUNT && reached[phase];
+}
+
+bool BootTimeline::isOk(BootPhase phase) {
+    return isReached(phase) && phaseOk[phase];
+}
+
+uint32_t BootTimeline::getMs(BootPhase phase) {
+    return isReached(phase) ? phaseMs[phase] : 0;
+}
+
+const char* BootTimeline::getPhaseName(BootPhase phase) {
+    return phase < BOOT_PHASE_COUNT ? phaseNames[phase] : "unknown";
+}
+
+void BootTimeline::print() {
+    LOGGER_INFO("Boot timeline (ms after startup):");
+    
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        BootPhase phase = (BootPhase)i;
+        if (!isReached(phase)) {
+            LOGGER_INFO("  %-12s -", getPhaseName(phase));
+            continue;
+        }
+        LOGGER_INFO("  %-12s %5u%s", getPhaseName(phase), getMs(phase), isOk(phase) ? "" : " failed");
+    }
+}
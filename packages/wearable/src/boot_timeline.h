@@ -0,0 +1,41 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Milestones of one boot. Components come up on their own tasks, so the
+// order between them varies from boot to boot.
+enum BootPhase {
+    BOOT_PHASE_SETUP,       // setup() entered
+    BOOT_PHASE_BLE,         // Stack and GATT service up
+    BOOT_PHASE_ADVERTISING, // First advertisement started
+    BOOT_PHASE_HAPTIC,
+    BOOT_PHASE_GESTURE,
+    BOOT_PHASE_VOICE,
+    BOOT_PHASE_READY,       // Every component has reported
+    BOOT_PHASE_CONNECTED,   // First connection
+    BOOT_PHASE_COUNT
+};
+
+// Time of each phase in ms on the esp_timer clock, which starts during
+// startup right after the second stage bootloader (about 30ms after reset
+// on a default build). Safe to mark from any task; the first mark of a
+// phase wins.
+class BootTimeline {
+private:
+    static volatile uint32_t phaseMs[BOOT_PHASE_COUNT];
+    static volatile bool phaseOk[BOOT_PHASE_COUNT];
+    static volatile bool reached[BOOT_PHASE_COUNT];
+
+public:
+    // ok false records a component that failed to start
+    static void mark(BootPhase phase, bool ok = true);
+    static bool isReached(BootPhase phase);
+    static bool isOk(BootPhase phase);
+    static uint32_t getMs(BootPhase phase); // 0 until reached
+    static const char* getPhaseName(BootPhase phase);
+    static void print();
+};
+
+#endif // BOOT_TIMELINE_H
@@ -0,0 +1,61 @@
+#include "command_queue.h"
+
+#if (COMMAND_QUEUE_SIZE & (COMMAND_QUEUE_SIZE - 1)) != 0
+#error "COMMAND_QUEUE_SIZE must be a power of two"
+#endif
+
+CommandQueue::CommandQueue() {
+    head.store(0);
+    tail.store(0);
+    dropped.store(0);
+}
+
+bool CommandQueue::push(const uint8_t* data, size_t length) {
+    uint32_t currentHead = head.load(std::memory_order_relaxed);
+    uint32_t currentTail = tail.load(std::memory_order_acquire);
+    
+    if (length == 0 || length > BLE_RX_BUFFER_SIZE || currentHead - currentTail >= COMMAND_QUEUE_SIZE) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    QueuedCommand& slot = slots[currentHead & (COMMAND_QUEUE_SIZE - 1)];
+    memcpy(slot.data, data, length);
+    slot.length = length;
+    slot.receivedUs = micros();
+    
+    // Publish the slot only after it has been filled
+    head.store(currentHead + 1, std::memory_order_release);
+    return true;
+}
+
+QueuedCommand* CommandQueue::peek() {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    
+    if (head.load(std::memory_order_acquire) == currentTail) {
+        return nullptr;
+    }
+    
+    return &slots[currentTail & (COMMAND_QUEUE_SIZE - 1)];
+}
+
+void CommandQueue::pop() {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    
+    if (head.load(std::memory_order_acquire) != currentTail) {
+        tail.store(currentTail + 1, std::memory_order_release);
+    }
+}
+
+void CommandQueue::clear() {
+    // Consumer side only, drops everything published so far
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+size_t CommandQueue::available() {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+uint32_t CommandQueue::getDropped() {
+    return dropped.load(std::memory_order_relaxed);
+}
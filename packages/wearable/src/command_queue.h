@@ -0,0 +1,42 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+// One raw message written by the app, copied as received
+struct QueuedCommand {
+    uint8_t data[BLE_RX_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t receivedUs;
+};
+
+// Single-producer/single-consumer lock-free queue of raw incoming messages.
+// push() is called from the BLE host task and pop() from the main loop.
+class CommandQueue {
+private:
+    QueuedCommand slots[COMMAND_QUEUE_SIZE];
+    
+    // Free-running positions, wrapped with COMMAND_QUEUE_SIZE - 1 on access
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> dropped;
+
+public:
+    CommandQueue();
+    
+    // Producer side, returns false if the queue is full or the message too long
+    bool push(const uint8_t* data, size_t length);
+    
+    // Consumer side
+    QueuedCommand* peek();
+    void pop();
+    void clear();
+    
+    // Status
+    size_t available();
+    uint32_t getDropped();
+};
+
+#endif // COMMAND_QUEUE_H
@@ -10,24 +10,122 @@
 #define LED_PIN 2
 #define BUTTON_PIN 0
 #define MIC_PIN 34
-#define HAPTIC_SDA_PIN 21
-#define HAPTIC_SCL_PIN 22
-#define ACCEL_SDA_PIN 21
-#define ACCEL_SCL_PIN 22
+#define I2C_SDA_PIN 21 // Shared by the DRV2605 and the LIS3DH
+#define I2C_SCL_PIN 22
+
+// I2C Bus Configuration
+#define I2C_BUS_FREQUENCY 400000 // Fast mode, both devices support it
+#define I2C_BUS_QUEUE_SIZE 8
+#define I2C_BUS_MAX_WRITE 16 // Register address plus data of one queued write
+#ifndef I2C_BUS_TASK
+#define I2C_BUS_TASK 1 // 0 runs transactions inline, used by the host build
+#endif
+#define I2C_BUS_TASK_CORE 1
+#define I2C_BUS_TASK_PRIORITY 4 // Above the loop task, below audio capture
+#define I2C_BUS_TASK_STACK_SIZE 3072
 
 // BLE Configuration
 #define BLE_SERVICE_UUID "12345678-1234-1234-1234-123456789abc"
 #define BLE_AUDIO_CHARACTERISTIC_UUID "12345678-1234-1234-1234-123456789abd"
 #define BLE_COMMAND_CHARACTERISTIC_UUID "12345678-1234-1234-1234-123456789abe"
 #define BLE_STATUS_CHARACTERISTIC_UUID "12345678-1234-1234-1234-123456789abf"
+#define BLE_TELEMETRY_CHARACTERISTIC_UUID "12345678-1234-1234-1234-123456789ac0"
+#define BLE_OTA_CHARACTERISTIC_UUID "12345678-1234-1234-1234-123456789ac1"
+#define BLE_TX_BUFFER_SIZE 256 // Largest JSON message or binary frame sent
+#define BLE_TX_POOL_BUFFERS 4
+#define BLE_RX_BUFFER_SIZE 256 // Largest message accepted from the app
+#define COMMAND_QUEUE_SIZE 8 // Incoming messages waiting for the main loop, power of two
+#define PROTOCOL_JSON_DOC_SIZE 384 // ArduinoJson pool, kept on the stack
+#define PROTOCOL_MESSAGE_ID_SIZE 24
+#define PROTOCOL_DATA_SIZE 128 // Command and status data strings, an audio_ack with a few ranges
+
+// BLE Link Configuration
+#define BLE_PREFERRED_MTU 517
+#define BLE_MAX_NOTIFY_PAYLOAD 512
+#define BLE_DATA_LENGTH 251 // LE data length extension, octets
+#define BLE_NOTIFY_TIMEOUT_MS 100 // Max wait for a free controller buffer
+#define BLE_STREAM_CONN_INTERVAL_MIN 6 // 7.5ms, units of 1.25ms
+#define BLE_STREAM_CONN_INTERVAL_MAX 12 // 15ms
+#define BLE_IDLE_CONN_INTERVAL_MIN 80 // 100ms
+#define BLE_IDLE_CONN_INTERVAL_MAX 160 // 200ms
+#define BLE_IDLE_SLAVE_LATENCY 4
+#define BLE_SUPERVISION_TIMEOUT 600 // 6s, units of 10ms
+#define BLE_ADV_FAST_INTERVAL 32 // 20ms, units of 0.625ms, while the phone is expected back
+#define BLE_ADV_SLOW_INTERVAL 2056 // 1285ms, still found by background scans on iOS
+#define BLE_NIMBLE_MIN_FREE_MBUFS 4 // NimBLE only, host buffers left free when pacing notifications
+#define STATE_HEARTBEAT_INTERVAL_MS 30000 // State record resent unchanged, well inside the app's heartbeat timeout
+#define STATE_HEAP_CHANGE_BYTES 4096 // Heap drift that counts as a state change
 
 // Voice Detection Configuration
 #define WAKE_WORD "Hey BIL"
-#define VOICE_THRESHOLD 1000
+#define VOICE_THRESHOLD 100 // Mean frame power, Q15 (32768 = full scale), about -25dBFS RMS
 #define RECORDING_DURATION_MS 5000
 #define SAMPLE_RATE 16000
 #define SAMPLE_BUFFER_SIZE 512
 
+// Wake Word Engine Configuration
+#define KWS_FRAME_MS 32 // Analysis window, must give a power of two FFT
+#define KWS_STRIDE_MS 16
+#define KWS_MIN_FREQ 20
+#define KWS_MAX_FREQ 4000
+#define KWS_DEFAULT_THRESHOLD 0.85f // Detection confidence, 0..1
+#define KWS_SENSITIVITY_RANGE 0.3f // Threshold change across set_sensitivity 0..1
+#define KWS_MIN_THRESHOLD 0.5f
+#define KWS_MAX_THRESHOLD 0.99f
+#define KWS_SMOOTHING_FRAMES 3
+#define KWS_REFRACTORY_MS 1500
+#define KWS_INFERENCE_BUDGET_US 2000 // Per frame, overruns are counted
+#define RECORDING_BUFFER_SAMPLES ((SAMPLE_RATE / 1000) * RECORDING_DURATION_MS)
+#define AUDIO_PREROLL_MS 500 // Audio kept from before startRecording(), 300-1000ms
+#define AUDIO_PREROLL_MAX_MS 1000
+#define AUDIO_PREROLL_MAX_SAMPLES ((SAMPLE_RATE / 1000) * AUDIO_PREROLL_MAX_MS)
+#define AUDIO_STREAMING_ENABLED true
+#define AUDIO_STREAM_CHUNK_SAMPLES 256 // 512 bytes per BLE chunk
+#define AUDIO_RETENTION_PSRAM_BYTES 262144 // Power of two, a whole PCM recording
+#define AUDIO_RETENTION_INTERNAL_BYTES 16384 // Power of two, without PSRAM
+#define AUDIO_TRANSFER_MAX_RANGES 8 // Selective ack blocks and queued holes
+#define AUDIO_TRANSFER_PUMP_BYTES 8192 // Sent per pass, the rest follows on the next
+#define AUDIO_TRANSFER_PUMP_INTERVAL_MS 10 // BLE task period while retained audio is unsent
+#define AUDIO_TRANSFER_SELECT_WAIT_MS 2000 // A new link sends no audio before set_transfer, then plain
+#define AUDIO_TRANSFER_RESEND_MS 500 // A hole still reported this long after its resend is asked for again
+
+// Audio Capture Task Configuration
+#define AUDIO_TASK_CORE 0
+#define AUDIO_TASK_PRIORITY 5
+#define AUDIO_TASK_STACK_SIZE 4096
+#define AUDIO_CAPTURE_FRAME_SAMPLES 256 // Read per wakeup in the low latency profile, 16ms
+#define AUDIO_RING_BUFFER_SAMPLES 8192 // Power of two, 512ms at 16kHz
+#define AUDIO_I2S_EVENT_QUEUE_SIZE 8 // Driver events, drained by the capture task
+#define AUDIO_DMA_BUFFER_COUNT 8
+#define AUDIO_DMA_BUFFER_FRAMES 256 // Fixed while the driver is installed, 16ms at 16kHz
+
+// Audio Capture Profiles
+#define AUDIO_DEFAULT_PROFILE AUDIO_PROFILE_AUTO
+#define AUDIO_LOW_POWER_SAMPLE_RATE 8000 // Must divide SAMPLE_RATE
+#define AUDIO_LOW_POWER_FRAME_SAMPLES 1024 // Read per wakeup, 128ms at 8kHz
+
+// Microphone, the built-in ADC on MIC_PIN or an I2S MEMS part (INMP441, ICS-43434)
+#ifndef AUDIO_MIC_I2S
+#define AUDIO_MIC_I2S 0
+#endif
+#define AUDIO_I2S_BCK_PIN 26
+#define AUDIO_I2S_WS_PIN 25
+#define AUDIO_I2S_DATA_PIN 33
+
+// Audio Front-end Configuration
+#define AUDIO_FRONTEND_MAX_SAMPLES 128 // Block size drained from the capture ring
+#if AUDIO_MIC_I2S
+#define AUDIO_FRONTEND_GAIN_SHIFT 0 // MEMS samples are already cut to 16 bit by the capture task
+#else
+#define AUDIO_FRONTEND_GAIN_SHIFT 4 // 12 bit built-in ADC to 16 bit PCM
+#endif
+
+// Audio Codec Configuration
+#define AUDIO_DEFAULT_CODEC AUDIO_CODEC_ADPCM
+#define OPUS_FRAME_SAMPLES 320 // 20ms at 16kHz
+#define OPUS_BITRATE 16000
+#define OPUS_COMPLEXITY 3
+
 // Haptic Feedback Configuration
 #define HAPTIC_I2C_ADDRESS 0x5A
 #define HAPTIC_STARTUP_EFFECT 1
@@ -36,19 +134,105 @@
 #define HAPTIC_CLICK_EFFECT 14
 #define HAPTIC_DOUBLE_CLICK_EFFECT 15
 #define HAPTIC_LONG_PRESS_EFFECT 47
+#define HAPTIC_QUEUE_SIZE 4
+#define HAPTIC_UPDATE_INTERVAL_MS 20 // Sequencer polling while a pattern is active
+#define HAPTIC_STALE_MS 300 // Low priority feedback older than this is dropped
 
 // Gesture Detection Configuration
 #define GESTURE_THRESHOLD 2.0
 #define GESTURE_TIMEOUT_MS 1000
+#define GESTURE_MIN_CONFIDENCE 60 // Percent, weaker model outputs are dropped
+#define GESTURE_CALIBRATION_SAMPLES 100 // 1s at the default ODR
+#define GESTURE_CALIBRATION_MAX_OFFSET 0.2f // g per axis, more means the device was not lying flat
 #define ACCEL_I2C_ADDRESS 0x19
+#define ACCEL_INT1_PIN 27 // LIS3DH INT1, -1 to poll the FIFO instead
+#define ACCEL_ODR_HZ 100
+#define ACCEL_FIFO_WATERMARK 8 // Samples per burst, 1-31
+#define ACCEL_HARDWARE_TAP_ENABLED true // Use the LIS3DH click engine for taps
+#define ACCEL_CLICK_THRESHOLD 40 // 16mg per LSB at +/-2g
+#define ACCEL_CLICK_TIME_LIMIT 10 // 1/ODR units
+#define ACCEL_CLICK_TIME_LATENCY 20
+#define ACCEL_CLICK_TIME_WINDOW 30
+#define ACCEL_WAKE_THRESHOLD 8 // Wake-on-motion, 16mg per LSB at +/-2g
+#define ACCEL_WAKE_DURATION 1 // 1/ODR units at the 10Hz wake rate
+
+// Scheduler Configuration
+#define SCHEDULER_MAX_TASKS 16
+#define SCHEDULER_MAX_SLEEP_MS 1000
+#define SCHEDULER_STATS_INTERVAL_MS 60000 // 0 disables the periodic report
+#define BUTTON_TICK_INTERVAL_MS 10 // Only while a press is being decoded
+#define VOICE_POLL_INTERVAL_MS 100 // Fallback, capture frames wake the voice task
+#define GESTURE_POLL_INTERVAL_MS ((ACCEL_INT1_PIN >= 0) ? 500 : (ACCEL_FIFO_WATERMARK * 1000 / ACCEL_ODR_HZ))
+#define CONNECTION_UPDATE_INTERVAL_MS 100
+#define BLE_UPDATE_INTERVAL_MS 100
+#define STATE_CHECK_INTERVAL_MS 1000 // Compares, only notifies on change or at the heartbeat deadline
+#define TELEMETRY_UPDATE_INTERVAL_MS 5000 // Refresh of the snapshot the app reads
+
+// Boot Configuration
+#define BOOT_TASK_STACK_SIZE 4096
+#define BOOT_TASK_PRIORITY 1 // Same as the loop task
+#define BOOT_TASK_CORE 0 // Sensors start here while the loop task brings up BLE on core 1
+#define BOOT_ADVERTISE_TARGET_MS 1000 // Time to first advertisement, logged when missed
 
 // Power Management
-#define SLEEP_TIMEOUT_MS 300000  // 5 minutes
+#define SLEEP_TIMEOUT_MS 300000  // 5 minutes, then deep sleep
+#define POWER_IDLE_TIMEOUT_MS 10000 // Then frequency scaling and light sleep
+#define POWER_UPDATE_INTERVAL_MS 1000
+#define POWER_MAX_CPU_FREQ_MHZ 240
+#define POWER_MIN_CPU_FREQ_MHZ 80
+#define POWER_LIGHT_SLEEP_ENABLED true // Needs CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#define POWER_DEEP_SLEEP_WHEN_CONNECTED false
 #define LOW_BATTERY_THRESHOLD 3.3
 #define BATTERY_PIN 35
+#define BATTERY_SAMPLE_INTERVAL_MS 10000
+#define BATTERY_AVERAGE_SAMPLES 8 // Moving average window
+#define BATTERY_OVERSAMPLE 16 // ADC reads per sample
+#define BATTERY_DIVIDER_RATIO 2.0 // Battery to ADC pin divider
+#define BATTERY_HYSTERESIS_MV 100 // Low battery clears above threshold + this
+
+// OTA Update Configuration
+#define OTA_WINDOW_BYTES 16384 // Power of two, sent by the app ahead of the last ack
+#define OTA_ACK_INTERVAL_BYTES 4096 // Flashed bytes between acks, a quarter of the window
+#define OTA_ACK_REPEAT_MS 250 // Ack resent while receiving, a lost one cannot stall the transfer
+#define OTA_WRITE_BLOCK_BYTES 4096 // Handed to esp_ota_write() at once, one flash sector
+#define OTA_TASK_CORE 1
+#define OTA_TASK_PRIORITY 3 // Below the I2C bus task, flash erases block for tens of ms
+#define OTA_TASK_STACK_SIZE 4096
+#define OTA_REBOOT_DELAY_MS 1000 // After the final ack, so it reaches the app
+#define OTA_TRIAL_TIMEOUT_MS 300000 // A new image the app never connects to is rolled back
+
+// Persistent Settings
+#define SETTINGS_NAMESPACE "bil" // NVS namespace, 15 characters at most
+#define SETTINGS_KEY "settings"
 
 // Debug Configuration
-#define DEBUG_ENABLED true
+#ifndef DEBUG_ENABLED
+#define DEBUG_ENABLED 1 // 0 in release builds, see env:esp32dev-release
+#endif
 #define SERIAL_BAUD_RATE 115200
 
+// Logging, messages below LOGGER_LEVEL are compiled out with their arguments
+#define LOGGER_LEVEL_NONE 0
+#define LOGGER_LEVEL_ERROR 1
+#define LOGGER_LEVEL_WARN 2
+#define LOGGER_LEVEL_INFO 3
+#define LOGGER_LEVEL_DEBUG 4 // Every message sent and received, gestures, state changes
+#ifndef LOGGER_LEVEL
+#define LOGGER_LEVEL (DEBUG_ENABLED ? LOGGER_LEVEL_DEBUG : LOGGER_LEVEL_WARN)
+#endif
+#ifndef LOGGER_DEFERRED
+#define LOGGER_DEFERRED 1 // 0 prints in the caller, e.g. host builds
+#endif
+#define LOGGER_RING_SLOTS 32 // Power of two; lines logged while it is full are dropped
+#define LOGGER_LINE_SIZE 160 // Longer lines are truncated
+#define LOGGER_TASK_CORE 0
+#define LOGGER_TASK_PRIORITY 1 // With the loop task, below everything that logs in a hurry
+#define LOGGER_TASK_STACK_SIZE 3072
+
+// Benchmarks (test firmware "bench" command)
+#define BENCHMARK_ITERATIONS 1000
+#define BENCHMARK_I2C_ITERATIONS 200
+#define BENCHMARK_CONNECT_TIMEOUT_MS 30000 // Wait for the app before the throughput run
+#define BENCHMARK_THROUGHPUT_MS 5000
+
 #endif // CONFIG_H
\ No newline at end of file
@@ -1,4 +1,14 @@
 #include "connection_manager.h"
+#include "logger.h"
+
+// Advertising interval per reconnection attempt, 0.625ms units. 20ms for the
+// first 30 seconds after a link loss, then Apple's recommended steps down to
+// BLE_ADV_SLOW_INTERVAL, which stays on once the attempts run out.
+static const uint16_t advertisingIntervals[] = {
+    BLE_ADV_FAST_INTERVAL, BLE_ADV_FAST_INTERVAL, BLE_ADV_FAST_INTERVAL,
+    244, 338, 510, 668, 874, 1216, 1636, BLE_ADV_SLOW_INTERVAL
+};
+#define ADVERTISING_INTERVAL_STEPS (sizeof(advertisingIntervals) / sizeof(advertisingIntervals[0]))
 
 ConnectionManager::ConnectionManager() {
     currentState = CONN_DISCONNECTED;
@@ -11,12 +21,21 @@ ConnectionManager::ConnectionManager() {
     heartbeatTimeout = 60000; // 60 seconds
     reconnectAttempts = 0;
     maxReconnectAttempts = 10;
+    linkLost = false;
+    linkLostTime = 0;
+    disconnectCount = 0;
+    reconnectCount = 0;
+    lastReconnectMs = 0;
+    maxReconnectMs = 0;
+    totalReconnectMs = 0;
     
     // Initialize callbacks to null
     onConnected = nullptr;
     onDisconnected = nullptr;
     onReconnecting = nullptr;
     onConnectionFailed = nullptr;
+    onStartAdvertising = nullptr;
+    onStopAdvertising = nullptr;
 }
 
 void ConnectionManager::begin() {
@@ -24,7 +43,7 @@ void ConnectionManager::begin() {
     reconnectAttempts = 0;
     resetReconnectInterval();
     
-    Serial.println("Connection Manager initialized");
+    LOGGER_INFO("Connection Manager initialized");
 }
 
 void ConnectionManager::update() {
@@ -38,9 +57,9 @@ void ConnectionManager::update() {
             break;
             
         case CONN_ADVERTISING:
-            // Check for advertising timeout
+            // Advertising keeps running, the next attempt only slows it down
             if (currentTime - lastConnectionAttempt > connectionTimeout) {
-                Serial.println("Advertising timeout, retrying...");
+                LOGGER_WARN("Advertising timeout, retrying...");
                 setState(CONN_RECONNECTING);
             }
             break;
@@ -48,7 +67,7 @@ void ConnectionManager::update() {
         case CONN_CONNECTING:
             // Check for connection timeout
             if (currentTime - lastConnectionAttempt > connectionTimeout) {
-                Serial.println("Connection timeout");
+                LOGGER_WARN("Connection timeout");
                 setState(CONN_RECONNECTING);
             }
             break;
@@ -56,7 +75,7 @@ void ConnectionManager::update() {
         case CONN_CONNECTED:
             // Check for heartbeat timeout
             if (isHeartbeatTimeout()) {
-                Serial.println("Heartbeat timeout, connection lost");
+                LOGGER_WARN("Heartbeat timeout, connection lost");
                 setState(CONN_DISCONNECTED);
             }
             break;
@@ -64,14 +83,16 @@ void ConnectionManager::update() {
         case CONN_RECONNECTING:
             if (currentTime - lastConnectionAttempt > reconnectInterval) {
                 if (reconnectAttempts < maxReconnectAttempts) {
-                    Serial.printf("Reconnection attempt %d/%d\n", reconnectAttempts + 1, maxReconnectAttempts);
+                    LOGGER_INFO("Reconnection attempt %d/%d", reconnectAttempts + 1, maxReconnectAttempts);
                     startAdvertising();
                     reconnectAttempts++;
                     incrementReconnectInterval();
                     lastConnectionAttempt = currentTime;
                     setState(CONN_ADVERTISING);
                 } else {
-                    Serial.println("Max reconnection attempts reached");
+                    // Still connectable, just at the slowest interval
+                    LOGGER_WARN("Max reconnection attempts reached");
+                    startAdvertising();
                     setState(CONN_ERROR);
                     if (onConnectionFailed) {
                         onConnectionFailed();
@@ -81,7 +102,7 @@ void ConnectionManager::update() {
             break;
             
         case CONN_ERROR:
-            // Stay in error state until manually reset
+            // Stay in error state until a connection or a manual reconnect
             break;
     }
 }
@@ -95,11 +116,25 @@ void ConnectionManager::setState(ConnectionState state) {
         ConnectionState previousState = currentState;
         currentState = state;
         
-        Serial.printf("Connection state changed: %d -> %d\n", previousState, state);
+        LOGGER_DEBUG("Connection state changed: %d -> %d", previousState, state);
+        
+        if (previousState == CONN_CONNECTED) {
+            linkLost = true;
+            linkLostTime = millis();
+            disconnectCount++;
+        }
         
         // Handle state transitions
         switch (state) {
             case CONN_CONNECTED:
+                if (linkLost) {
+                    linkLost = false;
+                    lastReconnectMs = millis() - linkLostTime;
+                    maxReconnectMs = max(maxReconnectMs, lastReconnectMs);
+                    totalReconnectMs += lastReconnectMs;
+                    reconnectCount++;
+                    LOGGER_INFO("Reconnected after %u ms", lastReconnectMs);
+                }
                 resetReconnectInterval();
                 reconnectAttempts = 0;
                 updateHeartbeat();
@@ -136,13 +171,17 @@ bool ConnectionManager::isAdvertising() {
 
 void ConnectionManager::startAdvertising() {
     lastConnectionAttempt = millis();
-    // This would be called by BLEManager
-    Serial.println("Starting advertising...");
+    LOGGER_INFO("Starting advertising...");
+    if (onStartAdvertising) {
+        onStartAdvertising(getAdvertisingInterval());
+    }
 }
 
 void ConnectionManager::stopAdvertising() {
-    // This would be called by BLEManager
-    Serial.println("Stopping advertising...");
+    LOGGER_INFO("Stopping advertising...");
+    if (onStopAdvertising) {
+        onStopAdvertising();
+    }
 }
 
 void ConnectionManager::disconnect() {
@@ -155,6 +194,17 @@ void ConnectionManager::reconnect() {
     setState(CONN_RECONNECTING);
 }
 
+void ConnectionManager::connectionLost() {
+    // A deliberate disconnect() already left CONN_CONNECTED
+    if (currentState != CONN_CONNECTED) {
+        return;
+    }
+    
+    // The phone is most likely still in range, start over at the fast interval
+    setState(CONN_DISCONNECTED);
+    reconnect();
+}
+
 void ConnectionManager::updateHeartbeat() {
     lastHeartbeat = millis();
 }
@@ -163,6 +213,11 @@ bool ConnectionManager::isHeartbeatTimeout() {
     return (millis() - lastHeartbeat) > heartbeatTimeout;
 }
 
+uint16_t ConnectionManager::getAdvertisingInterval() {
+    int step = min(reconnectAttempts, (int)ADVERTISING_INTERVAL_STEPS - 1);
+    return advertisingIntervals[step];
+}
+
 bool ConnectionManager::shouldReconnect() {
     return (millis() - lastConnectionAttempt) > reconnectInterval;
 }
@@ -204,4 +259,14 @@ uint32_t ConnectionManager::getConnectionDuration() {
         return millis() - lastConnectionAttempt;
     }
     return 0;
+}
+
+ReconnectStats ConnectionManager::getReconnectStats() {
+    ReconnectStats stats;
+    stats.disconnects = disconnectCount;
+    stats.reconnects = reconnectCount;
+    stats.lastMs = lastReconnectMs;
+    stats.avgMs = reconnectCount > 0 ? (uint32_t)(totalReconnectMs / reconnectCount) : 0;
+    stats.maxMs = maxReconnectMs;
+    return stats;
 }
\ No newline at end of file
@@ -13,6 +13,15 @@ enum ConnectionState {
     CONN_ERROR
 };
 
+// Link losses and how long each took to come back to CONN_CONNECTED
+struct ReconnectStats {
+    uint32_t disconnects;
+    uint32_t reconnects;
+    uint32_t lastMs;
+    uint32_t avgMs;
+    uint32_t maxMs;
+};
+
 class ConnectionManager {
 private:
     ConnectionState currentState;
@@ -26,6 +35,16 @@ private:
     int reconnectAttempts;
     int maxReconnectAttempts;
     
+    // Reconnect timing, from leaving CONN_CONNECTED to entering it again
+    bool linkLost;
+    uint32_t linkLostTime;
+    uint32_t disconnectCount;
+    uint32_t reconnectCount;
+    uint32_t lastReconnectMs;
+    uint32_t maxReconnectMs;
+    uint64_t totalReconnectMs;
+    
+    uint16_t getAdvertisingInterval();
     bool shouldReconnect();
     void incrementReconnectInterval();
     void resetReconnectInterval();
@@ -47,6 +66,7 @@ public:
     void stopAdvertising();
     void disconnect();
     void reconnect();
+    void connectionLost(); // The link dropped without disconnect() being asked for
     
     // Heartbeat management
     void updateHeartbeat();
@@ -62,12 +82,17 @@ public:
     int getReconnectAttempts();
     uint32_t getLastConnectionTime();
     uint32_t getConnectionDuration();
+    ReconnectStats getReconnectStats();
     
     // Event callbacks (to be implemented by user)
     void (*onConnected)();
     void (*onDisconnected)();
     void (*onReconnecting)();
     void (*onConnectionFailed)();
+    
+    // Advertising control, interval in 0.625ms units
+    void (*onStartAdvertising)(uint16_t interval);
+    void (*onStopAdvertising)();
 };
 
 #endif // CONNECTION_MANAGER_H
\ No newline at end of file
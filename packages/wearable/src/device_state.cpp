@@ -0,0 +1,27 @@
+#include "device_state.h"
+#include "battery_monitor.h"
+
+void DeviceState::capture(DeviceStateRecord& record, StatusType status) {
+    record.magic = STATE_RECORD_MAGIC;
+    record.version = STATE_RECORD_VERSION;
+    record.status = (uint8_t)status;
+    record.batteryPercent = BatteryMonitor::getPercent();
+    record.batteryMv = BatteryMonitor::getMillivolts();
+    record.uptimeMs = millis();
+    record.freeHeap = ESP.getFreeHeap();
+    record.minFreeHeap = ESP.getMinFreeHeap();
+}
+
+static uint32_t difference(uint32_t a, uint32_t b) {
+    return a > b ? a - b : b - a;
+}
+
+bool DeviceState::hasChanged(const DeviceStateRecord& current, const DeviceStateRecord& sent) {
+    if (current.status != sent.status || current.batteryPercent != sent.batteryPercent) {
+        return true;
+    }
+    
+    // The heap moves a little with every message, only report real drift
+    return difference(current.freeHeap, sent.freeHeap) >= STATE_HEAP_CHANGE_BYTES ||
+           difference(current.minFreeHeap, sent.minFreeHeap) >= STATE_HEAP_CHANGE_BYTES;
+}
@@ -0,0 +1,37 @@
+#ifndef DEVICE_STATE_H
+#define DEVICE_STATE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "protocol.h"
+
+// Periodic device state, notified on the status characteristic in place of
+// separate status and heartbeat messages. One fixed little-endian record
+// that fits a default 23 byte MTU notification. The magic byte tells it
+// apart from JSON ('{') and binary frames (0xB1) on the same characteristic.
+#define STATE_RECORD_MAGIC 0xB5
+#define STATE_RECORD_VERSION 1
+
+struct __attribute__((packed)) DeviceStateRecord {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t status;          // StatusType
+    uint8_t batteryPercent;
+    uint16_t batteryMv;
+    uint16_t sequence;       // Per connection, gaps are records the app missed
+    uint32_t uptimeMs;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+};
+
+class DeviceState {
+public:
+    // Cached battery values and the heap, no ADC access
+    static void capture(DeviceStateRecord& record, StatusType status);
+    
+    // Status or battery percentage differ, or the heap moved by at least
+    // STATE_HEAP_CHANGE_BYTES. Uptime alone never counts as a change.
+    static bool hasChanged(const DeviceStateRecord& current, const DeviceStateRecord& sent);
+};
+
+#endif // DEVICE_STATE_H
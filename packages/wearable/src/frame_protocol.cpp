@@ -0,0 +1,258 @@
+#include "frame_protocol.h"
+#include "battery_monitor.h"
+
+FrameWriter::FrameWriter(uint8_t* buffer, size_t capacity) {
+    this->buffer = buffer;
+    this->capacity = capacity;
+    position = 0;
+    overflow = false;
+}
+
+bool FrameWriter::reserve(size_t bytes) {
+    if (overflow || position + bytes > capacity) {
+        overflow = true;
+        return false;
+    }
+    return true;
+}
+
+void FrameWriter::begin(MessageType type, uint16_t sequence) {
+    position = 0;
+    overflow = false;
+    
+    if (!reserve(FRAME_HEADER_SIZE)) {
+        return;
+    }
+    
+    buffer[position++] = FRAME_MAGIC;
+    buffer[position++] = FRAME_VERSION;
+    buffer[position++] = (uint8_t)type;
+    buffer[position++] = sequence & 0xFF;
+    buffer[position++] = (sequence >> 8) & 0xFF;
+}
+
+void FrameWriter::putU8(uint8_t tag, uint8_t value) {
+    if (!reserve(3)) {
+        return;
+    }
+    
+    buffer[position++] = tag;
+    buffer[position++] = 1;
+    buffer[position++] = value;
+}
+
+void FrameWriter::putU16(uint8_t tag, uint16_t value) {
+    if (!reserve(4)) {
+        return;
+    }
+    
+    buffer[position++] = tag;
+    buffer[position++] = 2;
+    buffer[position++] = value & 0xFF;
+    buffer[position++] = (value >> 8) & 0xFF;
+}
+
+void FrameWriter::putU32(uint8_t tag, uint32_t value) {
+    if (!reserve(6)) {
+        return;
+    }
+    
+    buffer[position++] = tag;
+    buffer[position++] = 4;
+    for (int i = 0; i < 4; i++) {
+        buffer[position++] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+void FrameWriter::putString(uint8_t tag, const char* value) {
+    size_t valueLength = strlen(value);
+    if (valueLength > 255 || !reserve(2 + valueLength)) {
+        overflow = true;
+        return;
+    }
+    
+    buffer[position++] = tag;
+    buffer[position++] = (uint8_t)valueLength;
+    memcpy(buffer + position, value, valueLength);
+    position += valueLength;
+}
+
+size_t FrameWriter::length() {
+    return overflow ? 0 : position;
+}
+
+size_t FrameProtocol::createCommandFrame(uint8_t* buffer, size_t size, uint16_t sequence, const char* command, const char* data) {
+    FrameWriter writer(buffer, size);
+    
+    writer.begin(MSG_COMMAND, sequence);
+    writer.putU32(TAG_TIMESTAMP, Protocol::getTimestamp());
+    writer.putString(TAG_COMMAND_NAME, command);
+    writer.putU16(TAG_BATTERY_MV, getBatteryMillivolts());
+    
+    if (data && data[0] != '\0') {
+        writer.putString(TAG_DATA, data);
+    }
+    
+    return writer.length();
+}
+
+size_t FrameProtocol::createStatusFrame(uint8_t* buffer, size_t size, uint16_t sequence, StatusType status) {
+    FrameWriter writer(buffer, size);
+    
+    writer.begin(MSG_STATUS, sequence);
+    writer.putU32(TAG_TIMESTAMP, Protocol::getTimestamp());
+    writer.putU8(TAG_STATUS, (uint8_t)status);
+    writer.putU16(TAG_BATTERY_MV, getBatteryMillivolts());
+    writer.putU8(TAG_BATTERY_PERCENT, BatteryMonitor::getPercent());
+    
+    return writer.length();
+}
+
+size_t FrameProtocol::createErrorFrame(uint8_t* buffer, size_t size, uint16_t sequence, ErrorCode error, const char* description) {
+    FrameWriter writer(buffer, size);
+    
+    writer.begin(MSG_ERROR, sequence);
+    writer.putU32(TAG_TIMESTAMP, Protocol::getTimestamp());
+    writer.putU8(TAG_ERROR_CODE, (uint8_t)error);
+    writer.putU16(TAG_BATTERY_MV, getBatteryMillivolts());
+    
+    // The app maps error codes to text, only send explicit descriptions
+    if (description && description[0] != '\0') {
+        writer.putString(TAG_DESCRIPTION, description);
+    }
+    
+    return writer.length();
+}
+
+size_t FrameProtocol::createHeartbeatFrame(uint8_t* buffer, size_t size, uint16_t sequence) {
+    FrameWriter writer(buffer, size);
+    
+    writer.begin(MSG_HEARTBEAT, sequence);
+    writer.putU32(TAG_TIMESTAMP, Protocol::getTimestamp());
+    writer.putU16(TAG_BATTERY_MV, getBatteryMillivolts());
+    writer.putU8(TAG_BATTERY_PERCENT, BatteryMonitor::getPercent());
+    writer.putU32(TAG_UPTIME, millis());
+    writer.putU32(TAG_FREE_HEAP, ESP.getFreeHeap());
+    writer.putU32(TAG_LARGEST_FREE_BLOCK, Protocol::getLargestFreeBlock());
+    writer.putU32(TAG_MIN_FREE_HEAP, ESP.getMinFreeHeap());
+    
+    return writer.length();
+}
+
+size_t FrameProtocol::createAckFrame(uint8_t* buffer, size_t size, uint16_t sequence, uint16_t ackSequence) {
+    FrameWriter writer(buffer, size);
+    
+    writer.begin(MSG_ACK, sequence);
+    writer.putU16(TAG_ACK_SEQUENCE, ackSequence);
+    
+    return writer.length();
+}
+
+bool FrameProtocol::isFrame(const uint8_t* data, size_t length) {
+    return length >= FRAME_HEADER_SIZE && data[0] == FRAME_MAGIC;
+}
+
+bool FrameProtocol::parseFrame(const uint8_t* data, size_t length, FrameHeader& header, const uint8_t*& fields, size_t& fieldsLength) {
+    if (!isFrame(data, length)) {
+        return false;
+    }
+    
+    header.version = data[1];
+    if (header.version != FRAME_VERSION) {
+        return false;
+    }
+    
+    if (data[2] > MSG_ACK) {
+        return false;
+    }
+    header.type = (MessageType)data[2];
+    header.sequence = data[3] | (data[4] << 8);
+    
+    fields = data + FRAME_HEADER_SIZE;
+    fieldsLength = length - FRAME_HEADER_SIZE;
+    
+    return true;
+}
+
+bool FrameProtocol::findField(const uint8_t* fields, size_t fieldsLength, uint8_t tag, const uint8_t*& value, uint8_t& valueLength) {
+    size_t offset = 0;
+    
+    while (offset + 2 <= fieldsLength) {
+        uint8_t fieldTag = fields[offset];
+        uint8_t fieldLength = fields[offset + 1];
+        
+        if (offset + 2 + fieldLength > fieldsLength) {
+            return false; // Truncated field
+        }
+        
+        if (fieldTag == tag) {
+            value = fields + offset + 2;
+            valueLength = fieldLength;
+            return true;
+        }
+        
+        offset += 2 + fieldLength;
+    }
+    
+    return false;
+}
+
+bool FrameProtocol::parseCommand(const uint8_t* fields, size_t fieldsLength, CommandType& command, char* data, size_t dataSize) {
+    const uint8_t* value;
+    uint8_t valueLength;
+    
+    if (!findField(fields, fieldsLength, TAG_COMMAND_ID, value, valueLength) || valueLength != 1) {
+        return false;
+    }
+    
+    if (value[0] >= COMMAND_TYPE_COUNT) {
+        return false;
+    }
+    command = (CommandType)value[0];
+    
+    if (findField(fields, fieldsLength, TAG_DATA, value, valueLength)) {
+        copyString(value, valueLength, data, dataSize);
+    } else if (dataSize > 0) {
+        data[0] = '\0';
+    }
+    
+    return true;
+}
+
+bool FrameProtocol::parseStatus(const uint8_t* fields, size_t fieldsLength, StatusType& status, char* data, size_t dataSize) {
+    const uint8_t* value;
+    uint8_t valueLength;
+    
+    if (!findField(fields, fieldsLength, TAG_STATUS, value, valueLength) || valueLength != 1) {
+        return false;
+    }
+    
+    if (value[0] > STATUS_DISCONNECTED) {
+        return false;
+    }
+    status = (StatusType)value[0];
+    
+    if (findField(fields, fieldsLength, TAG_DATA, value, valueLength)) {
+        copyString(value, valueLength, data, dataSize);
+    } else if (dataSize > 0) {
+        data[0] = '\0';
+    }
+    
+    return true;
+}
+
+uint16_t FrameProtocol::getBatteryMillivolts() {
+    // Cached by the battery monitor, no ADC access here
+    return BatteryMonitor::getMillivolts();
+}
+
+void FrameProtocol::copyString(const uint8_t* value, uint8_t valueLength, char* data, size_t dataSize) {
+    if (dataSize == 0) {
+        return;
+    }
+    
+    // Truncate to the caller's buffer
+    size_t length = min((size_t)valueLength, dataSize - 1);
+    memcpy(data, value, length);
+    data[length] = '\0';
+}
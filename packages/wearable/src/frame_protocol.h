@@ -0,0 +1,86 @@
+#ifndef FRAME_PROTOCOL_H
+#define FRAME_PROTOCOL_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "protocol.h"
+
+// Compact binary frames, negotiated at connect as an alternative to JSON.
+//
+// Header: magic (0xB1), version, message type, sequence (uint16 LE)
+// Body:   TLV fields, each tag (1 byte), length (1 byte), value
+//
+// JSON messages always start with '{', so the magic byte tells the two apart.
+#define FRAME_MAGIC 0xB1
+#define FRAME_VERSION 1
+#define FRAME_HEADER_SIZE 5
+
+// TLV field tags
+enum FrameTag {
+    TAG_COMMAND_ID = 0x01,   // uint8, CommandType (app -> device)
+    TAG_COMMAND_NAME = 0x02, // string, event name (device -> app)
+    TAG_DATA = 0x03,         // string
+    TAG_STATUS = 0x04,       // uint8, StatusType
+    TAG_ERROR_CODE = 0x05,   // uint8, ErrorCode
+    TAG_DESCRIPTION = 0x06,  // string
+    TAG_TIMESTAMP = 0x07,    // uint32, ms since boot
+    TAG_BATTERY_MV = 0x08,   // uint16, millivolts
+    TAG_UPTIME = 0x09,       // uint32, ms
+    TAG_FREE_HEAP = 0x0A,    // uint32, bytes
+    TAG_ACK_SEQUENCE = 0x0B, // uint16
+    TAG_BATTERY_PERCENT = 0x0C, // uint8, estimated state of charge
+    TAG_LARGEST_FREE_BLOCK = 0x0D, // uint32, bytes
+    TAG_MIN_FREE_HEAP = 0x0E // uint32, bytes since boot
+};
+
+struct FrameHeader {
+    uint8_t version;
+    MessageType type;
+    uint16_t sequence;
+};
+
+// Serializes a frame into a caller supplied buffer
+class FrameWriter {
+private:
+    uint8_t* buffer;
+    size_t capacity;
+    size_t position;
+    bool overflow;
+    
+    bool reserve(size_t bytes);
+
+public:
+    FrameWriter(uint8_t* buffer, size_t capacity);
+    
+    void begin(MessageType type, uint16_t sequence);
+    void putU8(uint8_t tag, uint8_t value);
+    void putU16(uint8_t tag, uint16_t value);
+    void putU32(uint8_t tag, uint32_t value);
+    void putString(uint8_t tag, const char* value);
+    
+    // Frame length, or 0 if the frame did not fit
+    size_t length();
+};
+
+class FrameProtocol {
+public:
+    // Frame creation, each returns the frame length or 0 on overflow
+    static size_t createCommandFrame(uint8_t* buffer, size_t size, uint16_t sequence, const char* command, const char* data = nullptr);
+    static size_t createStatusFrame(uint8_t* buffer, size_t size, uint16_t sequence, StatusType status);
+    static size_t createErrorFrame(uint8_t* buffer, size_t size, uint16_t sequence, ErrorCode error, const char* description = nullptr);
+    static size_t createHeartbeatFrame(uint8_t* buffer, size_t size, uint16_t sequence);
+    static size_t createAckFrame(uint8_t* buffer, size_t size, uint16_t sequence, uint16_t ackSequence);
+    
+    // Frame parsing
+    static bool isFrame(const uint8_t* data, size_t length);
+    static bool parseFrame(const uint8_t* data, size_t length, FrameHeader& header, const uint8_t*& fields, size_t& fieldsLength);
+    static bool findField(const uint8_t* fields, size_t fieldsLength, uint8_t tag, const uint8_t*& value, uint8_t& valueLength);
+    static bool parseCommand(const uint8_t* fields, size_t fieldsLength, CommandType& command, char* data, size_t dataSize);
+    static bool parseStatus(const uint8_t* fields, size_t fieldsLength, StatusType& status, char* data, size_t dataSize);
+    
+private:
+    static uint16_t getBatteryMillivolts();
+    static void copyString(const uint8_t* value, uint8_t valueLength, char* data, size_t dataSize);
+};
+
+#endif // FRAME_PROTOCOL_H
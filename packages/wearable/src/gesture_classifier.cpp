@@ -0,0 +1,56 @@
+#include "gesture_classifier.h"
+
+GestureType GestureClassifier::classify(const GestureModel& model, const int16_t* features, uint8_t& confidence) {
+    uint16_t votes[GESTURE_TYPE_COUNT] = {0};
+    
+    for (int tree = 0; tree < model.treeCount; tree++) {
+        const GestureTreeNode* node = &model.nodes[model.roots[tree]];
+        
+        // Depth-limited, a bad table cannot stall the gesture task
+        for (int depth = 0; node->feature != GESTURE_TREE_LEAF && depth < GESTURE_MODEL_MAX_DEPTH; depth++) {
+            uint8_t next = features[node->feature] > node->threshold ? node->above : node->below;
+            node = &model.nodes[next];
+        }
+        
+        if (node->feature == GESTURE_TREE_LEAF) {
+            votes[node->below] += node->above;
+        }
+    }
+    
+    int best = GESTURE_NONE;
+    for (int gesture = 1; gesture < GESTURE_TYPE_COUNT; gesture++) {
+        if (votes[gesture] > votes[best]) {
+            best = gesture;
+        }
+    }
+    
+    confidence = model.treeCount > 0 ? votes[best] / model.treeCount : 0;
+    return (GestureType)best;
+}
+
+bool GestureClassifier::validate(const GestureModel& model) {
+    if (model.treeCount == 0) {
+        return false;
+    }
+    
+    for (int tree = 0; tree < model.treeCount; tree++) {
+        if (model.roots[tree] >= model.nodeCount) {
+            return false;
+        }
+    }
+    
+    for (int i = 0; i < model.nodeCount; i++) {
+        const GestureTreeNode& node = model.nodes[i];
+        
+        if (node.feature == GESTURE_TREE_LEAF) {
+            if (node.below >= GESTURE_TYPE_COUNT || node.above > 100) {
+                return false;
+            }
+        } else if (node.feature < 0 || node.feature >= GESTURE_FEATURE_COUNT ||
+                   node.below >= model.nodeCount || node.above >= model.nodeCount) {
+            return false;
+        }
+    }
+    
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef GESTURE_CLASSIFIER_H
+#define GESTURE_CLASSIFIER_H
+
+#include <Arduino.h>
+#include "gesture_detector.h"
+#include "gesture_model.h"
+
+// Runs a GestureModel on one feature vector. The cost is bounded by the
+// tree count and depth, whatever the gestures or the window size.
+class GestureClassifier {
+public:
+    // Winning gesture and its confidence in percent, averaged over the trees
+    static GestureType classify(const GestureModel& model, const int16_t* features, uint8_t& confidence);
+    
+    // Child indices, features and leaf gestures in range
+    static bool validate(const GestureModel& model);
+};
+
+#endif // GESTURE_CLASSIFIER_H
@@ -1,8 +1,14 @@
 #include "gesture_detector.h"
+#include "logger.h"
+#include "gesture_classifier.h"
+#include "i2c_bus.h"
 
 // LIS3DH register addresses (common accelerometer)
 #define LIS3DH_REG_CTRL1 0x20
+#define LIS3DH_REG_CTRL2 0x21
+#define LIS3DH_REG_CTRL3 0x22
 #define LIS3DH_REG_CTRL4 0x23
+#define LIS3DH_REG_CTRL5 0x24
 #define LIS3DH_REG_OUT_X_L 0x28
 #define LIS3DH_REG_OUT_X_H 0x29
 #define LIS3DH_REG_OUT_Y_L 0x2A
@@ -10,56 +16,138 @@
 #define LIS3DH_REG_OUT_Z_L 0x2C
 #define LIS3DH_REG_OUT_Z_H 0x2D
 #define LIS3DH_REG_WHO_AM_I 0x0F
+#define LIS3DH_REG_FIFO_CTRL 0x2E
+#define LIS3DH_REG_FIFO_SRC 0x2F
+#define LIS3DH_REG_INT1_CFG 0x30
+#define LIS3DH_REG_INT1_SRC 0x31
+#define LIS3DH_REG_INT1_THS 0x32
+#define LIS3DH_REG_INT1_DURATION 0x33
+#define LIS3DH_REG_CLICK_CFG 0x38
+#define LIS3DH_REG_CLICK_SRC 0x39
+#define LIS3DH_REG_CLICK_THS 0x3A
+#define LIS3DH_REG_TIME_LIMIT 0x3B
+#define LIS3DH_REG_TIME_LATENCY 0x3C
+#define LIS3DH_REG_TIME_WINDOW 0x3D
+
+// Register bits
+#define LIS3DH_CTRL3_I1_CLICK 0x80
+#define LIS3DH_CTRL1_ACTIVE 0x57 // 100Hz, normal mode, XYZ
+#define LIS3DH_CTRL1_WAKE 0x2F // 10Hz, low power, XYZ
+#define LIS3DH_CTRL2_HP_IA1 0x01 // High-pass filter on INT1, removes gravity
+#define LIS3DH_CTRL3_I1_IA1 0x40
+#define LIS3DH_CTRL3_I1_WTM 0x04
+#define LIS3DH_CTRL5_FIFO_EN 0x40
+#define LIS3DH_CTRL5_LIR_INT1 0x08
+#define LIS3DH_INT1_CFG_XYZ_HIGH 0x2A
+#define LIS3DH_FIFO_MODE_STREAM 0x80
+#define LIS3DH_FIFO_SRC_OVRN 0x40
+#define LIS3DH_FIFO_SRC_FSS 0x1F
+#define LIS3DH_CLICK_CFG_ALL 0x3F // Single and double click on X, Y, Z
+#define LIS3DH_CLICK_THS_LIR 0x80 // Latch CLICK_SRC until read
+#define LIS3DH_CLICK_SRC_IA 0x40
+#define LIS3DH_CLICK_SRC_DCLICK 0x20
+#define LIS3DH_CLICK_SRC_SCLICK 0x10
+
+#define LIS3DH_BURST_SAMPLES 20 // 120 bytes, fits the Wire buffer
+
+volatile bool GestureDetector::accelInterruptPending = false;
+void (*GestureDetector::onInterrupt)() = nullptr;
+
+void IRAM_ATTR GestureDetector::onAccelInterrupt() {
+    accelInterruptPending = true;
+    
+    if (onInterrupt) {
+        onInterrupt();
+    }
+}
 
 GestureDetector::GestureDetector() {
     isInitialized = false;
-    bufferIndex = 0;
-    tapThreshold = GESTURE_THRESHOLD;
-    swipeThreshold = GESTURE_THRESHOLD * 1.5;
-    shakeThreshold = GESTURE_THRESHOLD * 2.0;
+    tapThreshold = GESTURE_TAP_THRESHOLD;
+    swipeThreshold = GESTURE_SWIPE_THRESHOLD;
+    shakeThreshold = GESTURE_SHAKE_THRESHOLD;
     gestureTimeout = GESTURE_TIMEOUT_MS;
     lastGestureTime = 0;
     lastTapTime = 0;
+    sampleClockBase = 0;
+    sampleCount = 0;
+    fifoOverruns = 0;
+    readFailures = 0;
+    fifoSource = 0;
+    clickSource = 0;
+    fifoRequested = 0;
+    fifoReceived = 0;
+    fifoBurst = 0;
+    fifoInFlight = false;
+    fifoDiscard = false;
+    fifoFailed = false;
+    fifoComplete = false;
+    pendingGesture = GESTURE_NONE;
+    lastConfidence = 0;
+    hardwareTapEnabled = ACCEL_HARDWARE_TAP_ENABLED;
+    wakeOnMotion = false;
+    calibrationRemaining = 0;
+    memset(calibrationSum, 0, sizeof(calibrationSum));
+    memset(&baseline, 0, sizeof(baseline));
+    memset(&offset, 0, sizeof(offset));
+    onCalibrated = nullptr;
+    onSamplesReady = nullptr;
     
     // Initialize data structures
-    memset(&currentAccel, 0, sizeof(AccelData));
-    memset(&previousAccel, 0, sizeof(AccelData));
-    memset(gestureBuffer, 0, sizeof(gestureBuffer));
+    clearBuffer();
+    updateFeatureScales();
 }
 
 bool GestureDetector::begin() {
-    Serial.println("Initializing Gesture Detector...");
+    LOGGER_INFO("Initializing Gesture Detector...");
     
-    // Initialize I2C if not already done
-    Wire.begin(ACCEL_SDA_PIN, ACCEL_SCL_PIN);
+    if (!GestureClassifier::validate(gestureModel)) {
+        LOGGER_ERROR("Gesture model tables are inconsistent");
+        return false;
+    }
+    LOGGER_INFO("Gesture model '%s': %u tree(s), %u nodes", gestureModel.name, gestureModel.treeCount, gestureModel.nodeCount);
+    
+    // Shared with the haptic driver, whichever starts first brings it up
+    if (!I2CBus::begin()) {
+        return false;
+    }
     
     // Initialize accelerometer
     if (!initializeAccelerometer()) {
-        Serial.println("Failed to initialize accelerometer");
+        LOGGER_ERROR("Failed to initialize accelerometer");
         return false;
     }
     
     isInitialized = true;
-    Serial.println("Gesture Detector initialized successfully");
+    LOGGER_INFO("Gesture Detector initialized successfully");
     
     return true;
 }
 
 void GestureDetector::end() {
+    if (isInitialized && ACCEL_INT1_PIN >= 0) {
+        detachInterrupt(digitalPinToInterrupt(ACCEL_INT1_PIN));
+    }
     isInitialized = false;
+    
+    // The bus task still owns the buffers until a queued read completes
+    while (fifoInFlight && !fifoComplete) {
+        delay(1);
+    }
+    fifoInFlight = false;
 }
 
 bool GestureDetector::initializeAccelerometer() {
     // Check WHO_AM_I register
     uint8_t whoAmI = readRegister(LIS3DH_REG_WHO_AM_I);
     if (whoAmI != 0x33) {
-        Serial.printf("Unexpected WHO_AM_I value: 0x%02X\n", whoAmI);
+        LOGGER_ERROR("Unexpected WHO_AM_I value: 0x%02X", whoAmI);
         // Continue anyway, might be a different accelerometer
     }
     
     // Configure accelerometer
     // CTRL1: Normal mode, 100Hz, XYZ enabled
-    writeRegister(LIS3DH_REG_CTRL1, 0x57);
+    writeRegister(LIS3DH_REG_CTRL1, LIS3DH_CTRL1_ACTIVE);
     
     // CTRL4: +/- 2g, high resolution
     writeRegister(LIS3DH_REG_CTRL4, 0x08);
@@ -69,43 +157,103 @@ bool GestureDetector::initializeAccelerometer() {
     // Test read
     AccelData testData;
     if (!readAccelerometer(testData)) {
-        Serial.println("Failed to read test data from accelerometer");
+        LOGGER_ERROR("Failed to read test data from accelerometer");
         return false;
     }
     
+    configureFifo();
+    configureClickDetection();
+    
+    // Watermark and click both raise INT1
+    if (ACCEL_INT1_PIN >= 0) {
+        pinMode(ACCEL_INT1_PIN, INPUT);
+        attachInterrupt(digitalPinToInterrupt(ACCEL_INT1_PIN), onAccelInterrupt, RISING);
+        writeRegister(LIS3DH_REG_CTRL3, LIS3DH_CTRL3_I1_WTM | (hardwareTapEnabled ? LIS3DH_CTRL3_I1_CLICK : 0));
+    }
+    
     return true;
 }
 
+void GestureDetector::setWakeOnMotion(bool enabled) {
+    if (!isInitialized || enabled == wakeOnMotion) {
+        return;
+    }
+    
+    wakeOnMotion = enabled;
+    fifoDiscard = fifoInFlight;
+    
+    if (enabled) {
+        // Low power 10Hz with a latched high-g interrupt on any axis
+        writeRegister(LIS3DH_REG_CTRL3, 0x00);
+        writeRegister(LIS3DH_REG_FIFO_CTRL, 0x00);
+        writeRegister(LIS3DH_REG_CTRL1, LIS3DH_CTRL1_WAKE);
+        writeRegister(LIS3DH_REG_CTRL2, LIS3DH_CTRL2_HP_IA1);
+        writeRegister(LIS3DH_REG_CTRL5, LIS3DH_CTRL5_LIR_INT1);
+        writeRegister(LIS3DH_REG_INT1_THS, ACCEL_WAKE_THRESHOLD & 0x7F);
+        writeRegister(LIS3DH_REG_INT1_DURATION, ACCEL_WAKE_DURATION & 0x7F);
+        writeRegister(LIS3DH_REG_INT1_CFG, LIS3DH_INT1_CFG_XYZ_HIGH);
+        readRegister(LIS3DH_REG_INT1_SRC); // Clear a stale latch
+        writeRegister(LIS3DH_REG_CTRL3, LIS3DH_CTRL3_I1_IA1);
+    } else {
+        writeRegister(LIS3DH_REG_CTRL3, 0x00);
+        writeRegister(LIS3DH_REG_INT1_CFG, 0x00);
+        writeRegister(LIS3DH_REG_CTRL2, 0x00);
+        readRegister(LIS3DH_REG_INT1_SRC);
+        writeRegister(LIS3DH_REG_CTRL1, LIS3DH_CTRL1_ACTIVE);
+        
+        // Old samples would be timestamped wrongly, start a fresh window
+        clearBuffer();
+        pendingGesture = GESTURE_NONE;
+        configureFifo();
+        configureClickDetection();
+        writeRegister(LIS3DH_REG_CTRL3, LIS3DH_CTRL3_I1_WTM | (hardwareTapEnabled ? LIS3DH_CTRL3_I1_CLICK : 0));
+    }
+    
+    accelInterruptPending = false;
+}
+
+bool GestureDetector::isWakeOnMotion() {
+    return wakeOnMotion;
+}
+
+void GestureDetector::configureFifo() {
+    // Stream mode keeps the newest 32 samples, watermark triggers a burst read
+    writeRegister(LIS3DH_REG_CTRL5, LIS3DH_CTRL5_FIFO_EN);
+    writeRegister(LIS3DH_REG_FIFO_CTRL, 0x00); // Bypass clears the FIFO
+    writeRegister(LIS3DH_REG_FIFO_CTRL, LIS3DH_FIFO_MODE_STREAM | (ACCEL_FIFO_WATERMARK & LIS3DH_FIFO_SRC_FSS));
+    
+    sampleClockBase = millis();
+    sampleCount = 0;
+}
+
+void GestureDetector::configureClickDetection() {
+    if (!hardwareTapEnabled) {
+        writeRegister(LIS3DH_REG_CLICK_CFG, 0x00);
+        return;
+    }
+    
+    writeRegister(LIS3DH_REG_CLICK_CFG, LIS3DH_CLICK_CFG_ALL);
+    writeRegister(LIS3DH_REG_CLICK_THS, LIS3DH_CLICK_THS_LIR | (ACCEL_CLICK_THRESHOLD & 0x7F));
+    writeRegister(LIS3DH_REG_TIME_LIMIT, ACCEL_CLICK_TIME_LIMIT);
+    writeRegister(LIS3DH_REG_TIME_LATENCY, ACCEL_CLICK_TIME_LATENCY);
+    writeRegister(LIS3DH_REG_TIME_WINDOW, ACCEL_CLICK_TIME_WINDOW);
+}
+
 void GestureDetector::writeRegister(uint8_t reg, uint8_t value) {
-    Wire.beginTransmission(ACCEL_I2C_ADDRESS);
-    Wire.write(reg);
-    Wire.write(value);
-    Wire.endTransmission();
+    I2CBus::writeRegister(ACCEL_I2C_ADDRESS, reg, value);
 }
 
 uint8_t GestureDetector::readRegister(uint8_t reg) {
-    Wire.beginTransmission(ACCEL_I2C_ADDRESS);
-    Wire.write(reg);
-    Wire.endTransmission(false);
-    
-    Wire.requestFrom(ACCEL_I2C_ADDRESS, 1);
-    if (Wire.available()) {
-        return Wire.read();
-    }
-    return 0;
+    return I2CBus::readRegister(ACCEL_I2C_ADDRESS, reg);
 }
 
 bool GestureDetector::readAccelerometer(AccelData& data) {
-    Wire.beginTransmission(ACCEL_I2C_ADDRESS);
-    Wire.write(LIS3DH_REG_OUT_X_L | 0x80); // Auto-increment
-    Wire.endTransmission(false);
+    uint8_t raw[6];
     
-    Wire.requestFrom(ACCEL_I2C_ADDRESS, 6);
-    
-    if (Wire.available() >= 6) {
-        int16_t x = Wire.read() | (Wire.read() << 8);
-        int16_t y = Wire.read() | (Wire.read() << 8);
-        int16_t z = Wire.read() | (Wire.read() << 8);
+    if (I2CBus::readRegisters(ACCEL_I2C_ADDRESS, LIS3DH_REG_OUT_X_L | 0x80, raw, sizeof(raw))) { // Auto-increment
+        int16_t x = raw[0] | (raw[1] << 8);
+        int16_t y = raw[2] | (raw[3] << 8);
+        int16_t z = raw[4] | (raw[5] << 8);
         
         // Convert to g-force (assuming +/- 2g range)
         data.x = (float)x / 16384.0;
@@ -116,241 +264,478 @@ bool GestureDetector::readAccelerometer(AccelData& data) {
         return true;
     }
     
+    readFailures++;
     return false;
 }
 
 void GestureDetector::update() {
-    if (!isInitialized) {
+    // Samples the bus task fetched since the last run
+    collectFifo();
+    
+    // In wake-on-motion mode INT1 only means the device was moved
+    if (!isInitialized || wakeOnMotion || fifoInFlight) {
         return;
     }
     
-    // Read current accelerometer data
-    previousAccel = currentAccel;
-    if (readAccelerometer(currentAccel)) {
-        addToBuffer(currentAccel);
+    // Only touch the bus when INT1 says there is something to read. The line
+    // stays high while the watermark is still met, so check the level too.
+    if (ACCEL_INT1_PIN >= 0) {
+        if (!accelInterruptPending && digitalRead(ACCEL_INT1_PIN) != HIGH) {
+            return;
+        }
+        accelInterruptPending = false;
+    }
+    
+    startFifoRead();
+    
+    // Without a bus task the read has already finished
+    collectFifo();
+}
+
+void GestureDetector::startFifoRead() {
+    fifoRequested = 0;
+    fifoReceived = 0;
+    clickSource = 0;
+    fifoFailed = false;
+    fifoComplete = false;
+    fifoInFlight = true;
+    
+    // The chain continues in the bus task, see onFifoSourceRead()
+    if (!I2CBus::readRegistersAsync(ACCEL_I2C_ADDRESS, LIS3DH_REG_FIFO_SRC, &fifoSource, 1, onFifoSourceRead, this)) {
+        fifoInFlight = false;
     }
 }
 
-GestureType GestureDetector::detectGesture() {
-    if (!isInitialized) {
-        return GESTURE_NONE;
+void GestureDetector::onFifoSourceRead(void* context, bool ok) {
+    GestureDetector* detector = (GestureDetector*)context;
+    if (!ok) {
+        detector->finishFifoRead(false);
+        return;
     }
     
-    // Check for timeout since last gesture
-    if (millis() - lastGestureTime < 200) {
-        return GESTURE_NONE; // Prevent rapid-fire gestures
+    // After an overrun the whole FIFO holds valid samples
+    uint8_t source = detector->fifoSource;
+    detector->fifoRequested = (source & LIS3DH_FIFO_SRC_OVRN) ? ACCEL_FIFO_DEPTH : (source & LIS3DH_FIFO_SRC_FSS);
+    detector->requestFifoBurst();
+}
+
+void GestureDetector::onFifoBurstRead(void* context, bool ok) {
+    GestureDetector* detector = (GestureDetector*)context;
+    if (!ok) {
+        detector->finishFifoRead(false);
+        return;
     }
     
-    // Check for tap first (most common)
-    if (detectTap()) {
-        if (detectDoubleTap()) {
-            lastGestureTime = millis();
-            return GESTURE_DOUBLE_TAP;
-        } else {
-            lastGestureTime = millis();
-            return GESTURE_TAP;
+    detector->fifoReceived += detector->fifoBurst;
+    detector->requestFifoBurst();
+}
+
+void GestureDetector::onClickSourceRead(void* context, bool ok) {
+    ((GestureDetector*)context)->finishFifoRead(ok);
+}
+
+void GestureDetector::requestFifoBurst() {
+    if (fifoReceived < fifoRequested) {
+        fifoBurst = min(fifoRequested - fifoReceived, (size_t)LIS3DH_BURST_SAMPLES);
+        if (!I2CBus::readRegistersAsync(ACCEL_I2C_ADDRESS, LIS3DH_REG_OUT_X_L | 0x80, // Auto-increment
+                                        fifoData + fifoReceived * 6, fifoBurst * 6, onFifoBurstRead, this)) {
+            finishFifoRead(false);
         }
+        return;
     }
     
-    // Check for shake
-    if (detectShake()) {
-        lastGestureTime = millis();
-        return GESTURE_SHAKE;
+    // Reading CLICK_SRC also releases the latched interrupt
+    if (hardwareTapEnabled) {
+        if (!I2CBus::readRegistersAsync(ACCEL_I2C_ADDRESS, LIS3DH_REG_CLICK_SRC, &clickSource, 1, onClickSourceRead, this)) {
+            finishFifoRead(false);
+        }
+        return;
     }
     
-    // Check for swipe
-    GestureType swipe = detectSwipe();
-    if (swipe != GESTURE_NONE) {
-        lastGestureTime = millis();
-        return swipe;
-    }
+    finishFifoRead(true);
+}
+
+void GestureDetector::finishFifoRead(bool ok) {
+    fifoFailed = !ok;
+    fifoComplete = true;
     
-    // Check for twist
-    GestureType twist = detectTwist();
-    if (twist != GESTURE_NONE) {
-        lastGestureTime = millis();
-        return twist;
+    if (onSamplesReady) {
+        onSamplesReady();
     }
-    
-    return GESTURE_NONE;
 }
 
-bool GestureDetector::detectTap() {
-    float magnitude = calculateMagnitude(currentAccel);
-    float prevMagnitude = calculateMagnitude(previousAccel);
+void GestureDetector::collectFifo() {
+    if (!fifoInFlight || !fifoComplete) {
+        return;
+    }
+    fifoInFlight = false;
     
-    // Look for sudden acceleration spike
-    if (magnitude > tapThreshold && magnitude > prevMagnitude * 1.5) {
-        return true;
+    if (fifoFailed) {
+        readFailures++;
     }
     
-    return false;
-}
-
-bool GestureDetector::detectDoubleTap() {
-    uint32_t currentTime = millis();
+    // Read for a configuration that is gone, the samples would be misplaced
+    if (fifoDiscard || wakeOnMotion) {
+        fifoDiscard = false;
+        return;
+    }
     
-    // Check if this tap is within double-tap window
-    if (currentTime - lastTapTime < 500) {
-        lastTapTime = 0; // Reset to prevent triple-tap
-        return true;
+    if (fifoSource & LIS3DH_FIFO_SRC_OVRN) {
+        // Samples were lost, the ODR clock no longer lines up with millis()
+        fifoOverruns++;
+        sampleClockBase = millis() - (fifoRequested * 1000) / ACCEL_ODR_HZ;
+        sampleCount = 0;
     }
     
-    lastTapTime = currentTime;
-    return false;
+    // Whatever arrived before a failed burst is still good
+    const uint8_t* raw = fifoData;
+    for (size_t i = 0; i < fifoReceived; i++, raw += 6) {
+        int16_t x = raw[0] | (raw[1] << 8);
+        int16_t y = raw[2] | (raw[3] << 8);
+        int16_t z = raw[4] | (raw[5] << 8);
+        processSample(x, y, z);
+    }
+    
+    handleClickSource(clickSource);
 }
 
-GestureType GestureDetector::detectSwipe() {
-    if (bufferIndex < 8) {
-        return GESTURE_NONE; // Need enough data points
+void GestureDetector::handleClickSource(uint8_t source) {
+    if (!(source & LIS3DH_CLICK_SRC_IA)) {
+        return;
     }
     
-    // Analyze recent motion in buffer
-    AccelData start = gestureBuffer[(bufferIndex - 8) % 32];
-    AccelData end = gestureBuffer[(bufferIndex - 1) % 32];
+    // The click engine has no notion of confidence
+    if (source & LIS3DH_CLICK_SRC_DCLICK) {
+        pendingGesture = GESTURE_DOUBLE_TAP;
+        lastConfidence = 100;
+    } else if ((source & LIS3DH_CLICK_SRC_SCLICK) && pendingGesture == GESTURE_NONE) {
+        pendingGesture = GESTURE_TAP;
+        lastConfidence = 100;
+    }
+}
+
+void GestureDetector::processSample(int16_t rawX, int16_t rawY, int16_t rawZ) {
+    // The model only ever sees offset corrected samples
+    AccelSample sample = { removeOffset(rawX, offset.x), removeOffset(rawY, offset.y), removeOffset(rawZ, offset.z) };
     
-    float deltaX = end.x - start.x;
-    float deltaY = end.y - start.y;
-    float deltaZ = end.z - start.z;
+    lastSampleTime = sampleClockBase + (sampleCount * 1000) / ACCEL_ODR_HZ;
     
-    // Check for significant movement in one direction
-    if (abs(deltaX) > swipeThreshold && abs(deltaX) > abs(deltaY) && abs(deltaX) > abs(deltaZ)) {
-        return deltaX > 0 ? GESTURE_SWIPE_RIGHT : GESTURE_SWIPE_LEFT;
+    // Whole seconds move into the base, so the product never overflows
+    if (++sampleCount == ACCEL_ODR_HZ) {
+        sampleClockBase += 1000;
+        sampleCount = 0;
     }
+    addToBuffer(sample);
     
-    if (abs(deltaY) > swipeThreshold && abs(deltaY) > abs(deltaX) && abs(deltaY) > abs(deltaZ)) {
-        return deltaY > 0 ? GESTURE_SWIPE_UP : GESTURE_SWIPE_DOWN;
+    // The device is meant to be still while calibrating, no gestures
+    if (calibrationRemaining > 0) {
+        calibrationSum[0] += rawX;
+        calibrationSum[1] += rawY;
+        calibrationSum[2] += rawZ;
+        
+        if (--calibrationRemaining == 0) {
+            finishCalibration();
+        }
+        return;
     }
     
-    return GESTURE_NONE;
+    // Every sample is classified, the first gesture found waits for detectGesture()
+    if (pendingGesture == GESTURE_NONE) {
+        pendingGesture = classifyWindow();
+    }
 }
 
-bool GestureDetector::detectShake() {
-    if (bufferIndex < 16) {
-        return false; // Need enough data points
+GestureType GestureDetector::detectGesture() {
+    if (!isInitialized) {
+        return GESTURE_NONE;
     }
     
-    // Calculate variance in recent accelerometer readings
-    float variance = 0;
-    float mean = 0;
+    GestureType gesture = pendingGesture;
+    pendingGesture = GESTURE_NONE;
+    return gesture;
+}
+
+GestureType GestureDetector::classifyWindow() {
+    uint32_t sampleTime = lastSampleTime;
     
-    for (int i = 0; i < 16; i++) {
-        int index = (bufferIndex - 16 + i) % 32;
-        float magnitude = calculateMagnitude(gestureBuffer[index]);
-        mean += magnitude;
+    // Check for timeout since last gesture
+    if (sampleTime - lastGestureTime < 200) {
+        return GESTURE_NONE; // Prevent rapid-fire gestures
     }
-    mean /= 16;
     
-    for (int i = 0; i < 16; i++) {
-        int index = (bufferIndex - 16 + i) % 32;
-        float magnitude = calculateMagnitude(gestureBuffer[index]);
-        variance += (magnitude - mean) * (magnitude - mean);
+    if (sampleIndex < GESTURE_WINDOW) {
+        return GESTURE_NONE; // Need a full window
     }
-    variance /= 16;
     
-    return variance > shakeThreshold;
-}
-
-GestureType GestureDetector::detectTwist() {
-    // Simplified twist detection based on Z-axis rotation
-    // This would need more sophisticated implementation for real twist detection
-    if (bufferIndex < 8) {
+    computeFeatures();
+    
+    uint8_t confidence;
+    GestureType gesture = GestureClassifier::classify(gestureModel, features, confidence);
+    if (gesture == GESTURE_NONE || confidence < GESTURE_MIN_CONFIDENCE) {
         return GESTURE_NONE;
     }
     
-    AccelData start = gestureBuffer[(bufferIndex - 8) % 32];
-    AccelData end = gestureBuffer[(bufferIndex - 1) % 32];
+    // Taps come from the click engine when it is enabled
+    if (gesture == GESTURE_TAP || gesture == GESTURE_DOUBLE_TAP) {
+        if (hardwareTapEnabled) {
+            return GESTURE_NONE;
+        }
+        gesture = detectDoubleTap() ? GESTURE_DOUBLE_TAP : GESTURE_TAP;
+    }
+    
+    lastGestureTime = sampleTime;
+    lastConfidence = confidence;
+    return gesture;
+}
+
+void GestureDetector::computeFeatures() {
+    const float mgPerCount = 1000.0f / ACCEL_COUNTS_PER_G;
+    
+    float magnitude = sqrtf((float)currentMagnitudeSq) * mgPerCount;
+    float previousMagnitude = sqrtf((float)previousMagnitudeSq) * mgPerCount;
+    features[GESTURE_FEATURE_MAGNITUDE] = toFeature(magnitude, tapScale);
+    features[GESTURE_FEATURE_MAGNITUDE_JUMP] = toFeature(magnitude - previousMagnitude, tapScale);
+    
+    // N * sum(x^2) - sum(x)^2 is N^2 * variance, kept exact in integers
+    int64_t scaledVariance = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        scaledVariance += GESTURE_WINDOW * windowSumSq[axis] - (int64_t)windowSum[axis] * windowSum[axis];
+    }
+    float deviation = sqrtf((float)scaledVariance) / GESTURE_WINDOW * mgPerCount;
+    features[GESTURE_FEATURE_MOTION] = toFeature(deviation, shakeScale);
+    
+    // Half sums instead of two samples, a single noisy reading does not swipe
+    int32_t older[3];
+    for (int axis = 0; axis < 3; axis++) {
+        older[axis] = windowSum[axis] - recentSum[axis];
+        float shift = (float)(recentSum[axis] - older[axis]) / GESTURE_HALF_WINDOW * mgPerCount;
+        features[GESTURE_FEATURE_SHIFT_X + axis] = toFeature(shift, swipeScale);
+    }
     
-    float deltaZ = end.z - start.z;
+    // Twisting the wrist turns gravity in the Y-Z plane. The cross product of
+    // the two half means over their lengths is the sine of that rotation.
+    float cross = (float)older[1] * recentSum[2] - (float)older[2] * recentSum[1];
+    float lengths = sqrtf(((float)older[1] * older[1] + (float)older[2] * older[2]) *
+                          ((float)recentSum[1] * recentSum[1] + (float)recentSum[2] * recentSum[2]));
+    features[GESTURE_FEATURE_ROLL] = lengths > 0.0f ? toFeature(cross / lengths * 1000.0f, 256) : 0;
+}
+
+bool GestureDetector::detectDoubleTap() {
+    uint32_t currentTime = lastSampleTime;
     
-    if (abs(deltaZ) > swipeThreshold * 0.8) {
-        return deltaZ > 0 ? GESTURE_TWIST_CW : GESTURE_TWIST_CCW;
+    // Check if this tap is within double-tap window
+    if (currentTime - lastTapTime < 500) {
+        lastTapTime = 0; // Reset to prevent triple-tap
+        return true;
     }
     
-    return GESTURE_NONE;
+    lastTapTime = currentTime;
+    return false;
+}
+
+uint32_t GestureDetector::magnitudeSquared(const AccelSample& sample) {
+    return (uint32_t)((int32_t)sample.x * sample.x) + (uint32_t)((int32_t)sample.y * sample.y) +
+           (uint32_t)((int32_t)sample.z * sample.z);
+}
+
+int16_t GestureDetector::toFeature(float value, int32_t scale) {
+    float scaled = value * scale / 256.0f;
+    return (int16_t)constrain(scaled, (float)INT16_MIN, (float)INT16_MAX);
 }
 
-float GestureDetector::calculateMagnitude(const AccelData& data) {
-    return sqrt(data.x * data.x + data.y * data.y + data.z * data.z);
+int16_t GestureDetector::removeOffset(int16_t raw, int16_t correction) {
+    return (int16_t)constrain((int32_t)raw - correction, (int32_t)INT16_MIN, (int32_t)INT16_MAX);
 }
 
-float GestureDetector::calculateDistance(const AccelData& a, const AccelData& b) {
-    float dx = a.x - b.x;
-    float dy = a.y - b.y;
-    float dz = a.z - b.z;
-    return sqrt(dx * dx + dy * dy + dz * dz);
+const AccelSample& GestureDetector::sampleAt(uint32_t samplesBack) {
+    return sampleBuffer[(sampleIndex - 1 - samplesBack) & GESTURE_BUFFER_MASK];
 }
 
-void GestureDetector::addToBuffer(const AccelData& data) {
-    gestureBuffer[bufferIndex] = data;
-    bufferIndex = (bufferIndex + 1) % 32;
+void GestureDetector::addToBuffer(const AccelSample& sample) {
+    // Slide the window: drop the sample leaving it, add the new one
+    if (sampleIndex >= GESTURE_WINDOW) {
+        const AccelSample& leaving = sampleAt(GESTURE_WINDOW - 1);
+        windowSum[0] -= leaving.x;
+        windowSum[1] -= leaving.y;
+        windowSum[2] -= leaving.z;
+        windowSumSq[0] -= (int32_t)leaving.x * leaving.x;
+        windowSumSq[1] -= (int32_t)leaving.y * leaving.y;
+        windowSumSq[2] -= (int32_t)leaving.z * leaving.z;
+    }
+    
+    // The sample leaving the newer half moves to the older one
+    if (sampleIndex >= GESTURE_HALF_WINDOW) {
+        const AccelSample& halfway = sampleAt(GESTURE_HALF_WINDOW - 1);
+        recentSum[0] -= halfway.x;
+        recentSum[1] -= halfway.y;
+        recentSum[2] -= halfway.z;
+    }
+    
+    windowSum[0] += sample.x;
+    windowSum[1] += sample.y;
+    windowSum[2] += sample.z;
+    windowSumSq[0] += (int32_t)sample.x * sample.x;
+    windowSumSq[1] += (int32_t)sample.y * sample.y;
+    windowSumSq[2] += (int32_t)sample.z * sample.z;
+    recentSum[0] += sample.x;
+    recentSum[1] += sample.y;
+    recentSum[2] += sample.z;
+    
+    sampleBuffer[sampleIndex & GESTURE_BUFFER_MASK] = sample;
+    sampleIndex++;
+    
+    previousMagnitudeSq = currentMagnitudeSq;
+    currentMagnitudeSq = magnitudeSquared(sample);
 }
 
 void GestureDetector::clearBuffer() {
-    bufferIndex = 0;
-    memset(gestureBuffer, 0, sizeof(gestureBuffer));
+    sampleIndex = 0;
+    lastSampleTime = 0;
+    currentMagnitudeSq = 0;
+    previousMagnitudeSq = 0;
+    memset(sampleBuffer, 0, sizeof(sampleBuffer));
+    memset(windowSum, 0, sizeof(windowSum));
+    memset(windowSumSq, 0, sizeof(windowSumSq));
+    memset(recentSum, 0, sizeof(recentSum));
+    memset(features, 0, sizeof(features));
+}
+
+void GestureDetector::updateFeatureScales() {
+    // A lower threshold makes the features look stronger to the model
+    tapScale = (int32_t)(256.0f * GESTURE_TAP_THRESHOLD / tapThreshold);
+    swipeScale = (int32_t)(256.0f * GESTURE_SWIPE_THRESHOLD / swipeThreshold);
+    
+    // The shake threshold is a variance, the feature a deviation
+    shakeScale = (int32_t)(256.0f * sqrtf(GESTURE_SHAKE_THRESHOLD / shakeThreshold));
 }
 
 void GestureDetector::setTapThreshold(float threshold) {
     tapThreshold = threshold;
+    updateFeatureScales();
 }
 
 void GestureDetector::setSwipeThreshold(float threshold) {
     swipeThreshold = threshold;
+    updateFeatureScales();
 }
 
 void GestureDetector::setShakeThreshold(float threshold) {
     shakeThreshold = threshold;
+    updateFeatureScales();
 }
 
 void GestureDetector::setGestureTimeout(uint32_t timeoutMs) {
     gestureTimeout = timeoutMs;
 }
 
+void GestureDetector::setHardwareTapEnabled(bool enabled) {
+    hardwareTapEnabled = enabled;
+    
+    if (isInitialized) {
+        configureClickDetection();
+        if (ACCEL_INT1_PIN >= 0) {
+            writeRegister(LIS3DH_REG_CTRL3, LIS3DH_CTRL3_I1_WTM | (enabled ? LIS3DH_CTRL3_I1_CLICK : 0));
+        }
+    }
+}
+
 void GestureDetector::calibrate() {
     if (!isInitialized) {
-        Serial.println("Gesture detector not initialized");
+        LOGGER_ERROR("Gesture detector not initialized");
         return;
     }
     
-    Serial.println("Calibrating gesture detector...");
-    Serial.println("Keep device still for 3 seconds");
+    // Same path as the background calibration, just waited for
+    startCalibration();
     
-    delay(3000);
+    uint32_t startTime = millis();
+    uint32_t timeout = GESTURE_CALIBRATION_SAMPLES * 2000 / ACCEL_ODR_HZ;
+    while (isCalibrating() && millis() - startTime < timeout) {
+        update();
+        delay(10);
+    }
     
-    // Read baseline values
-    AccelData baseline;
-    float totalX = 0, totalY = 0, totalZ = 0;
+    if (isCalibrating()) {
+        calibrationRemaining = 0;
+        LOGGER_ERROR("Calibration timed out");
+    }
+}
+
+void GestureDetector::startCalibration() {
+    if (!isInitialized) {
+        return;
+    }
+    
+    // Non-blocking, averages the next samples read from the FIFO
+    memset(calibrationSum, 0, sizeof(calibrationSum));
+    calibrationRemaining = GESTURE_CALIBRATION_SAMPLES;
+    pendingGesture = GESTURE_NONE;
+    LOGGER_INFO("Calibrating gesture detector, keep device still");
+}
+
+void GestureDetector::finishCalibration() {
+    float scale = 1.0f / ((float)GESTURE_CALIBRATION_SAMPLES * ACCEL_COUNTS_PER_G);
+    baseline.x = calibrationSum[0] * scale;
+    baseline.y = calibrationSum[1] * scale;
+    baseline.z = calibrationSum[2] * scale;
+    baseline.timestamp = lastSampleTime;
+    
+    LOGGER_INFO("Baseline: X=%.3f, Y=%.3f, Z=%.3f", baseline.x, baseline.y, baseline.z);
+    
+    // Lying flat, the only true reading is +1g on Z; the rest is zero-g offset
+    int32_t measured[3];
+    bool accepted = true;
+    for (int axis = 0; axis < 3; axis++) {
+        measured[axis] = calibrationSum[axis] / GESTURE_CALIBRATION_SAMPLES;
+    }
+    measured[2] -= ACCEL_COUNTS_PER_G;
     
-    for (int i = 0; i < 100; i++) {
-        if (readAccelerometer(baseline)) {
-            totalX += baseline.x;
-            totalY += baseline.y;
-            totalZ += baseline.z;
+    for (int axis = 0; axis < 3; axis++) {
+        if (abs(measured[axis]) > (int32_t)(GESTURE_CALIBRATION_MAX_OFFSET * ACCEL_COUNTS_PER_G)) {
+            accepted = false;
         }
-        delay(10);
     }
     
-    // Calculate average baseline
-    AccelData avgBaseline;
-    avgBaseline.x = totalX / 100;
-    avgBaseline.y = totalY / 100;
-    avgBaseline.z = totalZ / 100;
+    if (accepted) {
+        AccelSample zeroOffset = { (int16_t)measured[0], (int16_t)measured[1], (int16_t)measured[2] };
+        setOffset(zeroOffset);
+    } else {
+        LOGGER_WARN("Device was not lying flat, offset kept");
+    }
     
-    Serial.printf("Baseline: X=%.3f, Y=%.3f, Z=%.3f\n", 
-                  avgBaseline.x, avgBaseline.y, avgBaseline.z);
+    if (onCalibrated) {
+        onCalibrated(accepted);
+    }
+}
+
+bool GestureDetector::isCalibrating() {
+    return calibrationRemaining > 0;
+}
+
+void GestureDetector::setOffset(const AccelSample& zeroOffset) {
+    offset = zeroOffset;
     
-    Serial.println("Calibration complete");
+    // The window holds samples with the old correction, a step would look like a swipe
+    clearBuffer();
+    LOGGER_INFO("Accelerometer offset: X=%d, Y=%d, Z=%d counts", offset.x, offset.y, offset.z);
+}
+
+AccelSample GestureDetector::getOffset() {
+    return offset;
+}
+
+AccelData GestureDetector::getBaseline() {
+    return baseline;
 }
 
 void GestureDetector::test() {
     if (!isInitialized) {
-        Serial.println("Gesture detector not initialized");
+        LOGGER_ERROR("Gesture detector not initialized");
         return;
     }
     
-    Serial.println("Testing gesture detection for 10 seconds...");
-    Serial.println("Try tapping, shaking, or swiping the device");
+    LOGGER_INFO("Testing gesture detection for 10 seconds...");
+    LOGGER_INFO("Try tapping, shaking, or swiping the device");
     
     uint32_t startTime = millis();
     while (millis() - startTime < 10000) {
@@ -358,19 +743,44 @@ void GestureDetector::test() {
         
         GestureType gesture = detectGesture();
         if (gesture != GESTURE_NONE) {
-            Serial.printf("Detected gesture: %d\n", gesture);
+            LOGGER_INFO("Detected gesture: %d", gesture);
         }
         
         delay(50);
     }
     
-    Serial.println("Gesture test complete");
+    LOGGER_INFO("Gesture test complete");
 }
 
 AccelData GestureDetector::getCurrentAccel() {
-    return currentAccel;
+    AccelData data;
+    const AccelSample& sample = sampleAt(0);
+    
+    // Convert to g-force only when asked
+    data.x = (float)sample.x / ACCEL_COUNTS_PER_G;
+    data.y = (float)sample.y / ACCEL_COUNTS_PER_G;
+    data.z = (float)sample.z / ACCEL_COUNTS_PER_G;
+    data.timestamp = lastSampleTime;
+    
+    return data;
 }
 
 bool GestureDetector::isReady() {
     return isInitialized;
+}
+
+uint32_t GestureDetector::getFifoOverruns() {
+    return fifoOverruns;
+}
+
+uint32_t GestureDetector::getReadFailures() {
+    return readFailures;
+}
+
+uint8_t GestureDetector::getConfidence() {
+    return lastConfidence;
+}
+
+const int16_t* GestureDetector::getFeatures() {
+    return features;
 }
\ No newline at end of file
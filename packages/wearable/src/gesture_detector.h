@@ -2,8 +2,8 @@
 #define GESTURE_DETECTOR_H
 
 #include <Arduino.h>
-#include <Wire.h>
 #include "config.h"
+#include "gesture_model.h"
 
 enum GestureType {
     GESTURE_NONE,
@@ -15,7 +15,8 @@ enum GestureType {
     GESTURE_SWIPE_RIGHT,
     GESTURE_SHAKE,
     GESTURE_TWIST_CW,
-    GESTURE_TWIST_CCW
+    GESTURE_TWIST_CCW,
+    GESTURE_TYPE_COUNT
 };
 
 struct AccelData {
@@ -25,20 +26,94 @@ struct AccelData {
     uint32_t timestamp;
 };
 
+// Raw LIS3DH output, 16384 counts per g at +/-2g
+struct AccelSample {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+#define ACCEL_COUNTS_PER_G 16384
+#define ACCEL_FIFO_DEPTH 32 // LIS3DH FIFO, samples
+#define GESTURE_BUFFER_SIZE 32 // Power of two
+#define GESTURE_BUFFER_MASK (GESTURE_BUFFER_SIZE - 1)
+#define GESTURE_WINDOW 16 // Samples the features cover, an even count
+#define GESTURE_HALF_WINDOW (GESTURE_WINDOW / 2)
+
+#if GESTURE_WINDOW > GESTURE_BUFFER_SIZE
+#error "The gesture window must fit in the gesture buffer"
+#endif
+
+// Thresholds the default model was built for, in g. The setters scale the
+// matching features relative to these, so the model splits stay as trained.
+#define GESTURE_TAP_THRESHOLD GESTURE_THRESHOLD
+#define GESTURE_SWIPE_THRESHOLD (GESTURE_THRESHOLD * 1.5f)
+#define GESTURE_SHAKE_THRESHOLD (GESTURE_THRESHOLD * 2.0f)
+
 class GestureDetector {
 private:
+    // Test firmware benchmarks time the private hot paths
+    friend class FirmwareBenchmark;
+    
     bool isInitialized;
     
-    // Accelerometer data
-    AccelData currentAccel;
-    AccelData previousAccel;
-    AccelData gestureBuffer[32];
-    size_t bufferIndex;
+    // Raw sample ring, sampleIndex counts every sample ever added
+    AccelSample sampleBuffer[GESTURE_BUFFER_SIZE];
+    uint32_t sampleIndex;
+    uint32_t lastSampleTime;
+    
+    // Running sums updated in O(1) per sample: the whole window, and the
+    // newer half of it
+    uint32_t currentMagnitudeSq;
+    uint32_t previousMagnitudeSq;
+    int32_t windowSum[3];
+    int64_t windowSumSq[3];
+    int32_t recentSum[3];
+    
+    // Feature vector of the newest window and what the model made of it
+    int16_t features[GESTURE_FEATURE_COUNT];
+    uint8_t lastConfidence;
+    
+    // FIFO batching, samples are timestamped from the ODR
+    uint32_t sampleClockBase;
+    uint32_t sampleCount; // Since sampleClockBase, below ACCEL_ODR_HZ
+    uint32_t fifoOverruns;
+    uint32_t readFailures; // Short or NACKed I2C reads
+    
+    // FIFO drain queued on the I2C bus. The bus task fills these while
+    // fifoInFlight is set and raises fifoComplete when it is done.
+    uint8_t fifoSource;
+    uint8_t clickSource;
+    uint8_t fifoData[ACCEL_FIFO_DEPTH * 6];
+    size_t fifoRequested;
+    size_t fifoReceived;
+    size_t fifoBurst;
+    bool fifoInFlight;
+    bool fifoDiscard; // Reconfigured meanwhile, drop what arrives
+    volatile bool fifoFailed;
+    volatile bool fifoComplete;
+    GestureType pendingGesture;
+    bool hardwareTapEnabled;
+    bool wakeOnMotion;
+    
+    // Background calibration, averaged from the regular sample stream.
+    // offset is the zero-g error it found, removed from every sample.
+    uint32_t calibrationRemaining;
+    int32_t calibrationSum[3];
+    AccelData baseline;
+    AccelSample offset;
+    static volatile bool accelInterruptPending;
+    static void IRAM_ATTR onAccelInterrupt();
     
     // Gesture detection parameters
     float tapThreshold;
     float swipeThreshold;
     float shakeThreshold;
+    
+    // The same thresholds as feature scales, Q8
+    int32_t tapScale;
+    int32_t swipeScale;
+    int32_t shakeScale;
     uint32_t gestureTimeout;
     uint32_t lastGestureTime;
     uint32_t lastTapTime;
@@ -48,19 +123,33 @@ private:
     bool readAccelerometer(AccelData& data);
     void writeRegister(uint8_t reg, uint8_t value);
     uint8_t readRegister(uint8_t reg);
+    void configureFifo();
+    void configureClickDetection();
+    void startFifoRead();
+    void collectFifo();
+    void handleClickSource(uint8_t source);
+    void processSample(int16_t rawX, int16_t rawY, int16_t rawZ);
+    void finishCalibration();
     
-    // Gesture analysis
-    GestureType analyzeGestureBuffer();
-    bool detectTap();
+    // FIFO read chain, run by the I2C bus task
+    static void onFifoSourceRead(void* context, bool ok);
+    static void onFifoBurstRead(void* context, bool ok);
+    static void onClickSourceRead(void* context, bool ok);
+    void requestFifoBurst();
+    void finishFifoRead(bool ok);
+    
+    // Gesture analysis, one feature vector and one model run per sample
+    GestureType classifyWindow();
+    void computeFeatures();
     bool detectDoubleTap();
-    GestureType detectSwipe();
-    bool detectShake();
-    GestureType detectTwist();
     
     // Utility functions
-    float calculateMagnitude(const AccelData& data);
-    float calculateDistance(const AccelData& a, const AccelData& b);
-    void addToBuffer(const AccelData& data);
+    static uint32_t magnitudeSquared(const AccelSample& sample);
+    static int16_t toFeature(float value, int32_t scale);
+    static int16_t removeOffset(int16_t raw, int16_t correction);
+    const AccelSample& sampleAt(uint32_t samplesBack);
+    void updateFeatureScales();
+    void addToBuffer(const AccelSample& sample);
     void clearBuffer();
 
 public:
@@ -77,12 +166,42 @@ public:
     void setSwipeThreshold(float threshold);
     void setShakeThreshold(float threshold);
     void setGestureTimeout(uint32_t timeoutMs);
+    void setHardwareTapEnabled(bool enabled);
     
-    // Calibration and testing
+    // Calibration and testing. calibrate() blocks until startCalibration()
+    // is done, for the test firmware. The offset is in raw counts and can be
+    // restored from storage at boot instead of calibrating again.
     void calibrate();
+    void startCalibration();
+    bool isCalibrating();
+    AccelData getBaseline();
+    void setOffset(const AccelSample& zeroOffset);
+    AccelSample getOffset();
     void test();
     AccelData getCurrentAccel();
     bool isReady();
+    uint32_t getFifoOverruns();
+    uint32_t getReadFailures();
+    
+    // Model output for the last gesture returned, percent, and the features
+    // it was classified from
+    uint8_t getConfidence();
+    const int16_t* getFeatures();
+    
+    // Low power activity interrupt on INT1, used as a sleep wake source
+    void setWakeOnMotion(bool enabled);
+    bool isWakeOnMotion();
+    
+    // Called in interrupt context when INT1 fires, must be IRAM safe
+    static void (*onInterrupt)();
+    
+    // Called from the I2C bus task once a FIFO read is done, update()
+    // picks the samples up
+    void (*onSamplesReady)();
+    
+    // Called from update() once startCalibration() is done, accepted is
+    // false when the device was not lying flat and the offset was kept
+    void (*onCalibrated)(bool accepted);
 };
 
 #endif // GESTURE_DETECTOR_H
\ No newline at end of file
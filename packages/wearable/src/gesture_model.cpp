@@ -0,0 +1,36 @@
+#include "gesture_model.h"
+#include "gesture_detector.h"
+
+// Hand-built tree that follows the old threshold cascade: tap, shake, swipe
+// on X then Y, twist. Replace this file with the one exported by the
+// training pipeline; the detector only depends on the features and tables.
+static const GestureTreeNode nodes[] = {
+    GESTURE_SPLIT(GESTURE_FEATURE_MAGNITUDE, 2000, 1, 2),       // 0
+    GESTURE_SPLIT(GESTURE_FEATURE_MOTION, 2000, 3, 4),          // 1
+    GESTURE_SPLIT(GESTURE_FEATURE_MAGNITUDE_JUMP, 650, 1, 5),   // 2: spike, but only a tap if sudden
+    GESTURE_SPLIT(GESTURE_FEATURE_SHIFT_X, 1200, 6, 7),         // 3
+    GESTURE_LEAF(GESTURE_SHAKE, 90),                            // 4
+    GESTURE_LEAF(GESTURE_TAP, 90),                              // 5
+    GESTURE_SPLIT(GESTURE_FEATURE_SHIFT_X, -1200, 8, 9),        // 6
+    GESTURE_LEAF(GESTURE_SWIPE_RIGHT, 80),                      // 7
+    GESTURE_LEAF(GESTURE_SWIPE_LEFT, 80),                       // 8
+    GESTURE_SPLIT(GESTURE_FEATURE_SHIFT_Y, 1200, 10, 11),       // 9
+    GESTURE_SPLIT(GESTURE_FEATURE_SHIFT_Y, -1200, 12, 13),      // 10
+    GESTURE_LEAF(GESTURE_SWIPE_UP, 80),                         // 11
+    GESTURE_LEAF(GESTURE_SWIPE_DOWN, 80),                       // 12
+    GESTURE_SPLIT(GESTURE_FEATURE_ROLL, 500, 14, 15),           // 13
+    GESTURE_SPLIT(GESTURE_FEATURE_ROLL, -500, 16, 17),          // 14
+    GESTURE_LEAF(GESTURE_TWIST_CW, 70),                         // 15
+    GESTURE_LEAF(GESTURE_TWIST_CCW, 70),                        // 16
+    GESTURE_LEAF(GESTURE_NONE, 95)                              // 17
+};
+
+static const uint8_t roots[] = { 0 };
+
+const GestureModel gestureModel = {
+    "cascade",
+    nodes,
+    sizeof(nodes) / sizeof(nodes[0]),
+    roots,
+    sizeof(roots) / sizeof(roots[0])
+};
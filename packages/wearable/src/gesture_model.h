@@ -0,0 +1,48 @@
+#ifndef GESTURE_MODEL_H
+#define GESTURE_MODEL_H
+
+#include <Arduino.h>
+
+// Features computed once per sample over the sliding gesture window, all
+// int16 and updated in O(1) from running sums. Accelerations are in mg.
+enum GestureFeature {
+    GESTURE_FEATURE_MAGNITUDE,      // |a| of the newest sample
+    GESTURE_FEATURE_MAGNITUDE_JUMP, // |a| minus |a| of the sample before
+    GESTURE_FEATURE_MOTION,         // Standard deviation over the window, all axes
+    GESTURE_FEATURE_SHIFT_X,        // Mean of the newer half minus the older half
+    GESTURE_FEATURE_SHIFT_Y,
+    GESTURE_FEATURE_SHIFT_Z,
+    GESTURE_FEATURE_ROLL,           // Sine of the gravity rotation about X between the halves, x1000
+    GESTURE_FEATURE_COUNT
+};
+
+#define GESTURE_TREE_LEAF -1
+#define GESTURE_MODEL_MAX_DEPTH 16 // Longest root to leaf path the classifier follows
+
+// Decision tree node, 6 bytes. Splits go to above when the feature is
+// greater than the threshold and to below otherwise. Leaves carry the
+// gesture in below and its confidence in percent in above.
+struct GestureTreeNode {
+    int8_t feature;     // GestureFeature, GESTURE_TREE_LEAF on leaves
+    uint8_t below;
+    uint8_t above;
+    int16_t threshold;
+};
+
+#define GESTURE_SPLIT(feature, threshold, below, above) { feature, below, above, threshold }
+#define GESTURE_LEAF(gesture, confidence) { GESTURE_TREE_LEAF, gesture, confidence, 0 }
+
+// One or more trees sharing a node table. Each tree votes for a gesture
+// with its leaf confidence; the forest answers with the best summed vote.
+struct GestureModel {
+    const char* name;
+    const GestureTreeNode* nodes;
+    uint8_t nodeCount;
+    const uint8_t* roots;
+    uint8_t treeCount;
+};
+
+// Model tables are exported by the training pipeline into gesture_model.cpp
+extern const GestureModel gestureModel;
+
+#endif // GESTURE_MODEL_H
@@ -1,236 +1,450 @@
 #include "haptic_controller.h"
+#include "logger.h"
+#include "i2c_bus.h"
+
+// DRV2605 register addresses
+#define DRV2605_REG_STATUS 0x00
+#define DRV2605_REG_MODE 0x01
+#define DRV2605_REG_RTPIN 0x02
+#define DRV2605_REG_LIBRARY 0x03
+#define DRV2605_REG_WAVESEQ1 0x04
+#define DRV2605_REG_WAVESEQ2 0x05
+#define DRV2605_REG_GO 0x0C
+#define DRV2605_REG_OVERDRIVE 0x0D
+#define DRV2605_REG_SUSTAINPOS 0x0E
+#define DRV2605_REG_SUSTAINNEG 0x0F
+#define DRV2605_REG_BREAK 0x10
+#define DRV2605_REG_AUDIOMAX 0x13
+#define DRV2605_REG_FEEDBACK 0x1A
+#define DRV2605_REG_CONTROL3 0x1D
+
+// Register bits
+#define DRV2605_GO_BIT 0x01
+#define DRV2605_MODE_INTTRIG 0x00 // Internal trigger, out of standby
+#define DRV2605_FEEDBACK_LRA 0x80
+#define DRV2605_CONTROL3_ERM_OPEN_LOOP 0x20
+#define DRV2605_LIBRARY_ERM_A 1
+
+// Power-on setup for an ERM motor, the same values the Adafruit library writes
+static const uint8_t drv2605Setup[][2] = {
+    { DRV2605_REG_MODE, DRV2605_MODE_INTTRIG },
+    { DRV2605_REG_RTPIN, 0x00 },
+    { DRV2605_REG_WAVESEQ1, 1 },
+    { DRV2605_REG_WAVESEQ2, 0 },
+    { DRV2605_REG_OVERDRIVE, 0 },
+    { DRV2605_REG_SUSTAINPOS, 0 },
+    { DRV2605_REG_SUSTAINNEG, 0 },
+    { DRV2605_REG_BREAK, 0 },
+    { DRV2605_REG_AUDIOMAX, 0x64 },
+    { DRV2605_REG_LIBRARY, DRV2605_LIBRARY_ERM_A },
+};
+
+// Indexed by HapticPattern. Effects are DRV2605 library 1 waveform ids,
+// pauses between them are sequencer wait entries so no delay() is needed.
+static const HapticSequence hapticSequences[] = {
+    // HAPTIC_STARTUP: gentle ascending pattern
+    { {2, HAPTIC_WAIT(100), 4, HAPTIC_WAIT(100), 6, HAPTIC_WAIT(100), 8}, 7, HAPTIC_PRIORITY_NORMAL },
+    // HAPTIC_CONFIRMATION: double pulse
+    { {HAPTIC_CONFIRMATION_EFFECT}, 1, HAPTIC_PRIORITY_NORMAL },
+    // HAPTIC_ERROR: strong buzz
+    { {HAPTIC_ERROR_EFFECT}, 1, HAPTIC_PRIORITY_HIGH },
+    // HAPTIC_CLICK: light click
+    { {HAPTIC_CLICK_EFFECT}, 1, HAPTIC_PRIORITY_LOW },
+    // HAPTIC_DOUBLE_CLICK: two quick clicks
+    { {HAPTIC_CLICK_EFFECT, HAPTIC_WAIT(50), HAPTIC_CLICK_EFFECT}, 3, HAPTIC_PRIORITY_LOW },
+    // HAPTIC_LONG_PRESS: long vibration
+    { {HAPTIC_LONG_PRESS_EFFECT}, 1, HAPTIC_PRIORITY_LOW },
+    // HAPTIC_WAKE_WORD: soft fuzz
+    { {10}, 1, HAPTIC_PRIORITY_NORMAL },
+    // HAPTIC_RECORDING_START: rising
+    { {1, HAPTIC_WAIT(50), 3, HAPTIC_WAIT(50), 5}, 5, HAPTIC_PRIORITY_NORMAL },
+    // HAPTIC_RECORDING_STOP: falling
+    { {5, HAPTIC_WAIT(50), 3, HAPTIC_WAIT(50), 1}, 5, HAPTIC_PRIORITY_NORMAL },
+    // HAPTIC_LOW_BATTERY: strong buzz repeated
+    { {58, HAPTIC_WAIT(200), 58, HAPTIC_WAIT(200), 58}, 5, HAPTIC_PRIORITY_HIGH },
+    // HAPTIC_GESTURE_TAP: sharp click
+    { {14}, 1, HAPTIC_PRIORITY_LOW },
+    // HAPTIC_GESTURE_SWIPE: soft bump
+    { {12}, 1, HAPTIC_PRIORITY_LOW },
+    // HAPTIC_GESTURE_SHAKE: buzz
+    { {47}, 1, HAPTIC_PRIORITY_LOW },
+};
+
+// Indexed by HapticPattern
+static const char* const hapticPatternNames[] = {
+    "startup",
+    "confirmation",
+    "error",
+    "click",
+    "double_click",
+    "long_press",
+    "wake_word",
+    "recording_start",
+    "recording_stop",
+    "low_battery",
+    "gesture_tap",
+    "gesture_swipe",
+    "gesture_shake",
+};
+
+#define HAPTIC_PATTERN_COUNT (sizeof(hapticPatternNames) / sizeof(hapticPatternNames[0]))
 
 HapticController::HapticController() {
     isInitialized = false;
-    lastFeedbackTime = 0;
-    feedbackCooldown = 100; // 100ms cooldown between feedback
+    queueCount = 0;
+    playing = false;
+    currentPattern = HAPTIC_CLICK;
+    currentPriority = HAPTIC_PRIORITY_LOW;
+    droppedPatterns = 0;
+    goRegister = 0;
+    statusInFlight = false;
+    statusReady = false;
+    sequencerRunning = false;
+    sequenceCount = 0;
+    statusSequence = 0;
+    onPending = nullptr;
 }
 
 bool HapticController::begin() {
-    Serial.println("Initializing Haptic Controller...");
+    LOGGER_INFO("Initializing Haptic Controller...");
     
-    // Initialize I2C
-    Wire.begin(HAPTIC_SDA_PIN, HAPTIC_SCL_PIN);
+    // Shared with the accelerometer, whichever starts first brings it up
+    if (!I2CBus::begin()) {
+        return false;
+    }
     
     // Initialize DRV2605 haptic driver
-    if (!drv.begin()) {
-        Serial.println("Failed to initialize DRV2605 haptic driver");
+    if (!initializeDriver()) {
+        LOGGER_ERROR("Failed to initialize DRV2605 haptic driver");
         return false;
     }
     
-    // Select library
-    drv.selectLibrary(1);
+    isInitialized = true;
+    LOGGER_INFO("Haptic Controller initialized successfully");
+    
+    return true;
+}
+
+bool HapticController::initializeDriver() {
+    // Any answer on the status register means the driver is there
+    uint8_t status;
+    if (!I2CBus::readRegisters(HAPTIC_I2C_ADDRESS, DRV2605_REG_STATUS, &status, 1)) {
+        return false;
+    }
     
-    // Set mode to internal trigger
-    drv.setMode(DRV2605_MODE_INTTRIG);
+    for (size_t i = 0; i < sizeof(drv2605Setup) / sizeof(drv2605Setup[0]); i++) {
+        if (!I2CBus::writeRegister(HAPTIC_I2C_ADDRESS, drv2605Setup[i][0], drv2605Setup[i][1])) {
+            return false;
+        }
+    }
     
-    isInitialized = true;
-    Serial.println("Haptic Controller initialized successfully");
+    // ERM in open loop
+    uint8_t feedback = I2CBus::readRegister(HAPTIC_I2C_ADDRESS, DRV2605_REG_FEEDBACK);
+    I2CBus::writeRegister(HAPTIC_I2C_ADDRESS, DRV2605_REG_FEEDBACK, feedback & ~DRV2605_FEEDBACK_LRA);
+    uint8_t control = I2CBus::readRegister(HAPTIC_I2C_ADDRESS, DRV2605_REG_CONTROL3);
+    I2CBus::writeRegister(HAPTIC_I2C_ADDRESS, DRV2605_REG_CONTROL3, control | DRV2605_CONTROL3_ERM_OPEN_LOOP);
     
     return true;
 }
 
 void HapticController::end() {
+    clear();
     isInitialized = false;
 }
 
-void HapticController::playEffect(uint8_t effect) {
-    if (!isInitialized) {
-        return;
+const HapticSequence& HapticController::getSequence(HapticPattern pattern) {
+    size_t index = (size_t)pattern;
+    if (index >= sizeof(hapticSequences) / sizeof(hapticSequences[0])) {
+        index = HAPTIC_CLICK;
     }
-    
-    // Check cooldown
-    if (millis() - lastFeedbackTime < feedbackCooldown) {
-        return;
+    return hapticSequences[index];
+}
+
+bool HapticController::isSequencerRunning() {
+    // GO stays set until the last slot has played. Each call answers from the
+    // previous read and queues the next one, so the loop never waits on the bus.
+    if (statusInFlight) {
+        if (!statusReady) {
+            return true;
+        }
+        statusInFlight = false;
+        
+        if (statusSequence == sequenceCount && !sequencerRunning) {
+            return false;
+        }
     }
     
-    drv.setWaveform(0, effect);
-    drv.setWaveform(1, 0); // End waveform
-    drv.go();
+    statusSequence = sequenceCount;
+    statusReady = false;
+    statusInFlight = I2CBus::readRegistersAsync(HAPTIC_I2C_ADDRESS, DRV2605_REG_GO, &goRegister, 1, onStatusRead, this);
+    return true;
+}
+
+void HapticController::onStatusRead(void* context, bool ok) {
+    HapticController* controller = (HapticController*)context;
     
-    lastFeedbackTime = millis();
+    // A failed read counts as finished, so a bus error cannot wedge the queue
+    controller->sequencerRunning = ok && (controller->goRegister & DRV2605_GO_BIT);
+    controller->statusReady = true;
 }
 
-void HapticController::playCustomPattern(uint8_t* effects, size_t count, uint16_t* delays) {
-    if (!isInitialized || count == 0) {
-        return;
+void HapticController::startSequence(HapticPattern pattern) {
+    const HapticSequence& sequence = getSequence(pattern);
+    
+    // All slots in one auto-increment write, then GO, both queued in order
+    uint8_t slots[HAPTIC_SEQUENCE_SLOTS];
+    memcpy(slots, sequence.steps, sequence.length);
+    size_t length = sequence.length;
+    if (length < HAPTIC_SEQUENCE_SLOTS) {
+        slots[length++] = 0; // End of sequence
     }
     
-    // Check cooldown
-    if (millis() - lastFeedbackTime < feedbackCooldown) {
+    uint8_t go = DRV2605_GO_BIT;
+    if (!I2CBus::writeRegistersAsync(HAPTIC_I2C_ADDRESS, DRV2605_REG_WAVESEQ1, slots, length) ||
+        !I2CBus::writeRegistersAsync(HAPTIC_I2C_ADDRESS, DRV2605_REG_GO, &go, 1)) {
+        droppedPatterns++;
         return;
     }
     
-    for (size_t i = 0; i < count && i < 8; i++) {
-        drv.setWaveform(i, effects[i]);
-        if (i < count - 1 && delays && delays[i] > 0) {
-            // Add delay between effects if specified
-            drv.setWaveform(i + 1, 0); // Pause
+    sequenceCount++;
+    playing = true;
+    currentPattern = pattern;
+    currentPriority = sequence.priority;
+}
+
+bool HapticController::playPattern(HapticPattern pattern) {
+    if (!isInitialized) {
+        return false;
+    }
+    
+    HapticPriority priority = getSequence(pattern).priority;
+    
+    // Coalesce: the same pattern already waiting covers this request
+    for (size_t i = 0; i < queueCount; i++) {
+        if (queue[i].pattern == pattern) {
+            return true;
         }
     }
-    drv.setWaveform(count < 8 ? count : 7, 0); // End waveform
-    drv.go();
     
-    // If delays are specified, handle them manually
-    if (delays) {
-        for (size_t i = 0; i < count - 1; i++) {
-            if (delays[i] > 0) {
-                delay(delays[i]);
+    // Urgent patterns cut off whatever lower priority pattern is playing
+    if (playing && priority == HAPTIC_PRIORITY_HIGH && currentPriority < HAPTIC_PRIORITY_HIGH) {
+        stopSequence();
+        playing = false;
+    }
+    
+    // Queue full: make room by evicting the oldest entry of lower priority
+    if (queueCount == HAPTIC_QUEUE_SIZE) {
+        size_t victim = HAPTIC_QUEUE_SIZE;
+        for (size_t i = 0; i < queueCount; i++) {
+            if (queue[i].priority < priority && (victim == HAPTIC_QUEUE_SIZE || queue[i].priority < queue[victim].priority)) {
+                victim = i;
             }
         }
+        
+        if (victim == HAPTIC_QUEUE_SIZE) {
+            droppedPatterns++;
+            return false;
+        }
+        removeAt(victim);
+        droppedPatterns++;
+    }
+    
+    queue[queueCount].pattern = pattern;
+    queue[queueCount].priority = priority;
+    queue[queueCount].queuedAt = millis();
+    queueCount++;
+    
+    // Start right away when the sequencer is free
+    update();
+    
+    if (onPending) {
+        onPending();
+    }
+    
+    return true;
+}
+
+bool HapticController::dequeue(HapticQueueEntry& entry) {
+    uint32_t now = millis();
+    
+    // Feedback for an input that happened long ago is confusing, drop it
+    for (size_t i = 0; i < queueCount;) {
+        if (queue[i].priority == HAPTIC_PRIORITY_LOW && now - queue[i].queuedAt > HAPTIC_STALE_MS) {
+            removeAt(i);
+            droppedPatterns++;
+        } else {
+            i++;
+        }
+    }
+    
+    if (queueCount == 0) {
+        return false;
+    }
+    
+    // Highest priority first, first in first out within a priority
+    size_t best = 0;
+    for (size_t i = 1; i < queueCount; i++) {
+        if (queue[i].priority > queue[best].priority) {
+            best = i;
+        }
+    }
+    
+    entry = queue[best];
+    removeAt(best);
+    return true;
+}
+
+void HapticController::stopSequence() {
+    uint8_t stop = 0;
+    I2CBus::writeRegistersAsync(HAPTIC_I2C_ADDRESS, DRV2605_REG_GO, &stop, 1);
+}
+
+void HapticController::removeAt(size_t index) {
+    for (size_t i = index; i + 1 < queueCount; i++) {
+        queue[i] = queue[i + 1];
+    }
+    queueCount--;
+}
+
+void HapticController::update() {
+    if (!isInitialized) {
+        return;
+    }
+    
+    if (playing) {
+        if (isSequencerRunning()) {
+            return;
+        }
+        playing = false;
     }
     
-    lastFeedbackTime = millis();
+    HapticQueueEntry entry;
+    if (dequeue(entry)) {
+        startSequence(entry.pattern);
+    }
 }
 
 void HapticController::playStartupPattern() {
-    // Gentle ascending pattern for startup
-    uint8_t effects[] = {2, 4, 6, 8};
-    uint16_t delays[] = {100, 100, 100, 0};
-    playCustomPattern(effects, 4, delays);
+    playPattern(HAPTIC_STARTUP);
 }
 
 void HapticController::playConfirmationPattern() {
-    // Double pulse for confirmation
-    playEffect(HAPTIC_CONFIRMATION_EFFECT);
+    playPattern(HAPTIC_CONFIRMATION);
 }
 
 void HapticController::playErrorPattern() {
-    // Strong buzz for error
-    playEffect(HAPTIC_ERROR_EFFECT);
+    playPattern(HAPTIC_ERROR);
 }
 
 void HapticController::playClickPattern() {
-    // Light click
-    playEffect(HAPTIC_CLICK_EFFECT);
+    playPattern(HAPTIC_CLICK);
 }
 
 void HapticController::playDoubleClickPattern() {
-    // Two quick clicks
-    uint8_t effects[] = {HAPTIC_CLICK_EFFECT, HAPTIC_CLICK_EFFECT};
-    uint16_t delays[] = {50, 0};
-    playCustomPattern(effects, 2, delays);
+    playPattern(HAPTIC_DOUBLE_CLICK);
 }
 
 void HapticController::playLongPressPattern() {
-    // Long vibration for long press
-    playEffect(HAPTIC_LONG_PRESS_EFFECT);
+    playPattern(HAPTIC_LONG_PRESS);
 }
 
 void HapticController::playWakeWordPattern() {
-    // Gentle pulse for wake word detection
-    playEffect(10); // Soft fuzz effect
+    playPattern(HAPTIC_WAKE_WORD);
 }
 
 void HapticController::playRecordingStartPattern() {
-    // Rising pattern for recording start
-    uint8_t effects[] = {1, 3, 5};
-    uint16_t delays[] = {50, 50, 0};
-    playCustomPattern(effects, 3, delays);
+    playPattern(HAPTIC_RECORDING_START);
 }
 
 void HapticController::playRecordingStopPattern() {
-    // Falling pattern for recording stop
-    uint8_t effects[] = {5, 3, 1};
-    uint16_t delays[] = {50, 50, 0};
-    playCustomPattern(effects, 3, delays);
+    playPattern(HAPTIC_RECORDING_STOP);
 }
 
 void HapticController::playLowBatteryPattern() {
-    // Urgent pattern for low battery
-    uint8_t effects[] = {58, 58, 58}; // Strong buzz repeated
-    uint16_t delays[] = {200, 200, 0};
-    playCustomPattern(effects, 3, delays);
+    playPattern(HAPTIC_LOW_BATTERY);
 }
 
 void HapticController::playGesturePattern(GestureType gesture) {
     switch (gesture) {
         case GESTURE_TAP:
-            playEffect(14); // Sharp click
+            playPattern(HAPTIC_GESTURE_TAP);
             break;
         case GESTURE_DOUBLE_TAP:
-            playDoubleClickPattern();
+            playPattern(HAPTIC_DOUBLE_CLICK);
             break;
         case GESTURE_SWIPE_UP:
         case GESTURE_SWIPE_DOWN:
         case GESTURE_SWIPE_LEFT:
         case GESTURE_SWIPE_RIGHT:
-            playEffect(12); // Soft bump
+            playPattern(HAPTIC_GESTURE_SWIPE);
             break;
         case GESTURE_SHAKE:
-            playEffect(47); // Buzz
+            playPattern(HAPTIC_GESTURE_SHAKE);
             break;
         default:
-            playClickPattern();
+            playPattern(HAPTIC_CLICK);
             break;
     }
 }
 
-void HapticController::playPattern(HapticPattern pattern) {
-    switch (pattern) {
-        case HAPTIC_STARTUP:
-            playStartupPattern();
-            break;
-        case HAPTIC_CONFIRMATION:
-            playConfirmationPattern();
-            break;
-        case HAPTIC_ERROR:
-            playErrorPattern();
-            break;
-        case HAPTIC_CLICK:
-            playClickPattern();
-            break;
-        case HAPTIC_DOUBLE_CLICK:
-            playDoubleClickPattern();
-            break;
-        case HAPTIC_LONG_PRESS:
-            playLongPressPattern();
-            break;
-        case HAPTIC_WAKE_WORD:
-            playWakeWordPattern();
-            break;
-        case HAPTIC_RECORDING_START:
-            playRecordingStartPattern();
-            break;
-        case HAPTIC_RECORDING_STOP:
-            playRecordingStopPattern();
-            break;
-        case HAPTIC_LOW_BATTERY:
-            playLowBatteryPattern();
-            break;
-        default:
-            playClickPattern();
-            break;
+bool HapticController::isReady() {
+    return isInitialized;
+}
+
+bool HapticController::isBusy() {
+    return playing || queueCount > 0;
+}
+
+void HapticController::clear() {
+    if (isInitialized && playing) {
+        stopSequence();
     }
+    queueCount = 0;
+    playing = false;
 }
 
-bool HapticController::isReady() {
-    return isInitialized && (millis() - lastFeedbackTime >= feedbackCooldown);
+bool HapticController::parsePatternName(const char* name, HapticPattern& pattern) {
+    for (size_t i = 0; i < HAPTIC_PATTERN_COUNT; i++) {
+        if (strcmp(name, hapticPatternNames[i]) == 0) {
+            pattern = (HapticPattern)i;
+            return true;
+        }
+    }
+    
+    char* end;
+    long index = strtol(name, &end, 10);
+    if (end != name && *end == '\0' && index >= 0 && index < (long)HAPTIC_PATTERN_COUNT) {
+        pattern = (HapticPattern)index;
+        return true;
+    }
+    
+    return false;
 }
 
-void HapticController::setCooldown(uint32_t cooldownMs) {
-    feedbackCooldown = cooldownMs;
+uint32_t HapticController::getDroppedPatterns() {
+    return droppedPatterns;
 }
 
 void HapticController::test() {
     if (!isInitialized) {
-        Serial.println("Haptic controller not initialized");
+        LOGGER_ERROR("Haptic controller not initialized");
         return;
     }
     
-    Serial.println("Testing haptic patterns...");
-    
-    playStartupPattern();
-    delay(1000);
-    
-    playConfirmationPattern();
-    delay(500);
+    LOGGER_INFO("Testing haptic patterns...");
     
-    playErrorPattern();
-    delay(500);
+    HapticPattern patterns[] = {HAPTIC_STARTUP, HAPTIC_CONFIRMATION, HAPTIC_ERROR, HAPTIC_CLICK};
     
-    playClickPattern();
-    delay(500);
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        playPattern(patterns[i]);
+        
+        // Drive the queue until the pattern has played
+        while (isBusy()) {
+            update();
+            delay(HAPTIC_UPDATE_INTERVAL_MS);
+        }
+        delay(300);
+    }
     
-    Serial.println("Haptic test complete");
-}
\ No newline at end of file
+    LOGGER_INFO("Haptic test complete");
+}
@@ -2,8 +2,6 @@
 #define HAPTIC_CONTROLLER_H
 
 #include <Arduino.h>
-#include <Wire.h>
-#include <Adafruit_DRV2605.h>
 #include "config.h"
 #include "gesture_detector.h"
 
@@ -23,22 +21,68 @@ enum HapticPattern {
     HAPTIC_GESTURE_SHAKE
 };
 
+enum HapticPriority {
+    HAPTIC_PRIORITY_LOW,    // Input feedback, dropped when stale
+    HAPTIC_PRIORITY_NORMAL, // State changes
+    HAPTIC_PRIORITY_HIGH    // Errors and warnings, interrupt anything playing
+};
+
+// Wait entry for the DRV2605 sequencer, 10ms units up to 1270ms
+#define HAPTIC_WAIT(ms) (0x80 | (((ms) / 10) & 0x7F))
+#define HAPTIC_SEQUENCE_SLOTS 8
+
+// A pattern compiled to the DRV2605's 8-slot waveform sequencer
+struct HapticSequence {
+    uint8_t steps[HAPTIC_SEQUENCE_SLOTS];
+    uint8_t length;
+    HapticPriority priority;
+};
+
+struct HapticQueueEntry {
+    HapticPattern pattern;
+    HapticPriority priority;
+    uint32_t queuedAt;
+};
+
 class HapticController {
 private:
-    Adafruit_DRV2605 drv;
     bool isInitialized;
-    uint32_t lastFeedbackTime;
-    uint32_t feedbackCooldown;
     
-    void playEffect(uint8_t effect);
-    void playCustomPattern(uint8_t* effects, size_t count, uint16_t* delays);
+    // Patterns waiting for the sequencer, played highest priority first
+    HapticQueueEntry queue[HAPTIC_QUEUE_SIZE];
+    size_t queueCount;
+    bool playing;
+    HapticPattern currentPattern;
+    HapticPriority currentPriority;
+    uint32_t droppedPatterns;
+    
+    // GO register polled through the I2C bus without waiting for it. A
+    // read queued before the current sequence started is not trusted.
+    uint8_t goRegister;
+    bool statusInFlight;
+    volatile bool statusReady;
+    volatile bool sequencerRunning;
+    uint32_t sequenceCount;
+    uint32_t statusSequence;
+    static void onStatusRead(void* context, bool ok);
+    
+    bool initializeDriver();
+    void stopSequence();
+    static const HapticSequence& getSequence(HapticPattern pattern);
+    bool isSequencerRunning();
+    void startSequence(HapticPattern pattern);
+    bool dequeue(HapticQueueEntry& entry);
+    void removeAt(size_t index);
 
 public:
     HapticController();
     bool begin();
     void end();
     
-    // Pattern playback methods
+    // Starts the next queued pattern once the current one has finished
+    void update();
+    
+    // Pattern playback methods, all return immediately
     void playStartupPattern();
     void playConfirmationPattern();
     void playErrorPattern();
@@ -51,13 +95,21 @@ public:
     void playLowBatteryPattern();
     void playGesturePattern(GestureType gesture);
     
-    // Generic pattern method
-    void playPattern(HapticPattern pattern);
+    // Generic pattern method, returns false if the pattern was dropped
+    bool playPattern(HapticPattern pattern);
+    
+    // Pattern names used by the haptic_feedback command, a number also works
+    static bool parsePatternName(const char* name, HapticPattern& pattern);
     
     // Utility methods
     bool isReady();
-    void setCooldown(uint32_t cooldownMs);
+    bool isBusy();
+    void clear();
+    uint32_t getDroppedPatterns();
     void test();
+    
+    // Called when a pattern is queued, so the owner can start polling update()
+    void (*onPending)();
 };
 
 #endif // HAPTIC_CONTROLLER_H
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "i2c_bus.h"
+#include "logger.h"
+
+bool I2CBus::initialized = false;
+uint32_t I2CBus::errorCount = 0;
+uint32_t I2CBus::queueFullCount = 0;
+
+#if I2C_BUS_TASK
+QueueHandle_t I2CBus::queue = nullptr;
+SemaphoreHandle_t I2CBus::mutex = nullptr;
+#endif
+
+bool I2CBus::begin() {
+    if (initialized) {
+        return true;
+    }
+    
+    if (!Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN, I2C_BUS_FREQUENCY)) {
+        LOGGER_ERROR("Failed to start I2C bus");
+        return false;
+    }
+
+#if I2C_BUS_TASK
+    queue = xQueueCreate(I2C_BUS_QUEUE_SIZE, sizeof(I2CTransaction));
+    mutex = xSemaphoreCreateMutex();
+    if (!queue || !mutex) {
+        LOGGER_ERROR("Failed to allocate I2C bus queue");
+        return false;
+    }
+    
+    BaseType_t result = xTaskCreatePinnedToCore(
+        taskEntry,
+        "i2c_bus",
+        I2C_BUS_TASK_STACK_SIZE,
+        nullptr,
+        I2C_BUS_TASK_PRIORITY,
+        nullptr,
+        I2C_BUS_TASK_CORE
+    );
+    if (result != pdPASS) {
+        LOGGER_ERROR("Failed to start I2C bus task");
+        return false;
+    }
+#endif
+
+    initialized = true;
+    LOGGER_INFO("I2C bus at %u kHz", I2C_BUS_FREQUENCY / 1000);
+    return true;
+}
+
+bool I2CBus::isReady() {
+    return initialized;
+}
+
+#if I2C_BUS_TASK
+void I2CBus::taskEntry(void* param) {
+    I2CTransaction transaction;
+    
+    while (true) {
+        if (xQueueReceive(queue, &transaction, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        
+        bool ok = run(transaction);
+        
+        // Outside the lock, completions may queue the next transaction
+        if (transaction.onComplete) {
+            transaction.onComplete(transaction.context, ok);
+        }
+    }
+}
+#endif
+
+bool I2CBus::run(const I2CTransaction& transaction) {
+#if I2C_BUS_TASK
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool ok = execute(transaction);
+    xSemaphoreGive(mutex);
+    return ok;
+#else
+    return execute(transaction);
+#endif
+}
+
+bool I2CBus::execute(const I2CTransaction& transaction) {
+    Wire.beginTransmission(transaction.address);
+    for (uint8_t i = 0; i < transaction.txLength; i++) {
+        Wire.write(transaction.tx[i]);
+    }
+    
+    // Repeated start when a read follows
+    bool ok = Wire.endTransmission(transaction.rxLength == 0) == 0;
+    
+    if (ok && transaction.rxLength > 0) {
+        Wire.requestFrom((int)transaction.address, (int)transaction.rxLength);
+        if (Wire.available() < (int)transaction.rxLength) {
+            ok = false;
+        } else {
+            for (size_t i = 0; i < transaction.rxLength; i++) {
+                transaction.rx[i] = Wire.read();
+            }
+        }
+    }
+    
+    if (!ok) {
+        errorCount++;
+    }
+    return ok;
+}
+
+bool I2CBus::submit(const I2CTransaction& transaction) {
+    if (!initialized) {
+        return false;
+    }
+
+#if I2C_BUS_TASK
+    if (xQueueSend(queue, &transaction, 0) != pdTRUE) {
+        queueFullCount++;
+        return false;
+    }
+#else
+    bool ok = execute(transaction);
+    if (transaction.onComplete) {
+        transaction.onComplete(transaction.context, ok);
+    }
+#endif
+    return true;
+}
+
+bool I2CBus::writeRegistersAsync(uint8_t address, uint8_t reg, const uint8_t* data, size_t length,
+                                 I2CCompletion onComplete, void* context) {
+    if (length + 1 > I2C_BUS_MAX_WRITE) {
+        return false;
+    }
+    
+    I2CTransaction transaction;
+    transaction.address = address;
+    transaction.txLength = length + 1;
+    transaction.tx[0] = reg;
+    memcpy(transaction.tx + 1, data, length);
+    transaction.rx = nullptr;
+    transaction.rxLength = 0;
+    transaction.onComplete = onComplete;
+    transaction.context = context;
+    return submit(transaction);
+}
+
+bool I2CBus::readRegistersAsync(uint8_t address, uint8_t reg, uint8_t* data, size_t length,
+                                I2CCompletion onComplete, void* context) {
+    I2CTransaction transaction;
+    transaction.address = address;
+    transaction.txLength = 1;
+    transaction.tx[0] = reg;
+    transaction.rx = data;
+    transaction.rxLength = length;
+    transaction.onComplete = onComplete;
+    transaction.context = context;
+    return submit(transaction);
+}
+
+bool I2CBus::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+    return writeRegisters(address, reg, &value, 1);
+}
+
+bool I2CBus::writeRegisters(uint8_t address, uint8_t reg, const uint8_t* data, size_t length) {
+    if (!initialized || length + 1 > I2C_BUS_MAX_WRITE) {
+        return false;
+    }
+    
+    I2CTransaction transaction;
+    transaction.address = address;
+    transaction.txLength = length + 1;
+    transaction.tx[0] = reg;
+    memcpy(transaction.tx + 1, data, length);
+    transaction.rx = nullptr;
+    transaction.rxLength = 0;
+    return run(transaction);
+}
+
+bool I2CBus::readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t length) {
+    if (!initialized) {
+        return false;
+    }
+    
+    I2CTransaction transaction;
+    transaction.address = address;
+    transaction.txLength = 1;
+    transaction.tx[0] = reg;
+    transaction.rx = data;
+    transaction.rxLength = length;
+    return run(transaction);
+}
+
+uint8_t I2CBus::readRegister(uint8_t address, uint8_t reg) {
+    uint8_t value = 0;
+    if (!readRegisters(address, reg, &value, 1)) {
+        return 0;
+    }
+    return value;
+}
+
+uint32_t I2CBus::getErrors() {
+    return errorCount;
+}
+
+uint32_t I2CBus::getQueueFull() {
+    return queueFullCount;
+}
@@ -0,0 +1,74 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "config.h"
+
+#if I2C_BUS_TASK
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
+
+// Called once a queued transaction is done, from the bus task
+typedef void (*I2CCompletion)(void* context, bool ok);
+
+// Register write of up to I2C_BUS_MAX_WRITE bytes, then an optional read
+// after a repeated start. The write bytes are copied when queued; rx must
+// stay valid until the completion runs.
+struct I2CTransaction {
+    uint8_t address;
+    uint8_t txLength;
+    uint8_t tx[I2C_BUS_MAX_WRITE];
+    uint8_t* rx;
+    size_t rxLength;
+    I2CCompletion onComplete;
+    void* context;
+};
+
+// Sole owner of the shared Wire bus (LIS3DH and DRV2605) in fast mode.
+// Queued transactions run one after another in the bus task, so a long
+// FIFO burst no longer holds up the main loop. The blocking helpers are
+// for setup and rare configuration writes and wait for the bus in turn.
+// With I2C_BUS_TASK 0 (host builds) everything runs inline in the caller.
+class I2CBus {
+private:
+    static bool initialized;
+    static uint32_t errorCount;
+    static uint32_t queueFullCount;
+
+#if I2C_BUS_TASK
+    static QueueHandle_t queue;
+    static SemaphoreHandle_t mutex;
+    static void taskEntry(void* param);
+#endif
+
+    static bool execute(const I2CTransaction& transaction);
+    static bool run(const I2CTransaction& transaction);
+
+public:
+    // Safe to call from every driver, the first call brings the bus up
+    static bool begin();
+    static bool isReady();
+    
+    // Queued, false when the queue is full. onComplete may be null.
+    static bool submit(const I2CTransaction& transaction);
+    static bool writeRegistersAsync(uint8_t address, uint8_t reg, const uint8_t* data, size_t length,
+                                    I2CCompletion onComplete = nullptr, void* context = nullptr);
+    static bool readRegistersAsync(uint8_t address, uint8_t reg, uint8_t* data, size_t length,
+                                   I2CCompletion onComplete, void* context);
+    
+    // Blocking, serialized with the queued transactions
+    static bool writeRegister(uint8_t address, uint8_t reg, uint8_t value);
+    static bool writeRegisters(uint8_t address, uint8_t reg, const uint8_t* data, size_t length);
+    static bool readRegisters(uint8_t address, uint8_t reg, uint8_t* data, size_t length);
+    static uint8_t readRegister(uint8_t address, uint8_t reg); // 0 on failure
+    
+    // NACKs and short reads, transactions refused because the queue was full
+    static uint32_t getErrors();
+    static uint32_t getQueueFull();
+};
+
+#endif // I2C_BUS_H
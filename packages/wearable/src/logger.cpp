@@ -0,0 +1,156 @@
+#include "logger.h"
+#include <stdarg.h>
+
+#if LOGGER_DEFERRED
+static_assert((LOGGER_RING_SLOTS & (LOGGER_RING_SLOTS - 1)) == 0, "LOGGER_RING_SLOTS must be a power of two");
+
+LoggerRecord Logger::records[LOGGER_RING_SLOTS];
+std::atomic<uint32_t> Logger::head(0);
+std::atomic<uint32_t> Logger::tail(0);
+std::atomic<uint32_t> Logger::droppedLines(0);
+uint32_t Logger::reportedDrops = 0;
+std::atomic<bool> Logger::deferred(false);
+TaskHandle_t Logger::task = nullptr;
+SemaphoreHandle_t Logger::flushMutex = nullptr;
+#endif
+
+bool Logger::begin() {
+#if LOGGER_DEFERRED
+    if (deferred.load()) {
+        return true;
+    }
+    
+    for (uint32_t i = 0; i < LOGGER_RING_SLOTS; i++) {
+        records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    
+    flushMutex = xSemaphoreCreateMutex();
+    if (!flushMutex) {
+        Serial.println("Failed to allocate logger mutex, logging in place");
+        return false;
+    }
+    
+    BaseType_t result = xTaskCreatePinnedToCore(
+        taskEntry,
+        "logger",
+        LOGGER_TASK_STACK_SIZE,
+        nullptr,
+        LOGGER_TASK_PRIORITY,
+        &task,
+        LOGGER_TASK_CORE
+    );
+    if (result != pdPASS) {
+        Serial.println("Failed to start logger task, logging in place");
+        return false;
+    }
+    
+    deferred.store(true, std::memory_order_release);
+#endif
+    return true;
+}
+
+void Logger::write(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+
+#if LOGGER_DEFERRED
+    if (deferred.load(std::memory_order_acquire)) {
+        // Claim the slot at head once it is free, i.e. the flush task is a
+        // whole ring behind at most
+        uint32_t position = head.load(std::memory_order_relaxed);
+        LoggerRecord* record;
+        while (true) {
+            record = &records[position & (LOGGER_RING_SLOTS - 1)];
+            int32_t lag = (int32_t)(record->sequence.load(std::memory_order_acquire) - position);
+            if (lag == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lag < 0) {
+                droppedLines.fetch_add(1, std::memory_order_relaxed);
+                va_end(args);
+                return;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+        
+        int length = vsnprintf(record->text, LOGGER_LINE_SIZE - 1, format, args);
+        va_end(args);
+        length = constrain(length, 0, LOGGER_LINE_SIZE - 2);
+        record->text[length] = '\n';
+        record->length = length + 1;
+        record->sequence.store(position + 1);
+        
+        // The flush task only sleeps once it reached an unwritten slot, and
+        // only the writer of that slot has to wake it. Sequentially
+        // consistent with the flush task's tail store and slot load, so one
+        // of the two always sees the other.
+        if (tail.load() == position) {
+            xTaskNotifyGive(task);
+        }
+        return;
+    }
+#endif
+
+    char line[LOGGER_LINE_SIZE];
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    Serial.println(line);
+}
+
+#if LOGGER_DEFERRED
+void Logger::taskEntry(void* param) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        xSemaphoreTake(flushMutex, portMAX_DELAY);
+        drain();
+        xSemaphoreGive(flushMutex);
+    }
+}
+
+void Logger::drain() {
+    uint32_t position = tail.load(std::memory_order_relaxed);
+    while (true) {
+        LoggerRecord& record = records[position & (LOGGER_RING_SLOTS - 1)];
+        if (record.sequence.load() != position + 1) {
+            break;
+        }
+        
+        // The slow part, the UART takes about 87us per byte
+        Serial.write((const uint8_t*)record.text, record.length);
+        
+        record.sequence.store(position + LOGGER_RING_SLOTS, std::memory_order_release);
+        position++;
+        tail.store(position);
+    }
+    
+    uint32_t drops = droppedLines.load(std::memory_order_relaxed);
+    if (drops != reportedDrops) {
+        Serial.printf("Logger dropped %u lines\n", drops - reportedDrops);
+        reportedDrops = drops;
+    }
+}
+#endif
+
+void Logger::flush() {
+#if LOGGER_DEFERRED
+    if (deferred.load(std::memory_order_acquire)) {
+        xSemaphoreTake(flushMutex, portMAX_DELAY);
+        drain();
+        xSemaphoreGive(flushMutex);
+    }
+#endif
+    Serial.flush();
+}
+
+uint32_t Logger::getDroppedLines() {
+#if LOGGER_DEFERRED
+    return droppedLines.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,84 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+#if LOGGER_DEFERRED
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#endif
+
+// Levelled log lines, the newline is added. Levels above LOGGER_LEVEL are
+// dead code: still type checked, but their arguments are never evaluated
+// and the strings do not end up in flash.
+#if LOGGER_LEVEL >= LOGGER_LEVEL_ERROR
+#define LOGGER_ERROR(...) Logger::write(__VA_ARGS__)
+#else
+#define LOGGER_ERROR(...) do { if (0) Logger::write(__VA_ARGS__); } while (0)
+#endif
+
+#if LOGGER_LEVEL >= LOGGER_LEVEL_WARN
+#define LOGGER_WARN(...) Logger::write(__VA_ARGS__)
+#else
+#define LOGGER_WARN(...) do { if (0) Logger::write(__VA_ARGS__); } while (0)
+#endif
+
+#if LOGGER_LEVEL >= LOGGER_LEVEL_INFO
+#define LOGGER_INFO(...) Logger::write(__VA_ARGS__)
+#else
+#define LOGGER_INFO(...) do { if (0) Logger::write(__VA_ARGS__); } while (0)
+#endif
+
+#if LOGGER_LEVEL >= LOGGER_LEVEL_DEBUG
+#define LOGGER_DEBUG(...) Logger::write(__VA_ARGS__)
+#else
+#define LOGGER_DEBUG(...) do { if (0) Logger::write(__VA_ARGS__); } while (0)
+#endif
+
+// One formatted line waiting for the flush task. sequence says whose turn
+// the slot is: its position when free, position + 1 once written.
+struct LoggerRecord {
+    std::atomic<uint32_t> sequence;
+    uint16_t length;
+    char text[LOGGER_LINE_SIZE];
+};
+
+// Serial output off the hot paths. A caller formats into a slot of a
+// bounded multi-producer ring it claims with a compare-and-swap, and the
+// low-priority flush task writes the slots out in order. Nothing waits
+// for the UART or a lock: a line logged while the ring is full is dropped
+// and counted. Until begin(), and with LOGGER_DEFERRED 0, lines are
+// printed in the caller. Not for interrupt handlers.
+class Logger {
+private:
+#if LOGGER_DEFERRED
+    static LoggerRecord records[LOGGER_RING_SLOTS];
+    
+    // Free-running positions, wrapped with the slot count on access
+    static std::atomic<uint32_t> head;
+    static std::atomic<uint32_t> tail;
+    static std::atomic<uint32_t> droppedLines;
+    static uint32_t reportedDrops;
+    
+    static std::atomic<bool> deferred;
+    static TaskHandle_t task;
+    static SemaphoreHandle_t flushMutex; // Flush task and flush() callers only
+    static void taskEntry(void* param);
+    static void drain();
+#endif
+
+public:
+    static bool begin();
+    
+    static void write(const char* format, ...) __attribute__((format(printf, 1, 2)));
+    
+    // Writes out what is queued from the calling task, e.g. before a restart
+    static void flush();
+    
+    static uint32_t getDroppedLines();
+};
+
+#endif // LOGGER_H
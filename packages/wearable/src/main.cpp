@@ -1,11 +1,6 @@
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
 #include <ArduinoJson.h>
 #include <OneButton.h>
-#include <Adafruit_DRV2605.h>
 #include "config.h"
 #include "ble_manager.h"
 #include "voice_detector.h"
@@ -13,6 +8,14 @@
 #include "gesture_detector.h"
 #include "connection_manager.h"
 #include "protocol.h"
+#include "audio_codec.h"
+#include "scheduler.h"
+#include "power_manager.h"
+#include "battery_monitor.h"
+#include "telemetry.h"
+#include "settings_store.h"
+#include "boot_timeline.h"
+#include "logger.h"
 
 // Global instances
 BLEManager bleManager;
@@ -20,14 +23,36 @@ VoiceDetector voiceDetector;
 HapticController hapticController;
 GestureDetector gestureDetector;
 ConnectionManager connectionManager;
+AudioEncoder audioEncoder;
+Scheduler scheduler;
+PowerManager powerManager;
+BatteryMonitor batteryMonitor;
+SettingsStore settingsStore;
 
 // Hardware pins
 OneButton button(BUTTON_PIN, true);
 
 // System state
 bool systemReady = false;
-uint32_t lastStatusUpdate = 0;
-uint32_t statusUpdateInterval = 5000; // 5 seconds
+
+// Components started by the boot tasks, taken over by bootTask() once reported
+bool hapticReported = false;
+bool gestureReported = false;
+bool voiceReported = false;
+
+// Reported and started; until then commands, buttons and power changes
+// leave the component alone while its boot task is still in begin()
+bool gestureStarted = false;
+bool voiceStarted = false;
+
+// Scheduler task ids that change their own period or wait for a component
+int bootTaskId = -1;
+int voiceTaskId = -1;
+int gestureTaskId = -1;
+int buttonTaskId = -1;
+int ledTaskId = -1;
+int hapticTaskId = -1;
+int bleTaskId = -1;
 
 // Function declarations
 void onButtonClick();
@@ -36,79 +61,228 @@ void onButtonLongPress();
 void handleWakeWordDetected();
 void handleGestureDetected(GestureType gesture);
 void handleVoiceRecordingComplete();
-void checkBatteryLevel();
-void sendPeriodicStatus();
+void beginAudioStream();
+bool streamVoiceAudio(bool flush);
+void batteryTask();
+void onLowBattery();
+void onBatteryAdcAcquire();
+void onBatteryAdcRelease();
+void stateTask();
+StatusType getDeviceStatus();
 void updateStatusLED();
 void onBLEConnected();
 void onBLEDisconnected();
 void onBLEReconnecting();
+void onBLELinkChange(bool connected);
+void onStartAdvertising(uint16_t interval);
+void onStopAdvertising();
+
+// Boot, sensors and audio start on their own tasks while BLE comes up
+void startComponentTask(const char* name, void (*start)());
+void componentTaskEntry(void* param);
+void startI2CComponents();
+void startAudioComponents();
+void bootTask();
+
+// Scheduler tasks and event sources
+void setupScheduler();
+void buttonTask();
+void voiceTask();
+void gestureTask();
+void bleTask();
+void connectionTask();
+void hapticTask();
+void onHapticPending();
+void printSchedulerStats();
+void telemetryTask();
+void IRAM_ATTR onButtonEdge();
+void IRAM_ATTR onAccelInterrupt();
+void onAccelSamplesReady();
+void onAudioAvailable();
+void onBLEEvent();
+void onBLECommand(CommandType command, const char* data);
+void setSensitivity(const char* data);
+void applySensitivity(float sensitivity);
+void onGestureCalibrated(bool accepted);
+void applyGestureSettings();
+void applyVoiceSettings();
+void saveSettings(const DeviceSettings& settings);
+
+// Power management callbacks
+void powerTask();
+void onPowerEnterIdle();
+void onPowerExitIdle();
+void onPowerDeepSleep();
+bool canEnterDeepSleep();
 
 void setup() {
+    BootTimeline::mark(BOOT_PHASE_SETUP);
     Serial.begin(115200);
-    Serial.println("BIL Wearable Device Starting...");
+    Logger::begin();
+    LOGGER_INFO("BIL Wearable Device Starting...");
     
     // Initialize hardware components
     pinMode(LED_PIN, OUTPUT);
-    pinMode(BATTERY_PIN, INPUT);
     digitalWrite(LED_PIN, LOW);
     
+    // Calibration and tuning from the last session, one NVS read
+    settingsStore.begin();
+    
+    // First battery sample is taken before the microphone owns ADC1
+    batteryMonitor.begin();
+    batteryMonitor.onAdcAcquire = onBatteryAdcAcquire;
+    batteryMonitor.onAdcRelease = onBatteryAdcRelease;
+    batteryMonitor.onLowBattery = onLowBattery;
+    
     // Initialize button
     button.attachClick(onButtonClick);
     button.attachDoubleClick(onButtonDoubleClick);
     button.attachLongPressStart(onButtonLongPress);
     
-    // Initialize haptic feedback
-    if (!hapticController.begin()) {
-        Serial.println("Failed to initialize haptic controller");
-        hapticController.playErrorPattern();
-    } else {
-        Serial.println("Haptic controller initialized");
-    }
+    // Find out whether this boot is a wake from deep sleep
+    powerManager.begin();
+    powerManager.onEnterIdle = onPowerEnterIdle;
+    powerManager.onExitIdle = onPowerExitIdle;
+    powerManager.onDeepSleep = onPowerDeepSleep;
+    powerManager.canDeepSleep = canEnterDeepSleep;
     
-    // Initialize gesture detection
-    if (!gestureDetector.begin()) {
-        Serial.println("Failed to initialize gesture detector");
-        if (hapticController.isReady()) {
-            hapticController.playErrorPattern();
-        }
-    } else {
-        Serial.println("Gesture detector initialized");
-    }
-    
-    // Initialize voice detection
-    if (!voiceDetector.begin()) {
-        Serial.println("Failed to initialize voice detector");
-        if (hapticController.isReady()) {
-            hapticController.playErrorPattern();
-        }
-    } else {
-        Serial.println("Voice detector initialized");
-    }
+    // Sensors and audio come up on their own tasks while this one starts
+    // BLE, the slowest step; each reports to bootTask() when it is done
+    startComponentTask("boot_i2c", startI2CComponents);
+    startComponentTask("boot_audio", startAudioComponents);
     
     // Initialize connection manager
     connectionManager.begin();
     connectionManager.onConnected = onBLEConnected;
     connectionManager.onDisconnected = onBLEDisconnected;
     connectionManager.onReconnecting = onBLEReconnecting;
+    connectionManager.onStartAdvertising = onStartAdvertising;
+    connectionManager.onStopAdvertising = onStopAdvertising;
     
-    // Initialize BLE
+    // Initialize BLE, begin() already starts advertising
     if (!bleManager.begin()) {
-        Serial.println("Failed to initialize BLE");
+        BootTimeline::mark(BOOT_PHASE_BLE, false);
+        LOGGER_ERROR("Failed to initialize BLE");
+        
+        // The haptic driver may still be starting on its own task
+        uint32_t waitStart = millis();
+        while (!BootTimeline::isReached(BOOT_PHASE_HAPTIC) && millis() - waitStart < 1000) {
+            delay(10);
+        }
         if (hapticController.isReady()) {
             hapticController.playErrorPattern();
         }
         return;
     }
+    BootTimeline::mark(BOOT_PHASE_BLE);
+    BootTimeline::mark(BOOT_PHASE_ADVERTISING);
+    
+    uint32_t advertiseMs = BootTimeline::getMs(BOOT_PHASE_ADVERTISING);
+    LOGGER_INFO("Advertising %u ms after startup%s", advertiseMs,
+                advertiseMs > BOOT_ADVERTISE_TARGET_MS ? ", over target" : "");
+    
+    setupScheduler();
+    
+    // Fast while a bonded phone may be looking for us
+    connectionManager.startAdvertising();
+    connectionManager.setState(CONN_ADVERTISING);
     
     systemReady = true;
-    Serial.println("BIL Wearable Device Ready");
+}
+
+void startComponentTask(const char* name, void (*start)()) {
+    BaseType_t result = xTaskCreatePinnedToCore(componentTaskEntry, name, BOOT_TASK_STACK_SIZE,
+                                                (void*)start, BOOT_TASK_PRIORITY, nullptr, BOOT_TASK_CORE);
     
-    if (hapticController.isReady()) {
-        hapticController.playStartupPattern();
+    // Still boots without the task, just in series
+    if (result != pdPASS) {
+        LOGGER_ERROR("Failed to create %s task, starting inline", name);
+        start();
     }
+}
+
+void componentTaskEntry(void* param) {
+    void (*start)() = (void (*)())param;
+    start();
+    vTaskDelete(NULL);
+}
+
+void startI2CComponents() {
+    // The haptic driver and the accelerometer share the bus, one after the other
+    BootTimeline::mark(BOOT_PHASE_HAPTIC, hapticController.begin());
+    scheduler.signal(EVENT_BOOT);
     
-    // Start advertising
-    connectionManager.setState(CONN_ADVERTISING);
+    BootTimeline::mark(BOOT_PHASE_GESTURE, gestureDetector.begin());
+    scheduler.signal(EVENT_BOOT);
+}
+
+void startAudioComponents() {
+    BootTimeline::mark(BOOT_PHASE_VOICE, voiceDetector.begin());
+    scheduler.signal(EVENT_BOOT);
+}
+
+void bootTask() {
+    // Components are only touched from the loop once their boot task reported
+    if (!hapticReported && BootTimeline::isReached(BOOT_PHASE_HAPTIC)) {
+        hapticReported = true;
+        if (BootTimeline::isOk(BOOT_PHASE_HAPTIC)) {
+            LOGGER_INFO("Haptic controller initialized");
+        } else {
+            LOGGER_ERROR("Failed to initialize haptic controller");
+        }
+    }
+    
+    if (!gestureReported && BootTimeline::isReached(BOOT_PHASE_GESTURE)) {
+        gestureReported = true;
+        if (BootTimeline::isOk(BOOT_PHASE_GESTURE)) {
+            applyGestureSettings();
+            gestureStarted = true;
+            scheduler.setEnabled(gestureTaskId, true);
+            
+            // Idle was entered without it
+            if (powerManager.isIdle()) {
+                gestureDetector.setWakeOnMotion(true);
+            }
+            LOGGER_INFO("Gesture detector initialized");
+        } else {
+            LOGGER_ERROR("Failed to initialize gesture detector");
+        }
+    }
+    
+    if (!voiceReported && BootTimeline::isReached(BOOT_PHASE_VOICE)) {
+        voiceReported = true;
+        if (BootTimeline::isOk(BOOT_PHASE_VOICE)) {
+            applyVoiceSettings();
+            voiceStarted = true;
+            scheduler.setEnabled(voiceTaskId, true);
+            
+            if (powerManager.isIdle() && !bleManager.isConnected()) {
+                voiceDetector.suspend();
+            }
+            LOGGER_INFO("Voice detector initialized");
+        } else {
+            LOGGER_ERROR("Failed to initialize voice detector");
+        }
+    }
+    
+    if (!hapticReported || !gestureReported || !voiceReported) {
+        return;
+    }
+    
+    BootTimeline::mark(BOOT_PHASE_READY);
+    scheduler.setEnabled(bootTaskId, false);
+    LOGGER_INFO("BIL Wearable Device Ready");
+    BootTimeline::print();
+    
+    // Queued, the sequencer plays it from the haptic task. Skip the startup
+    // buzz when the user only woke the device.
+    if (hapticController.isReady()) {
+        if (!BootTimeline::isOk(BOOT_PHASE_GESTURE) || !BootTimeline::isOk(BOOT_PHASE_VOICE)) {
+            hapticController.playErrorPattern();
+        } else if (!powerManager.wokeFromDeepSleep()) {
+            hapticController.playStartupPattern();
+        }
+    }
 }
 
 void loop() {
@@ -117,55 +291,397 @@ void loop() {
         return;
     }
     
-    // Update button state
-    button.tick();
+    // Dispatches whatever is due, otherwise sleeps until the next event or deadline
+    scheduler.run();
+}
+
+void setupScheduler() {
+    scheduler.begin();
     
-    // Update connection manager
-    connectionManager.update();
+    // Event driven tasks keep a slow period as a fallback
+    bootTaskId = scheduler.addTask("boot", bootTask, 0, SCHEDULER_EVENT_BIT(EVENT_BOOT));
+    buttonTaskId = scheduler.addTask("button", buttonTask, 0, SCHEDULER_EVENT_BIT(EVENT_BUTTON));
+    voiceTaskId = scheduler.addTask("voice", voiceTask, VOICE_POLL_INTERVAL_MS, SCHEDULER_EVENT_BIT(EVENT_AUDIO));
+    gestureTaskId = scheduler.addTask("gesture", gestureTask, GESTURE_POLL_INTERVAL_MS, SCHEDULER_EVENT_BIT(EVENT_ACCEL));
     
-    // Update BLE manager
-    bleManager.update();
+    // Enabled by bootTask() once their component has started
+    scheduler.setEnabled(voiceTaskId, false);
+    scheduler.setEnabled(gestureTaskId, false);
+    bleTaskId = scheduler.addTask("ble", bleTask, BLE_UPDATE_INTERVAL_MS, SCHEDULER_EVENT_BIT(EVENT_BLE));
+    scheduler.addTask("connection", connectionTask, CONNECTION_UPDATE_INTERVAL_MS, SCHEDULER_EVENT_BIT(EVENT_BLE));
+    hapticTaskId = scheduler.addTask("haptic", hapticTask, HAPTIC_UPDATE_INTERVAL_MS);
+    
+    // Timers
+    scheduler.addTask("state", stateTask, STATE_CHECK_INTERVAL_MS);
+    scheduler.addTask("battery", batteryTask, BATTERY_SAMPLE_INTERVAL_MS);
+    ledTaskId = scheduler.addTask("led", updateStatusLED, 100);
+    scheduler.addTask("telemetry", telemetryTask, TELEMETRY_UPDATE_INTERVAL_MS);
     
-    // Update voice detector
+    // Registered last so it sees activity recorded by the tasks above in the same pass
+    scheduler.addTask("power", powerTask, POWER_UPDATE_INTERVAL_MS,
+                      SCHEDULER_EVENT_BIT(EVENT_BUTTON) | SCHEDULER_EVENT_BIT(EVENT_ACCEL) | SCHEDULER_EVENT_BIT(EVENT_BLE));
+#if SCHEDULER_STATS_INTERVAL_MS > 0
+    scheduler.addTask("stats", printSchedulerStats, SCHEDULER_STATS_INTERVAL_MS);
+#endif
+    
+    // Event sources
+    attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), onButtonEdge, CHANGE);
+    GestureDetector::onInterrupt = onAccelInterrupt;
+    gestureDetector.onSamplesReady = onAccelSamplesReady;
+    voiceDetector.onAudioAvailable = onAudioAvailable;
+    bleManager.onEvent = onBLEEvent;
+    bleManager.onCommand = onBLECommand;
+    bleManager.onLinkChange = onBLELinkChange;
+    gestureDetector.onCalibrated = onGestureCalibrated;
+    hapticController.onPending = onHapticPending;
+}
+
+void buttonTask() {
+    button.tick();
+    powerManager.notifyActivity();
+    
+    // Tick at debounce rate only while a click or long press is in progress
+    scheduler.setPeriod(buttonTaskId, button.isIdle() ? 0 : BUTTON_TICK_INTERVAL_MS);
+}
+
+void voiceTask() {
     voiceDetector.update();
     
-    // Update gesture detector
-    gestureDetector.update();
+    if (voiceDetector.isRecording()) {
+        powerManager.notifyActivity();
+    }
     
     // Check for wake word detection
     if (voiceDetector.detectWakeWord()) {
-        Serial.println("Wake word detected!");
+        LOGGER_INFO("Wake word detected!");
         hapticController.playWakeWordPattern();
         handleWakeWordDetected();
     }
     
+#if AUDIO_STREAMING_ENABLED
+    // Stream audio in chunks while the user is still speaking
+    if (voiceDetector.isRecording()) {
+        streamVoiceAudio(false);
+    }
+#endif
+    
+    // Handle voice recording completion
+    if (voiceDetector.getState() == VOICE_PROCESSING) {
+        handleVoiceRecordingComplete();
+    }
+}
+
+void gestureTask() {
+    // In idle the accelerometer only raises INT1 when the device is moved
+    if (gestureDetector.isWakeOnMotion()) {
+        if (ACCEL_INT1_PIN >= 0 && digitalRead(ACCEL_INT1_PIN) == HIGH) {
+            powerManager.notifyActivity();
+        }
+        return;
+    }
+    
+    gestureDetector.update();
+    
     // Check for gesture input
     GestureType gesture = gestureDetector.detectGesture();
     if (gesture != GESTURE_NONE) {
-        Serial.printf("Gesture detected: %d\n", gesture);
+        LOGGER_DEBUG("Gesture detected: %d", gesture);
+        powerManager.notifyActivity();
         handleGestureDetected(gesture);
     }
+}
+
+void bleTask() {
+    bleManager.update();
     
-    // Handle voice recording completion
-    if (voiceDetector.getState() == VOICE_RECORDING && !voiceDetector.isRecording()) {
-        handleVoiceRecordingComplete();
+    // A firmware update keeps the device awake until it restarts
+    bool otaActive = bleManager.isOtaActive();
+    if (otaActive) {
+        powerManager.notifyActivity();
+    }
+    
+    // Keep draining retained audio and OTA acks quickly, e.g. the backlog after a reconnect
+    bool fast = otaActive || bleManager.isAudioPending();
+    scheduler.setPeriod(bleTaskId, fast ? AUDIO_TRANSFER_PUMP_INTERVAL_MS : BLE_UPDATE_INTERVAL_MS);
+}
+
+void connectionTask() {
+    // The link being up only shows the phone is in range, the heartbeat
+    // timeout is about the app: any write from it counts
+    static uint32_t lastReceiveTime = 0;
+    uint32_t receiveTime = bleManager.getLastReceiveTime();
+    if (bleManager.isConnected() && receiveTime != lastReceiveTime) {
+        connectionManager.updateHeartbeat();
+    }
+    lastReceiveTime = receiveTime;
+    connectionManager.update();
+}
+
+void hapticTask() {
+    hapticController.update();
+    
+    // Only poll the sequencer while something is playing or queued
+    if (!hapticController.isBusy()) {
+        scheduler.setPeriod(hapticTaskId, 0);
     }
+}
+
+void onHapticPending() {
+    scheduler.setPeriod(hapticTaskId, HAPTIC_UPDATE_INTERVAL_MS);
+}
+
+void printSchedulerStats() {
+    scheduler.printStats();
+    scheduler.resetStats();
+    bleManager.printCommandStats();
+    bleManager.resetCommandStats();
+    
+    // Largest block should stay flat if the message path is allocation free
+    LOGGER_INFO("Heap: free %u, min %u, largest block %u, fragmentation %u%%, tx pool misses %u",
+                ESP.getFreeHeap(), ESP.getMinFreeHeap(), Protocol::getLargestFreeBlock(),
+                Protocol::getHeapFragmentation(), bleManager.getTxPoolExhausted());
+}
+
+void telemetryTask() {
+    TelemetrySnapshot snapshot;
+    TelemetryTaskRecord records[SCHEDULER_MAX_TASKS];
+    memset(&snapshot, 0, sizeof(snapshot));
+    
+    Telemetry::captureSystem(snapshot);
+    Telemetry::captureScheduler(snapshot, records, scheduler);
     
-    // Check battery level periodically
-    checkBatteryLevel();
+    snapshot.captureStackFree = (uint16_t)min(voiceDetector.getCaptureStackFree(), (uint32_t)UINT16_MAX);
+    snapshot.i2sOverruns = voiceDetector.getI2SOverruns();
+    snapshot.audioDroppedSamples = voiceDetector.getDroppedSamples();
+    snapshot.accelReadFailures = gestureDetector.getReadFailures();
+    snapshot.accelFifoOverruns = gestureDetector.getFifoOverruns();
     
-    // Send periodic status updates
-    sendPeriodicStatus();
+    snapshot.notifyFailures = bleManager.getTotalNotifyFailures();
+    snapshot.notifyDrops = bleManager.getTotalDrops();
+    snapshot.droppedCommands = bleManager.getDroppedCommands();
+    snapshot.txPoolExhausted = bleManager.getTxPoolExhausted();
     
-    // Update LED status
-    updateStatusLED();
+    ReconnectStats reconnect = connectionManager.getReconnectStats();
+    snapshot.disconnects = (uint16_t)min(reconnect.disconnects, (uint32_t)UINT16_MAX);
+    snapshot.reconnects = (uint16_t)min(reconnect.reconnects, (uint32_t)UINT16_MAX);
+    snapshot.lastReconnectMs = reconnect.lastMs;
+    snapshot.avgReconnectMs = reconnect.avgMs;
+    snapshot.maxReconnectMs = reconnect.maxMs;
     
-    // Small delay to prevent watchdog issues
-    delay(10);
+    // Cached in the attribute, reads from the app never reach the main loop
+    uint8_t buffer[TELEMETRY_MAX_SIZE];
+    size_t length = Telemetry::serialize(snapshot, records, buffer, sizeof(buffer));
+    if (length > 0) {
+        bleManager.setTelemetry(buffer, length);
+    }
+}
+
+void IRAM_ATTR onButtonEdge() {
+    PowerManager::handleWakeInterrupt(BUTTON_PIN);
+    scheduler.signalFromISR(EVENT_BUTTON);
+}
+
+void IRAM_ATTR onAccelInterrupt() {
+    PowerManager::handleWakeInterrupt(ACCEL_INT1_PIN);
+    scheduler.signalFromISR(EVENT_ACCEL);
+}
+
+void onAccelSamplesReady() {
+    // From the I2C bus task, the gesture task processes the burst
+    scheduler.signal(EVENT_ACCEL);
+}
+
+void onAudioAvailable() {
+    scheduler.signal(EVENT_AUDIO);
+}
+
+void onBLEEvent() {
+    powerManager.notifyActivity();
+    scheduler.signal(EVENT_BLE);
+}
+
+void onBLECommand(CommandType command, const char* data) {
+    // Runs in the ble task, after the message was taken off the receive queue
+    switch (command) {
+        case CMD_START_RECORDING:
+            if (!voiceStarted) {
+                LOGGER_WARN("Voice detector not started, recording ignored");
+            } else if (!voiceDetector.isRecording() && voiceDetector.startRecording()) {
+                beginAudioStream();
+                hapticController.playRecordingStartPattern();
+            }
+            break;
+        case CMD_STOP_RECORDING:
+            // The voice task sends the tail once the detector reaches VOICE_PROCESSING
+            if (voiceStarted && voiceDetector.isRecording()) {
+                voiceDetector.stopRecording();
+            }
+            break;
+        case CMD_HAPTIC_FEEDBACK: {
+            HapticPattern pattern;
+            if (HapticController::parsePatternName(data, pattern)) {
+                hapticController.playPattern(pattern);
+            } else {
+                LOGGER_WARN("Unknown haptic pattern: %s", data);
+            }
+            break;
+        }
+        case CMD_SET_SENSITIVITY:
+            setSensitivity(data);
+            break;
+        case CMD_CALIBRATE:
+            if (gestureStarted) {
+                gestureDetector.startCalibration();
+            } else {
+                LOGGER_WARN("Gesture detector not started, calibration ignored");
+                bleManager.sendCommand("calibration_failed");
+            }
+            break;
+        case CMD_SLEEP:
+            // Applied by the power task later in the same scheduler pass
+            powerManager.requestIdle();
+            break;
+        case CMD_WAKE:
+            powerManager.notifyActivity();
+            break;
+        case CMD_SET_AUDIO_PROFILE: {
+            AudioCaptureProfile profile;
+            if (!voiceStarted) {
+                LOGGER_WARN("Voice detector not started, audio capture profile unchanged");
+            } else if (VoiceDetector::parseProfileName(data, profile)) {
+                voiceDetector.setCaptureProfile(profile);
+                LOGGER_INFO("Audio capture profile set to %s", VoiceDetector::getProfileName(profile));
+            } else {
+                LOGGER_WARN("Unknown audio capture profile: %s", data);
+            }
+            // The selection, the capture task takes it up after its current read
+            bleManager.sendCommand("audio_profile_selected",
+                                   VoiceDetector::getProfileName(voiceDetector.getCaptureProfile()));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void setSensitivity(const char* data) {
+    // 0 is least and 1 most sensitive, 0.5 keeps the defaults
+    char* end;
+    float sensitivity = strtof(data, &end);
+    if (end == data || sensitivity < 0.0f || sensitivity > 1.0f) {
+        LOGGER_WARN("Invalid sensitivity: %s", data);
+        return;
+    }
+    
+    // Before the detector started, bootTask() applies it from the settings
+    if (voiceStarted) {
+        applySensitivity(sensitivity);
+    }
+    LOGGER_INFO("Sensitivity set to %.2f", sensitivity);
+    
+    DeviceSettings settings = settingsStore.get();
+    settings.sensitivity = sensitivity;
+    saveSettings(settings);
+}
+
+void applySensitivity(float sensitivity) {
+    float threshold = KWS_DEFAULT_THRESHOLD + (0.5f - sensitivity) * KWS_SENSITIVITY_RANGE;
+    voiceDetector.setWakeWordThreshold(constrain(threshold, KWS_MIN_THRESHOLD, KWS_MAX_THRESHOLD));
+    voiceDetector.setVoiceThreshold(VOICE_THRESHOLD * (1.5f - sensitivity));
+}
+
+void onGestureCalibrated(bool accepted) {
+    if (accepted) {
+        hapticController.playConfirmationPattern();
+        
+        AccelSample offset = gestureDetector.getOffset();
+        DeviceSettings settings = settingsStore.get();
+        settings.accelOffset[0] = offset.x;
+        settings.accelOffset[1] = offset.y;
+        settings.accelOffset[2] = offset.z;
+        settings.flags |= SETTINGS_FLAG_CALIBRATED;
+        saveSettings(settings);
+    } else {
+        hapticController.playErrorPattern();
+    }
+    
+    if (connectionManager.isConnected()) {
+        bleManager.sendCommand(accepted ? "calibration_complete" : "calibration_failed");
+    }
+}
+
+void applyGestureSettings() {
+    const DeviceSettings& settings = settingsStore.get();
+    
+    // A stored offset replaces calibrating at every boot
+    if (settings.flags & SETTINGS_FLAG_CALIBRATED) {
+        AccelSample offset = { settings.accelOffset[0], settings.accelOffset[1], settings.accelOffset[2] };
+        gestureDetector.setOffset(offset);
+    }
+}
+
+void applyVoiceSettings() {
+    applySensitivity(settingsStore.get().sensitivity);
+}
+
+void saveSettings(const DeviceSettings& settings) {
+    // Only what the caller changed differs from the stored copy
+    if (!settingsStore.save(settings)) {
+        LOGGER_WARN("Settings not saved, they last until the next restart");
+    }
+}
+
+void powerTask() {
+    powerManager.update();
+}
+
+void onPowerEnterIdle() {
+    // Slow connection events with slave latency let the radio modem sleep
+    bleManager.setStreamingMode(false);
+    
+    // Nobody to send a wake word to, so stop the microphone as well
+    if (voiceStarted && !bleManager.isConnected()) {
+        voiceDetector.suspend();
+    }
+    
+    // A component still starting is put in idle by bootTask()
+    if (gestureStarted) {
+        gestureDetector.setWakeOnMotion(true);
+    }
+}
+
+void onPowerExitIdle() {
+    if (gestureStarted) {
+        gestureDetector.setWakeOnMotion(false);
+    }
+    
+    if (voiceStarted && voiceDetector.isSuspended()) {
+        voiceDetector.resume();
+    }
+}
+
+void onPowerDeepSleep() {
+    // The LIS3DH stays powered and wakes the ESP32 through ext1
+    voiceDetector.end();
+    bleManager.stopAdvertising();
+    gestureDetector.setWakeOnMotion(true);
+}
+
+bool canEnterDeepSleep() {
+    // Not while a boot task may still be starting a component
+    if (!BootTimeline::isReached(BOOT_PHASE_READY)) {
+        return false;
+    }
+    
+    if (voiceDetector.isRecording()) {
+        return false;
+    }
+    
+    return POWER_DEEP_SLEEP_WHEN_CONNECTED || !bleManager.isConnected();
 }
 
 void onButtonClick() {
-    Serial.println("Button clicked");
+    LOGGER_DEBUG("Button clicked");
     hapticController.playClickPattern();
     
     if (connectionManager.isConnected()) {
@@ -174,30 +690,32 @@ void onButtonClick() {
 }
 
 void onButtonDoubleClick() {
-    Serial.println("Button double clicked");
+    LOGGER_DEBUG("Button double clicked");
     hapticController.playDoubleClickPattern();
     
     // Toggle voice recording
+    if (!voiceStarted) {
+        return;
+    }
     if (voiceDetector.isRecording()) {
         voiceDetector.stopRecording();
-    } else {
-        voiceDetector.startRecording();
+    } else if (voiceDetector.startRecording()) {
+        beginAudioStream();
     }
 }
 
 void onButtonLongPress() {
-    Serial.println("Button long pressed");
+    LOGGER_DEBUG("Button long pressed");
     hapticController.playLongPressPattern();
     
     // Enter pairing mode or disconnect
     if (connectionManager.isConnected()) {
-        Serial.println("Disconnecting from current device");
+        LOGGER_INFO("Disconnecting from current device");
         connectionManager.disconnect();
         bleManager.disconnect();
     } else {
-        Serial.println("Starting advertising for pairing");
-        connectionManager.setState(CONN_ADVERTISING);
-        bleManager.startAdvertising();
+        LOGGER_INFO("Starting advertising for pairing");
+        connectionManager.reconnect();
     }
 }
 
@@ -205,23 +723,25 @@ void handleWakeWordDetected() {
     if (connectionManager.isConnected()) {
         // Start voice recording and notify mobile app
         if (voiceDetector.startRecording()) {
+            beginAudioStream();
             bleManager.sendCommand("wake_word_detected");
             hapticController.playRecordingStartPattern();
-            Serial.println("Started voice recording");
+            LOGGER_INFO("Started voice recording");
         } else {
-            Serial.println("Failed to start voice recording");
+            LOGGER_ERROR("Failed to start voice recording");
             hapticController.playErrorPattern();
         }
     } else {
         // Not connected, play error pattern
-        Serial.println("Wake word detected but not connected to mobile app");
+        LOGGER_WARN("Wake word detected but not connected to mobile app");
         hapticController.playErrorPattern();
     }
 }
 
 void handleGestureDetected(GestureType gesture) {
     if (connectionManager.isConnected()) {
-        String gestureCommand = "gesture_" + String(gesture);
+        char gestureCommand[16];
+        snprintf(gestureCommand, sizeof(gestureCommand), "gesture_%d", gesture);
         bleManager.sendCommand(gestureCommand);
         hapticController.playGesturePattern(gesture);
     } else {
@@ -231,68 +751,133 @@ void handleGestureDetected(GestureType gesture) {
 }
 
 void handleVoiceRecordingComplete() {
-    Serial.println("Voice recording completed");
+    LOGGER_INFO("Voice recording completed");
     
+#if AUDIO_STREAMING_ENABLED
+    // Most of the recording has already been streamed; the tail joins the
+    // retained stream even while the link is down and the BLE layer sends
+    // audio_stream_end once everything is out
+    if (streamVoiceAudio(true)) {
+        hapticController.playRecordingStopPattern();
+    } else {
+        LOGGER_WARN("Audio retention buffer full, end of recording lost");
+        hapticController.playErrorPattern();
+    }
+#else
     if (connectionManager.isConnected()) {
-        // Get recorded audio data
-        int16_t* audioBuffer = voiceDetector.getAudioBuffer();
-        size_t recordedSamples = voiceDetector.getRecordedSamples();
+        // The recording may wrap around the circular buffer, send it in order
+        size_t audioSize = voiceDetector.getRecordedSamples() * sizeof(int16_t);
+        bool sent = audioSize > 0;
         
-        if (recordedSamples > 0) {
-            // Convert to bytes and send via BLE
-            uint8_t* audioBytes = (uint8_t*)audioBuffer;
-            size_t audioSize = recordedSamples * sizeof(int16_t);
-            
-            if (bleManager.sendAudioData(audioBytes, audioSize)) {
-                Serial.printf("Sent %d bytes of audio data\n", audioSize);
-                hapticController.playRecordingStopPattern();
-            } else {
-                Serial.println("Failed to send audio data");
-                hapticController.playErrorPattern();
-            }
+        while (sent && voiceDetector.getPendingStreamSamples() > 0) {
+            const int16_t* samples = nullptr;
+            size_t count = voiceDetector.readStreamChunk(samples, voiceDetector.getPendingStreamSamples());
+            sent = bleManager.sendAudioData((uint8_t*)samples, count * sizeof(int16_t));
         }
         
-        // Clear the buffer for next recording
-        voiceDetector.clearBuffer();
+        if (sent) {
+            LOGGER_DEBUG("Sent %d bytes of audio data", audioSize);
+            hapticController.playRecordingStopPattern();
+        } else if (audioSize > 0) {
+            LOGGER_ERROR("Failed to send audio data");
+            hapticController.playErrorPattern();
+        }
     }
+    bleManager.setStreamingMode(false);
+#endif
+    
+    // Clear the buffer for next recording
+    voiceDetector.clearBuffer();
 }
 
-void checkBatteryLevel() {
-    static uint32_t lastBatteryCheck = 0;
+void beginAudioStream() {
+    // Codec is fixed for the whole stream, link switches to short intervals
+    audioEncoder.setCodec(bleManager.getAudioCodec());
+    bleManager.beginAudioTransfer();
+    bleManager.setStreamingMode(true);
+}
+
+bool streamVoiceAudio(bool flush) {
+    static uint8_t encoded[AUDIO_STREAM_CHUNK_SAMPLES * sizeof(int16_t) + OPUS_FRAME_SAMPLES * sizeof(int16_t)];
     
-    if (millis() - lastBatteryCheck > 30000) { // Check every 30 seconds
-        float batteryVoltage = Protocol::getBatteryVoltage();
+    // Encoded audio is retained whether or not the link is up. When the
+    // retention buffer is full the samples wait in the recording buffer.
+    while (voiceDetector.getPendingStreamSamples() >= AUDIO_STREAM_CHUNK_SAMPLES ||
+           (flush && voiceDetector.getPendingStreamSamples() > 0)) {
+        if (bleManager.getAudioQueueSpace() < sizeof(encoded)) {
+            break;
+        }
         
-        if (batteryVoltage < LOW_BATTERY_THRESHOLD) {
-            Serial.printf("Low battery: %.2fV\n", batteryVoltage);
-            hapticController.playLowBatteryPattern();
-            
-            if (connectionManager.isConnected()) {
-                bleManager.sendStatus("low_battery");
-            }
+        const int16_t* samples = nullptr;
+        size_t count = voiceDetector.readStreamChunk(samples, AUDIO_STREAM_CHUNK_SAMPLES);
+        size_t encodedSize = audioEncoder.encode(samples, count, encoded, sizeof(encoded));
+        
+        if (encodedSize > 0 && !bleManager.queueAudioData(encoded, encodedSize)) {
+            return false;
+        }
+    }
+    
+    if (flush) {
+        // Anything still pending is lost with the recording buffer
+        if (voiceDetector.getPendingStreamSamples() > 0) {
+            return false;
         }
         
-        lastBatteryCheck = millis();
+        // Frame based codecs may still hold a partial frame
+        size_t encodedSize = audioEncoder.flush(encoded, sizeof(encoded));
+        if (encodedSize > 0 && !bleManager.queueAudioData(encoded, encodedSize)) {
+            return false;
+        }
+        bleManager.endAudioTransfer();
     }
+    
+    bleManager.pumpAudio();
+    return true;
 }
 
-void sendPeriodicStatus() {
-    if (connectionManager.isConnected() && millis() - lastStatusUpdate > statusUpdateInterval) {
-        String status = "ready";
-        
-        if (voiceDetector.isRecording()) {
-            status = "recording";
-        } else if (voiceDetector.getState() == VOICE_PROCESSING) {
-            status = "processing";
-        }
-        
-        bleManager.sendStatus(status);
-        lastStatusUpdate = millis();
+void batteryTask() {
+    // A sample briefly takes ADC1 from the microphone, skip it mid recording
+    // and while the microphone is still being set up
+    if (voiceReported && !voiceDetector.isRecording()) {
+        batteryMonitor.update();
+    }
+}
+
+void onLowBattery() {
+    LOGGER_WARN("Low battery: %.2fV (%u%%)", BatteryMonitor::getVoltage(), BatteryMonitor::getPercent());
+    hapticController.playLowBatteryPattern();
+    
+    if (connectionManager.isConnected()) {
+        bleManager.updateState(getDeviceStatus());
+    }
+}
+
+void onBatteryAdcAcquire() {
+    voiceDetector.pauseAdc();
+}
+
+void onBatteryAdcRelease() {
+    voiceDetector.resumeAdc();
+}
+
+void stateTask() {
+    // Cheap compare every STATE_CHECK_INTERVAL_MS, the radio is only used on change
+    if (connectionManager.isConnected()) {
+        bleManager.updateState(getDeviceStatus());
+    }
+}
+
+StatusType getDeviceStatus() {
+    if (voiceDetector.isRecording()) {
+        return STATUS_RECORDING;
     }
+    if (voiceDetector.getState() == VOICE_PROCESSING) {
+        return STATUS_PROCESSING;
+    }
+    return batteryMonitor.isLow() ? STATUS_LOW_BATTERY : STATUS_READY;
 }
 
 void updateStatusLED() {
-    static uint32_t lastLEDUpdate = 0;
     static bool ledState = false;
     
     uint32_t blinkInterval = 1000; // Default 1 second
@@ -306,37 +891,65 @@ void updateStatusLED() {
             break;
         case CONN_CONNECTED:
             digitalWrite(LED_PIN, HIGH); // Solid on
+            scheduler.setPeriod(ledTaskId, 250);
             return;
         case CONN_RECONNECTING:
             blinkInterval = 200; // Very fast blink
             break;
         case CONN_ERROR:
             digitalWrite(LED_PIN, LOW); // Off
+            scheduler.setPeriod(ledTaskId, 250);
             return;
         default:
             break;
     }
     
-    if (millis() - lastLEDUpdate > blinkInterval) {
-        ledState = !ledState;
-        digitalWrite(LED_PIN, ledState ? HIGH : LOW);
-        lastLEDUpdate = millis();
-    }
+    // The task period is the blink interval, so every run is a toggle
+    ledState = !ledState;
+    digitalWrite(LED_PIN, ledState ? HIGH : LOW);
+    scheduler.setPeriod(ledTaskId, blinkInterval);
 }
 
 // BLE Connection callbacks
 void onBLEConnected() {
-    Serial.println("BLE Connected");
+    LOGGER_INFO("BLE Connected");
     hapticController.playConfirmationPattern();
     connectionManager.updateHeartbeat();
 }
 
 void onBLEDisconnected() {
-    Serial.println("BLE Disconnected");
+    LOGGER_INFO("BLE Disconnected");
     hapticController.playErrorPattern();
+    
+    // Heartbeat timeout: the link is still up but the app went quiet, drop
+    // it so the app reconnects
+    if (bleManager.isConnected()) {
+        bleManager.disconnect();
+    }
 }
 
 void onBLEReconnecting() {
-    Serial.println("BLE Reconnecting...");
+    LOGGER_INFO("BLE Reconnecting...");
     hapticController.playClickPattern();
-}
\ No newline at end of file
+}
+
+void onBLELinkChange(bool connected) {
+    if (connected && !BootTimeline::isReached(BOOT_PHASE_CONNECTED)) {
+        BootTimeline::mark(BOOT_PHASE_CONNECTED);
+        LOGGER_INFO("First connection %u ms after startup", BootTimeline::getMs(BOOT_PHASE_CONNECTED));
+    }
+    
+    if (connected) {
+        connectionManager.setState(CONN_CONNECTED);
+    } else {
+        connectionManager.connectionLost();
+    }
+}
+
+void onStartAdvertising(uint16_t interval) {
+    bleManager.startAdvertising(interval);
+}
+
+void onStopAdvertising() {
+    bleManager.stopAdvertising();
+}
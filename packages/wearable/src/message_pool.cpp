@@ -0,0 +1,48 @@
+#include "message_pool.h"
+
+MessagePool::MessagePool() {
+    for (int i = 0; i < BLE_TX_POOL_BUFFERS; i++) {
+        inUse[i].store(false);
+    }
+    exhausted.store(0);
+    highWater.store(0);
+    claimed.store(0);
+}
+
+uint8_t* MessagePool::acquire() {
+    for (int i = 0; i < BLE_TX_POOL_BUFFERS; i++) {
+        bool expected = false;
+        if (inUse[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            uint8_t count = claimed.fetch_add(1) + 1;
+            if (count > highWater.load()) {
+                highWater.store(count);
+            }
+            return buffers[i];
+        }
+    }
+    
+    exhausted.fetch_add(1);
+    return nullptr;
+}
+
+void MessagePool::release(uint8_t* buffer) {
+    for (int i = 0; i < BLE_TX_POOL_BUFFERS; i++) {
+        if (buffers[i] == buffer) {
+            claimed.fetch_sub(1);
+            inUse[i].store(false, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+size_t MessagePool::getBufferSize() {
+    return BLE_TX_BUFFER_SIZE;
+}
+
+uint32_t MessagePool::getExhaustedCount() {
+    return exhausted.load();
+}
+
+uint8_t MessagePool::getHighWater() {
+    return highWater.load();
+}
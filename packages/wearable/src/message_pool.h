@@ -0,0 +1,31 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+// Fixed set of statically allocated TX buffers. acquire() and release() are
+// lock-free, so the BLE stack task and the main loop can both send messages.
+class MessagePool {
+private:
+    uint8_t buffers[BLE_TX_POOL_BUFFERS][BLE_TX_BUFFER_SIZE];
+    std::atomic<bool> inUse[BLE_TX_POOL_BUFFERS];
+    std::atomic<uint32_t> exhausted;
+    std::atomic<uint8_t> highWater;
+    std::atomic<uint8_t> claimed;
+
+public:
+    MessagePool();
+    
+    // Returns nullptr when every buffer is in use
+    uint8_t* acquire();
+    void release(uint8_t* buffer);
+    
+    // Status
+    size_t getBufferSize();
+    uint32_t getExhaustedCount();
+    uint8_t getHighWater();
+};
+
+#endif // MESSAGE_POOL_H
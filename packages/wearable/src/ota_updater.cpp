@@ -0,0 +1,486 @@
+#include "ota_updater.h"
+#include "logger.h"
+
+static const char* const errorNames[OTA_ERROR_COUNT] = {
+    "none", "busy", "bad_request", "too_large", "no_partition", "no_memory",
+    "flash", "decompress", "hash", "image", "aborted",
+    "insecure"
+};
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// The Arduino core would confirm a pending image right after boot, leave
+// that to confirmImage() once the app has connected
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+
+OtaUpdater::OtaUpdater() {
+    state = OTA_IDLE;
+    error = OTA_ERROR_NONE;
+    format = OTA_FORMAT_RAW;
+    partition = nullptr;
+    handle = 0;
+    transferSize = 0;
+    imageBytes = 0;
+    memset(expectedHash, 0, sizeof(expectedHash));
+    window = nullptr;
+    received = 0;
+    written = 0;
+    gapSeen = false;
+    resendRequested = false;
+    resendCount = 0;
+    inflater = nullptr;
+    dictionary = nullptr;
+    dictionaryPos = 0;
+    inflateDone = false;
+    task = nullptr;
+    abortRequested = false;
+    ackedOffset = 0;
+    ackedState = OTA_IDLE;
+    ackedResend = false;
+    ackedTime = 0;
+    trial = false;
+    trialStartTime = 0;
+    onProgress = nullptr;
+}
+
+void OtaUpdater::begin() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    esp_ota_img_states_t imageState;
+    
+    // Needs a bootloader with app rollback, otherwise images are never pending
+    if (running && esp_ota_get_state_partition(running, &imageState) == ESP_OK &&
+        imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+        trial = true;
+        trialStartTime = millis();
+        LOGGER_INFO("New image in %s, kept once the app connects", running->label);
+    }
+}
+
+void OtaUpdater::update() {
+    if (trial && millis() - trialStartTime > OTA_TRIAL_TIMEOUT_MS) {
+        LOGGER_INFO("New image never reached the app");
+        rollback();
+    }
+}
+
+void OtaUpdater::confirmImage() {
+    if (!trial) {
+        return;
+    }
+    
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+        trial = false;
+        LOGGER_INFO("New image confirmed");
+    }
+}
+
+void OtaUpdater::rollback() {
+    if (!trial) {
+        return;
+    }
+    
+    // Boots the previous image, does not return when that worked
+    LOGGER_INFO("Rolling back to the previous image");
+    Logger::flush();
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+    trial = false;
+}
+
+bool OtaUpdater::isOnTrial() {
+    return trial;
+}
+
+OtaError OtaUpdater::start(uint32_t size, const uint8_t* sha256, OtaImageFormat imageFormat) {
+    if (state == OTA_RECEIVING || task != nullptr) {
+        return OTA_ERROR_BUSY;
+    }
+    if (size == 0) {
+        return OTA_ERROR_BAD_REQUEST;
+    }
+    
+    // The other slot of the A/B pair, never the running one
+    partition = esp_ota_get_next_update_partition(nullptr);
+    if (!partition) {
+        return OTA_ERROR_NO_PARTITION;
+    }
+    if (imageFormat == OTA_FORMAT_RAW && size > partition->size) {
+        return OTA_ERROR_TOO_LARGE;
+    }
+    
+    if (!window) {
+        window = (uint8_t*)malloc(OTA_WINDOW_BYTES);
+    }
+    if (imageFormat == OTA_FORMAT_ZLIB) {
+        inflater = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+        dictionary = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+    }
+    if (!window || (imageFormat == OTA_FORMAT_ZLIB && (!inflater || !dictionary))) {
+        releaseTransfer();
+        return OTA_ERROR_NO_MEMORY;
+    }
+    
+    // Sectors are erased as the writes reach them, not all up front
+    if (esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle) != ESP_OK) {
+        releaseTransfer();
+        return OTA_ERROR_FLASH;
+    }
+    
+    format = imageFormat;
+    transferSize = size;
+    imageBytes = 0;
+    memcpy(expectedHash, sha256, OTA_SHA256_SIZE);
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    
+    if (inflater) {
+        tinfl_init(inflater);
+    }
+    dictionaryPos = 0;
+    inflateDone = false;
+    
+    received = 0;
+    written = 0;
+    gapSeen = false;
+    resendRequested = false;
+    resendCount = 0;
+    ackedOffset = 0;
+    ackedState = OTA_IDLE;
+    ackedResend = false;
+    ackedTime = 0;
+    abortRequested = false;
+    error = OTA_ERROR_NONE;
+    state = OTA_RECEIVING;
+    
+    BaseType_t result = xTaskCreatePinnedToCore(
+        taskEntry,
+        "ota",
+        OTA_TASK_STACK_SIZE,
+        this,
+        OTA_TASK_PRIORITY,
+        &task,
+        OTA_TASK_CORE
+    );
+    if (result != pdPASS) {
+        task = nullptr;
+        fail(OTA_ERROR_NO_MEMORY);
+        releaseTransfer();
+        return OTA_ERROR_NO_MEMORY;
+    }
+    
+    LOGGER_INFO("OTA update of %u bytes (%s) into %s", size,
+                format == OTA_FORMAT_ZLIB ? "zlib" : "raw", partition->label);
+    return OTA_ERROR_NONE;
+}
+
+void OtaUpdater::abort() {
+    TaskHandle_t worker = task;
+    if (state != OTA_RECEIVING || !worker) {
+        return;
+    }
+    
+    abortRequested = true;
+    xTaskNotifyGive(worker);
+}
+
+bool OtaUpdater::receive(const uint8_t* packet, size_t length) {
+    if (state != OTA_RECEIVING || length <= OTA_PACKET_HEADER_SIZE) {
+        return false;
+    }
+    
+    uint32_t offset = packet[0] | (packet[1] << 8) | (packet[2] << 16) | ((uint32_t)packet[3] << 24);
+    const uint8_t* payload = packet + OTA_PACKET_HEADER_SIZE;
+    size_t size = length - OTA_PACKET_HEADER_SIZE;
+    uint32_t position = received.load(std::memory_order_relaxed);
+    
+    // Only the next packet in order is taken. Whatever follows a loss is
+    // dropped until the app resends from the offset in the next ack.
+    if (offset != position || size > transferSize - position ||
+        position + size - written.load(std::memory_order_acquire) > OTA_WINDOW_BYTES) {
+        if (!gapSeen) {
+            gapSeen = true;
+            resendCount++;
+            resendRequested.store(true, std::memory_order_release);
+            if (onProgress) {
+                onProgress();
+            }
+        }
+        return false;
+    }
+    if (gapSeen) {
+        gapSeen = false;
+        resendRequested.store(false, std::memory_order_release);
+    }
+    
+    // At most two copies, before and after the wrap
+    size_t start = position & (OTA_WINDOW_BYTES - 1);
+    size_t first = min(size, (size_t)OTA_WINDOW_BYTES - start);
+    memcpy(window + start, payload, first);
+    memcpy(window, payload + first, size - first);
+    
+    received.store(position + size, std::memory_order_release);
+    
+    TaskHandle_t worker = task;
+    if (worker) {
+        xTaskNotifyGive(worker);
+    }
+    return true;
+}
+
+void OtaUpdater::taskEntry(void* param) {
+    OtaUpdater* updater = (OtaUpdater*)param;
+    updater->taskLoop();
+    
+    updater->task = nullptr;
+    vTaskDelete(NULL);
+}
+
+void OtaUpdater::taskLoop() {
+    while (state == OTA_RECEIVING) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        uint32_t position = written.load(std::memory_order_relaxed);
+        uint32_t end = received.load(std::memory_order_acquire);
+        
+        while (position < end && state == OTA_RECEIVING && !abortRequested) {
+            // Contiguous blocks of up to one flash sector
+            size_t start = position & (OTA_WINDOW_BYTES - 1);
+            size_t block = min((size_t)(end - position), (size_t)OTA_WRITE_BLOCK_BYTES);
+            block = min(block, (size_t)OTA_WINDOW_BYTES - start);
+            
+            if (!consume(window + start, block)) {
+                break;
+            }
+            
+            position += block;
+            written.store(position, std::memory_order_release);
+            if (onProgress) {
+                onProgress();
+            }
+            
+            end = received.load(std::memory_order_acquire);
+        }
+        
+        if (abortRequested && state == OTA_RECEIVING) {
+            fail(OTA_ERROR_ABORTED);
+        } else if (state == OTA_RECEIVING && position == transferSize) {
+            finish();
+        }
+    }
+    
+    releaseTransfer();
+    if (onProgress) {
+        onProgress();
+    }
+}
+
+bool OtaUpdater::consume(const uint8_t* data, size_t length) {
+    if (format == OTA_FORMAT_ZLIB) {
+        uint32_t end = written.load(std::memory_order_relaxed) + length;
+        return inflate(data, length, end < transferSize);
+    }
+    return writeImage(data, length);
+}
+
+bool OtaUpdater::inflate(const uint8_t* data, size_t length, bool moreInput) {
+    mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (moreInput ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+    
+    while (true) {
+        if (inflateDone) {
+            // Nothing may follow the end of the deflate stream
+            if (length > 0) {
+                fail(OTA_ERROR_DECOMPRESS);
+                return false;
+            }
+            return true;
+        }
+        
+        // The dictionary doubles as the output ring, flushed after each call
+        size_t inSize = length;
+        size_t outSize = TINFL_LZ_DICT_SIZE - dictionaryPos;
+        tinfl_status status = tinfl_decompress(inflater, data, &inSize, dictionary,
+                                               dictionary + dictionaryPos, &outSize, flags);
+        data += inSize;
+        length -= inSize;
+        
+        if (outSize > 0 && !writeImage(dictionary + dictionaryPos, outSize)) {
+            return false;
+        }
+        dictionaryPos = (dictionaryPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+        
+        if (status < TINFL_STATUS_DONE) {
+            fail(OTA_ERROR_DECOMPRESS);
+            return false;
+        }
+        if (status == TINFL_STATUS_DONE) {
+            inflateDone = true;
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0) {
+            return true;
+        }
+    }
+}
+
+bool OtaUpdater::writeImage(const uint8_t* data, size_t length) {
+    if (imageBytes + length > partition->size) {
+        fail(OTA_ERROR_TOO_LARGE);
+        return false;
+    }
+    
+    // The first write is checked for the image header magic as well
+    esp_err_t err = esp_ota_write(handle, data, length);
+    if (err != ESP_OK) {
+        fail(err == ESP_ERR_OTA_VALIDATE_FAILED ? OTA_ERROR_IMAGE : OTA_ERROR_FLASH);
+        return false;
+    }
+    
+    mbedtls_sha256_update_ret(&sha, data, length);
+    imageBytes += length;
+    return true;
+}
+
+void OtaUpdater::finish() {
+    if (format == OTA_FORMAT_ZLIB && !inflateDone) {
+        fail(OTA_ERROR_DECOMPRESS);
+        return;
+    }
+    
+    uint8_t hash[OTA_SHA256_SIZE];
+    mbedtls_sha256_finish_ret(&sha, hash);
+    mbedtls_sha256_free(&sha);
+    if (memcmp(hash, expectedHash, OTA_SHA256_SIZE) != 0) {
+        fail(OTA_ERROR_HASH);
+        return;
+    }
+    
+    // Checks the image structure and its own checksum, then closes the handle
+    esp_err_t err = esp_ota_end(handle);
+    handle = 0;
+    if (err != ESP_OK) {
+        fail(err == ESP_ERR_OTA_VALIDATE_FAILED ? OTA_ERROR_IMAGE : OTA_ERROR_FLASH);
+        return;
+    }
+    
+    if (esp_ota_set_boot_partition(partition) != ESP_OK) {
+        fail(OTA_ERROR_FLASH);
+        return;
+    }
+    
+    LOGGER_INFO("OTA image of %u bytes verified, boots from %s next", imageBytes, partition->label);
+    state = OTA_READY;
+}
+
+void OtaUpdater::fail(OtaError reason) {
+    if (handle) {
+        esp_ota_abort(handle);
+        handle = 0;
+    }
+    mbedtls_sha256_free(&sha);
+    
+    LOGGER_ERROR("OTA update failed: %s", getErrorName(reason));
+    error = reason;
+    state = OTA_FAILED;
+}
+
+void OtaUpdater::releaseTransfer() {
+    // The window stays, the host task may still be writing into it
+    free(inflater);
+    free(dictionary);
+    inflater = nullptr;
+    dictionary = nullptr;
+}
+
+bool OtaUpdater::peekAck(OtaAckRecord& record) {
+    uint32_t position = written.load(std::memory_order_acquire);
+    bool resend = resendRequested.load(std::memory_order_acquire);
+    OtaState current = state;
+    
+    // Acks slide the window, often enough that the app never waits on one.
+    // While receiving the last one is repeated, it may have been lost.
+    bool due = resend != ackedResend || current != ackedState;
+    if (current == OTA_RECEIVING) {
+        due = due || position - ackedOffset >= OTA_ACK_INTERVAL_BYTES ||
+              millis() - ackedTime >= OTA_ACK_REPEAT_MS;
+    }
+    if (!due) {
+        return false;
+    }
+    
+    record.state = current;
+    record.error = error;
+    record.flags = resend ? OTA_ACK_FLAG_RESEND : 0;
+    record.reserved = 0;
+    record.received = received.load(std::memory_order_acquire);
+    record.written = position;
+    return true;
+}
+
+void OtaUpdater::ackSent(const OtaAckRecord& record) {
+    ackedOffset = record.written;
+    ackedState = (OtaState)record.state;
+    ackedResend = record.flags & OTA_ACK_FLAG_RESEND;
+    ackedTime = millis();
+}
+
+OtaState OtaUpdater::getState() {
+    return state;
+}
+
+OtaError OtaUpdater::getError() {
+    return error;
+}
+
+uint32_t OtaUpdater::getWrittenBytes() {
+    return written.load(std::memory_order_relaxed);
+}
+
+uint32_t OtaUpdater::getResendCount() {
+    return resendCount;
+}
+
+bool OtaUpdater::parseBegin(const char* data, uint32_t& size, uint8_t* sha256, OtaImageFormat& imageFormat) {
+    char* end;
+    size = strtoul(data, &end, 10);
+    if (end == data || *end != ',') {
+        return false;
+    }
+    
+    const char* cursor = end + 1;
+    for (int i = 0; i < OTA_SHA256_SIZE; i++) {
+        int high = hexValue(cursor[0]);
+        int low = high < 0 ? -1 : hexValue(cursor[1]);
+        if (low < 0) {
+            return false;
+        }
+        sha256[i] = (uint8_t)((high << 4) | low);
+        cursor += 2;
+    }
+    
+    imageFormat = OTA_FORMAT_RAW;
+    if (*cursor == '\0') {
+        return true;
+    }
+    if (strcmp(cursor, ",raw") == 0) {
+        return true;
+    }
+    if (strcmp(cursor, ",zlib") == 0) {
+        imageFormat = OTA_FORMAT_ZLIB;
+        return true;
+    }
+    return false;
+}
+
+const char* OtaUpdater::getErrorName(OtaError reason) {
+    return reason < OTA_ERROR_COUNT ? errorNames[reason] : "unknown";
+}
@@ -0,0 +1,149 @@
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include <esp32/rom/miniz.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config.h"
+
+// Firmware image received over the OTA characteristic and written to the
+// inactive app partition as it arrives. The app announces the transfer with
+// ota_begin, then writes packets without response: the transfer offset of
+// the first payload byte (uint32 LE) followed by the payload. It keeps at
+// most OTA_WINDOW_BYTES ahead of the last acknowledged offset.
+#define OTA_PACKET_HEADER_SIZE 4
+#define OTA_ACK_FLAG_RESEND 0x01 // A packet was lost, resend from received
+#define OTA_SHA256_SIZE 32
+
+enum OtaState {
+    OTA_IDLE,
+    OTA_RECEIVING,
+    OTA_READY,  // Verified and set as the boot partition, restart pending
+    OTA_FAILED
+};
+
+// Transfer encoding, the hash always covers the image as written to flash
+enum OtaImageFormat {
+    OTA_FORMAT_RAW,
+    OTA_FORMAT_ZLIB // Deflate stream with zlib header, inflated by the ROM
+};
+
+enum OtaError {
+    OTA_ERROR_NONE,
+    OTA_ERROR_BUSY,
+    OTA_ERROR_BAD_REQUEST,
+    OTA_ERROR_TOO_LARGE,
+    OTA_ERROR_NO_PARTITION,
+    OTA_ERROR_NO_MEMORY,
+    OTA_ERROR_FLASH,
+    OTA_ERROR_DECOMPRESS,
+    OTA_ERROR_HASH,
+    OTA_ERROR_IMAGE,   // Rejected by esp_ota_end(), not a valid app image
+    OTA_ERROR_ABORTED,
+    OTA_ERROR_INSECURE, // ota_begin over a link that is not encrypted and bonded
+    OTA_ERROR_COUNT
+};
+
+// Notified on the OTA characteristic, 12 bytes little endian
+struct __attribute__((packed)) OtaAckRecord {
+    uint8_t state;     // OtaState
+    uint8_t error;     // OtaError
+    uint8_t flags;     // OTA_ACK_FLAG_*
+    uint8_t reserved;
+    uint32_t received; // Next transfer offset the device expects
+    uint32_t written;  // Transfer bytes on flash, the window starts here
+};
+
+class OtaUpdater {
+private:
+    volatile OtaState state;
+    volatile OtaError error;
+    OtaImageFormat format;
+    
+    const esp_partition_t* partition;
+    esp_ota_handle_t handle;
+    uint32_t transferSize;
+    uint32_t imageBytes;
+    uint8_t expectedHash[OTA_SHA256_SIZE];
+    mbedtls_sha256_context sha;
+    
+    // Receive window, written by the BLE host task and drained to flash by
+    // the OTA task. Positions are transfer offsets, wrapped with the mask.
+    // Kept once allocated, a late write may still land after a failure.
+    uint8_t* window;
+    std::atomic<uint32_t> received;
+    std::atomic<uint32_t> written;
+    bool gapSeen;                      // Host task only
+    std::atomic<bool> resendRequested; // Set while packets are missing
+    uint32_t resendCount;
+    
+    // Inflate state, allocated for compressed transfers only
+    tinfl_decompressor* inflater;
+    uint8_t* dictionary;
+    size_t dictionaryPos;
+    bool inflateDone;
+    
+    TaskHandle_t task;
+    volatile bool abortRequested;
+    
+    // Last ack that went out, see ackSent()
+    uint32_t ackedOffset;
+    OtaState ackedState;
+    bool ackedResend;
+    uint32_t ackedTime;
+    
+    // The running image is on trial until confirmImage()
+    bool trial;
+    uint32_t trialStartTime;
+    
+    static void taskEntry(void* param);
+    void taskLoop();
+    bool consume(const uint8_t* data, size_t length);
+    bool inflate(const uint8_t* data, size_t length, bool moreInput);
+    bool writeImage(const uint8_t* data, size_t length);
+    void finish();
+    void fail(OtaError reason);
+    void releaseTransfer();
+
+public:
+    OtaUpdater();
+    
+    // Finds out whether the running image was just installed
+    void begin();
+    
+    // Rolls back a trial image that is not confirmed in OTA_TRIAL_TIMEOUT_MS
+    void update();
+    void confirmImage();
+    void rollback();
+    bool isOnTrial();
+    
+    // Transfers, start() from one task, receive() from the BLE host task.
+    // abort() is safe from any task.
+    OtaError start(uint32_t size, const uint8_t* sha256, OtaImageFormat imageFormat);
+    void abort();
+    bool receive(const uint8_t* packet, size_t length);
+    
+    // True when there is news for the app or the last ack is due again.
+    // Nothing changes until ackSent(), so an ack the stack had no buffer
+    // for is offered again on the next call.
+    bool peekAck(OtaAckRecord& record);
+    void ackSent(const OtaAckRecord& record);
+    
+    OtaState getState();
+    OtaError getError();
+    uint32_t getWrittenBytes();
+    uint32_t getResendCount();
+    
+    // "size,sha256 in hex[,raw|zlib]"
+    static bool parseBegin(const char* data, uint32_t& size, uint8_t* sha256, OtaImageFormat& imageFormat);
+    static const char* getErrorName(OtaError reason);
+    
+    // Called from the OTA task after each block reached flash
+    void (*onProgress)();
+};
+
+#endif // OTA_UPDATER_H
@@ -0,0 +1,254 @@
+#include "power_manager.h"
+#include "logger.h"
+#include <driver/rtc_io.h>
+#include <hal/gpio_ll.h>
+
+// Survives deep sleep, cleared on power-on reset
+RTC_DATA_ATTR static uint32_t deepSleepCount = 0;
+
+volatile bool PowerManager::wakePinsArmed = false;
+
+PowerManager::PowerManager() {
+    currentState = POWER_ACTIVE;
+    lastActivity = 0;
+    wakeRequested = false;
+    idleRequested = false;
+    wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    pmConfigured = false;
+#if CONFIG_PM_ENABLE
+    cpuLock = nullptr;
+    sleepLock = nullptr;
+#endif
+    onEnterIdle = nullptr;
+    onExitIdle = nullptr;
+    onDeepSleep = nullptr;
+    canDeepSleep = nullptr;
+}
+
+bool PowerManager::begin() {
+    LOGGER_INFO("Initializing Power Manager...");
+    
+    wakeCause = esp_sleep_get_wakeup_cause();
+    switch (wakeCause) {
+        case ESP_SLEEP_WAKEUP_EXT0:
+            LOGGER_INFO("Woke from deep sleep by button (%u sleeps)", deepSleepCount);
+            break;
+        case ESP_SLEEP_WAKEUP_EXT1:
+            LOGGER_INFO("Woke from deep sleep by motion (%u sleeps)", deepSleepCount);
+            break;
+        default:
+            deepSleepCount = 0;
+            break;
+    }
+    
+    // Deep sleep leaves the wake pins routed to the RTC mux
+    rtc_gpio_deinit((gpio_num_t)BUTTON_PIN);
+    if (ACCEL_INT1_PIN >= 0) {
+        rtc_gpio_deinit((gpio_num_t)ACCEL_INT1_PIN);
+    }
+    
+    pmConfigured = configurePowerManagement();
+    if (!pmConfigured) {
+        LOGGER_WARN("Power management not available, running at full clock");
+    }
+    
+    currentState = POWER_ACTIVE;
+    lastActivity = millis();
+    
+    LOGGER_INFO("Power Manager initialized successfully");
+    return true;
+}
+
+bool PowerManager::configurePowerManagement() {
+#if CONFIG_PM_ENABLE
+    // Locks held while active, releasing them lets the PM scale and sleep
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power_active", &cpuLock) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "power_awake", &sleepLock) != ESP_OK) {
+        return false;
+    }
+    
+    esp_pm_lock_acquire(cpuLock);
+    esp_pm_lock_acquire(sleepLock);
+    
+    // Automatic light sleep needs tickless idle; the BLE controller and the
+    // I2S driver hold their own locks while they need the clocks
+    esp_pm_config_esp32_t config = {
+        .max_freq_mhz = POWER_MAX_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_CPU_FREQ_MHZ,
+        .light_sleep_enable = POWER_LIGHT_SLEEP_ENABLED
+    };
+    
+    esp_err_t err = esp_pm_configure(&config);
+    if (err == ESP_ERR_NOT_SUPPORTED && config.light_sleep_enable) {
+        // SDK built without tickless idle, keep frequency scaling at least
+        LOGGER_WARN("Light sleep not supported by this SDK build");
+        config.light_sleep_enable = false;
+        err = esp_pm_configure(&config);
+    }
+    
+    if (err != ESP_OK) {
+        LOGGER_ERROR("Failed to configure power management: %d", err);
+        return false;
+    }
+    
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PowerManager::update() {
+    if (wakeRequested) {
+        wakeRequested = false;
+        if (currentState == POWER_IDLE) {
+            exitIdle();
+        }
+    }
+    
+    if (idleRequested) {
+        idleRequested = false;
+        if (currentState == POWER_ACTIVE) {
+            enterIdle();
+        }
+    }
+    
+    uint32_t idleTime = getIdleTime();
+    
+    if (currentState == POWER_ACTIVE && idleTime > POWER_IDLE_TIMEOUT_MS) {
+        enterIdle();
+    }
+    
+    if (idleTime > SLEEP_TIMEOUT_MS && (!canDeepSleep || canDeepSleep())) {
+        enterDeepSleep();
+    }
+}
+
+void PowerManager::notifyActivity() {
+    lastActivity = millis();
+    
+    // State changes happen in update() on the main task
+    if (currentState != POWER_ACTIVE) {
+        wakeRequested = true;
+    }
+}
+
+void PowerManager::requestIdle() {
+    idleRequested = true;
+}
+
+void PowerManager::enterIdle() {
+    LOGGER_INFO("Entering idle power mode");
+    currentState = POWER_IDLE;
+    
+    if (onEnterIdle) {
+        onEnterIdle();
+    }
+    
+    armLightSleepWake();
+    
+#if CONFIG_PM_ENABLE
+    if (pmConfigured) {
+        esp_pm_lock_release(sleepLock);
+        esp_pm_lock_release(cpuLock);
+    }
+#endif
+}
+
+void PowerManager::exitIdle() {
+#if CONFIG_PM_ENABLE
+    if (pmConfigured) {
+        esp_pm_lock_acquire(cpuLock);
+        esp_pm_lock_acquire(sleepLock);
+    }
+#endif
+    
+    disarmLightSleepWake();
+    
+    currentState = POWER_ACTIVE;
+    LOGGER_INFO("Leaving idle power mode");
+    
+    if (onExitIdle) {
+        onExitIdle();
+    }
+}
+
+void PowerManager::armLightSleepWake() {
+    // Light sleep can only be left on a GPIO level, not on the edges the
+    // button and INT1 interrupts normally use
+    gpio_wakeup_enable((gpio_num_t)BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+    if (ACCEL_INT1_PIN >= 0) {
+        gpio_wakeup_enable((gpio_num_t)ACCEL_INT1_PIN, GPIO_INTR_HIGH_LEVEL);
+    }
+    esp_sleep_enable_gpio_wakeup();
+    wakePinsArmed = true;
+}
+
+void PowerManager::disarmLightSleepWake() {
+    wakePinsArmed = false;
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+    
+    gpio_wakeup_disable((gpio_num_t)BUTTON_PIN);
+    gpio_set_intr_type((gpio_num_t)BUTTON_PIN, GPIO_INTR_ANYEDGE);
+    if (ACCEL_INT1_PIN >= 0) {
+        gpio_wakeup_disable((gpio_num_t)ACCEL_INT1_PIN);
+        gpio_set_intr_type((gpio_num_t)ACCEL_INT1_PIN, GPIO_INTR_POSEDGE);
+    }
+}
+
+void IRAM_ATTR PowerManager::handleWakeInterrupt(int pin) {
+    if (!wakePinsArmed) {
+        return;
+    }
+    
+    // A level interrupt keeps firing while the pin is asserted, mute it
+    // until exitIdle() restores the edge trigger. Straight to the register:
+    // the GPIO ISR service runs during flash writes, gpio_set_intr_type()
+    // is in flash.
+    gpio_ll_set_intr_type(&GPIO, pin, GPIO_INTR_DISABLE);
+}
+
+void PowerManager::enterDeepSleep() {
+    LOGGER_INFO("Entering deep sleep");
+    currentState = POWER_DEEP_SLEEP;
+    
+    if (onDeepSleep) {
+        onDeepSleep();
+    }
+    
+    // Button is active low, the LIS3DH activity interrupt is latched high
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)BUTTON_PIN, 0);
+    rtc_gpio_pullup_en((gpio_num_t)BUTTON_PIN);
+    rtc_gpio_pulldown_dis((gpio_num_t)BUTTON_PIN);
+    
+    if (ACCEL_INT1_PIN >= 0) {
+        esp_sleep_enable_ext1_wakeup(1ULL << ACCEL_INT1_PIN, ESP_EXT1_WAKEUP_ANY_HIGH);
+    }
+    
+    deepSleepCount++;
+    Logger::flush();
+    esp_deep_sleep_start();
+}
+
+PowerState PowerManager::getState() {
+    return currentState;
+}
+
+bool PowerManager::isIdle() {
+    return currentState == POWER_IDLE;
+}
+
+uint32_t PowerManager::getIdleTime() {
+    return millis() - lastActivity;
+}
+
+esp_sleep_wakeup_cause_t PowerManager::getWakeCause() {
+    return wakeCause;
+}
+
+bool PowerManager::wokeFromDeepSleep() {
+    return wakeCause == ESP_SLEEP_WAKEUP_EXT0 || wakeCause == ESP_SLEEP_WAKEUP_EXT1;
+}
+
+uint32_t PowerManager::getDeepSleepCount() {
+    return deepSleepCount;
+}
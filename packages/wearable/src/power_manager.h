@@ -0,0 +1,72 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_pm.h>
+#include <driver/gpio.h>
+#include "config.h"
+
+enum PowerState {
+    POWER_ACTIVE,     // Full clock, light sleep blocked
+    POWER_IDLE,       // Frequency scaling and automatic light sleep allowed
+    POWER_DEEP_SLEEP  // Entered from update(), does not return
+};
+
+// Power state machine. Activity keeps the device in POWER_ACTIVE; after
+// POWER_IDLE_TIMEOUT_MS it drops to POWER_IDLE and after SLEEP_TIMEOUT_MS,
+// when canDeepSleep() agrees, into deep sleep. The button and the LIS3DH
+// activity interrupt wake the device from both.
+class PowerManager {
+private:
+    PowerState currentState;
+    volatile uint32_t lastActivity;
+    volatile bool wakeRequested;
+    volatile bool idleRequested;
+    esp_sleep_wakeup_cause_t wakeCause;
+    bool pmConfigured;
+    
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t cpuLock;
+    esp_pm_lock_handle_t sleepLock;
+#endif
+    
+    // GPIO level wake for light sleep, restored to edge triggers on exit
+    static volatile bool wakePinsArmed;
+    
+    bool configurePowerManagement();
+    void enterIdle();
+    void exitIdle();
+    void enterDeepSleep();
+    void armLightSleepWake();
+    void disarmLightSleepWake();
+
+public:
+    PowerManager();
+    
+    bool begin();
+    void update();
+    
+    // Activity tracking, safe to call from any task
+    void notifyActivity();
+    void requestIdle();
+    
+    // State
+    PowerState getState();
+    bool isIdle();
+    uint32_t getIdleTime();
+    esp_sleep_wakeup_cause_t getWakeCause();
+    bool wokeFromDeepSleep();
+    uint32_t getDeepSleepCount();
+    
+    // Wake pin ISRs call this first, it stops a level wake from re-firing
+    static void IRAM_ATTR handleWakeInterrupt(int pin);
+    
+    // Event callbacks (to be implemented by user)
+    void (*onEnterIdle)();
+    void (*onExitIdle)();
+    void (*onDeepSleep)();
+    bool (*canDeepSleep)();
+};
+
+#endif // POWER_MANAGER_H
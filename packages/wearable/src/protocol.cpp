@@ -1,76 +1,66 @@
 #include "protocol.h"
+#include "logger.h"
 #include "config.h"
+#include "battery_monitor.h"
 
-String Protocol::createCommandMessage(const String& command, const String& data) {
-    DynamicJsonDocument doc(512);
+size_t Protocol::serialize(const JsonDocument& doc, char* buffer, size_t size) {
+    // Refuse to send a truncated message
+    if (measureJson(doc) >= size) {
+        return 0;
+    }
+    
+    return serializeJson(doc, buffer, size);
+}
+
+size_t Protocol::createCommandMessage(char* buffer, size_t size, const char* command, const char* data) {
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
+    char id[PROTOCOL_MESSAGE_ID_SIZE];
+    generateMessageId(id, sizeof(id));
     
     doc["type"] = "command";
-    doc["id"] = generateMessageId();
+    doc["id"] = (const char*)id;
     doc["timestamp"] = getTimestamp();
     doc["command"] = command;
     doc["battery"] = getBatteryVoltage();
     
-    if (data.length() > 0) {
+    if (data && data[0] != '\0') {
         doc["data"] = data;
     }
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    return serialize(doc, buffer, size);
 }
 
-String Protocol::createStatusMessage(StatusType status, const String& data) {
-    DynamicJsonDocument doc(512);
+size_t Protocol::createStatusMessage(char* buffer, size_t size, StatusType status, const char* data) {
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
+    char id[PROTOCOL_MESSAGE_ID_SIZE];
+    generateMessageId(id, sizeof(id));
     
     doc["type"] = "status";
-    doc["id"] = generateMessageId();
+    doc["id"] = (const char*)id;
     doc["timestamp"] = getTimestamp();
     doc["battery"] = getBatteryVoltage();
+    doc["battery_percent"] = BatteryMonitor::getPercent();
+    doc["status"] = getStatusName(status);
     
-    // Convert status enum to string
-    switch (status) {
-        case STATUS_READY:
-            doc["status"] = "ready";
-            break;
-        case STATUS_RECORDING:
-            doc["status"] = "recording";
-            break;
-        case STATUS_PROCESSING:
-            doc["status"] = "processing";
-            break;
-        case STATUS_LOW_BATTERY:
-            doc["status"] = "low_battery";
-            break;
-        case STATUS_ERROR:
-            doc["status"] = "error";
-            break;
-        case STATUS_DISCONNECTED:
-            doc["status"] = "disconnected";
-            break;
-        default:
-            doc["status"] = "unknown";
-            break;
-    }
-    
-    if (data.length() > 0) {
+    if (data && data[0] != '\0') {
         doc["data"] = data;
     }
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    return serialize(doc, buffer, size);
 }
 
-String Protocol::createErrorMessage(ErrorCode error, const String& description) {
-    DynamicJsonDocument doc(512);
+size_t Protocol::createErrorMessage(char* buffer, size_t size, ErrorCode error, const char* description) {
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
+    char id[PROTOCOL_MESSAGE_ID_SIZE];
+    generateMessageId(id, sizeof(id));
     
     doc["type"] = "error";
-    doc["id"] = generateMessageId();
+    doc["id"] = (const char*)id;
     doc["timestamp"] = getTimestamp();
     doc["error_code"] = error;
     doc["battery"] = getBatteryVoltage();
     
-    if (description.length() > 0) {
+    if (description && description[0] != '\0') {
         doc["description"] = description;
     } else {
         // Default error descriptions
@@ -102,188 +92,271 @@ String Protocol::createErrorMessage(ErrorCode error, const String& description)
         }
     }
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    return serialize(doc, buffer, size);
 }
 
-String Protocol::createHeartbeatMessage() {
-    DynamicJsonDocument doc(256);
+size_t Protocol::createHeartbeatMessage(char* buffer, size_t size) {
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
+    char id[PROTOCOL_MESSAGE_ID_SIZE];
+    generateMessageId(id, sizeof(id));
     
     doc["type"] = "heartbeat";
-    doc["id"] = generateMessageId();
+    doc["id"] = (const char*)id;
     doc["timestamp"] = getTimestamp();
     doc["battery"] = getBatteryVoltage();
+    doc["battery_percent"] = BatteryMonitor::getPercent();
     doc["uptime"] = millis();
     doc["free_heap"] = ESP.getFreeHeap();
+    doc["min_free_heap"] = ESP.getMinFreeHeap();
+    doc["largest_free_block"] = getLargestFreeBlock();
+    doc["heap_fragmentation"] = getHeapFragmentation();
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    return serialize(doc, buffer, size);
 }
 
-String Protocol::createAckMessage(const String& messageId) {
-    DynamicJsonDocument doc(256);
+size_t Protocol::createAckMessage(char* buffer, size_t size, const char* messageId) {
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
+    char id[PROTOCOL_MESSAGE_ID_SIZE];
+    generateMessageId(id, sizeof(id));
     
     doc["type"] = "ack";
-    doc["id"] = generateMessageId();
+    doc["id"] = (const char*)id;
     doc["timestamp"] = getTimestamp();
     doc["ack_id"] = messageId;
     
-    String result;
-    serializeJson(doc, result);
-    return result;
+    return serialize(doc, buffer, size);
 }
 
-bool Protocol::parseMessage(const String& json, MessageType& type, String& payload) {
-    DynamicJsonDocument doc(512);
-    DeserializationError error = deserializeJson(doc, json);
+bool Protocol::parseMessage(JsonDocument& doc, const char* json, size_t length, MessageType& type) {
+    DeserializationError error = deserializeJson(doc, json, length);
     
     if (error) {
-        Serial.printf("JSON parse error: %s\n", error.c_str());
+        LOGGER_WARN("JSON parse error: %s", error.c_str());
         return false;
     }
     
-    String typeStr = doc["type"];
+    const char* typeStr = doc["type"] | "";
     
-    if (typeStr == "command") {
+    if (strcmp(typeStr, "command") == 0) {
         type = MSG_COMMAND;
-    } else if (typeStr == "status") {
+    } else if (strcmp(typeStr, "status") == 0) {
         type = MSG_STATUS;
-    } else if (typeStr == "audio_data") {
+    } else if (strcmp(typeStr, "audio_data") == 0) {
         type = MSG_AUDIO_DATA;
-    } else if (typeStr == "heartbeat") {
+    } else if (strcmp(typeStr, "heartbeat") == 0) {
         type = MSG_HEARTBEAT;
-    } else if (typeStr == "error") {
+    } else if (strcmp(typeStr, "error") == 0) {
         type = MSG_ERROR;
-    } else if (typeStr == "ack") {
+    } else if (strcmp(typeStr, "ack") == 0) {
         type = MSG_ACK;
     } else {
         return false;
     }
     
-    // Extract the payload (everything except type)
-    doc.remove("type");
-    serializeJson(doc, payload);
-    
     return true;
 }
 
-bool Protocol::parseCommand(const String& payload, CommandType& command, String& data) {
-    DynamicJsonDocument doc(512);
-    DeserializationError error = deserializeJson(doc, payload);
-    
-    if (error) {
+bool Protocol::parseCommand(JsonDocument& doc, CommandType& command, const char*& data) {
+    if (!parseCommandName(doc["command"] | "", command)) {
         return false;
     }
     
-    String commandStr = doc["command"];
-    
-    if (commandStr == "start_recording") {
-        command = CMD_START_RECORDING;
-    } else if (commandStr == "stop_recording") {
-        command = CMD_STOP_RECORDING;
-    } else if (commandStr == "haptic_feedback") {
-        command = CMD_HAPTIC_FEEDBACK;
-    } else if (commandStr == "set_sensitivity") {
-        command = CMD_SET_SENSITIVITY;
-    } else if (commandStr == "calibrate") {
-        command = CMD_CALIBRATE;
-    } else if (commandStr == "sleep") {
-        command = CMD_SLEEP;
-    } else if (commandStr == "wake") {
-        command = CMD_WAKE;
-    } else if (commandStr == "reset") {
-        command = CMD_RESET;
-    } else {
+    // Points into doc, valid until the document is reused
+    data = doc["data"] | "";
+    return true;
+}
+
+bool Protocol::parseStatus(JsonDocument& doc, StatusType& status, const char*& data) {
+    if (!parseStatusName(doc["status"] | "", status)) {
         return false;
     }
     
-    if (doc.containsKey("data")) {
-        data = doc["data"].as<String>();
-    } else {
-        data = "";
-    }
-    
+    data = doc["data"] | "";
     return true;
 }
 
-bool Protocol::parseStatus(const String& payload, StatusType& status, String& data) {
-    DynamicJsonDocument doc(512);
-    DeserializationError error = deserializeJson(doc, payload);
-    
-    if (error) {
-        return false;
+const char* Protocol::getStatusName(StatusType status) {
+    switch (status) {
+        case STATUS_READY:
+            return "ready";
+        case STATUS_RECORDING:
+            return "recording";
+        case STATUS_PROCESSING:
+            return "processing";
+        case STATUS_LOW_BATTERY:
+            return "low_battery";
+        case STATUS_ERROR:
+            return "error";
+        case STATUS_DISCONNECTED:
+            return "disconnected";
+        default:
+            return "unknown";
     }
-    
-    String statusStr = doc["status"];
-    
-    if (statusStr == "ready") {
+}
+
+bool Protocol::parseStatusName(const char* name, StatusType& status) {
+    if (strcmp(name, "ready") == 0) {
         status = STATUS_READY;
-    } else if (statusStr == "recording") {
+    } else if (strcmp(name, "recording") == 0) {
         status = STATUS_RECORDING;
-    } else if (statusStr == "processing") {
+    } else if (strcmp(name, "processing") == 0) {
         status = STATUS_PROCESSING;
-    } else if (statusStr == "low_battery") {
+    } else if (strcmp(name, "low_battery") == 0) {
         status = STATUS_LOW_BATTERY;
-    } else if (statusStr == "error") {
+    } else if (strcmp(name, "error") == 0) {
         status = STATUS_ERROR;
-    } else if (statusStr == "disconnected") {
+    } else if (strcmp(name, "disconnected") == 0) {
         status = STATUS_DISCONNECTED;
     } else {
         return false;
     }
     
-    if (doc.containsKey("data")) {
-        data = doc["data"].as<String>();
+    return true;
+}
+
+const char* Protocol::getCommandName(CommandType command) {
+    switch (command) {
+        case CMD_START_RECORDING:
+            return "start_recording";
+        case CMD_STOP_RECORDING:
+            return "stop_recording";
+        case CMD_HAPTIC_FEEDBACK:
+            return "haptic_feedback";
+        case CMD_SET_SENSITIVITY:
+            return "set_sensitivity";
+        case CMD_CALIBRATE:
+            return "calibrate";
+        case CMD_SLEEP:
+            return "sleep";
+        case CMD_WAKE:
+            return "wake";
+        case CMD_RESET:
+            return "reset";
+        case CMD_SET_CODEC:
+            return "set_codec";
+        case CMD_SET_PROTOCOL:
+            return "set_protocol";
+        case CMD_SET_TRANSFER:
+            return "set_transfer";
+        case CMD_AUDIO_ACK:
+            return "audio_ack";
+        case CMD_SET_AUDIO_PROFILE:
+            return "set_audio_profile";
+        case CMD_OTA_BEGIN:
+            return "ota_begin";
+        case CMD_OTA_ABORT:
+            return "ota_abort";
+        default:
+            return "unknown";
+    }
+}
+
+bool Protocol::parseCommandName(const char* name, CommandType& command) {
+    if (strcmp(name, "start_recording") == 0) {
+        command = CMD_START_RECORDING;
+    } else if (strcmp(name, "stop_recording") == 0) {
+        command = CMD_STOP_RECORDING;
+    } else if (strcmp(name, "haptic_feedback") == 0) {
+        command = CMD_HAPTIC_FEEDBACK;
+    } else if (strcmp(name, "set_sensitivity") == 0) {
+        command = CMD_SET_SENSITIVITY;
+    } else if (strcmp(name, "calibrate") == 0) {
+        command = CMD_CALIBRATE;
+    } else if (strcmp(name, "sleep") == 0) {
+        command = CMD_SLEEP;
+    } else if (strcmp(name, "wake") == 0) {
+        command = CMD_WAKE;
+    } else if (strcmp(name, "reset") == 0) {
+        command = CMD_RESET;
+    } else if (strcmp(name, "set_codec") == 0) {
+        command = CMD_SET_CODEC;
+    } else if (strcmp(name, "set_protocol") == 0) {
+        command = CMD_SET_PROTOCOL;
+    } else if (strcmp(name, "set_transfer") == 0) {
+        command = CMD_SET_TRANSFER;
+    } else if (strcmp(name, "audio_ack") == 0) {
+        command = CMD_AUDIO_ACK;
+    } else if (strcmp(name, "set_audio_profile") == 0) {
+        command = CMD_SET_AUDIO_PROFILE;
+    } else if (strcmp(name, "ota_begin") == 0) {
+        command = CMD_OTA_BEGIN;
+    } else if (strcmp(name, "ota_abort") == 0) {
+        command = CMD_OTA_ABORT;
     } else {
-        data = "";
+        return false;
     }
     
     return true;
 }
 
-String Protocol::encodeAudioData(uint8_t* data, size_t length) {
-    // Simple base64-like encoding for audio data
-    String encoded = "";
+size_t Protocol::encodeAudioData(const uint8_t* data, size_t length, char* buffer, size_t size) {
+    // Hex encoding with a line break every 64 bytes
+    static const char hexDigits[] = "0123456789abcdef";
+    size_t position = 0;
     
     for (size_t i = 0; i < length; i++) {
-        if (i > 0 && i % 64 == 0) {
-            encoded += "\n"; // Line breaks for readability
+        size_t needed = (i > 0 && i % 64 == 0) ? 3 : 2;
+        if (position + needed >= size) {
+            return 0;
         }
-        encoded += String(data[i], HEX);
-        if (data[i] < 16) {
-            encoded = encoded.substring(0, encoded.length() - 1) + "0" + encoded.substring(encoded.length() - 1);
+        
+        if (needed == 3) {
+            buffer[position++] = '\n'; // Line breaks for readability
         }
+        buffer[position++] = hexDigits[data[i] >> 4];
+        buffer[position++] = hexDigits[data[i] & 0x0F];
     }
     
-    return encoded;
+    if (size > 0) {
+        buffer[position] = '\0';
+    }
+    return position;
 }
 
-bool Protocol::decodeAudioData(const String& encoded, uint8_t* buffer, size_t& length) {
-    String cleaned = encoded;
-    cleaned.replace("\n", "");
-    cleaned.replace(" ", "");
+bool Protocol::decodeAudioData(const char* encoded, uint8_t* buffer, size_t& length) {
+    size_t count = 0;
+    int high = -1;
     
-    if (cleaned.length() % 2 != 0) {
-        return false; // Invalid hex string
+    for (const char* p = encoded; *p != '\0'; p++) {
+        if (*p == '\n' || *p == ' ') {
+            continue;
+        }
+        
+        int nibble;
+        if (*p >= '0' && *p <= '9') {
+            nibble = *p - '0';
+        } else if (*p >= 'a' && *p <= 'f') {
+            nibble = *p - 'a' + 10;
+        } else if (*p >= 'A' && *p <= 'F') {
+            nibble = *p - 'A' + 10;
+        } else {
+            return false;
+        }
+        
+        if (high < 0) {
+            high = nibble;
+        } else {
+            buffer[count++] = (uint8_t)((high << 4) | nibble);
+            high = -1;
+        }
     }
     
-    length = cleaned.length() / 2;
-    
-    for (size_t i = 0; i < length; i++) {
-        String byteStr = cleaned.substring(i * 2, i * 2 + 2);
-        buffer[i] = (uint8_t)strtol(byteStr.c_str(), NULL, 16);
+    if (high >= 0) {
+        return false; // Invalid hex string
     }
     
+    length = count;
     return true;
 }
 
-String Protocol::generateMessageId() {
+size_t Protocol::generateMessageId(char* buffer, size_t size) {
     static uint32_t counter = 0;
     counter++;
     
-    return String(ESP.getChipId(), HEX) + "_" + String(counter);
+    // Low bytes of the factory MAC identify the device
+    uint32_t deviceId = (uint32_t)(ESP.getEfuseMac() >> 16);
+    int written = snprintf(buffer, size, "%x_%u", deviceId, counter);
+    return written > 0 ? min((size_t)written, size - 1) : 0;
 }
 
 uint32_t Protocol::getTimestamp() {
@@ -291,21 +364,36 @@ uint32_t Protocol::getTimestamp() {
 }
 
 float Protocol::getBatteryVoltage() {
-    int rawValue = analogRead(BATTERY_PIN);
-    return (rawValue * 3.3) / 4095.0;
+    // Cached by the battery monitor, no ADC access in the message path
+    return BatteryMonitor::getVoltage();
 }
 
-String Protocol::getDeviceInfo() {
-    DynamicJsonDocument doc(256);
+size_t Protocol::getDeviceInfo(char* buffer, size_t size) {
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
+    char chipId[12];
+    snprintf(chipId, sizeof(chipId), "%x", (uint32_t)(ESP.getEfuseMac() >> 16));
     
     doc["device_name"] = DEVICE_NAME;
     doc["version"] = DEVICE_VERSION;
     doc["manufacturer"] = MANUFACTURER_NAME;
-    doc["chip_id"] = String(ESP.getChipId(), HEX);
+    doc["chip_id"] = (const char*)chipId;
     doc["flash_size"] = ESP.getFlashChipSize();
     doc["free_heap"] = ESP.getFreeHeap();
+    doc["largest_free_block"] = getLargestFreeBlock();
     
-    String result;
-    serializeJson(doc, result);
-    return result;
-}
\ No newline at end of file
+    return serialize(doc, buffer, size);
+}
+
+uint32_t Protocol::getLargestFreeBlock() {
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+uint8_t Protocol::getHeapFragmentation() {
+    // Share of free memory that cannot be handed out as one block
+    uint32_t freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    if (freeBytes == 0) {
+        return 100;
+    }
+    
+    return (uint8_t)(100 - ((uint64_t)getLargestFreeBlock() * 100) / freeBytes);
+}
@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <esp_heap_caps.h>
+#include "config.h"
 
 // Message types for BLE communication
 enum MessageType {
@@ -23,9 +25,18 @@ enum CommandType {
     CMD_CALIBRATE,
     CMD_SLEEP,
     CMD_WAKE,
-    CMD_RESET
+    CMD_RESET,
+    CMD_SET_CODEC,
+    CMD_SET_PROTOCOL,
+    CMD_SET_TRANSFER,
+    CMD_AUDIO_ACK,
+    CMD_SET_AUDIO_PROFILE,
+    CMD_OTA_BEGIN,
+    CMD_OTA_ABORT
 };
 
+#define COMMAND_TYPE_COUNT (CMD_OTA_ABORT + 1)
+
 // Status types to mobile app
 enum StatusType {
     STATUS_READY,
@@ -48,29 +59,45 @@ enum ErrorCode {
     ERROR_TIMEOUT = 7
 };
 
+// JSON messages are serialized into caller supplied buffers with fixed
+// size documents, so building or parsing a message never touches the heap.
+// Functions returning size_t give the message length, or 0 if it did not fit.
 class Protocol {
 public:
     // Message creation
-    static String createCommandMessage(const String& command, const String& data = "");
-    static String createStatusMessage(StatusType status, const String& data = "");
-    static String createErrorMessage(ErrorCode error, const String& description = "");
-    static String createHeartbeatMessage();
-    static String createAckMessage(const String& messageId);
+    static size_t createCommandMessage(char* buffer, size_t size, const char* command, const char* data = nullptr);
+    static size_t createStatusMessage(char* buffer, size_t size, StatusType status, const char* data = nullptr);
+    static size_t createErrorMessage(char* buffer, size_t size, ErrorCode error, const char* description = nullptr);
+    static size_t createHeartbeatMessage(char* buffer, size_t size);
+    static size_t createAckMessage(char* buffer, size_t size, const char* messageId);
+    
+    // Message parsing, parseMessage() fills doc once and the others read from it
+    static bool parseMessage(JsonDocument& doc, const char* json, size_t length, MessageType& type);
+    static bool parseCommand(JsonDocument& doc, CommandType& command, const char*& data);
+    static bool parseStatus(JsonDocument& doc, StatusType& status, const char*& data);
     
-    // Message parsing
-    static bool parseMessage(const String& json, MessageType& type, String& payload);
-    static bool parseCommand(const String& payload, CommandType& command, String& data);
-    static bool parseStatus(const String& payload, StatusType& status, String& data);
+    // Name lookup, shared with the binary frame path
+    static const char* getStatusName(StatusType status);
+    static bool parseStatusName(const char* name, StatusType& status);
+    static const char* getCommandName(CommandType command);
+    static bool parseCommandName(const char* name, CommandType& command);
     
     // Audio data encoding
-    static String encodeAudioData(uint8_t* data, size_t length);
-    static bool decodeAudioData(const String& encoded, uint8_t* buffer, size_t& length);
+    static size_t encodeAudioData(const uint8_t* data, size_t length, char* buffer, size_t size);
+    static bool decodeAudioData(const char* encoded, uint8_t* buffer, size_t& length);
     
     // Utility functions
-    static String generateMessageId();
+    static size_t generateMessageId(char* buffer, size_t size);
     static uint32_t getTimestamp();
     static float getBatteryVoltage();
-    static String getDeviceInfo();
+    static size_t getDeviceInfo(char* buffer, size_t size);
+    
+    // Heap health, reported in heartbeats to watch for fragmentation
+    static uint32_t getLargestFreeBlock();
+    static uint8_t getHeapFragmentation();
+
+private:
+    static size_t serialize(const JsonDocument& doc, char* buffer, size_t size);
 };
 
 #endif // PROTOCOL_H
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "scheduler.h"
+#include "logger.h"
+
+// Upper bounds of the jitter buckets, the last one is open ended
+static const uint32_t SCHEDULER_JITTER_BOUNDS_US[SCHEDULER_JITTER_BUCKETS - 1] = {
+    50, 100, 200, 500, 1000, 2000, 5000
+};
+
+Scheduler::Scheduler() {
+    taskCount = 0;
+    loopTask = nullptr;
+    pendingEvents.store(0);
+    memset(tasks, 0, sizeof(tasks));
+    memset((void*)signalTimeUs, 0, sizeof(signalTimeUs));
+    idleUs = 0;
+    statsStartUs = 0;
+    memset(jitterHistogram, 0, sizeof(jitterHistogram));
+}
+
+bool Scheduler::begin() {
+    // Must be called from the task that will call run()
+    loopTask = xTaskGetCurrentTaskHandle();
+    statsStartUs = micros();
+    
+    LOGGER_INFO("Scheduler initialized");
+    return loopTask != nullptr;
+}
+
+int Scheduler::addTask(const char* name, void (*callback)(), uint32_t periodMs, uint32_t eventMask) {
+    if (taskCount >= SCHEDULER_MAX_TASKS || !callback) {
+        LOGGER_WARN("Cannot add scheduler task %s", name);
+        return -1;
+    }
+    
+    Task& task = tasks[taskCount];
+    memset(&task, 0, sizeof(Task));
+    task.name = name;
+    task.callback = callback;
+    task.eventMask = eventMask;
+    task.periodUs = periodMs * 1000;
+    task.nextRunUs = micros() + task.periodUs;
+    task.enabled = true;
+    
+    return taskCount++;
+}
+
+void Scheduler::setPeriod(int taskId, uint32_t periodMs) {
+    if (taskId < 0 || taskId >= taskCount) {
+        return;
+    }
+    
+    uint32_t periodUs = periodMs * 1000;
+    if (tasks[taskId].periodUs != periodUs) {
+        tasks[taskId].periodUs = periodUs;
+        tasks[taskId].nextRunUs = micros() + periodUs;
+    }
+}
+
+void Scheduler::setEnabled(int taskId, bool enabled) {
+    if (taskId < 0 || taskId >= taskCount) {
+        return;
+    }
+    
+    if (enabled && !tasks[taskId].enabled) {
+        tasks[taskId].nextRunUs = micros() + tasks[taskId].periodUs;
+    }
+    tasks[taskId].enabled = enabled;
+}
+
+void IRAM_ATTR Scheduler::stampSignal(SchedulerEvent event, uint32_t bit) {
+    uint32_t now = micros();
+    bool stamped = (pendingEvents.load() & bit) == 0;
+    if (stamped) {
+        signalTimeUs[event] = now;
+    }
+    
+    // run() took the burst between the check and here, this signal starts
+    // the next one
+    if ((pendingEvents.fetch_or(bit) & bit) == 0 && !stamped) {
+        signalTimeUs[event] = now;
+    }
+}
+
+void Scheduler::signal(SchedulerEvent event) {
+    uint32_t bit = SCHEDULER_EVENT_BIT(event);
+    
+    // Latency is measured from the first signal of a burst
+    stampSignal(event, bit);
+    
+    if (loopTask) {
+        xTaskNotifyGive(loopTask);
+    }
+}
+
+void IRAM_ATTR Scheduler::signalFromISR(SchedulerEvent event) {
+    uint32_t bit = SCHEDULER_EVENT_BIT(event);
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    
+    stampSignal(event, bit);
+    
+    if (loopTask) {
+        vTaskNotifyGiveFromISR(loopTask, &higherPriorityTaskWoken);
+        if (higherPriorityTaskWoken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+uint32_t Scheduler::timeUntilNextDeadline(uint32_t nowUs) {
+    uint32_t sleepUs = SCHEDULER_MAX_SLEEP_MS * 1000;
+    
+    for (int i = 0; i < taskCount; i++) {
+        if (!tasks[i].enabled || tasks[i].periodUs == 0) {
+            continue;
+        }
+        
+        int32_t remaining = (int32_t)(tasks[i].nextRunUs - nowUs);
+        if (remaining <= 0) {
+            return 0;
+        }
+        if ((uint32_t)remaining < sleepUs) {
+            sleepUs = remaining;
+        }
+    }
+    
+    return sleepUs;
+}
+
+void Scheduler::run() {
+    uint32_t nowUs = micros();
+    uint32_t sleepUs = timeUntilNextDeadline(nowUs);
+    
+    // Block until an event arrives or the next deadline, rounding up so a
+    // task is never woken just before it is due
+    if (sleepUs > 0 && pendingEvents.load() == 0) {
+        TickType_t ticks = (sleepUs + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+        ulTaskNotifyTake(pdTRUE, ticks);
+        
+        uint32_t wokeUs = micros();
+        idleUs += wokeUs - nowUs;
+        nowUs = wokeUs;
+    }
+    
+    uint32_t events = pendingEvents.exchange(0);
+    
+    for (int i = 0; i < taskCount; i++) {
+        Task& task = tasks[i];
+        if (!task.enabled) {
+            continue;
+        }
+        
+        uint32_t triggered = events & task.eventMask;
+        if (triggered) {
+            // Report the oldest of the events that woke this task
+            uint32_t latencyUs = 0;
+            for (int e = 0; e < EVENT_COUNT; e++) {
+                if (triggered & SCHEDULER_EVENT_BIT(e)) {
+                    latencyUs = max(latencyUs, (uint32_t)(micros() - signalTimeUs[e]));
+                }
+            }
+            dispatch(task, latencyUs);
+        } else if (task.periodUs > 0 && (int32_t)(micros() - task.nextRunUs) >= 0) {
+            dispatch(task, micros() - task.nextRunUs);
+        }
+    }
+}
+
+void Scheduler::dispatch(Task& task, uint32_t latencyUs) {
+    uint32_t startUs = micros();
+    
+    task.callback();
+    
+    uint32_t endUs = micros();
+    uint32_t runUs = endUs - startUs;
+    
+    task.runs++;
+    task.totalLatencyUs += latencyUs;
+    task.maxLatencyUs = max(task.maxLatencyUs, latencyUs);
+    task.maxRunUs = max(task.maxRunUs, runUs);
+    task.totalRunUs += runUs;
+    
+    int bucket = 0;
+    while (bucket < SCHEDULER_JITTER_BUCKETS - 1 && latencyUs > SCHEDULER_JITTER_BOUNDS_US[bucket]) {
+        bucket++;
+    }
+    jitterHistogram[bucket]++;
+    
+    // Any run restarts the period, so event driven tasks only poll as a fallback
+    task.nextRunUs = endUs + task.periodUs;
+}
+
+int Scheduler::getTaskCount() {
+    return taskCount;
+}
+
+SchedulerTaskStats Scheduler::getTaskStats(int taskId) {
+    SchedulerTaskStats stats;
+    memset(&stats, 0, sizeof(stats));
+    
+    if (taskId < 0 || taskId >= taskCount) {
+        return stats;
+    }
+    
+    const Task& task = tasks[taskId];
+    stats.name = task.name;
+    stats.runs = task.runs;
+    stats.avgLatencyUs = task.runs > 0 ? task.totalLatencyUs / task.runs : 0;
+    stats.maxLatencyUs = task.maxLatencyUs;
+    stats.maxRunUs = task.maxRunUs;
+    
+    uint32_t elapsed = micros() - statsStartUs;
+    stats.cpuPermille = elapsed > 0 ? (uint16_t)min(task.totalRunUs * 1000 / elapsed, (uint64_t)1000) : 0;
+    
+    return stats;
+}
+
+uint8_t Scheduler::getIdlePercent() {
+    uint32_t elapsed = micros() - statsStartUs;
+    if (elapsed == 0) {
+        return 0;
+    }
+    
+    return (uint8_t)(((uint64_t)idleUs * 100) / elapsed);
+}
+
+uint32_t Scheduler::getStatsWindowMs() {
+    return (micros() - statsStartUs) / 1000;
+}
+
+void Scheduler::getJitterHistogram(uint32_t* buckets) {
+    memcpy(buckets, jitterHistogram, sizeof(jitterHistogram));
+}
+
+void Scheduler::resetStats() {
+    for (int i = 0; i < taskCount; i++) {
+        tasks[i].runs = 0;
+        tasks[i].totalLatencyUs = 0;
+        tasks[i].maxLatencyUs = 0;
+        tasks[i].maxRunUs = 0;
+        tasks[i].totalRunUs = 0;
+    }
+    
+    memset(jitterHistogram, 0, sizeof(jitterHistogram));
+    idleUs = 0;
+    statsStartUs = micros();
+}
+
+void Scheduler::printStats() {
+    LOGGER_INFO("Scheduler: %u%% idle", getIdlePercent());
+    
+    for (int i = 0; i < taskCount; i++) {
+        SchedulerTaskStats stats = getTaskStats(i);
+        LOGGER_INFO("  %-12s runs %u, latency avg %u us max %u us, run max %u us, cpu %u.%u%%",
+                    stats.name, stats.runs, stats.avgLatencyUs, stats.maxLatencyUs, stats.maxRunUs,
+                    stats.cpuPermille / 10, stats.cpuPermille % 10);
+    }
+    
+    // One log line, built up front
+    char histogram[LOGGER_LINE_SIZE];
+    int length = 0;
+    for (int i = 0; i < SCHEDULER_JITTER_BUCKETS && length < (int)sizeof(histogram); i++) {
+        if (i < SCHEDULER_JITTER_BUCKETS - 1) {
+            length += snprintf(histogram + length, sizeof(histogram) - length, " <=%u:%u",
+                               SCHEDULER_JITTER_BOUNDS_US[i], jitterHistogram[i]);
+        } else {
+            length += snprintf(histogram + length, sizeof(histogram) - length, " more:%u", jitterHistogram[i]);
+        }
+    }
+    LOGGER_INFO("  latency histogram%s", histogram);
+}
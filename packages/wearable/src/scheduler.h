@@ -0,0 +1,100 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+// Event sources that can wake the scheduler, one bit each
+enum SchedulerEvent {
+    EVENT_AUDIO = 0,  // Capture task queued a frame
+    EVENT_ACCEL,      // LIS3DH INT1
+    EVENT_BUTTON,     // Button edge
+    EVENT_BLE,        // Connection change or incoming write
+    EVENT_BOOT,       // A component finished starting
+    EVENT_COUNT
+};
+
+#define SCHEDULER_EVENT_BIT(event) (1UL << (event))
+
+// Dispatch latency histogram over all tasks: up to 50, 100, 200, 500 us,
+// 1, 2, 5 ms, and anything slower in the last bucket
+#define SCHEDULER_JITTER_BUCKETS 8
+
+// Per-task dispatch statistics. Latency is measured from the event signal
+// (or the periodic deadline) to the start of the callback.
+struct SchedulerTaskStats {
+    const char* name;
+    uint32_t runs;
+    uint32_t avgLatencyUs;
+    uint32_t maxLatencyUs;
+    uint32_t maxRunUs;
+    uint16_t cpuPermille; // Share of the stats window spent in the callback
+};
+
+// Cooperative scheduler for the Arduino loop task. Tasks run when one of
+// their events is signalled or their period elapses; in between the loop
+// task blocks so the idle task (and automatic light sleep) can run.
+class Scheduler {
+private:
+    struct Task {
+        const char* name;
+        void (*callback)();
+        uint32_t eventMask;
+        uint32_t periodUs;   // 0 for event-only tasks
+        uint32_t nextRunUs;
+        bool enabled;
+        
+        uint32_t runs;
+        uint64_t totalLatencyUs;
+        uint32_t maxLatencyUs;
+        uint32_t maxRunUs;
+        uint64_t totalRunUs;
+    };
+    
+    Task tasks[SCHEDULER_MAX_TASKS];
+    int taskCount;
+    TaskHandle_t loopTask;
+    
+    // Set by signal(), consumed by run()
+    std::atomic<uint32_t> pendingEvents;
+    volatile uint32_t signalTimeUs[EVENT_COUNT];
+    
+    uint32_t idleUs;
+    uint32_t statsStartUs;
+    uint32_t jitterHistogram[SCHEDULER_JITTER_BUCKETS];
+    
+    // Time of a burst's first signal, stored before its bit is published so
+    // run() does not pair the bit with the previous burst's time
+    void IRAM_ATTR stampSignal(SchedulerEvent event, uint32_t bit);
+    uint32_t timeUntilNextDeadline(uint32_t nowUs);
+    void dispatch(Task& task, uint32_t latencyUs);
+
+public:
+    Scheduler();
+    
+    bool begin();
+    
+    // Registration, returns the task id or -1 when the table is full
+    int addTask(const char* name, void (*callback)(), uint32_t periodMs, uint32_t eventMask = 0);
+    void setPeriod(int taskId, uint32_t periodMs);
+    void setEnabled(int taskId, bool enabled);
+    
+    // Event sources, safe from any task or from an ISR respectively
+    void signal(SchedulerEvent event);
+    void IRAM_ATTR signalFromISR(SchedulerEvent event);
+    
+    // Runs everything that is due, otherwise blocks until the next deadline
+    void run();
+    
+    // Diagnostics
+    int getTaskCount();
+    SchedulerTaskStats getTaskStats(int taskId);
+    uint8_t getIdlePercent();
+    uint32_t getStatsWindowMs();
+    void getJitterHistogram(uint32_t* buckets); // SCHEDULER_JITTER_BUCKETS entries
+    void resetStats();
+    void printStats();
+};
+
+#endif // SCHEDULER_H
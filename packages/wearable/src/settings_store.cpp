@@ -0,0 +1,72 @@
+#include "settings_store.h"
+#include "logger.h"
+
+SettingsStore::SettingsStore() {
+    loaded = false;
+    setDefaults(settings);
+}
+
+void SettingsStore::setDefaults(DeviceSettings& defaults) {
+    memset(&defaults, 0, sizeof(defaults));
+    defaults.version = SETTINGS_VERSION;
+    defaults.sensitivity = 0.5f;
+}
+
+bool SettingsStore::begin() {
+    Preferences preferences;
+    
+    // Read only fails until the first save created the namespace
+    if (!preferences.begin(SETTINGS_NAMESPACE, true)) {
+        LOGGER_INFO("No stored settings, using defaults");
+        return false;
+    }
+    
+    DeviceSettings stored;
+    size_t length = preferences.getBytes(SETTINGS_KEY, &stored, sizeof(stored));
+    preferences.end();
+    
+    if (length != sizeof(stored) || stored.version != SETTINGS_VERSION) {
+        LOGGER_INFO("Stored settings not usable, using defaults");
+        return false;
+    }
+    
+    settings = stored;
+    loaded = true;
+    LOGGER_INFO("Settings loaded, %s", (settings.flags & SETTINGS_FLAG_CALIBRATED) ? "calibrated" : "not calibrated");
+    return true;
+}
+
+const DeviceSettings& SettingsStore::get() {
+    return settings;
+}
+
+bool SettingsStore::isLoaded() {
+    return loaded;
+}
+
+bool SettingsStore::save(const DeviceSettings& updated) {
+    // Flash pages wear, repeated commands with the same values cost nothing
+    if (loaded && memcmp(&updated, &settings, sizeof(settings)) == 0) {
+        return true;
+    }
+    
+    Preferences preferences;
+    if (!preferences.begin(SETTINGS_NAMESPACE, false)) {
+        LOGGER_ERROR("Failed to open settings storage");
+        return false;
+    }
+    
+    DeviceSettings record = updated;
+    record.version = SETTINGS_VERSION;
+    size_t written = preferences.putBytes(SETTINGS_KEY, &record, sizeof(record));
+    preferences.end();
+    
+    if (written != sizeof(record)) {
+        LOGGER_ERROR("Failed to save settings");
+        return false;
+    }
+    
+    settings = record;
+    loaded = true;
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "config.h"
+
+#define SETTINGS_VERSION 2
+#define SETTINGS_FLAG_CALIBRATED 0x01
+
+// Calibration and tuning that survive a restart. Kept as one blob under a
+// single NVS key: read once at boot, written only when a value changes.
+// A blob of another size or version is ignored and the defaults are used.
+struct DeviceSettings {
+    uint8_t version;
+    uint8_t flags;
+    int16_t accelOffset[3]; // Zero-g offset, raw LIS3DH counts
+    float sensitivity;      // Last set_sensitivity, 0..1
+};
+
+class SettingsStore {
+private:
+    DeviceSettings settings;
+    bool loaded;
+    
+    static void setDefaults(DeviceSettings& defaults);
+
+public:
+    SettingsStore();
+    
+    // Loads the stored blob, false only means the defaults are in use
+    bool begin();
+    
+    const DeviceSettings& get();
+    bool isLoaded();
+    
+    // Writes to flash unless nothing changed
+    bool save(const DeviceSettings& updated);
+};
+
+#endif // SETTINGS_STORE_H
@@ -0,0 +1,57 @@
+#include "telemetry.h"
+#include "protocol.h"
+
+void Telemetry::captureSystem(TelemetrySnapshot& snapshot) {
+    snapshot.version = TELEMETRY_VERSION;
+    snapshot.uptimeMs = millis();
+    
+    snapshot.freeHeap = ESP.getFreeHeap();
+    snapshot.minFreeHeap = ESP.getMinFreeHeap();
+    snapshot.largestFreeBlock = Protocol::getLargestFreeBlock();
+    
+    // Through a local copy, the packed member may be unaligned
+    uint32_t bootPhaseMs[BOOT_PHASE_COUNT];
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        bootPhaseMs[i] = BootTimeline::getMs((BootPhase)i);
+    }
+    memcpy(snapshot.bootPhaseMs, bootPhaseMs, sizeof(bootPhaseMs));
+    
+    // High-water mark in bytes on the ESP32 port
+    snapshot.loopStackFree = (uint16_t)min(uxTaskGetStackHighWaterMark(NULL), (UBaseType_t)UINT16_MAX);
+}
+
+void Telemetry::captureScheduler(TelemetrySnapshot& snapshot, TelemetryTaskRecord* records, Scheduler& scheduler) {
+    snapshot.idlePercent = scheduler.getIdlePercent();
+    snapshot.windowMs = scheduler.getStatsWindowMs();
+    
+    // Through a local copy, the packed member may be unaligned
+    uint32_t histogram[SCHEDULER_JITTER_BUCKETS];
+    scheduler.getJitterHistogram(histogram);
+    memcpy(snapshot.jitterHistogram, histogram, sizeof(histogram));
+    
+    int count = min(scheduler.getTaskCount(), SCHEDULER_MAX_TASKS);
+    for (int i = 0; i < count; i++) {
+        SchedulerTaskStats stats = scheduler.getTaskStats(i);
+        TelemetryTaskRecord& record = records[i];
+        
+        memset(record.tag, 0, sizeof(record.tag));
+        strncpy(record.tag, stats.name, sizeof(record.tag));
+        record.cpuPermille = stats.cpuPermille;
+        record.maxRunUs = (uint16_t)min(stats.maxRunUs, (uint32_t)UINT16_MAX);
+        record.maxLatencyUs = (uint16_t)min(stats.maxLatencyUs, (uint32_t)UINT16_MAX);
+    }
+    snapshot.taskCount = count;
+}
+
+size_t Telemetry::serialize(const TelemetrySnapshot& snapshot, const TelemetryTaskRecord* records, uint8_t* buffer, size_t size) {
+    size_t recordsLength = snapshot.taskCount * sizeof(TelemetryTaskRecord);
+    size_t length = sizeof(TelemetrySnapshot) + recordsLength;
+    if (length > size) {
+        return 0;
+    }
+    
+    // Packed structs, the ESP32 is little-endian like the wire format
+    memcpy(buffer, &snapshot, sizeof(TelemetrySnapshot));
+    memcpy(buffer + sizeof(TelemetrySnapshot), records, recordsLength);
+    return length;
+}
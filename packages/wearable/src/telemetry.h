@@ -0,0 +1,81 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "scheduler.h"
+#include "boot_timeline.h"
+
+// Runtime health snapshot served on the telemetry characteristic. The app
+// polls it with a plain read; the layout is fixed and little-endian, one
+// TelemetrySnapshot header followed by taskCount TelemetryTaskRecords.
+// Scheduler figures cover the current stats window (windowMs), everything
+// else counts since boot.
+#define TELEMETRY_VERSION 2
+
+struct __attribute__((packed)) TelemetryTaskRecord {
+    char tag[4];           // Scheduler task name, truncated, zero padded
+    uint16_t cpuPermille;
+    uint16_t maxRunUs;     // Saturate at 65535
+    uint16_t maxLatencyUs;
+};
+
+struct __attribute__((packed)) TelemetrySnapshot {
+    uint8_t version;
+    uint8_t taskCount;
+    uint8_t idlePercent;
+    uint8_t reserved;
+    uint32_t uptimeMs;
+    uint32_t windowMs;
+    
+    // Heap, bytes
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestFreeBlock;
+    
+    // Stack high-water marks, bytes never used
+    uint16_t loopStackFree;
+    uint16_t captureStackFree;
+    
+    // Dispatch latency, see SCHEDULER_JITTER_BUCKETS
+    uint32_t jitterHistogram[SCHEDULER_JITTER_BUCKETS];
+    
+    // Sensors
+    uint32_t i2sOverruns;
+    uint32_t audioDroppedSamples;
+    uint32_t accelReadFailures;
+    uint32_t accelFifoOverruns;
+    
+    // BLE
+    uint32_t notifyFailures;
+    uint32_t notifyDrops;
+    uint32_t droppedCommands;
+    uint32_t txPoolExhausted;
+    
+    // Connection, see ReconnectStats
+    uint16_t disconnects;
+    uint16_t reconnects;
+    uint32_t lastReconnectMs;
+    uint32_t avgReconnectMs;
+    uint32_t maxReconnectMs;
+    
+    // Boot, ms per BootPhase with 0 for phases not reached yet
+    uint32_t bootPhaseMs[BOOT_PHASE_COUNT];
+};
+
+#define TELEMETRY_MAX_SIZE (sizeof(TelemetrySnapshot) + SCHEDULER_MAX_TASKS * sizeof(TelemetryTaskRecord))
+
+class Telemetry {
+public:
+    // Heap, uptime and the caller's stack. Call from the loop task.
+    static void captureSystem(TelemetrySnapshot& snapshot);
+    
+    // Idle time, jitter histogram and one record per task into records,
+    // which must hold SCHEDULER_MAX_TASKS entries
+    static void captureScheduler(TelemetrySnapshot& snapshot, TelemetryTaskRecord* records, Scheduler& scheduler);
+    
+    // Header plus snapshot.taskCount records, returns the length or 0 if it does not fit
+    static size_t serialize(const TelemetrySnapshot& snapshot, const TelemetryTaskRecord* records, uint8_t* buffer, size_t size);
+};
+
+#endif // TELEMETRY_H
@@ -13,12 +13,306 @@
 #include "haptic_controller.h"
 #include "gesture_detector.h"
 #include "protocol.h"
+#include "frame_protocol.h"
+#include "battery_monitor.h"
 
 // Test instances
 BLEManager testBLE;
 VoiceDetector testVoice;
 HapticController testHaptic;
 GestureDetector testGesture;
+BatteryMonitor testBatteryMonitor;
+
+// Micro-benchmarks for the hot paths, started with the "bench" command.
+// Each result is one JSON line so runs can be diffed between releases:
+// {"bench":"name","iterations":N,"min_cycles":..,"avg_cycles":..,"max_cycles":..,"avg_us":..}
+// Cycle counts are ESP.getCycleCount() deltas less the cost of reading the counter.
+class FirmwareBenchmark {
+private:
+    static uint32_t timerOverhead;
+    
+    template <typename Body>
+    static void run(const char* name, uint32_t iterations, Body body) {
+        uint32_t minCycles = UINT32_MAX;
+        uint32_t maxCycles = 0;
+        uint64_t totalCycles = 0;
+        
+        for (uint32_t i = 0; i < iterations; i++) {
+            uint32_t start = ESP.getCycleCount();
+            body();
+            uint32_t cycles = ESP.getCycleCount() - start;
+            cycles = cycles > timerOverhead ? cycles - timerOverhead : 0;
+            
+            minCycles = min(minCycles, cycles);
+            maxCycles = max(maxCycles, cycles);
+            totalCycles += cycles;
+        }
+        
+        uint32_t avgCycles = (uint32_t)(totalCycles / iterations);
+        Serial.printf("{\"bench\":\"%s\",\"iterations\":%u,\"min_cycles\":%u,\"avg_cycles\":%u,\"max_cycles\":%u,\"avg_us\":%.2f}\n",
+                      name, iterations, minCycles, avgCycles, maxCycles,
+                      (float)avgCycles / ESP.getCpuFreqMHz());
+    }
+    
+    static void skipped(const char* name, const char* reason) {
+        Serial.printf("{\"bench\":\"%s\",\"skipped\":\"%s\"}\n", name, reason);
+    }
+    
+    static void calibrate() {
+        timerOverhead = UINT32_MAX;
+        for (int i = 0; i < 100; i++) {
+            uint32_t start = ESP.getCycleCount();
+            timerOverhead = min(timerOverhead, ESP.getCycleCount() - start);
+        }
+    }
+    
+    static void benchmarkGesture() {
+        // Own instance, analysis needs no accelerometer
+        GestureDetector gesture;
+        
+        // Resting on the table with a little noise, and a tap every 64 samples
+        for (uint32_t i = 0; i < GESTURE_BUFFER_SIZE; i++) {
+            gesture.processSample(i & 7, -(int16_t)(i & 3), ACCEL_COUNTS_PER_G);
+        }
+        
+        uint32_t n = 0;
+        run("gesture_process_sample", BENCHMARK_ITERATIONS, [&]() {
+            int16_t z = (n % 64 == 0) ? 3 * ACCEL_COUNTS_PER_G : ACCEL_COUNTS_PER_G + (int16_t)(n & 15);
+            gesture.processSample(n & 7, -(int16_t)(n & 3), z);
+            gesture.pendingGesture = GESTURE_NONE; // Analyse every sample
+            n++;
+        });
+        
+        run("gesture_classify_window", BENCHMARK_ITERATIONS, [&]() {
+            gesture.classifyWindow();
+        });
+        
+        gesture.isInitialized = true;
+        run("gesture_detect", BENCHMARK_ITERATIONS, [&]() {
+            gesture.detectGesture();
+        });
+    }
+    
+    static void benchmarkAccelerometer() {
+        if (!testGesture.isReady() && !testGesture.begin()) {
+            skipped("accel_i2c_read", "no_accelerometer");
+            return;
+        }
+        
+        AccelData data;
+        run("accel_i2c_read", BENCHMARK_I2C_ITERATIONS, [&]() {
+            testGesture.readAccelerometer(data);
+        });
+    }
+    
+    static void benchmarkAudio() {
+        // 500Hz tone around the ADC midpoint, one capture block
+        static int16_t tone[AUDIO_FRONTEND_MAX_SAMPLES];
+        static int16_t block[AUDIO_FRONTEND_MAX_SAMPLES];
+        for (size_t i = 0; i < AUDIO_FRONTEND_MAX_SAMPLES; i++) {
+            tone[i] = 2048 + (int16_t)(400.0f * sinf(2.0f * PI * 500.0f * i / SAMPLE_RATE));
+        }
+        
+        AudioFrontend frontend;
+        AudioFeatures features;
+        run("audio_frontend_process", BENCHMARK_ITERATIONS, [&]() {
+            memcpy(block, tone, sizeof(block));
+            frontend.process(block, AUDIO_FRONTEND_MAX_SAMPLES, features);
+        });
+        
+        run("voice_detect_activity", BENCHMARK_ITERATIONS, [&]() {
+            testVoice.detectVoiceActivity(features);
+        });
+        
+        run("voice_process_wake_word", BENCHMARK_ITERATIONS, [&]() {
+            testVoice.processWakeWord(features);
+        });
+        
+        WakeWordEngine& engine = testVoice.getWakeWordEngine();
+        if (engine.isReady()) {
+            run("wake_word_engine_process", BENCHMARK_ITERATIONS, [&]() {
+                engine.process(features.samples, features.count);
+            });
+        } else {
+            skipped("wake_word_engine_process", "engine_not_ready");
+        }
+    }
+    
+    static void benchmarkProtocol() {
+        char message[BLE_TX_BUFFER_SIZE];
+        uint8_t frame[BLE_TX_BUFFER_SIZE];
+        StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
+        MessageType type;
+        
+        run("protocol_create_command", BENCHMARK_ITERATIONS, [&]() {
+            Protocol::createCommandMessage(message, sizeof(message), "gesture", "tap");
+        });
+        run("protocol_create_status", BENCHMARK_ITERATIONS, [&]() {
+            Protocol::createStatusMessage(message, sizeof(message), STATUS_READY);
+        });
+        run("protocol_create_error", BENCHMARK_ITERATIONS, [&]() {
+            Protocol::createErrorMessage(message, sizeof(message), ERROR_TIMEOUT, "benchmark");
+        });
+        run("protocol_create_heartbeat", BENCHMARK_ITERATIONS, [&]() {
+            Protocol::createHeartbeatMessage(message, sizeof(message));
+        });
+        run("protocol_create_ack", BENCHMARK_ITERATIONS, [&]() {
+            Protocol::createAckMessage(message, sizeof(message), "0123456789ab-1");
+        });
+        
+        static const char commandJson[] = "{\"type\":\"command\",\"command\":\"haptic_feedback\",\"data\":\"click\"}";
+        run("protocol_parse_command", BENCHMARK_ITERATIONS, [&]() {
+            CommandType command;
+            const char* data;
+            if (Protocol::parseMessage(doc, commandJson, sizeof(commandJson) - 1, type)) {
+                Protocol::parseCommand(doc, command, data);
+            }
+        });
+        
+        static const char statusJson[] = "{\"type\":\"status\",\"status\":\"ready\",\"data\":\"\"}";
+        run("protocol_parse_status", BENCHMARK_ITERATIONS, [&]() {
+            StatusType status;
+            const char* data;
+            if (Protocol::parseMessage(doc, statusJson, sizeof(statusJson) - 1, type)) {
+                Protocol::parseStatus(doc, status, data);
+            }
+        });
+        
+        // One streaming chunk worth of audio
+        static uint8_t audio[64];
+        static char encoded[2 * sizeof(audio) + 2];
+        for (size_t i = 0; i < sizeof(audio); i++) {
+            audio[i] = (uint8_t)(i * 37);
+        }
+        run("protocol_encode_audio", BENCHMARK_ITERATIONS, [&]() {
+            Protocol::encodeAudioData(audio, sizeof(audio), encoded, sizeof(encoded));
+        });
+        run("protocol_decode_audio", BENCHMARK_ITERATIONS, [&]() {
+            size_t length;
+            Protocol::decodeAudioData(encoded, audio, length);
+        });
+        
+        uint16_t sequence = 0;
+        run("frame_create_command", BENCHMARK_ITERATIONS, [&]() {
+            FrameProtocol::createCommandFrame(frame, sizeof(frame), sequence++, "gesture", "tap");
+        });
+        run("frame_create_status", BENCHMARK_ITERATIONS, [&]() {
+            FrameProtocol::createStatusFrame(frame, sizeof(frame), sequence++, STATUS_READY);
+        });
+        run("frame_create_error", BENCHMARK_ITERATIONS, [&]() {
+            FrameProtocol::createErrorFrame(frame, sizeof(frame), sequence++, ERROR_TIMEOUT, "benchmark");
+        });
+        run("frame_create_heartbeat", BENCHMARK_ITERATIONS, [&]() {
+            FrameProtocol::createHeartbeatFrame(frame, sizeof(frame), sequence++);
+        });
+        run("frame_create_ack", BENCHMARK_ITERATIONS, [&]() {
+            FrameProtocol::createAckFrame(frame, sizeof(frame), sequence++, 1);
+        });
+        
+        // Command frame as the app sends it
+        FrameWriter writer(frame, sizeof(frame));
+        writer.begin(MSG_COMMAND, 1);
+        writer.putU8(TAG_COMMAND_ID, CMD_HAPTIC_FEEDBACK);
+        writer.putString(TAG_DATA, "click");
+        size_t commandLength = writer.length();
+        
+        run("frame_parse_command", BENCHMARK_ITERATIONS, [&]() {
+            FrameHeader header;
+            const uint8_t* fields;
+            size_t fieldsLength;
+            CommandType command;
+            char data[PROTOCOL_DATA_SIZE];
+            if (FrameProtocol::parseFrame(frame, commandLength, header, fields, fieldsLength)) {
+                FrameProtocol::parseCommand(fields, fieldsLength, command, data, sizeof(data));
+            }
+        });
+        
+        uint8_t statusFrame[BLE_TX_BUFFER_SIZE];
+        size_t statusLength = FrameProtocol::createStatusFrame(statusFrame, sizeof(statusFrame), 1, STATUS_READY);
+        run("frame_parse_status", BENCHMARK_ITERATIONS, [&]() {
+            FrameHeader header;
+            const uint8_t* fields;
+            size_t fieldsLength;
+            StatusType status;
+            char data[PROTOCOL_DATA_SIZE];
+            if (FrameProtocol::parseFrame(statusFrame, statusLength, header, fields, fieldsLength)) {
+                FrameProtocol::parseStatus(fields, fieldsLength, status, data, sizeof(data));
+            }
+        });
+    }
+    
+    static void benchmarkBLEThroughput() {
+        if (!testBLE.isConnected()) {
+            Serial.printf("Connect the app within %u seconds for the throughput run...\n",
+                          BENCHMARK_CONNECT_TIMEOUT_MS / 1000);
+            uint32_t waitStart = millis();
+            while (!testBLE.isConnected() && millis() - waitStart < BENCHMARK_CONNECT_TIMEOUT_MS) {
+                testBLE.update();
+                delay(100);
+            }
+        }
+        
+        if (!testBLE.isConnected()) {
+            skipped("ble_send_audio", "not_connected");
+            return;
+        }
+        
+        // Same chunk size as live streaming
+        static uint8_t chunk[AUDIO_STREAM_CHUNK_SAMPLES * sizeof(int16_t)];
+        for (size_t i = 0; i < sizeof(chunk); i++) {
+            chunk[i] = (uint8_t)i;
+        }
+        
+        testBLE.setStreamingMode(true);
+        testBLE.resetThroughputStats();
+        
+        uint32_t calls = 0;
+        uint32_t failed = 0;
+        uint64_t totalCycles = 0;
+        uint32_t maxCycles = 0;
+        uint32_t runStart = millis();
+        
+        while (millis() - runStart < BENCHMARK_THROUGHPUT_MS && testBLE.isConnected()) {
+            uint32_t start = ESP.getCycleCount();
+            bool sent = testBLE.sendAudioData(chunk, sizeof(chunk));
+            uint32_t cycles = ESP.getCycleCount() - start;
+            
+            calls++;
+            failed += sent ? 0 : 1;
+            totalCycles += cycles;
+            maxCycles = max(maxCycles, cycles);
+        }
+        
+        BLEThroughputStats stats = testBLE.getThroughputStats();
+        testBLE.setStreamingMode(false);
+        
+        uint32_t avgCycles = calls > 0 ? (uint32_t)(totalCycles / calls) : 0;
+        Serial.printf("{\"bench\":\"ble_send_audio\",\"stack\":\"%s\",\"chunk_bytes\":%u,\"calls\":%u,\"failed\":%u,"
+                      "\"avg_cycles\":%u,\"max_cycles\":%u,\"bytes\":%u,\"bytes_per_second\":%u,"
+                      "\"notifications\":%u,\"drops\":%u,\"credit_waits\":%u,\"mtu\":%u}\n",
+                      testBLE.getStackName(), (unsigned)sizeof(chunk), calls, failed,
+                      avgCycles, maxCycles, stats.bytesSent, stats.bytesPerSecond,
+                      stats.notifications, stats.drops, stats.creditWaits, stats.mtu);
+    }
+
+public:
+    static void runAll() {
+        calibrate();
+        Serial.printf("{\"bench_run\":\"start\",\"version\":\"%s\",\"sdk\":\"%s\",\"cpu_mhz\":%u,\"timer_overhead_cycles\":%u}\n",
+                      DEVICE_VERSION, ESP.getSdkVersion(), ESP.getCpuFreqMHz(), timerOverhead);
+        
+        benchmarkGesture();
+        benchmarkAccelerometer();
+        benchmarkAudio();
+        benchmarkProtocol();
+        benchmarkBLEThroughput();
+        
+        Serial.printf("{\"bench_run\":\"end\",\"free_heap\":%u,\"min_free_heap\":%u}\n",
+                      ESP.getFreeHeap(), ESP.getMinFreeHeap());
+    }
+};
+
+uint32_t FirmwareBenchmark::timerOverhead = 0;
 
 void setup() {
     Serial.begin(115200);
@@ -62,6 +356,8 @@ void loop() {
             testVoiceDetector();
         } else if (command == "battery") {
             testBattery();
+        } else if (command == "bench") {
+            FirmwareBenchmark::runAll();
         } else if (command == "help") {
             printHelp();
         } else {
@@ -151,9 +447,18 @@ void testVoiceDetector() {
         Serial.println("Try saying 'Hey BIL' or making noise...");
         
         uint32_t startTime = millis();
+        uint32_t lastLevelPrint = 0;
         while (millis() - startTime < 10000) {
             testVoice.update();
             
+            // Levels for tuning VOICE_THRESHOLD
+            if (millis() - lastLevelPrint > 500) {
+                const AudioFeatures& features = testVoice.getLastFeatures();
+                Serial.printf("Level: energy %u, peak %u, zero crossings %u\n",
+                              features.energy, features.peak, features.zeroCrossings);
+                lastLevelPrint = millis();
+            }
+            
             if (testVoice.detectWakeWord()) {
                 Serial.println("Wake word detected!");
                 if (testHaptic.isReady()) {
@@ -188,7 +493,7 @@ void testBLEManager() {
                 
                 // Test sending data
                 testBLE.sendCommand("test_command");
-                testBLE.sendStatus("test_status");
+                testBLE.sendStatus(STATUS_READY);
                 
                 delay(1000);
                 break;
@@ -207,37 +512,48 @@ void testProtocol() {
     Serial.println("\n--- Testing Protocol Functions ---");
     
     // Test message creation
-    String commandMsg = Protocol::createCommandMessage("test_command", "test_data");
-    Serial.println("Command message: " + commandMsg);
+    char commandMsg[BLE_TX_BUFFER_SIZE];
+    size_t commandLength = Protocol::createCommandMessage(commandMsg, sizeof(commandMsg), "test_command", "test_data");
+    Serial.printf("Command message: %s\n", commandMsg);
+    
+    char message[BLE_TX_BUFFER_SIZE];
+    Protocol::createStatusMessage(message, sizeof(message), STATUS_READY, "test_status");
+    Serial.printf("Status message: %s\n", message);
     
-    String statusMsg = Protocol::createStatusMessage(STATUS_READY, "test_status");
-    Serial.println("Status message: " + statusMsg);
+    Protocol::createErrorMessage(message, sizeof(message), ERROR_NONE, "test_error");
+    Serial.printf("Error message: %s\n", message);
     
-    String errorMsg = Protocol::createErrorMessage(ERROR_NONE, "test_error");
-    Serial.println("Error message: " + errorMsg);
+    Protocol::createHeartbeatMessage(message, sizeof(message));
+    Serial.printf("Heartbeat message: %s\n", message);
     
-    String heartbeatMsg = Protocol::createHeartbeatMessage();
-    Serial.println("Heartbeat message: " + heartbeatMsg);
+    // Messages that do not fit are rejected rather than truncated
+    if (Protocol::createHeartbeatMessage(message, 16) != 0) {
+        Serial.println("Overflow check FAILED");
+    }
     
     // Test message parsing
+    StaticJsonDocument<PROTOCOL_JSON_DOC_SIZE> doc;
     MessageType msgType;
-    String payload;
     
-    if (Protocol::parseMessage(commandMsg, msgType, payload)) {
-        Serial.printf("Parsed message type: %d\n", msgType);
-        Serial.println("Payload: " + payload);
+    if (Protocol::parseMessage(doc, commandMsg, commandLength, msgType)) {
+        Serial.printf("Parsed message type: %d, command: %s\n", msgType, doc["command"] | "");
     } else {
         Serial.println("Message parsing FAILED");
     }
     
+    Serial.printf("Largest free block: %u, fragmentation %u%%\n",
+                  Protocol::getLargestFreeBlock(), Protocol::getHeapFragmentation());
+    
     Serial.println("Protocol test complete");
 }
 
 void testBattery() {
     Serial.println("\n--- Battery Test ---");
     
+    // begin() takes a fresh calibrated sample and seeds the cached value
+    testBatteryMonitor.begin();
     float voltage = Protocol::getBatteryVoltage();
-    Serial.printf("Battery voltage: %.2fV\n", voltage);
+    Serial.printf("Battery voltage: %.2fV (%u%%)\n", voltage, BatteryMonitor::getPercent());
     
     if (voltage < LOW_BATTERY_THRESHOLD) {
         Serial.println("LOW BATTERY WARNING!");
@@ -255,6 +571,7 @@ void printHelp() {
     Serial.println("gesture - Test gesture detection");
     Serial.println("voice   - Test voice detection");
     Serial.println("battery - Check battery level");
+    Serial.println("bench   - Run benchmarks, results as JSON lines");
     Serial.println("help    - Show this help message");
     Serial.println();
 }
@@ -1,12 +1,65 @@
 #include "voice_detector.h"
+#include "logger.h"
+
+#if SAMPLE_RATE % AUDIO_LOW_POWER_SAMPLE_RATE != 0
+#error "AUDIO_LOW_POWER_SAMPLE_RATE must divide SAMPLE_RATE"
+#endif
+#if AUDIO_LOW_POWER_FRAME_SAMPLES < AUDIO_CAPTURE_FRAME_SAMPLES
+#error "captureFrame is sized by AUDIO_LOW_POWER_FRAME_SAMPLES"
+#endif
+
+#if AUDIO_MIC_I2S
+#define CAPTURE_I2S_MODE (I2S_MODE_MASTER | I2S_MODE_RX)
+#define CAPTURE_BITS I2S_BITS_PER_SAMPLE_32BIT
+#define CAPTURE_FORMAT I2S_COMM_FORMAT_STAND_I2S
+#else
+#define CAPTURE_I2S_MODE (I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN)
+#define CAPTURE_BITS I2S_BITS_PER_SAMPLE_16BIT
+#define CAPTURE_FORMAT I2S_COMM_FORMAT_I2S_LSB
+#endif
+
+struct AudioProfileConfig {
+    uint32_t sampleRate;
+    size_t frameSamples; // Read per capture task wakeup
+};
+
+// Indexed by AudioCaptureProfile, AUTO picks one of the others
+static const AudioProfileConfig profiles[] = {
+    { AUDIO_LOW_POWER_SAMPLE_RATE, AUDIO_LOW_POWER_FRAME_SAMPLES },
+    { SAMPLE_RATE, AUDIO_CAPTURE_FRAME_SAMPLES }
+};
+
+static const char* const profileNames[AUDIO_PROFILE_COUNT] = { "low_power", "low_latency", "auto" };
 
 VoiceDetector::VoiceDetector() {
     currentState = VOICE_IDLE;
-    isInitialized = false;
+    initialized = false;
     recordingActive = false;
     audioBuffer = nullptr;
-    bufferSize = SAMPLE_BUFFER_SIZE;
-    bufferIndex = 0;
+    bufferSize = RECORDING_BUFFER_SAMPLES + AUDIO_PREROLL_MAX_SAMPLES;
+    writePos = 0;
+    listenedSamples = 0;
+    prerollSamples = 0;
+    recordPos = 0;
+    recordedSamples = 0;
+    streamedSamples = 0;
+    setPrerollDuration(AUDIO_PREROLL_MS);
+    memset(&features, 0, sizeof(features));
+    captureTask = nullptr;
+    captureRunning = false;
+    captureSuspended = false;
+    i2sEvents = nullptr;
+    i2sOverruns = 0;
+    selectedProfile = AUDIO_DEFAULT_PROFILE;
+    requestedProfile = resolveProfile(VOICE_LISTENING);
+    captureProfile = requestedProfile;
+    profileSwitchPending = false;
+    profileSwitchAt = 0;
+    capturedSamples = 0;
+    drainedSamples = 0;
+    applyProcessingProfile(captureProfile);
+    lastStoredSample = 0;
+    onAudioAvailable = nullptr;
     energyThreshold = VOICE_THRESHOLD;
     lastVoiceActivity = 0;
     wakeWordDetected = false;
@@ -19,71 +72,142 @@ VoiceDetector::~VoiceDetector() {
 }
 
 bool VoiceDetector::begin() {
-    Serial.println("Initializing Voice Detector...");
+    LOGGER_INFO("Initializing Voice Detector...");
     
     // Allocate audio buffer
-    audioBuffer = (int16_t*)malloc(bufferSize * sizeof(int16_t));
-    if (!audioBuffer) {
-        Serial.println("Failed to allocate audio buffer");
+    if (!allocateAudioBuffer()) {
+        LOGGER_ERROR("Failed to allocate audio buffer");
         return false;
     }
     
+    // Allocate ring between the capture task and update()
+    if (!captureRing.begin(AUDIO_RING_BUFFER_SAMPLES)) {
+        LOGGER_ERROR("Failed to allocate capture ring buffer");
+        free(audioBuffer);
+        audioBuffer = nullptr;
+        return false;
+    }
+    
+    // Whatever was selected before begin(), the clock starts there
+    requestedProfile = resolveProfile(VOICE_LISTENING);
+    captureProfile = requestedProfile;
+    profileSwitchPending = false;
+    capturedSamples = 0;
+    drainedSamples = 0;
+    applyProcessingProfile(captureProfile);
+    
     // Initialize I2S for microphone input
     if (!initializeI2S()) {
-        Serial.println("Failed to initialize I2S");
+        LOGGER_ERROR("Failed to initialize I2S");
+        captureRing.end();
         free(audioBuffer);
         audioBuffer = nullptr;
         return false;
     }
     
+    // Start capturing on a dedicated core
+    if (!startCaptureTask()) {
+        LOGGER_ERROR("Failed to start audio capture task");
+        deinitializeI2S();
+        captureRing.end();
+        free(audioBuffer);
+        audioBuffer = nullptr;
+        return false;
+    }
+    
+    // Keyword spotter, falls back to the energy heuristic without a model
+    if (!wakeWordEngine.begin(profiles[processingProfile].sampleRate)) {
+        LOGGER_WARN("Failed to initialize wake word engine, using energy detection");
+    } else if (!wakeWordEngine.isReady()) {
+        LOGGER_INFO("No trained wake word model, using energy detection");
+    }
+    
     currentState = VOICE_LISTENING;
-    isInitialized = true;
+    initialized = true;
     
-    Serial.println("Voice Detector initialized successfully");
+    LOGGER_INFO("Voice Detector initialized successfully");
     return true;
 }
 
 void VoiceDetector::end() {
-    if (isInitialized) {
+    if (initialized) {
+        stopCaptureTask();
         deinitializeI2S();
+        captureRing.end();
+        wakeWordEngine.end();
+        captureSuspended = false;
         
         if (audioBuffer) {
             free(audioBuffer);
             audioBuffer = nullptr;
         }
         
-        isInitialized = false;
+        initialized = false;
         currentState = VOICE_IDLE;
     }
 }
 
+bool VoiceDetector::allocateAudioBuffer() {
+    // The recording buffer holds the full RECORDING_DURATION_MS plus the
+    // pre-roll, which is too large for internal RAM, so prefer PSRAM
+#ifdef BOARD_HAS_PSRAM
+    if (psramFound()) {
+        audioBuffer = (int16_t*)ps_malloc(bufferSize * sizeof(int16_t));
+        if (audioBuffer) {
+            LOGGER_INFO("Allocated %d sample recording buffer in PSRAM", bufferSize);
+            return true;
+        }
+    }
+#endif
+    
+    audioBuffer = (int16_t*)malloc(bufferSize * sizeof(int16_t));
+    return audioBuffer != nullptr;
+}
+
 bool VoiceDetector::initializeI2S() {
-    // Configure I2S for microphone input
+    // The DMA buffers stay as allocated here until the driver is removed,
+    // profiles only change the clock and how many buffers a read waits for
     i2s_config_t i2s_config = {
-        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN),
-        .sample_rate = SAMPLE_RATE,
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .mode = (i2s_mode_t)CAPTURE_I2S_MODE,
+        .sample_rate = (int)profiles[captureProfile].sampleRate,
+        .bits_per_sample = CAPTURE_BITS,
         .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
-        .communication_format = I2S_COMM_FORMAT_I2S_LSB,
+        .communication_format = CAPTURE_FORMAT,
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 4,
-        .dma_buf_len = 1024,
+        .dma_buf_count = AUDIO_DMA_BUFFER_COUNT,
+        .dma_buf_len = AUDIO_DMA_BUFFER_FRAMES,
         .use_apll = false,
         .tx_desc_auto_clear = false,
         .fixed_mclk = 0
     };
     
-    // Install I2S driver
-    esp_err_t err = i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
+    // Install I2S driver, with an event queue so DMA overruns can be counted
+    esp_err_t err = i2s_driver_install(I2S_NUM_0, &i2s_config, AUDIO_I2S_EVENT_QUEUE_SIZE, &i2sEvents);
     if (err != ESP_OK) {
-        Serial.printf("Failed to install I2S driver: %d\n", err);
+        LOGGER_ERROR("Failed to install I2S driver: %d", err);
         return false;
     }
+
+#if AUDIO_MIC_I2S
+    // Receive only, the microphone's L/R pin selects the left slot
+    i2s_pin_config_t pins;
+    pins.mck_io_num = I2S_PIN_NO_CHANGE;
+    pins.bck_io_num = AUDIO_I2S_BCK_PIN;
+    pins.ws_io_num = AUDIO_I2S_WS_PIN;
+    pins.data_out_num = I2S_PIN_NO_CHANGE;
+    pins.data_in_num = AUDIO_I2S_DATA_PIN;
     
+    err = i2s_set_pin(I2S_NUM_0, &pins);
+    if (err != ESP_OK) {
+        LOGGER_ERROR("Failed to set I2S pins: %d", err);
+        i2s_driver_uninstall(I2S_NUM_0);
+        return false;
+    }
+#else
     // Set ADC pin for microphone input
     err = i2s_set_adc_mode(ADC_UNIT_1, ADC1_CHANNEL_6); // GPIO34
     if (err != ESP_OK) {
-        Serial.printf("Failed to set ADC mode: %d\n", err);
+        LOGGER_ERROR("Failed to set ADC mode: %d", err);
         i2s_driver_uninstall(I2S_NUM_0);
         return false;
     }
@@ -91,83 +215,281 @@ bool VoiceDetector::initializeI2S() {
     // Enable ADC
     err = i2s_adc_enable(I2S_NUM_0);
     if (err != ESP_OK) {
-        Serial.printf("Failed to enable ADC: %d\n", err);
+        LOGGER_ERROR("Failed to enable ADC: %d", err);
         i2s_driver_uninstall(I2S_NUM_0);
         return false;
     }
-    
+#endif
+
     return true;
 }
 
 void VoiceDetector::deinitializeI2S() {
+#if !AUDIO_MIC_I2S
     i2s_adc_disable(I2S_NUM_0);
+#endif
     i2s_driver_uninstall(I2S_NUM_0);
+    i2sEvents = nullptr; // Deleted with the driver
+}
+
+bool VoiceDetector::startCaptureTask() {
+    captureRunning = true;
+    
+    BaseType_t result = xTaskCreatePinnedToCore(
+        captureTaskEntry,
+        "audio_capture",
+        AUDIO_TASK_STACK_SIZE,
+        this,
+        AUDIO_TASK_PRIORITY,
+        &captureTask,
+        AUDIO_TASK_CORE
+    );
+    
+    if (result != pdPASS) {
+        captureRunning = false;
+        captureTask = nullptr;
+        return false;
+    }
+    
+    return true;
+}
+
+void VoiceDetector::stopCaptureTask() {
+    captureRunning = false;
+    
+    // The task clears its handle once it has left i2s_read
+    while (captureTask != nullptr) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+void VoiceDetector::captureTaskEntry(void* param) {
+    VoiceDetector* detector = (VoiceDetector*)param;
+    detector->captureLoop();
+    
+    detector->captureTask = nullptr;
+    vTaskDelete(NULL);
+}
+
+void VoiceDetector::captureLoop() {
+    while (captureRunning) {
+        // One switch at a time, update() must have taken up the last one
+        AudioCaptureProfile profile = requestedProfile;
+        if (profile != captureProfile && !profileSwitchPending.load(std::memory_order_acquire)) {
+            switchCaptureProfile(profile);
+        }
+        
+        // The driver posts an event per DMA buffer, only overflows matter here
+        i2s_event_t event;
+        while (i2sEvents && xQueueReceive(i2sEvents, &event, 0) == pdTRUE) {
+            if (event.type == I2S_EVENT_RX_Q_OVF) {
+                i2sOverruns++;
+            }
+        }
+        
+        // Block until the DMA has a full frame, the task only wakes for real data
+        size_t count = readFrame(profiles[captureProfile].frameSamples, pdMS_TO_TICKS(100));
+        if (count > 0) {
+            queueFrame(count);
+        }
+    }
+}
+
+size_t VoiceDetector::readFrame(size_t count, TickType_t ticksToWait) {
+    size_t bytesRead = 0;
+    esp_err_t err = i2s_read(I2S_NUM_0, captureFrame, count * sizeof(AudioCaptureWord), &bytesRead, ticksToWait);
+    if (err != ESP_OK) {
+        return 0;
+    }
+    return bytesRead / sizeof(AudioCaptureWord);
+}
+
+void VoiceDetector::queueFrame(size_t count) {
+#if AUDIO_MIC_I2S
+    // Top 16 of the 24 significant bits, in blocks through the stack
+    int16_t samples[AUDIO_FRONTEND_MAX_SAMPLES];
+    for (size_t offset = 0; offset < count; offset += AUDIO_FRONTEND_MAX_SAMPLES) {
+        size_t block = min(count - offset, (size_t)AUDIO_FRONTEND_MAX_SAMPLES);
+        for (size_t i = 0; i < block; i++) {
+            samples[i] = captureFrame[offset + i] >> 16;
+        }
+        capturedSamples += captureRing.write(samples, block);
+    }
+#else
+    // The built-in ADC puts its channel number in the top four bits
+    for (size_t i = 0; i < count; i++) {
+        captureFrame[i] &= 0x0FFF;
+    }
+    capturedSamples += captureRing.write(captureFrame, count);
+#endif
+
+    if (onAudioAvailable) {
+        onAudioAvailable();
+    }
+}
+
+void VoiceDetector::queueDmaBacklog() {
+    // Completed DMA buffers only, nothing waits for the next one
+    size_t count;
+    while ((count = readFrame(AUDIO_LOW_POWER_FRAME_SAMPLES, 0)) > 0) {
+        queueFrame(count);
+    }
+}
+
+bool VoiceDetector::configureClock(AudioCaptureProfile profile) {
+    // Stops RX, reprograms the dividers and restarts on the same DMA buffers
+    esp_err_t err = i2s_set_clk(I2S_NUM_0, profiles[profile].sampleRate, CAPTURE_BITS, I2S_CHANNEL_MONO);
+    return err == ESP_OK;
+}
+
+void VoiceDetector::switchCaptureProfile(AudioCaptureProfile profile) {
+    // Audio the DMA holds was taken at the old rate, it goes first. A buffer
+    // that completes while the clock is being changed is still old audio.
+    queueDmaBacklog();
+    if (!configureClock(profile)) {
+        requestedProfile = captureProfile;
+        return;
+    }
+    queueDmaBacklog();
+    
+    captureProfile = profile;
+    profileSwitchAt = capturedSamples;
+    profileSwitchPending.store(true, std::memory_order_release);
 }
 
 void VoiceDetector::update() {
-    if (!isInitialized) {
+    if (!initialized) {
         return;
     }
     
-    // Read audio data from I2S
-    size_t bytesRead = 0;
-    int16_t samples[128];
+    // Drain everything the capture task has queued since the last call
+    int16_t samples[AUDIO_FRONTEND_MAX_SAMPLES];
     
-    esp_err_t err = i2s_read(I2S_NUM_0, samples, sizeof(samples), &bytesRead, 10);
-    if (err == ESP_OK && bytesRead > 0) {
-        size_t samplesRead = bytesRead / sizeof(int16_t);
+    while (true) {
+        size_t limit = AUDIO_FRONTEND_MAX_SAMPLES;
         
-        // Process audio based on current state
-        switch (currentState) {
-            case VOICE_LISTENING:
-                if (detectVoiceActivity(samples, samplesRead)) {
-                    if (processWakeWord(samples, samplesRead)) {
-                        wakeWordDetected = true;
-                    }
-                }
-                break;
-                
-            case VOICE_RECORDING:
-                // Store samples in buffer for transmission
-                for (size_t i = 0; i < samplesRead && bufferIndex < bufferSize; i++) {
-                    audioBuffer[bufferIndex++] = samples[i];
+        // Blocks never straddle a profile switch
+        if (profileSwitchPending.load(std::memory_order_acquire)) {
+            uint32_t remaining = profileSwitchAt - drainedSamples;
+            if (remaining == 0) {
+                applyProcessingProfile(captureProfile);
+                profileSwitchPending.store(false, std::memory_order_release);
+                continue;
+            }
+            limit = min(limit, (size_t)remaining);
+        }
+        
+        size_t samplesRead = captureRing.read(samples, limit);
+        if (samplesRead == 0) {
+            break;
+        }
+        drainedSamples += samplesRead;
+        
+        // Filtered in place, every consumer below reads the same block
+        frontend.process(samples, samplesRead, features);
+        processSamples(features);
+    }
+}
+
+void VoiceDetector::applyProcessingProfile(AudioCaptureProfile profile) {
+    processingProfile = profile;
+    upsampleFactor = SAMPLE_RATE / profiles[profile].sampleRate;
+}
+
+AudioCaptureProfile VoiceDetector::resolveProfile(VoiceState state) {
+    if (selectedProfile != AUDIO_PROFILE_AUTO) {
+        return selectedProfile;
+    }
+    return state == VOICE_RECORDING ? AUDIO_PROFILE_LOW_LATENCY : AUDIO_PROFILE_LOW_POWER;
+}
+
+void VoiceDetector::processSamples(const AudioFeatures& block) {
+    // Process audio based on current state
+    switch (currentState) {
+        case VOICE_LISTENING: {
+            // Pre-roll, so a recording can start before the wake word
+            size_t stored = storeSamples(block.samples, block.count, bufferSize);
+            listenedSamples = min(listenedSamples + stored, bufferSize);
+            
+            // Frame length and filterbank follow the rate, the threshold is kept
+            uint32_t rate = profiles[processingProfile].sampleRate;
+            if (wakeWordEngine.getSampleRate() != rate) {
+                wakeWordEngine.setSampleRate(rate);
+            }
+            
+            if (wakeWordEngine.isReady()) {
+                // The spotter needs every frame to keep its history continuous
+                detectVoiceActivity(block);
+                if (wakeWordEngine.process(block.samples, block.count)) {
+                    wakeWordDetected = true;
                 }
-                
-                // Check if recording should stop
-                if (millis() - recordingStartTime > maxRecordingDuration || bufferIndex >= bufferSize) {
-                    stopRecording();
+            } else if (detectVoiceActivity(block)) {
+                if (processWakeWord(block)) {
+                    wakeWordDetected = true;
                 }
-                break;
-                
-            default:
-                break;
+            }
+            break;
+        }
+        
+        case VOICE_RECORDING: {
+            // Store samples in buffer for transmission, never past the recording start
+            recordedSamples += storeSamples(block.samples, block.count, bufferSize - recordedSamples);
+            
+            // Check if recording should stop
+            if (millis() - recordingStartTime > maxRecordingDuration || recordedSamples >= bufferSize) {
+                stopRecording();
+            }
+            break;
         }
+        
+        default:
+            break;
     }
 }
 
-bool VoiceDetector::detectVoiceActivity(int16_t* samples, size_t count) {
-    float energy = calculateEnergy(samples, count);
+void VoiceDetector::writeToBuffer(const int16_t* samples, size_t count) {
+    // At most two copies, before and after the wrap
+    size_t first = min(count, bufferSize - writePos);
+    memcpy(audioBuffer + writePos, samples, first * sizeof(int16_t));
+    memcpy(audioBuffer, samples + first, (count - first) * sizeof(int16_t));
     
-    if (energy > energyThreshold) {
-        lastVoiceActivity = millis();
-        return true;
+    writePos = (writePos + count) % bufferSize;
+}
+
+size_t VoiceDetector::storeSamples(const int16_t* samples, size_t count, size_t limit) {
+    if (upsampleFactor == 1) {
+        count = min(count, limit);
+        writeToBuffer(samples, count);
+        if (count > 0) {
+            lastStoredSample = samples[count - 1];
+        }
+        return count;
     }
     
-    return false;
+    // Low power capture, linearly interpolated up to SAMPLE_RATE
+    size_t stored = 0;
+    for (size_t i = 0; i < count && stored + upsampleFactor <= limit; i++) {
+        int32_t step = samples[i] - lastStoredSample;
+        for (uint8_t k = 1; k <= upsampleFactor; k++) {
+            audioBuffer[writePos] = lastStoredSample + step * k / upsampleFactor;
+            writePos = writePos + 1 == bufferSize ? 0 : writePos + 1;
+        }
+        lastStoredSample = samples[i];
+        stored += upsampleFactor;
+    }
+    return stored;
 }
 
-float VoiceDetector::calculateEnergy(int16_t* samples, size_t count) {
-    float energy = 0.0;
-    
-    for (size_t i = 0; i < count; i++) {
-        float sample = (float)samples[i] / 32768.0;
-        energy += sample * sample;
+bool VoiceDetector::detectVoiceActivity(const AudioFeatures& block) {
+    if (block.energy > energyThreshold) {
+        lastVoiceActivity = millis();
+        return true;
     }
     
-    return energy / count;
+    return false;
 }
 
-bool VoiceDetector::processWakeWord(int16_t* samples, size_t count) {
+bool VoiceDetector::processWakeWord(const AudioFeatures& block) {
     // Simplified wake word detection based on energy patterns
     // In a real implementation, this would use more sophisticated
     // algorithms like keyword spotting or neural networks
@@ -175,7 +497,7 @@ bool VoiceDetector::processWakeWord(int16_t* samples, size_t count) {
     static float energyHistory[10] = {0};
     static int historyIndex = 0;
     
-    float currentEnergy = calculateEnergy(samples, count);
+    float currentEnergy = block.energy;
     energyHistory[historyIndex] = currentEnergy;
     historyIndex = (historyIndex + 1) % 10;
     
@@ -204,21 +526,43 @@ bool VoiceDetector::detectWakeWord() {
 }
 
 void VoiceDetector::setWakeWordThreshold(float threshold) {
+    // Confidence from 0 to 1 the spotter must reach to fire
+    wakeWordEngine.setThreshold(threshold);
+}
+
+void VoiceDetector::setVoiceThreshold(float threshold) {
     energyThreshold = threshold;
 }
 
+WakeWordEngine& VoiceDetector::getWakeWordEngine() {
+    return wakeWordEngine;
+}
+
+const AudioFeatures& VoiceDetector::getLastFeatures() {
+    return features;
+}
+
 bool VoiceDetector::startRecording() {
-    if (!isInitialized || currentState == VOICE_RECORDING) {
+    if (!initialized || currentState == VOICE_RECORDING) {
         return false;
     }
     
-    Serial.println("Starting voice recording...");
+    if (captureSuspended && !resume()) {
+        return false;
+    }
+    
+    LOGGER_INFO("Starting voice recording...");
     
-    // Clear buffer and reset index
-    bufferIndex = 0;
+    // Start in the past by the pre-roll collected while listening, the
+    // samples are already in place so nothing is copied
+    size_t preroll = min(listenedSamples, prerollSamples);
+    recordPos = (writePos + bufferSize - preroll) % bufferSize;
+    recordedSamples = preroll;
+    streamedSamples = 0;
     recordingStartTime = millis();
     currentState = VOICE_RECORDING;
     recordingActive = true;
+    requestedProfile = resolveProfile(currentState);
     
     return true;
 }
@@ -228,10 +572,12 @@ bool VoiceDetector::stopRecording() {
         return false;
     }
     
-    Serial.printf("Stopping voice recording. Recorded %d samples\n", bufferIndex);
+    LOGGER_INFO("Stopping voice recording. Recorded %u samples", (unsigned)recordedSamples);
     
-    currentState = VOICE_LISTENING;
+    // Stay in processing until the recording has been sent and cleared
+    currentState = VOICE_PROCESSING;
     recordingActive = false;
+    requestedProfile = resolveProfile(currentState);
     
     return true;
 }
@@ -240,6 +586,14 @@ bool VoiceDetector::isRecording() {
     return recordingActive;
 }
 
+void VoiceDetector::setPrerollDuration(uint32_t durationMs) {
+    prerollSamples = (min(durationMs, (uint32_t)AUDIO_PREROLL_MAX_MS) * SAMPLE_RATE) / 1000;
+}
+
+uint32_t VoiceDetector::getPrerollDuration() {
+    return (prerollSamples * 1000) / SAMPLE_RATE;
+}
+
 int16_t* VoiceDetector::getAudioBuffer() {
     return audioBuffer;
 }
@@ -249,17 +603,166 @@ size_t VoiceDetector::getBufferSize() {
 }
 
 size_t VoiceDetector::getRecordedSamples() {
-    return bufferIndex;
+    return recordedSamples;
 }
 
 void VoiceDetector::clearBuffer() {
-    bufferIndex = 0;
+    recordedSamples = 0;
+    streamedSamples = 0;
+    
+    // The recording is not pre-roll for the next one
+    listenedSamples = 0;
+    
+    if (currentState == VOICE_PROCESSING) {
+        currentState = VOICE_LISTENING;
+        requestedProfile = resolveProfile(currentState);
+        
+        // Audio during the recording never reached the spotter
+        wakeWordEngine.reset();
+    }
+}
+
+size_t VoiceDetector::getPendingStreamSamples() {
+    return recordedSamples - streamedSamples;
+}
+
+size_t VoiceDetector::readStreamChunk(const int16_t*& samples, size_t maxSamples) {
+    size_t position = (recordPos + streamedSamples) % bufferSize;
+    size_t count = min(maxSamples, recordedSamples - streamedSamples);
+    count = min(count, bufferSize - position);
+    
+    // Hand out a pointer into the recording buffer, no copy needed
+    samples = audioBuffer + position;
+    streamedSamples += count;
+    
+    return count;
 }
 
 VoiceState VoiceDetector::getState() {
     return currentState;
 }
 
+bool VoiceDetector::suspend() {
+    if (!initialized || captureSuspended || currentState != VOICE_LISTENING) {
+        return false;
+    }
+    
+    // i2s_stop releases the driver's PM lock, so light sleep can happen
+    stopCaptureTask();
+#if !AUDIO_MIC_I2S
+    i2s_adc_disable(I2S_NUM_0);
+#endif
+    i2s_stop(I2S_NUM_0);
+    
+    captureSuspended = true;
+    currentState = VOICE_IDLE;
+    LOGGER_INFO("Voice capture suspended");
+    return true;
+}
+
+bool VoiceDetector::resume() {
+    if (!initialized || !captureSuspended) {
+        return false;
+    }
+    
+    // Driver and DMA buffers are still allocated, only the clocks restart
+    i2s_start(I2S_NUM_0);
+#if !AUDIO_MIC_I2S
+    i2s_adc_enable(I2S_NUM_0);
+#endif
+
+    // Nothing is written while the task is stopped, so the ring can be reset
+    // and a profile selected meanwhile applied here
+    AudioCaptureProfile profile = resolveProfile(VOICE_LISTENING);
+    if (profile != captureProfile && configureClock(profile)) {
+        captureProfile = profile;
+    }
+    requestedProfile = captureProfile;
+    profileSwitchPending = false;
+    capturedSamples = 0;
+    drainedSamples = 0;
+    applyProcessingProfile(captureProfile);
+    captureRing.clear();
+    frontend.reset();
+    wakeWordEngine.reset();
+    listenedSamples = 0;
+    
+    if (!startCaptureTask()) {
+        LOGGER_ERROR("Failed to restart audio capture task");
+        return false;
+    }
+    
+    captureSuspended = false;
+    currentState = VOICE_LISTENING;
+    LOGGER_INFO("Voice capture resumed");
+    return true;
+}
+
+void VoiceDetector::pauseAdc() {
+#if !AUDIO_MIC_I2S
+    // I2S ADC mode holds the ADC1 lock, adc1_get_raw() would block on it
+    if (initialized && !captureSuspended) {
+        i2s_adc_disable(I2S_NUM_0);
+    }
+#endif
+}
+
+void VoiceDetector::resumeAdc() {
+#if !AUDIO_MIC_I2S
+    if (initialized && !captureSuspended) {
+        i2s_adc_enable(I2S_NUM_0);
+    }
+#endif
+}
+
+void VoiceDetector::setCaptureProfile(AudioCaptureProfile profile) {
+    selectedProfile = profile;
+    requestedProfile = resolveProfile(currentState);
+}
+
+AudioCaptureProfile VoiceDetector::getCaptureProfile() {
+    return selectedProfile;
+}
+
+AudioCaptureProfile VoiceDetector::getActiveProfile() {
+    return processingProfile;
+}
+
+uint32_t VoiceDetector::getCaptureSampleRate() {
+    return profiles[processingProfile].sampleRate;
+}
+
+const char* VoiceDetector::getProfileName(AudioCaptureProfile profile) {
+    return profile < AUDIO_PROFILE_COUNT ? profileNames[profile] : "unknown";
+}
+
+bool VoiceDetector::parseProfileName(const char* name, AudioCaptureProfile& profile) {
+    for (int i = 0; i < AUDIO_PROFILE_COUNT; i++) {
+        if (strcmp(name, profileNames[i]) == 0) {
+            profile = (AudioCaptureProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VoiceDetector::isSuspended() {
+    return captureSuspended;
+}
+
 bool VoiceDetector::isInitialized() {
-    return isInitialized;
+    return initialized;
+}
+
+uint32_t VoiceDetector::getDroppedSamples() {
+    return captureRing.getDroppedSamples();
+}
+
+uint32_t VoiceDetector::getI2SOverruns() {
+    return i2sOverruns;
+}
+
+uint32_t VoiceDetector::getCaptureStackFree() {
+    TaskHandle_t task = captureTask;
+    return task ? uxTaskGetStackHighWaterMark(task) : 0;
 }
\ No newline at end of file
@@ -2,9 +2,14 @@
 #define VOICE_DETECTOR_H
 
 #include <Arduino.h>
+#include <atomic>
+#include <freertos/queue.h>
 #include <driver/i2s.h>
 #include <driver/adc.h>
 #include "config.h"
+#include "audio_ring_buffer.h"
+#include "audio_frontend.h"
+#include "wake_word_engine.h"
 
 enum VoiceState {
     VOICE_IDLE,
@@ -13,18 +18,72 @@ enum VoiceState {
     VOICE_PROCESSING
 };
 
+// Capture profiles, switched at runtime on the installed I2S driver
+enum AudioCaptureProfile {
+    AUDIO_PROFILE_LOW_POWER,   // AUDIO_LOW_POWER_SAMPLE_RATE, long reads, for the wake listener
+    AUDIO_PROFILE_LOW_LATENCY, // SAMPLE_RATE, one DMA buffer per read, for streaming
+    AUDIO_PROFILE_AUTO         // Low power while listening, low latency while recording
+};
+
+#define AUDIO_PROFILE_COUNT (AUDIO_PROFILE_AUTO + 1)
+
+#if AUDIO_MIC_I2S
+typedef int32_t AudioCaptureWord; // MEMS mics send 24 bit samples in 32 bit slots
+#else
+typedef int16_t AudioCaptureWord;
+#endif
+
 class VoiceDetector {
 private:
+    // Test firmware benchmarks time the private hot paths
+    friend class FirmwareBenchmark;
+    
     VoiceState currentState;
-    bool isInitialized;
+    bool initialized;
     bool recordingActive;
     
-    // Audio buffers
+    // Circular recording buffer. While listening it keeps the last
+    // prerollSamples, a recording starts that far back in the same buffer.
     int16_t* audioBuffer;
     size_t bufferSize;
-    size_t bufferIndex;
+    size_t writePos;
+    size_t listenedSamples;
+    size_t prerollSamples;
+    size_t recordPos;
+    size_t recordedSamples;
+    size_t streamedSamples;
+    
+    // Capture task feeding the ring, drained by update()
+    AudioRingBuffer captureRing;
+    TaskHandle_t captureTask;
+    volatile bool captureRunning;
+    bool captureSuspended;
+    
+    // Driver events, RX_Q_OVF means the DMA wrapped before i2s_read() caught up
+    QueueHandle_t i2sEvents;
+    volatile uint32_t i2sOverruns;
+    
+    // Capture profile. The capture task owns the I2S clock and switches it
+    // between reads; update() follows once it has drained the samples taken
+    // at the old rate, found by counting the samples each side has passed.
+    AudioCaptureProfile selectedProfile;           // May be AUTO
+    volatile AudioCaptureProfile requestedProfile; // Selected, AUTO resolved by state
+    AudioCaptureProfile captureProfile;            // At the I2S clock
+    std::atomic<bool> profileSwitchPending;
+    uint32_t profileSwitchAt;
+    uint32_t capturedSamples;                      // Written to the ring, capture task only
+    uint32_t drainedSamples;                       // Read from the ring, update() only
+    AudioCaptureProfile processingProfile;         // Rate of the samples update() works on
+    uint8_t upsampleFactor;                        // The recording buffer stays at SAMPLE_RATE
+    int16_t lastStoredSample;
+    AudioCaptureWord captureFrame[AUDIO_LOW_POWER_FRAME_SAMPLES]; // Too large for the task stack
+    
+    // Per block features, computed once for VAD, KWS and recording
+    AudioFrontend frontend;
+    AudioFeatures features;
     
     // Wake word detection
+    WakeWordEngine wakeWordEngine;
     float energyThreshold;
     uint32_t lastVoiceActivity;
     bool wakeWordDetected;
@@ -34,12 +93,26 @@ private:
     uint32_t maxRecordingDuration;
     
     // Audio processing methods
+    bool allocateAudioBuffer();
     bool initializeI2S();
     void deinitializeI2S();
-    float calculateEnergy(int16_t* samples, size_t count);
-    bool detectVoiceActivity(int16_t* samples, size_t count);
-    bool processWakeWord(int16_t* samples, size_t count);
+    bool startCaptureTask();
+    void stopCaptureTask();
+    static void captureTaskEntry(void* param);
+    void captureLoop();
+    size_t readFrame(size_t count, TickType_t ticksToWait);
+    void queueFrame(size_t count);
+    void queueDmaBacklog();
+    bool configureClock(AudioCaptureProfile profile);
+    void switchCaptureProfile(AudioCaptureProfile profile);
+    void applyProcessingProfile(AudioCaptureProfile profile);
+    AudioCaptureProfile resolveProfile(VoiceState state);
+    void processSamples(const AudioFeatures& block);
+    bool detectVoiceActivity(const AudioFeatures& block);
+    bool processWakeWord(const AudioFeatures& block);
     void processAudioBuffer();
+    void writeToBuffer(const int16_t* samples, size_t count);
+    size_t storeSamples(const int16_t* samples, size_t count, size_t limit);
 
 public:
     VoiceDetector();
@@ -52,21 +125,59 @@ public:
     // Wake word detection
     bool detectWakeWord();
     void setWakeWordThreshold(float threshold);
+    void setVoiceThreshold(float threshold);
+    WakeWordEngine& getWakeWordEngine();
+    const AudioFeatures& getLastFeatures();
     
     // Recording control
     bool startRecording();
     bool stopRecording();
     bool isRecording();
     
-    // Audio data access
+    // Audio from before startRecording() included in the recording, up to AUDIO_PREROLL_MAX_MS
+    void setPrerollDuration(uint32_t durationMs);
+    uint32_t getPrerollDuration();
+    
+    // Power saving, stops capture but keeps the I2S driver installed
+    bool suspend();
+    bool resume();
+    bool isSuspended();
+    
+    // Capture profile, taken up by the capture task after its current read.
+    // Samples already queued are processed at the rate they were taken at.
+    void setCaptureProfile(AudioCaptureProfile profile);
+    AudioCaptureProfile getCaptureProfile(); // As selected, may be AUTO
+    AudioCaptureProfile getActiveProfile();  // The one update() is working at
+    uint32_t getCaptureSampleRate();
+    static const char* getProfileName(AudioCaptureProfile profile);
+    static bool parseProfileName(const char* name, AudioCaptureProfile& profile);
+    
+    // Hands ADC1 to another user for a moment, capture sees a short gap.
+    // Nothing to do with an I2S microphone.
+    void pauseAdc();
+    void resumeAdc();
+    
+    // Audio data access. The buffer is circular, readStreamChunk() returns
+    // the recording in order.
     int16_t* getAudioBuffer();
     size_t getBufferSize();
     size_t getRecordedSamples();
     void clearBuffer();
     
+    // Streaming access (chunks leave the device while recording). A chunk
+    // stops short at the end of the circular buffer, call again for the rest.
+    size_t getPendingStreamSamples();
+    size_t readStreamChunk(const int16_t*& samples, size_t maxSamples);
+    
     // State management
     VoiceState getState();
     bool isInitialized();
+    uint32_t getDroppedSamples();
+    uint32_t getI2SOverruns();
+    uint32_t getCaptureStackFree(); // High-water mark in bytes, 0 when not running
+    
+    // Called from the capture task after each frame is queued
+    void (*onAudioAvailable)();
 };
 
 #endif // VOICE_DETECTOR_H
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "wake_word_engine.h"
+#include "logger.h"
+#include <esp_dsp.h>
+
+static bool fftTablesReady = false;
+
+static inline int8_t requantize(int32_t acc, const QuantizedLayer& layer) {
+    int total = 31 + layer.shift;
+    int64_t scaled = ((int64_t)acc * layer.multiplier + ((int64_t)1 << (total - 1))) >> total;
+    int32_t out = (int32_t)scaled + layer.outputZeroPoint;
+    
+    // ReLU in the quantized domain clamps at the zero point
+    if (out < layer.outputZeroPoint) {
+        out = layer.outputZeroPoint;
+    }
+    return (int8_t)constrain(out, -128, 127);
+}
+
+static inline float hzToMel(float hz) {
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static inline float melToHz(float mel) {
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+WakeWordEngine::WakeWordEngine() {
+    model = &wakeWordModel;
+    isInitialized = false;
+    sampleRate = 0;
+    frameCapacity = 0;
+    frameLength = 0;
+    frameStride = 0;
+    frameBuffer = nullptr;
+    frameFill = 0;
+    window = nullptr;
+    fftBuffer = nullptr;
+    melWeights = nullptr;
+    framesProcessed = 0;
+    threshold = KWS_DEFAULT_THRESHOLD;
+    lastScore = 0;
+    lastDetectionTime = 0;
+    lastFrameMicros = 0;
+    maxFrameMicros = 0;
+    budgetOverruns = 0;
+}
+
+WakeWordEngine::~WakeWordEngine() {
+    end();
+}
+
+bool WakeWordEngine::begin(uint32_t rate) {
+    if (!fftTablesReady) {
+        esp_err_t err = dsps_fft2r_init_fc32(NULL, CONFIG_DSP_MAX_FFT_SIZE);
+        if (err != ESP_OK) {
+            LOGGER_ERROR("Failed to initialize FFT tables: %d", err);
+            return false;
+        }
+        fftTablesReady = true;
+    }
+    
+    // Each triangle overlaps its neighbours by one half, so together they
+    // cover the spectrum twice plus one shared edge bin per band
+    frameCapacity = SAMPLE_RATE * KWS_FRAME_MS / 1000;
+    size_t maxWeights = 2 * (frameCapacity / 2) + KWS_MEL_BANDS;
+    
+    frameBuffer = (int16_t*)malloc(frameCapacity * sizeof(int16_t));
+    window = (float*)malloc(frameCapacity * sizeof(float));
+    fftBuffer = (float*)malloc(frameCapacity * 2 * sizeof(float));
+    melWeights = (float*)malloc(maxWeights * sizeof(float));
+    if (!frameBuffer || !window || !fftBuffer || !melWeights || !setSampleRate(rate)) {
+        end();
+        return false;
+    }
+    
+    LOGGER_INFO("Wake word engine ready: model '%s', %u point FFT, %d ms stride",
+                model->name, (unsigned)frameLength, KWS_STRIDE_MS);
+    return true;
+}
+
+void WakeWordEngine::end() {
+    free(frameBuffer);
+    free(window);
+    free(fftBuffer);
+    free(melWeights);
+    frameBuffer = nullptr;
+    window = nullptr;
+    fftBuffer = nullptr;
+    melWeights = nullptr;
+    frameCapacity = 0;
+    isInitialized = false;
+}
+
+bool WakeWordEngine::setSampleRate(uint32_t rate) {
+    // Not ready until the new framing is in place; a rate that does not fit
+    // stays recorded so the caller does not retry it every block
+    isInitialized = false;
+    sampleRate = rate;
+    frameLength = sampleRate * KWS_FRAME_MS / 1000;
+    frameStride = sampleRate * KWS_STRIDE_MS / 1000;
+    
+    if (!frameBuffer) {
+        return false;
+    }
+    
+    // The frame doubles as the FFT input, so it must be a power of two
+    if ((frameLength & (frameLength - 1)) != 0 || frameLength > frameCapacity) {
+        LOGGER_ERROR("KWS frame length %u is not a power of two up to %u",
+                     (unsigned)frameLength, (unsigned)frameCapacity);
+        return false;
+    }
+    
+    buildMelFilterbank();
+    dsps_wind_hann_f32(window, frameLength);
+    
+    isInitialized = true;
+    reset();
+    return true;
+}
+
+void WakeWordEngine::reset() {
+    frameFill = 0;
+    framesProcessed = 0;
+    
+    // Empty history reads as zero in each layer's quantized domain
+    memset(featureHistory, model->inputZeroPoint, sizeof(featureHistory));
+    memset(conv1History, model->conv1.outputZeroPoint, sizeof(conv1History));
+    memset(poolHistory, model->conv2.outputZeroPoint, sizeof(poolHistory));
+    for (int c = 0; c < KWS_CONV2_CHANNELS; c++) {
+        poolSum[c] = (int32_t)model->conv2.outputZeroPoint * KWS_POOL_FRAMES;
+    }
+    
+    memset(scoreHistory, 0, sizeof(scoreHistory));
+    lastScore = 0;
+}
+
+void WakeWordEngine::buildMelFilterbank() {
+    size_t bins = frameLength / 2 + 1;
+    float minMel = hzToMel(KWS_MIN_FREQ);
+    float maxMel = hzToMel(KWS_MAX_FREQ);
+    float melStep = (maxMel - minMel) / (KWS_MEL_BANDS + 1);
+    float binHz = (float)sampleRate / frameLength;
+    
+    // Band edges in FFT bins, including the outer edges
+    uint16_t edges[KWS_MEL_BANDS + 2];
+    for (int i = 0; i < KWS_MEL_BANDS + 2; i++) {
+        float hz = melToHz(minMel + i * melStep);
+        edges[i] = min((size_t)(hz / binHz + 0.5f), bins - 1);
+    }
+    
+    // Only the non-zero part of each triangle is stored
+    size_t totalWeights = 0;
+    for (int band = 0; band < KWS_MEL_BANDS; band++) {
+        melStart[band] = edges[band];
+        melLength[band] = max(edges[band + 2] - edges[band] + 1, 1);
+        melOffset[band] = totalWeights;
+        totalWeights += melLength[band];
+    }
+    
+    for (int band = 0; band < KWS_MEL_BANDS; band++) {
+        float left = edges[band];
+        float center = edges[band + 1];
+        float right = edges[band + 2];
+        
+        for (int i = 0; i < melLength[band]; i++) {
+            float bin = melStart[band] + i;
+            float weight = 0;
+            if (bin <= center && center > left) {
+                weight = (bin - left) / (center - left);
+            } else if (bin > center && right > center) {
+                weight = (right - bin) / (right - center);
+            } else if (bin == center) {
+                weight = 1.0f;
+            }
+            melWeights[melOffset[band] + i] = weight;
+        }
+    }
+}
+
+bool WakeWordEngine::process(const int16_t* samples, size_t count) {
+    if (!isInitialized) {
+        return false;
+    }
+    
+    bool detected = false;
+    size_t i = 0;
+    
+    while (i < count) {
+        size_t toCopy = min(count - i, frameLength - frameFill);
+        memcpy(frameBuffer + frameFill, samples + i, toCopy * sizeof(int16_t));
+        frameFill += toCopy;
+        i += toCopy;
+        
+        if (frameFill == frameLength) {
+            if (processFrame()) {
+                detected = true;
+            }
+            
+            // Keep the overlap for the next window
+            memmove(frameBuffer, frameBuffer + frameStride, (frameLength - frameStride) * sizeof(int16_t));
+            frameFill = frameLength - frameStride;
+        }
+    }
+    
+    return detected;
+}
+
+bool WakeWordEngine::processFrame() {
+    uint32_t startMicros = micros();
+    
+    int8_t features[KWS_MEL_BANDS];
+    computeFeatures(features);
+    float score = runModel(features);
+    
+    lastFrameMicros = micros() - startMicros;
+    maxFrameMicros = max(maxFrameMicros, lastFrameMicros);
+    if (lastFrameMicros > KWS_INFERENCE_BUDGET_US) {
+        budgetOverruns++;
+    }
+    
+    // Smooth over a few frames to reject single-frame spikes
+    scoreHistory[framesProcessed % KWS_SMOOTHING_FRAMES] = score;
+    framesProcessed++;
+    
+    float smoothed = 0;
+    for (int i = 0; i < KWS_SMOOTHING_FRAMES; i++) {
+        smoothed += scoreHistory[i];
+    }
+    smoothed /= KWS_SMOOTHING_FRAMES;
+    lastScore = smoothed;
+    
+    // Wait until the pooling window has seen real audio
+    if (framesProcessed < KWS_POOL_FRAMES) {
+        return false;
+    }
+    
+    if (smoothed >= threshold && millis() - lastDetectionTime > KWS_REFRACTORY_MS) {
+        lastDetectionTime = millis();
+        return true;
+    }
+    
+    return false;
+}
+
+void WakeWordEngine::computeFeatures(int8_t* features) {
+    // Windowed frame into the real part, imaginary part zeroed
+    for (size_t i = 0; i < frameLength; i++) {
+        fftBuffer[i * 2] = (frameBuffer[i] / 32768.0f) * window[i];
+        fftBuffer[i * 2 + 1] = 0;
+    }
+    
+    dsps_fft2r_fc32(fftBuffer, frameLength);
+    dsps_bit_rev_fc32(fftBuffer, frameLength);
+    
+    // Power spectrum in place, only the first half is used
+    for (size_t i = 0; i <= frameLength / 2; i++) {
+        float re = fftBuffer[i * 2];
+        float im = fftBuffer[i * 2 + 1];
+        fftBuffer[i] = re * re + im * im;
+    }
+    
+    for (int band = 0; band < KWS_MEL_BANDS; band++) {
+        float energy = 0;
+        const float* weights = melWeights + melOffset[band];
+        const float* power = fftBuffer + melStart[band];
+        
+        for (int i = 0; i < melLength[band]; i++) {
+            energy += weights[i] * power[i];
+        }
+        
+        float scaled = (logf(energy + 1e-6f) - model->featureOffset) * model->featureScale;
+        int32_t quantized = (int32_t)lroundf(scaled) + model->inputZeroPoint;
+        features[band] = (int8_t)constrain(quantized, -128, 127);
+    }
+}
+
+float WakeWordEngine::runModel(const int8_t* features) {
+    uint32_t frame = framesProcessed;
+    
+    // Newest feature frame into the conv1 history
+    memcpy(featureHistory[frame % KWS_CONV1_KERNEL], features, KWS_MEL_BANDS);
+    
+    // Conv1: kernel taps run oldest to newest
+    int8_t conv1Out[KWS_CONV1_CHANNELS];
+    const int32_t inputZero = model->inputZeroPoint;
+    for (int c = 0; c < KWS_CONV1_CHANNELS; c++) {
+        int32_t acc = model->conv1.bias[c];
+        const int8_t* weights = model->conv1.weights + c * KWS_CONV1_KERNEL * KWS_MEL_BANDS;
+        
+        for (int k = 0; k < KWS_CONV1_KERNEL; k++) {
+            const int8_t* input = featureHistory[(frame + 1 + k) % KWS_CONV1_KERNEL];
+            for (int m = 0; m < KWS_MEL_BANDS; m++) {
+                acc += weights[k * KWS_MEL_BANDS + m] * (input[m] - inputZero);
+            }
+        }
+        conv1Out[c] = requantize(acc, model->conv1);
+    }
+    memcpy(conv1History[frame % KWS_CONV2_SPAN], conv1Out, KWS_CONV1_CHANNELS);
+    
+    // Conv2: dilated taps over the conv1 history
+    int8_t conv2Out[KWS_CONV2_CHANNELS];
+    const int32_t conv1Zero = model->conv1.outputZeroPoint;
+    for (int c = 0; c < KWS_CONV2_CHANNELS; c++) {
+        int32_t acc = model->conv2.bias[c];
+        const int8_t* weights = model->conv2.weights + c * KWS_CONV2_KERNEL * KWS_CONV1_CHANNELS;
+        
+        for (int k = 0; k < KWS_CONV2_KERNEL; k++) {
+            uint32_t tapFrame = frame + KWS_CONV2_SPAN - (KWS_CONV2_KERNEL - 1 - k) * KWS_CONV2_DILATION;
+            const int8_t* input = conv1History[tapFrame % KWS_CONV2_SPAN];
+            for (int m = 0; m < KWS_CONV1_CHANNELS; m++) {
+                acc += weights[k * KWS_CONV1_CHANNELS + m] * (input[m] - conv1Zero);
+            }
+        }
+        conv2Out[c] = requantize(acc, model->conv2);
+    }
+    
+    // Running average pool: add the newest frame, drop the oldest
+    int8_t* oldest = poolHistory[frame % KWS_POOL_FRAMES];
+    for (int c = 0; c < KWS_CONV2_CHANNELS; c++) {
+        poolSum[c] += conv2Out[c] - oldest[c];
+        oldest[c] = conv2Out[c];
+    }
+    
+    // Dense layer to class logits
+    int32_t logits[KWS_CLASSES];
+    const int32_t conv2Zero = model->conv2.outputZeroPoint;
+    for (int k = 0; k < KWS_CLASSES; k++) {
+        int32_t acc = model->denseBias[k];
+        const int8_t* weights = model->denseWeights + k * KWS_CONV2_CHANNELS;
+        
+        for (int c = 0; c < KWS_CONV2_CHANNELS; c++) {
+            acc += weights[c] * (poolSum[c] / KWS_POOL_FRAMES - conv2Zero);
+        }
+        logits[k] = acc;
+    }
+    
+    // Two class softmax reduces to a sigmoid of the logit difference
+    float margin = (logits[KWS_CLASS_WAKE_WORD] - logits[0]) * model->outputScale;
+    return 1.0f / (1.0f + expf(-margin));
+}
+
+void WakeWordEngine::setThreshold(float value) {
+    threshold = constrain(value, 0.0f, 1.0f);
+}
+
+float WakeWordEngine::getThreshold() {
+    return threshold;
+}
+
+bool WakeWordEngine::isReady() {
+    return isInitialized && model->trained;
+}
+
+uint32_t WakeWordEngine::getSampleRate() {
+    return sampleRate;
+}
+
+float WakeWordEngine::getLastScore() {
+    return lastScore;
+}
+
+uint32_t WakeWordEngine::getLastFrameMicros() {
+    return lastFrameMicros;
+}
+
+uint32_t WakeWordEngine::getMaxFrameMicros() {
+    return maxFrameMicros;
+}
+
+uint32_t WakeWordEngine::getBudgetOverruns() {
+    return budgetOverruns;
+}
@@ -0,0 +1,87 @@
+#ifndef WAKE_WORD_ENGINE_H
+#define WAKE_WORD_ENGINE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "wake_word_model.h"
+
+// Frames of conv1 output the dilated conv2 needs to look back over
+#define KWS_CONV2_SPAN ((KWS_CONV2_KERNEL - 1) * KWS_CONV2_DILATION + 1)
+
+// On-device keyword spotter for WAKE_WORD.
+// Audio is framed into overlapping windows, turned into int8 log-mel features
+// with an ESP-DSP FFT, and each new frame advances the streaming model by one
+// step, so the cost per frame is fixed.
+class WakeWordEngine {
+private:
+    const WakeWordModel* model;
+    bool isInitialized;
+    
+    // Framing, frameLength is also the FFT size. Buffers are sized once for
+    // SAMPLE_RATE, a lower rate only uses the front of them.
+    uint32_t sampleRate;
+    size_t frameCapacity;
+    size_t frameLength;
+    size_t frameStride;
+    int16_t* frameBuffer;
+    size_t frameFill;
+    
+    // Feature extraction
+    float* window;
+    float* fftBuffer;
+    uint16_t melStart[KWS_MEL_BANDS];
+    uint16_t melLength[KWS_MEL_BANDS];
+    uint16_t melOffset[KWS_MEL_BANDS];
+    float* melWeights;
+    
+    // Per layer history rings
+    int8_t featureHistory[KWS_CONV1_KERNEL][KWS_MEL_BANDS];
+    int8_t conv1History[KWS_CONV2_SPAN][KWS_CONV1_CHANNELS];
+    int8_t poolHistory[KWS_POOL_FRAMES][KWS_CONV2_CHANNELS];
+    int32_t poolSum[KWS_CONV2_CHANNELS];
+    uint32_t framesProcessed;
+    
+    // Detection
+    float threshold;
+    float scoreHistory[KWS_SMOOTHING_FRAMES];
+    float lastScore;
+    uint32_t lastDetectionTime;
+    
+    // Inference timing
+    uint32_t lastFrameMicros;
+    uint32_t maxFrameMicros;
+    uint32_t budgetOverruns;
+    
+    void buildMelFilterbank();
+    void computeFeatures(int8_t* features);
+    float runModel(const int8_t* features);
+    bool processFrame();
+
+public:
+    WakeWordEngine();
+    ~WakeWordEngine();
+    
+    bool begin(uint32_t rate);
+    void end();
+    
+    // Frame length, window and filterbank for a new rate, no allocation
+    bool setSampleRate(uint32_t rate);
+    void reset();
+    
+    // Feed audio, returns true when the wake word is detected
+    bool process(const int16_t* samples, size_t count);
+    
+    // Configuration
+    void setThreshold(float value);
+    float getThreshold();
+    
+    // Status
+    bool isReady();
+    uint32_t getSampleRate(); // As last passed to begin() or setSampleRate()
+    float getLastScore();
+    uint32_t getLastFrameMicros();
+    uint32_t getMaxFrameMicros();
+    uint32_t getBudgetOverruns();
+};
+
+#endif // WAKE_WORD_ENGINE_H
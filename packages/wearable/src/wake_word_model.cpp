@@ -0,0 +1,25 @@
+#include "wake_word_model.h"
+
+// Placeholder model with the right shape but no trained weights. Replace this
+// file with the one exported by the training pipeline for WAKE_WORD; while
+// trained is false the engine falls back to the energy heuristic.
+
+static const int8_t conv1Weights[KWS_CONV1_CHANNELS * KWS_CONV1_KERNEL * KWS_MEL_BANDS] = {0};
+static const int32_t conv1Bias[KWS_CONV1_CHANNELS] = {0};
+static const int8_t conv2Weights[KWS_CONV2_CHANNELS * KWS_CONV2_KERNEL * KWS_CONV1_CHANNELS] = {0};
+static const int32_t conv2Bias[KWS_CONV2_CHANNELS] = {0};
+static const int8_t denseWeights[KWS_CLASSES * KWS_CONV2_CHANNELS] = {0};
+static const int32_t denseBias[KWS_CLASSES] = {0};
+
+const WakeWordModel wakeWordModel = {
+    "placeholder",
+    false,
+    -10.0f,         // featureOffset
+    8.0f,           // featureScale
+    -128,           // inputZeroPoint
+    { conv1Weights, conv1Bias, 1 << 30, 0, -128 },
+    { conv2Weights, conv2Bias, 1 << 30, 0, -128 },
+    denseWeights,
+    denseBias,
+    1.0f / 16.0f    // outputScale
+};
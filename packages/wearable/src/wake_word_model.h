@@ -0,0 +1,57 @@
+#ifndef WAKE_WORD_MODEL_H
+#define WAKE_WORD_MODEL_H
+
+#include <Arduino.h>
+
+// Streaming keyword spotting network, all layers int8 with int32 accumulators:
+//
+//   log-mel frame (KWS_MEL_BANDS)
+//   -> temporal conv, KWS_CONV1_KERNEL frames, KWS_CONV1_CHANNELS, ReLU
+//   -> dilated temporal conv, KWS_CONV2_KERNEL taps, KWS_CONV2_CHANNELS, ReLU
+//   -> running average over the last KWS_POOL_FRAMES frames
+//   -> dense, KWS_CLASSES logits (background, wake word)
+//
+// Every layer only consumes cached history plus the newest frame, so each
+// frame costs the same fixed number of multiply-accumulates.
+#define KWS_MEL_BANDS 40
+#define KWS_CONV1_KERNEL 3
+#define KWS_CONV1_CHANNELS 32
+#define KWS_CONV2_KERNEL 3
+#define KWS_CONV2_DILATION 2
+#define KWS_CONV2_CHANNELS 32
+#define KWS_POOL_FRAMES 32
+#define KWS_CLASSES 2
+#define KWS_CLASS_WAKE_WORD 1
+
+// Requantization of an int32 accumulator back to int8:
+// out = zeroPoint + round(acc * multiplier / 2^(31 + shift))
+struct QuantizedLayer {
+    const int8_t* weights;   // [outputs][kernel][inputs]
+    const int32_t* bias;     // [outputs]
+    int32_t multiplier;      // Q31
+    int8_t shift;
+    int8_t outputZeroPoint;
+};
+
+struct WakeWordModel {
+    const char* name;
+    bool trained;            // False for the placeholder model
+    
+    // Input quantization: q = round((log(mel) - featureOffset) * featureScale) + inputZeroPoint
+    float featureOffset;
+    float featureScale;
+    int8_t inputZeroPoint;
+    
+    QuantizedLayer conv1;
+    QuantizedLayer conv2;
+    
+    // Dense layer outputs dequantized logits
+    const int8_t* denseWeights; // [KWS_CLASSES][KWS_CONV2_CHANNELS]
+    const int32_t* denseBias;   // [KWS_CLASSES]
+    float outputScale;
+};
+
+// Model weights are exported by the training pipeline into wake_word_model.cpp
+extern const WakeWordModel wakeWordModel;
+
+#endif // WAKE_WORD_MODEL_H